@@ -0,0 +1,388 @@
+#include "core/DieGeometry.h"
+#include "core/ImageSampler.h"
+#include "core/BitClassifier.h"
+#include "core/BitPatchStream.h"
+#include "core/DieDescription.h"
+
+#include <QImage>
+#include <QString>
+#include <QVector>
+#include <QPointF>
+
+#include <pybind11/stl.h>
+#include <pybind11/numpy.h>
+#include <pybind11/pybind11.h>
+
+#include <exception>
+
+namespace py = pybind11;
+
+/// Zero-copy helpers /////////////////////////////////////////////////////////
+
+// Hands a heap-allocated Qt container to NumPy - the array's base capsule owns it
+// and deletes it once the last view is gone
+template <typename Container, typename T>
+static py::array_t<T> arrayOwning(Container* owner, const T* data, const std::vector<py::ssize_t>& shape)
+{
+    py::capsule base(owner, [](void* p) { delete reinterpret_cast<Container*>(p); });
+    return py::array_t<T>(shape, data, base);
+}
+
+
+// A (2, ...) float32 array with each plane contiguous - like the ones bit_locations()
+// returns - is used in place, anything else is converted first
+static py::array_t<float> locationPlanes(const py::array& locations)
+{
+    py::array_t<float> planes = py::array_t<float>::ensure(locations);
+    if (!planes || planes.ndim() < 1 || planes.shape(0) != 2)
+        throw py::value_error("bit locations must be a (2, ...) array of xs and ys");
+    
+    py::ssize_t expectedStride = sizeof(float);
+    for (py::ssize_t d = planes.ndim() - 1; d >= 1; d--)
+    {
+        if (planes.strides(d) != expectedStride)
+            return py::array_t<float, py::array::c_style>::ensure(planes);
+        expectedStride *= planes.shape(d);
+    }
+    return planes;
+}
+
+
+/// Image /////////////////////////////////////////////////////////////////////
+
+// An ImageSampler plus whatever owns its pixels when they came from NumPy
+struct PyImage
+{
+    ImageSampler sampler;
+    py::object owner;
+};
+
+
+static PyImage imageFromFile(const std::string& filename, const int& grayscaleBits)
+{
+    QImage image;
+    if (!image.load(QString::fromStdString(filename)))
+        throw py::value_error("unable to load image file " + filename);
+    
+    if (grayscaleBits == 8)
+        image = ImageSampler::luminanceImage(image, QImage::Format_Grayscale8);
+    else if (grayscaleBits == 16)
+        image = ImageSampler::luminanceImage(image, QImage::Format_Grayscale16);
+    else if (grayscaleBits != 0)
+        throw py::value_error("grayscale must be 0, 8 or 16");
+    
+    PyImage result;
+    result.sampler = ImageSampler(image);
+    return result;
+}
+
+
+static PyImage imageFromArray(const py::array& array)
+{
+    // Only contiguous rows can be wrapped in place
+    if (!(array.flags() & py::array::c_style))
+        throw py::value_error("image arrays must be C-contiguous");
+    
+    const int h = array.ndim() > 0 ? array.shape(0) : 0;
+    const int w = array.ndim() > 1 ? array.shape(1) : 0;
+    const int bytesPerLine = array.ndim() > 1 ? array.strides(0) : 0;
+    QImage::Format format = QImage::Format_Invalid;
+    if (array.ndim() == 2 && array.dtype().is(py::dtype::of<quint8>()))
+        format = QImage::Format_Grayscale8;
+    else if (array.ndim() == 2 && array.dtype().is(py::dtype::of<quint16>()))
+        format = QImage::Format_Grayscale16;
+    else if (array.ndim() == 3 && array.shape(2) == 3 && array.dtype().is(py::dtype::of<quint8>()))
+        format = QImage::Format_RGB888;
+    else
+        throw py::value_error("image arrays must be (h, w) uint8/uint16 or (h, w, 3) uint8");
+    
+    // The const constructor never writes to or frees the buffer
+    PyImage result;
+    result.sampler = ImageSampler(QImage(static_cast<const uchar*>(array.data()), w, h, bytesPerLine, format));
+    result.owner = array;
+    return result;
+}
+
+
+static py::array imageArray(const PyImage& image)
+{
+    // The view keeps its own reference to the (implicitly shared) pixels
+    const QImage& qImage = image.sampler.image();
+    QImage* shared = new QImage(qImage);
+    const py::ssize_t h = qImage.height();
+    const py::ssize_t w = qImage.width();
+    const py::ssize_t bpl = qImage.bytesPerLine();
+    py::capsule base(shared, [](void* p) { delete reinterpret_cast<QImage*>(p); });
+    
+    py::array result;
+    switch (qImage.format())
+    {
+        case QImage::Format_Grayscale8:
+            result = py::array_t<quint8>({ h, w }, { bpl, (py::ssize_t)1 }, shared->constBits(), base);
+            break;
+        case QImage::Format_Grayscale16:
+            result = py::array_t<quint16>({ h, w }, { bpl, (py::ssize_t)2 },
+                                          reinterpret_cast<const quint16*>(shared->constBits()), base);
+            break;
+        case QImage::Format_RGB888:
+            result = py::array_t<quint8>({ h, w, (py::ssize_t)3 }, { bpl, (py::ssize_t)3, (py::ssize_t)1 }, shared->constBits(), base);
+            break;
+        default:
+            // 32-bit formats are BGRA in memory on little-endian machines
+            if (qImage.depth() != 32)
+                throw py::value_error("image format has no array view - load it with grayscale=8 or 16");
+            result = py::array_t<quint8>({ h, w, (py::ssize_t)4 }, { bpl, (py::ssize_t)4, (py::ssize_t)1 }, shared->constBits(), base);
+            break;
+    }
+    
+    // Writing through the view would bypass QImage's copy-on-write
+    result.attr("setflags")(py::arg("write") = false);
+    return result;
+}
+
+
+/// Extraction ////////////////////////////////////////////////////////////////
+
+static py::array_t<float> bitLocations(const DieGeometry& geometry, const DieDescription& die)
+{
+    if (!geometry.isValid())
+        throw py::value_error("the geometry needs exactly 4 bounds points");
+    
+    BitLocationStore* locations = new BitLocationStore();
+    {
+        py::gil_scoped_release release;
+        *locations = geometry.computeBitLocations(die.horizontalSlices(), die.verticalSlices());
+    }
+    
+    // Both planes of the store's block as one (2, rows, columns) view
+    const py::ssize_t rows = locations->rows();
+    const py::ssize_t columns = locations->columns();
+    const float* xs = locations->xs();
+    py::capsule base(locations, [](void* p) { delete reinterpret_cast<BitLocationStore*>(p); });
+    return py::array_t<float>({ (py::ssize_t)2, rows, columns },
+                              { (py::ssize_t)locations->planeStride(), columns * (py::ssize_t)sizeof(float), (py::ssize_t)sizeof(float) },
+                              xs, base);
+}
+
+
+static py::array_t<float> samplePatches(const PyImage& image, const py::array& locations, const int& radius)
+{
+    if (radius < 0)
+        throw py::value_error("radius must not be negative");
+    
+    const py::array_t<float> planes = locationPlanes(locations);
+    const int count = planes.size() / 2;
+    const float* xs = planes.data(0);
+    const float* ys = planes.data(1);
+    const int singleDim = radius * 2 + 1;
+    QVector<float>* patches = new QVector<float>(count * singleDim * singleDim);
+    {
+        py::gil_scoped_release release;
+        image.sampler.luminancePatches(xs, ys, count, radius, patches->data());
+    }
+    
+    // The locations' dimensions after the plane, then the patch
+    std::vector<py::ssize_t> shape(planes.shape() + 1, planes.shape() + planes.ndim());
+    shape.push_back(singleDim);
+    shape.push_back(singleDim);
+    return arrayOwning(patches, patches->constData(), shape);
+}
+
+
+static py::tuple classifyPatches(const py::array_t<float, py::array::c_style | py::array::forcecast>& patches,
+                                 const bool& darkIsOne,
+                                 const py::object& threshold)
+{
+    if (patches.ndim() < 2)
+        throw py::value_error("patches must be at least (n, h, w)");
+    
+    const int patchSize = patches.shape(patches.ndim() - 2) * patches.shape(patches.ndim() - 1);
+    const int count = patchSize ? patches.size() / patchSize : 0;
+    const float fixedThreshold = threshold.is_none() ? -1.0f : threshold.cast<float>();
+    
+    QVector<quint8>* bits = new QVector<quint8>();
+    float usedThreshold = 0.0f;
+    {
+        py::gil_scoped_release release;
+        *bits = BitClassifier::classify(patches.data(), count, patchSize, darkIsOne, fixedThreshold, &usedThreshold);
+    }
+    
+    std::vector<py::ssize_t> shape(patches.shape(), patches.shape() + patches.ndim() - 2);
+    return py::make_tuple(arrayOwning(bits, bits->constData(), shape), usedThreshold);
+}
+
+
+// Hands each batch to a Python callable.  The ring's buffers are reused as soon as
+// the callback returns, so each call gets its own copies of them to keep.  Python
+// errors can't unwind through the stream's threads - the first one stops the
+// stream and is raised again once it's over.
+class PyCallbackSink : public BitPatchSink
+{
+public:
+    explicit PyCallbackSink(const py::function& callback)
+        : m_callback(callback)
+        , m_error()
+    {
+        
+    }
+
+    bool consume(const BitPatchBatch& batch)
+    {
+        py::gil_scoped_acquire acquire;
+        try
+        {
+            // No base, so NumPy copies the data
+            const py::ssize_t rows = batch.rowCount;
+            const py::ssize_t columns = batch.columns;
+            const py::ssize_t dim = batch.patchDim;
+            const py::array_t<float> xs({ rows, columns }, batch.xs);
+            const py::array_t<float> ys({ rows, columns }, batch.ys);
+            const py::array_t<float> patches({ rows, columns, dim, dim }, batch.luminance);
+            
+            const py::object result = m_callback(batch.firstRow, xs, ys, patches);
+            return result.is_none() || result.cast<bool>();
+        }
+        catch (const py::error_already_set&)
+        {
+            m_error = std::current_exception();
+        }
+        catch (const py::cast_error&)
+        {
+            m_error = std::current_exception();
+        }
+        return false;
+    }
+
+    // Raises whatever stopped the stream, if anything did - call with the GIL held
+    void rethrow()
+    {
+        if (m_error)
+        {
+            std::exception_ptr error = m_error;
+            m_error = std::exception_ptr();
+            std::rethrow_exception(error);
+        }
+    }
+
+private:
+    py::function m_callback;
+    std::exception_ptr m_error;
+};
+
+
+static bool streamPatches(const PyImage& image,
+                          const DieDescription& die,
+                          const py::function& callback,
+                          const int& radius,
+                          const int& chunkRows,
+                          const int& ringSize)
+{
+    const DieGeometry geometry(die.boundsPoints());
+    if (!geometry.isValid())
+        throw py::value_error("the die description needs exactly 4 bounds points");
+    
+    PyCallbackSink sink(callback);
+    BitPatchStream stream(image.sampler, geometry, die);
+    stream.setRadius(radius);
+    stream.setChunkRows(chunkRows);
+    stream.setRingSize(ringSize);
+    
+    bool success = false;
+    {
+        py::gil_scoped_release release;
+        success = stream.run(sink);
+    }
+    sink.rethrow();
+    return success;
+}
+
+
+/// Module ////////////////////////////////////////////////////////////////////
+
+PYBIND11_MODULE(dietoy, m)
+{
+    m.doc() = "Bit extraction from chip die images (the dieToy core)";
+
+    py::class_<DieDescription>(m, "DieDescription")
+        .def(py::init<>())
+        .def_static("load", [](const std::string& filename)
+            {
+                DieDescription die;
+                if (!die.loadJson(QString::fromStdString(filename)))
+                    throw py::value_error("unable to load die description file " + filename);
+                return die;
+            }, py::arg("filename"))
+        .def("save", [](const DieDescription& die, const std::string& filename)
+            {
+                if (!die.saveJson(QString::fromStdString(filename)))
+                    throw py::value_error("unable to save die description file " + filename);
+            }, py::arg("filename"))
+        .def_property("bounds_points",
+            [](const DieDescription& die)
+            {
+                std::vector<std::pair<double, double> > points;
+                for (int i = 0; i < die.boundsPoints().size(); i++)
+                    points.push_back(std::make_pair(die.boundsPoints()[i].x(), die.boundsPoints()[i].y()));
+                return points;
+            },
+            [](DieDescription& die, const std::vector<std::pair<double, double> >& points)
+            {
+                die.boundsPoints().clear();
+                for (size_t i = 0; i < points.size(); i++)
+                    die.boundsPoints().push_back(QPointF(points[i].first, points[i].second));
+            })
+        .def_property("horizontal_slices",
+            [](const DieDescription& die) { return std::vector<double>(die.horizontalSlices().positions().begin(), die.horizontalSlices().positions().end()); },
+            [](DieDescription& die, const std::vector<double>& positions)
+            {
+                die.horizontalSlices().clear();
+                die.horizontalSlices().insert(QVector<qreal>::fromStdVector(positions));
+            })
+        .def_property("vertical_slices",
+            [](const DieDescription& die) { return std::vector<double>(die.verticalSlices().positions().begin(), die.verticalSlices().positions().end()); },
+            [](DieDescription& die, const std::vector<double>& positions)
+            {
+                die.verticalSlices().clear();
+                die.verticalSlices().insert(QVector<qreal>::fromStdVector(positions));
+            })
+        .def_property_readonly("bit_count", [](const DieDescription& die)
+            {
+                // (rows, columns) to match the bit location array
+                return std::make_pair(die.bitCount().height(), die.bitCount().width());
+            });
+
+    py::class_<DieGeometry>(m, "DieGeometry")
+        .def(py::init([](const DieDescription& die) { return DieGeometry(die.boundsPoints()); }), py::arg("die"))
+        .def_property_readonly("is_valid", &DieGeometry::isValid)
+        .def("rom_die_from_image", [](const DieGeometry& geometry, const double& x, const double& y)
+            {
+                const QPointF p = geometry.romDieSpaceFromImagePoint(QPointF(x, y));
+                return std::make_pair(p.x(), p.y());
+            }, py::arg("x"), py::arg("y"))
+        .def("image_from_rom_die", [](const DieGeometry& geometry, const double& u, const double& v)
+            {
+                const QPointF p = geometry.imagePointFromRomDieSpace(QPointF(u, v));
+                return std::make_pair(p.x(), p.y());
+            }, py::arg("u"), py::arg("v"))
+        .def("bit_locations", &bitLocations, py::arg("die"),
+             "Image-space bit centres as a (2, rows, columns) float32 array - xs then ys");
+
+    py::class_<PyImage>(m, "Image")
+        .def(py::init(&imageFromFile), py::arg("filename"), py::arg("grayscale") = 0)
+        .def_static("from_array", &imageFromArray, py::arg("array"),
+                    "Wraps a (h, w) uint8/uint16 or (h, w, 3) uint8 array without copying it")
+        .def_property_readonly("size", [](const PyImage& image)
+            {
+                return std::make_pair(image.sampler.size().width(), image.sampler.size().height());
+            })
+        .def_property_readonly("array", &imageArray, "A read-only view of the pixels");
+
+    m.def("luminance_patches", &samplePatches, py::arg("image"), py::arg("locations"), py::arg("radius") = 6,
+          "(..., 2r+1, 2r+1) float32 luminance patches in [0, 1] around each location of a (2, ...) xs/ys array");
+    m.def("classify", &classifyPatches, py::arg("patches"), py::arg("dark_is_one") = false, py::arg("threshold") = py::none(),
+          "Thresholds patch means (Otsu unless given) - returns (bits, threshold)");
+    m.def("stream_patches", &streamPatches, py::arg("image"), py::arg("die"), py::arg("callback"),
+          py::arg("radius") = 6, py::arg("chunk_rows") = 8, py::arg("ring_size") = 2,
+          "Calls callback(first_row, xs, ys, patches) for each chunk of rows in order with arrays of its "
+          "own - returning False stops the stream, and an exception stops it and is raised from here");
+}
@@ -0,0 +1,85 @@
+#include "BitInspector.h"
+
+#include <QPainter>
+#include <QPalette>
+
+
+BitInspector::BitInspector(QWidget* parent)
+    : QWidget(parent)
+    , m_patch()
+    , m_bitCenters()
+    , m_highlightedBit(-1)
+    , m_caption()
+{
+    setBackgroundRole(QPalette::Dark);
+    setAutoFillBackground(true);
+}
+
+
+BitInspector::~BitInspector()
+{
+    
+}
+
+
+QSize BitInspector::sizeHint() const
+{
+    return QSize(256, 280);
+}
+
+
+QSize BitInspector::minimumSizeHint() const
+{
+    return QSize(128, 150);
+}
+
+
+void BitInspector::setPatch(const QImage& patch, const QVector<QPointF>& bitCenters, const int& highlightedBit, const QString& caption)
+{
+    m_patch = patch;
+    m_bitCenters = bitCenters;
+    m_highlightedBit = highlightedBit;
+    m_caption = caption;
+    update();
+}
+
+
+void BitInspector::clearPatch()
+{
+    m_patch = QImage();
+    m_bitCenters.clear();
+    m_highlightedBit = -1;
+    m_caption.clear();
+    update();
+}
+
+
+void BitInspector::paintEvent(QPaintEvent* event)
+{
+    QPainter painter(this);
+    
+    // Leave a strip at the bottom for the caption
+    const int captionHeight = fontMetrics().height() + 4;
+    const QRect patchArea(0, 0, width(), height() - captionHeight);
+    painter.setPen(palette().color(QPalette::BrightText));
+    painter.drawText(QRect(0, patchArea.height(), width(), captionHeight), Qt::AlignCenter, m_caption);
+    
+    if (m_patch.isNull() || patchArea.height() <= 0)
+        return;
+    
+    // Largest square-pixel upscale of the patch that fits, centered
+    const qreal scale = qMin((qreal)patchArea.width() / m_patch.width(), (qreal)patchArea.height() / m_patch.height());
+    const QSizeF drawSize = QSizeF(m_patch.size()) * scale;
+    const QPointF drawOrigin((patchArea.width() - drawSize.width()) * 0.5, (patchArea.height() - drawSize.height()) * 0.5);
+    painter.drawImage(QRectF(drawOrigin, drawSize), m_patch);
+    
+    // Mark the bits, the one under the mouse stands out
+    painter.setRenderHint(QPainter::Antialiasing, true);
+    const qreal diameter = qMax(scale * 2.0, 6.0);
+    for (int i = 0; i < m_bitCenters.size(); i++)
+    {
+        painter.setPen(QPen(i == m_highlightedBit ? QColor(255, 255, 0) : QColor(255, 0, 0), 1.5));
+        const QPointF center = drawOrigin + m_bitCenters[i] * scale;
+        painter.drawEllipse(center, diameter * 0.5, diameter * 0.5);
+    }
+}
@@ -0,0 +1,38 @@
+#ifndef DIETOY_BIT_INSPECTOR_H
+#define DIETOY_BIT_INSPECTOR_H
+
+#include <QImage>
+#include <QString>
+#include <QVector>
+#include <QWidget>
+
+
+/// Magnified view of the bits around the mouse ///////////////////////////////
+
+class BitInspector : public QWidget
+{
+    Q_OBJECT
+
+public:
+    explicit BitInspector(QWidget* parent = NULL);
+    ~BitInspector();
+
+    QSize sizeHint() const Q_DECL_OVERRIDE;
+    QSize minimumSizeHint() const Q_DECL_OVERRIDE;
+
+    // The patch is drawn upscaled with nearest-neighbor sampling, bit centers are in patch coordinates
+    void setPatch(const QImage& patch, const QVector<QPointF>& bitCenters, const int& highlightedBit, const QString& caption);
+    void clearPatch();
+
+protected:
+    void paintEvent(QPaintEvent* event) Q_DECL_OVERRIDE;
+
+private:
+    QImage m_patch;
+    QVector<QPointF> m_bitCenters;
+    int m_highlightedBit;
+    QString m_caption;
+};
+
+
+#endif // DIETOY_BIT_INSPECTOR_H
@@ -1,14 +1,26 @@
 #include "DrawWidget.h"
+#include "core/TileMosaic.h"
 
 #include <QDebug>
 #include <QPalette>
+#include <QtMath>
 #include <QMouseEvent>
 
+#include <cmath>
+
 
 DrawWidget::DrawWidget(QWidget* parent)
     : QWidget(parent)
     , m_qImage(NULL)
+    , m_imageReductions(NULL)
+    , m_mosaic(NULL)
     , m_circleCoords(NULL)
+    , m_bitLocations(NULL)
+    , m_bitLocationIndex(NULL)
+    , m_bitLayers(NULL)
+    , m_highlightedBit(-1)
+    , m_bitPreview(NULL)
+    , m_selectedBits(NULL)
     , m_convexPolygons(NULL)
     , m_lines(NULL)
     , m_lineColors(NULL)
@@ -16,9 +28,13 @@ DrawWidget::DrawWidget(QWidget* parent)
     , m_currentPos(0, 0)
     , m_zoomFactor(1.0)
     , m_imageLoc(0.0f, 0.0f)
+    , m_selectionShape(NoSelection)
+    , m_selectionStart(0, 0)
+    , m_selectionRegion()
 {
     setBackgroundRole(QPalette::Base);
     setAutoFillBackground(true);            // TODO: Look into to see if necessary (and/or how to change color)
+    setMouseTracking(true);
     
     // The middle button (panning) gets a default implementation
     connect(this, &DrawWidget::middleButtonClicked, this, &DrawWidget::imagePanStart);
@@ -44,29 +60,42 @@ QSize DrawWidget::minimumSizeHint() const
 }
 
 
+QSize DrawWidget::imageSize() const
+{
+    if (m_mosaic && !m_mosaic->isEmpty())
+        return m_mosaic->size();
+    if (m_qImage)
+        return m_qImage->size();
+    return QSize();
+}
+
+
 void DrawWidget::centerImage()
 {
-    if (m_qImage == NULL)
+    if (imageSize().isEmpty())
         return;
 
-    QSizeF foo = (size() - (m_qImage->size() * m_zoomFactor)) * 0.5f;
+    QSizeF foo = (size() - (imageSize() * m_zoomFactor)) * 0.5f;
     m_imageLoc.setX(foo.width());
     m_imageLoc.setY(foo.height());
     
+    emit viewportChanged();
     update();
 }
 
 
 void DrawWidget::scaleImageToViewport()
 {
-    if (m_qImage == NULL)
+    const QSize size = imageSize();
+    if (size.isEmpty())
         return;
     
-    if (m_qImage->size().width() > m_qImage->size().height())
-        m_zoomFactor = (float)width() / (float)m_qImage->size().width();
+    if (size.width() > size.height())
+        m_zoomFactor = (float)width() / (float)size.width();
     else
-        m_zoomFactor = (float)height() / (float)m_qImage->size().height();
+        m_zoomFactor = (float)height() / (float)size.height();
     
+    emit viewportChanged();
     update();
 }
 
@@ -97,6 +126,31 @@ QPointF DrawWidget::window2Image(const QPointF& window)
 }
 
 
+QRectF DrawWidget::visibleImageRect() const
+{
+    return QRectF(-m_imageLoc / m_zoomFactor, QSizeF(size()) / m_zoomFactor);
+}
+
+
+void DrawWidget::centerOn(const QPointF& imagePoint, const qreal& minimumZoom)
+{
+    m_zoomFactor = qMax(m_zoomFactor, qMin(minimumZoom, 500.0));
+    m_imageLoc = QPointF(width() * 0.5, height() * 0.5) - (imagePoint * m_zoomFactor);
+    
+    emit viewportChanged();
+    update();
+}
+
+
+
+QPen DrawWidget::cosmeticPen(const QColor& color, const qreal& width)
+{
+    QPen pen(color, width);
+    pen.setCosmetic(true);
+    return pen;
+}
+
+
 
 /// QWidget events ////////////////////////////////////////////////////////////
 
@@ -110,41 +164,134 @@ void DrawWidget::paintEvent(QPaintEvent* event)
     painter.translate(m_imageLoc);
     painter.scale(m_zoomFactor, m_zoomFactor);
     
-    // Draw the image
-    if (m_qImage)
+    // Draw the image - a mosaic is composited for just the visible part, at the
+    // coarsest level that still has a pixel per screen pixel
+    if (m_mosaic && !m_mosaic->isEmpty())
     {
-        painter.drawImage(QPoint(0, 0), *m_qImage);
+        const int level = (m_zoomFactor < 1.0) ? qMin(qFloor(std::log2(1.0 / m_zoomFactor)), 8) : 0;
+        const int step = 1 << level;
+        const QRect visible = visibleImageRect().toAlignedRect() & m_mosaic->rect();
+        if (!visible.isEmpty())
+        {
+            // Snapped to the level's pixel grid so panning doesn't shimmer
+            const QRect snapped(QPoint(visible.left() / step * step, visible.top() / step * step), visible.bottomRight());
+            const QImage region = m_mosaic->region(snapped, level);
+            painter.drawImage(QRectF(snapped.topLeft(), QSizeF(region.size() * step)), region);
+        }
+    }
+    else if (m_qImage)
+    {
+        // Zoomed out, the image's halved copies (when it has them) draw far faster than all of it scaled down
+        const int level = (m_imageReductions && m_zoomFactor < 1.0)
+                        ? qMin(qFloor(std::log2(1.0 / m_zoomFactor)), m_imageReductions->size()) : 0;
+        if (level > 0)
+            painter.drawImage(QRectF(QPointF(0, 0), QSizeF(m_qImage->size())), (*m_imageReductions)[level - 1]);
+        else
+            painter.drawImage(QPoint(0, 0), *m_qImage);
     }
     
+    // Marker sizes and line widths are in screen pixels, whatever the zoom - the pens are
+    // cosmetic, and the sizes go through the zoom factor into image units
+    
     // Draw the circles
     if (m_circleCoords)
     {
-        // TODO: Make the diameter and pen size scale appropriately with zoomFactor
-        const float diameter = 10.0f;
-        painter.setPen(QColor(255, 0, 0));
+        const qreal screenDiameter = 10.0;
+        const qreal diameter = screenToImage(screenDiameter);
+        painter.setPen(cosmeticPen(QColor(255, 0, 0)));
 
         for (int i = 0; i < m_circleCoords->size(); i++)
         {
             // Clipping
             const QRectF& viewportRect = painter.viewport();
             const QPointF clipLocation = (*m_circleCoords)[i] * painter.worldMatrix();
-            if (clipLocation.x() < -diameter || clipLocation.y() < -diameter)
+            if (clipLocation.x() < -screenDiameter || clipLocation.y() < -screenDiameter)
                 continue;
-            if (clipLocation.x() > viewportRect.width()+diameter || clipLocation.y() > viewportRect.height()+diameter)
+            if (clipLocation.x() > viewportRect.width()+screenDiameter || clipLocation.y() > viewportRect.height()+screenDiameter)
                 continue;
             
             // Draw everyone that survives the clippage
-            painter.save();
-            painter.translate((*m_circleCoords)[i]);
-            painter.drawEllipse(QRectF(-diameter / 2.0, -diameter / 2.0, diameter, diameter));
-            painter.restore();
+            painter.drawEllipse((*m_circleCoords)[i], diameter / 2.0, diameter / 2.0);
+        }
+    }
+    
+    // Draw the bit locations
+    if (m_bitLocations && !m_bitLocations->isEmpty())
+    {
+        // Bits keep their size in the image, but never shrink out of sight or swamp the view
+        const qreal diameter = qBound(screenToImage(4.0), 10.0, screenToImage(24.0));
+        painter.setPen(cosmeticPen(QColor(255, 0, 0)));
+        
+        // Just the bits in the visible part of the image - from the index when there is one,
+        // so the cost follows what's on screen rather than the size of the ROM
+        const QRectF visibleRect = visibleImageRect().adjusted(-diameter, -diameter, diameter, diameter);
+        const float* xs = m_bitLocations->xs();
+        const float* ys = m_bitLocations->ys();
+        const bool indexed = m_bitLocationIndex && !m_bitLocationIndex->isEmpty();
+        const QVector<int> visibleBits = indexed ? m_bitLocationIndex->inRect(visibleRect) : QVector<int>();
+        const int bitCount = indexed ? visibleBits.size() : m_bitLocations->size();
+        
+        // With layers for these bits: ones in green, hand-set bits in yellow, ignored bits in gray
+        const bool colorByLayers = m_bitLayers && m_bitLayers->size() == m_bitLocations->size();
+        const QPen zeroPen = cosmeticPen(QColor(255, 0, 0));
+        const QPen onePen = cosmeticPen(QColor(0, 255, 0));
+        const QPen overriddenPen = cosmeticPen(QColor(255, 255, 0));
+        const QPen ignoredPen = cosmeticPen(QColor(128, 128, 128));
+        for (int b = 0; b < bitCount; b++)
+        {
+            const int i = indexed ? visibleBits[b] : b;
+            if (i >= m_bitLocations->size())
+                continue;
+            if (!indexed && (xs[i] < visibleRect.left() || xs[i] > visibleRect.right() ||
+                             ys[i] < visibleRect.top() || ys[i] > visibleRect.bottom()))
+                continue;
+            
+            if (colorByLayers)
+            {
+                if (m_bitLayers->isIgnored(i))
+                    painter.setPen(ignoredPen);
+                else if (m_bitLayers->isOverridden(i))
+                    painter.setPen(overriddenPen);
+                else
+                    painter.setPen(m_bitLayers->value(i) ? onePen : zeroPen);
+            }
+            painter.drawEllipse(QPointF(xs[i], ys[i]), diameter / 2.0, diameter / 2.0);
+        }
+        
+        // Ring the highlighted bit so it stands out from its neighbors
+        if (m_highlightedBit >= 0 && m_highlightedBit < m_bitLocations->size())
+        {
+            painter.setPen(cosmeticPen(QColor(0, 255, 255), 2.0));
+            painter.drawEllipse(QPointF(xs[m_highlightedBit], ys[m_highlightedBit]), diameter, diameter);
+        }
+        
+        // And ring the selected ones in magenta
+        if (m_selectedBits && !m_selectedBits->isEmpty())
+        {
+            painter.setPen(cosmeticPen(QColor(255, 0, 255), 2.0));
+            for (int i = 0; i < m_selectedBits->size(); i++)
+            {
+                const int bit = (*m_selectedBits)[i];
+                if (bit < 0 || bit >= m_bitLocations->size() ||
+                    xs[bit] < visibleRect.left() || xs[bit] > visibleRect.right() ||
+                    ys[bit] < visibleRect.top() || ys[bit] > visibleRect.bottom())
+                    continue;
+                painter.drawEllipse(QPointF(xs[bit], ys[bit]), diameter * 0.75, diameter * 0.75);
+            }
         }
     }
     
+    // Draw the bit grid preview as single (screen-sized) dots
+    if (m_bitPreview && !m_bitPreview->isEmpty())
+    {
+        painter.setPen(cosmeticPen(QColor(255, 128, 0), 3.0));
+        painter.drawPoints(m_bitPreview->constData(), m_bitPreview->size());
+    }
+    
     // Draw the polygons
     if (m_convexPolygons)
     {
-        painter.setPen(QColor(0, 255, 0));
+        painter.setPen(cosmeticPen(QColor(0, 255, 0)));
         
         for (int i = 0; i < m_convexPolygons->size(); i++)
         {
@@ -152,16 +299,26 @@ void DrawWidget::paintEvent(QPaintEvent* event)
         }
     }
     
+    // Draw the selection gesture in progress
+    if (m_selectionShape != NoSelection && m_selectionRegion.size() > 1)
+    {
+        QPen selectionPen = cosmeticPen(QColor(255, 255, 255));
+        selectionPen.setStyle(Qt::DashLine);
+        painter.setPen(selectionPen);
+        painter.setBrush(Qt::NoBrush);
+        painter.drawPolygon(m_selectionRegion);
+    }
+    
     // Draw the lines
     if (m_lines)
     {
-        painter.setPen(QColor(0, 0, 255));
+        painter.setPen(cosmeticPen(QColor(0, 0, 255)));
         
         for (int i = 0; i < m_lines->size(); i++)
         {
             if (m_lineColors && m_lineColors->size() > i)
             {
-                painter.setPen((*m_lineColors)[i]);
+                painter.setPen(cosmeticPen((*m_lineColors)[i]));
             }
             
             painter.drawLine((*m_lines)[i]);
@@ -187,6 +344,7 @@ void DrawWidget::wheelEvent(QWheelEvent* event)
     m_zoomFactor = newZoom;
     m_imageLoc = event->pos() - (b * m_zoomFactor);
 
+    emit viewportChanged();
     update();
 }
 
@@ -195,7 +353,14 @@ void DrawWidget::mousePressEvent(QMouseEvent* event)
 {
     QPointF imagePointF = window2Image(event->pos());
 
-    if (event->buttons() & Qt::LeftButton)
+    // Shift starts a selection gesture instead of a click - ctrl too makes it a lasso
+    if (event->button() == Qt::LeftButton && (event->modifiers() & Qt::ShiftModifier))
+    {
+        m_selectionShape = (event->modifiers() & Qt::ControlModifier) ? LassoSelection : RectangleSelection;
+        m_selectionStart = imagePointF;
+        m_selectionRegion = QPolygonF() << imagePointF;
+    }
+    else if (event->buttons() & Qt::LeftButton)
     {
         emit leftButtonClicked(imagePointF);
     }
@@ -215,8 +380,24 @@ void DrawWidget::mousePressEvent(QMouseEvent* event)
 void DrawWidget::mouseMoveEvent(QMouseEvent* event)
 {
     QPointF imagePointF = window2Image(event->pos());
+    
+    emit mouseMoved(imagePointF);
 
-    if (event->buttons() & Qt::LeftButton)
+    if ((event->buttons() & Qt::LeftButton) && m_selectionShape == RectangleSelection)
+    {
+        m_selectionRegion = QPolygonF(QRectF(m_selectionStart, imagePointF).normalized());
+        update();
+    }
+    else if ((event->buttons() & Qt::LeftButton) && m_selectionShape == LassoSelection)
+    {
+        // A new lasso point every couple of screen pixels
+        if ((imagePointF - m_selectionRegion.last()).manhattanLength() * m_zoomFactor >= 2.0)
+        {
+            m_selectionRegion.push_back(imagePointF);
+            update();
+        }
+    }
+    else if (event->buttons() & Qt::LeftButton)
     {
         emit leftButtonDragged(imagePointF);
     }
@@ -237,23 +418,40 @@ void DrawWidget::mouseReleaseEvent(QMouseEvent* event)
 {
     QPointF imagePointF = window2Image(event->pos());
 
-    if (event->buttons() & Qt::LeftButton)
+    // buttons() no longer has the button that was just let go
+    if (event->button() == Qt::LeftButton && m_selectionShape != NoSelection)
+    {
+        const QPolygonF region = m_selectionRegion;
+        m_selectionShape = NoSelection;
+        m_selectionRegion.clear();
+        update();
+        if (region.size() >= 3 && !region.boundingRect().isEmpty())
+            emit regionSelected(region);
+    }
+    else if (event->button() == Qt::LeftButton)
     {
         emit leftButtonReleased(imagePointF);
     }
 
-    if (event->buttons() & Qt::MidButton)
+    if (event->button() == Qt::MidButton)
     {
         emit middleButtonReleased(event->pos());
     }
     
-    if (event->buttons() & Qt::RightButton)
+    if (event->button() == Qt::RightButton)
     {
       	emit rightButtonReleased(imagePointF);
     }
 }
 
 
+void DrawWidget::resizeEvent(QResizeEvent* event)
+{
+    QWidget::resizeEvent(event);
+    emit viewportChanged();
+}
+
+
 /// Default implementation of slots ///////////////////////////////////////////
 
 void DrawWidget::imagePanStart(const QPointF& position)
@@ -268,5 +466,6 @@ void DrawWidget::imagePanDrag(const QPointF& position)
     m_imageLoc += dMove;
 
     m_lastPos = position;
+    emit viewportChanged();
     update();
 }
@@ -1,10 +1,17 @@
 #ifndef DIETOY_DRAW_WIDGET_H
 #define DIETOY_DRAW_WIDGET_H
 
+#include "core/BitLayers.h"
+#include "core/BitLocationStore.h"
+#include "core/BitLocationIndex.h"
+
+class TileMosaic;
+
 #include <QImage>
 #include <QString>
 #include <QWidget>
 #include <QPainter>
+#include <QPolygonF>
 
 
 /// GUI draw widget ///////////////////////////////////////////////////////////
@@ -21,7 +28,15 @@ public:
     QSize minimumSizeHint() const Q_DECL_OVERRIDE;
 
     bool setImagePointer(const QImage* image) { m_qImage = image; }
+    void setImageReductionsPointer(const QVector<QImage>* reductions) { m_imageReductions = reductions; }
+    void setMosaicPointer(const TileMosaic* mosaic) { m_mosaic = mosaic; }
     bool setCircleCoordsPointer(const QVector<QPointF>* points) { m_circleCoords = points; }
+    // With the index over the bits, painting only visits the ones on screen
+    void setBitLocationsPointer(const BitLocationStore* bits, const BitLocationIndex* index = NULL) { m_bitLocations = bits; m_bitLocationIndex = index; }
+    void setBitLayersPointer(const BitLayers* layers) { m_bitLayers = layers; }
+    void setHighlightedBit(const int& bit) { m_highlightedBit = bit; update(); }
+    void setBitPreviewPointer(const QVector<QPointF>* points) { m_bitPreview = points; }
+    void setSelectedBitsPointer(const QVector<int>* bits) { m_selectedBits = bits; }
     bool setConvexPolyPointer(const QVector<QPolygonF>* polys) { m_convexPolygons = polys; }
     bool setLinesPointer(const QVector<QLineF>* lines) { m_lines = lines; }
     bool setLineColorsPointer(const QVector<QColor>* lineColors) { m_lineColors = lineColors; }
@@ -29,7 +44,23 @@ public:
     QPointF image2Window(const QPointF& image);
     QPointF window2Image(const QPointF& window);
     
+    // Screen pixels as image pixels at the current zoom - for hit tolerances and marker sizes
+    qreal screenToImage(const qreal& pixels) const { return pixels / m_zoomFactor; }
+    
+    // The part of the image inside the widget
+    QRectF visibleImageRect() const;
+    
+    // Pan (and zoom in to at least minimumZoom) so the given image point sits in the middle of the widget
+    void centerOn(const QPointF& imagePoint, const qreal& minimumZoom = 0.0);
+    
 signals:
+    // Panned, zoomed or resized
+    void viewportChanged();
+    
+    // A shift+drag rubber band (ctrl+shift+drag lasso) finished, in image coordinates
+    void regionSelected(const QPolygonF& region);
+    
+    void mouseMoved(const QPointF& position);
     void leftButtonClicked(const QPointF& position);
     void leftButtonDragged(const QPointF& position);
     void leftButtonReleased(const QPointF& position);
@@ -46,6 +77,7 @@ protected:
     void mouseMoveEvent(QMouseEvent* event) Q_DECL_OVERRIDE;
     void mousePressEvent(QMouseEvent* event) Q_DECL_OVERRIDE;
     void mouseReleaseEvent(QMouseEvent* event) Q_DECL_OVERRIDE;
+    void resizeEvent(QResizeEvent* event) Q_DECL_OVERRIDE;
 
 public slots:
     void centerImage();
@@ -59,9 +91,27 @@ protected slots:
     void imagePanDrag(const QPointF& position);
     
 private:
+    enum SelectionShape { NoSelection,
+                          RectangleSelection,
+                          LassoSelection };
+    
+    // The mosaic's size when there is one, otherwise the image's
+    QSize imageSize() const;
+    
+    // A pen width screen pixels wide at any zoom
+    static QPen cosmeticPen(const QColor& color, const qreal& width = 1.0);
+
     // Things that may need to be drawn
     const QImage* m_qImage;
+    const QVector<QImage>* m_imageReductions;
+    const TileMosaic* m_mosaic;
     const QVector<QPointF>* m_circleCoords;
+    const BitLocationStore* m_bitLocations;
+    const BitLocationIndex* m_bitLocationIndex;
+    const BitLayers* m_bitLayers;
+    int m_highlightedBit;
+    const QVector<QPointF>* m_bitPreview;
+    const QVector<int>* m_selectedBits;
     const QVector<QPolygonF>* m_convexPolygons;
     const QVector<QLineF>* m_lines;
     const QVector<QColor>* m_lineColors;
@@ -71,6 +121,11 @@ private:
     QPointF m_currentPos;
     qreal m_zoomFactor;
     QPointF m_imageLoc;
+    
+    // The selection gesture in progress
+    SelectionShape m_selectionShape;
+    QPointF m_selectionStart;
+    QPolygonF m_selectionRegion;
 };
 
 
@@ -1,59 +1,122 @@
 #include "MainWindow.h"
+#include "UndoCommands.h"
+#include "core/BitExporter.h"
+#include "core/BitPatchStream.h"
+#include "core/BitClassifier.h"
+#include "core/TemplateBitDetector.h"
+#include "core/ImageRegistration.h"
 
 #include <QDebug>
 #include <QWidget>
 #include <QAction>
 #include <QMenuBar>
-#include <QVector2D>
-#include <QVector3D>
+#include <QTimer>
+#include <QtMath>
+#include <QThread>
 #include <QKeyEvent>
-#include <QJsonArray>
+#include <QFileInfo>
 #include <QFileDialog>
-#include <QJsonObject>
+#include <QInputDialog>
 #include <QApplication>
 #include <QtAlgorithms>
-#include <QJsonDocument>
+
+#include <algorithm>
 
 //
 // TODO list
 // ---------
 //
 // * Status bar
-// * Convert everything to Qt undo command structure
-// * A view to see an enlarged version of the current bit region
-// * Mouseover support to show bits in said view using m_bitLocationTree
 // * A single click adds both a horizontal and vertical slice line
 // * Flesh out more ways to paste (paste as an offset of last line, etc)
-// * A range placement option - put start, put end, fill with X between
 // * DrawWidget image chunking for clipping potential
 // * Convert the inefficient vectors to linked lists where necessary
-// * Sort the vectors in various places other than just the bit creator
-// * The diameter doesn't scale in the DrawWidget point clipping, nor do the line widths, etc.
 //
 
 
+// Bit grids at least this big are recomputed off the GUI thread
+static const qint64 BackgroundBitGridSize = 1 << 20;
+
+// Zoomed out past this many bits on screen the slice modes' bit preview is left off
+static const int MaxBitPreviewPoints = 200000;
+
+
+// Computes a bit grid from its own copies of the geometry and slices, so editing
+// can carry on while it runs
+class MainWindow::BitGridWorker : public QThread
+{
+public:
+    BitGridWorker(const DieGeometry& geometry, const SliceList& horizSlices, const SliceList& vertSlices,
+                  const quint64& generation, QObject* parent)
+        : QThread(parent)
+        , m_geometry(geometry)
+        , m_horizontalSlices(horizSlices)
+        , m_verticalSlices(vertSlices)
+        , m_generation(generation)
+        , m_grid()
+    {
+    }
+    
+    const quint64& generation() const { return m_generation; }
+    const BitGrid& grid() const { return m_grid; }
+    
+protected:
+    void run() Q_DECL_OVERRIDE
+    {
+        m_grid.compute(m_geometry, m_horizontalSlices, m_verticalSlices);
+    }
+    
+private:
+    const DieGeometry m_geometry;
+    const SliceList m_horizontalSlices;
+    const SliceList m_verticalSlices;
+    const quint64 m_generation;
+    BitGrid m_grid;
+};
+
+
 MainWindow::MainWindow(QWidget* parent, Qt::WindowFlags flags)
     : m_uiMode(Navigation)
     , m_drawWidget()
     , m_qImage()
+    , m_imageReductions()
+    , m_imageCache()
     , m_dieDescriptionFilename("")
+    , m_workImage()
+    , m_workingImageDepth(WorkingColor)
+    , m_keepColorImage(false)
+    , m_sampler()
+    , m_mosaic()
     , m_activeBoundsPoint(-1)
-    , m_boundsPoints()
+    , m_die()
     , m_boundsPolygons()
-    , m_horizSlices()
-    , m_vertSlices()
     , m_sliceLines()
     , m_activeSlices()
     , m_sliceDragging(false)
-    , m_bitLocations()
+    , m_bitGrid()
+    , m_gridGeneration(1)
+    , m_bitGridGeneration(0)
+    , m_bitGridWorker(NULL)
+    , m_selectedBits()
+    , m_bitInspectorDock(NULL)
+    , m_bitInspector(NULL)
+    , m_inspectedBit(-1)
+    , m_bitInspectorUpdatePending(false)
+    , m_templateExemplars()
+    , m_reviewQueue()
+    , m_reviewPatches()
     , m_sliceLineColors()
+    , m_bitPreview()
+    , m_undoStack()
+    , m_dragSerial(0)
     , m_copiedSliceOffsets()
-    , m_romRegionHomography()
+    , m_geometry()
     , m_lmbClickedConnection()
     , m_lmbDraggedConnection()
     , m_lmbReleasedConnection()
     , m_rmbClickedConnection()
     , m_rmbDraggedConnection()
+    , m_mouseMovedConnection()
 {
     // Set the draw widget to be central and make sure it can receive focus via the mouse
     setCentralWidget(&m_drawWidget);
@@ -64,12 +127,25 @@ MainWindow::MainWindow(QWidget* parent, Qt::WindowFlags flags)
 
     // Register our local data with the pointers in the drawImage
     m_drawWidget.setImagePointer(&m_qImage);
-    m_drawWidget.setCircleCoordsPointer(&m_boundsPoints);
+    m_drawWidget.setImageReductionsPointer(&m_imageReductions);
+    m_drawWidget.setMosaicPointer(&m_mosaic);
+    m_drawWidget.setCircleCoordsPointer(&m_die.boundsPoints());
+    m_drawWidget.setBitLocationsPointer(NULL);
+    m_drawWidget.setBitLayersPointer(&m_die.bitLayers());
     m_drawWidget.setConvexPolyPointer(&m_boundsPolygons);
     m_drawWidget.setLinesPointer(&m_sliceLines);
     m_drawWidget.setLineColorsPointer(&m_sliceLineColors);
-
-    m_bitLocationTree = cv::ml::KNearest::create();
+    m_drawWidget.setBitPreviewPointer(&m_bitPreview);
+    m_drawWidget.setSelectedBitsPointer(&m_selectedBits);
+    connect(&m_drawWidget, &DrawWidget::regionSelected, this, &MainWindow::selectRegion);
+    connect(&m_drawWidget, &DrawWidget::viewportChanged, this, &MainWindow::updateBitPreview);
+
+    // The bit inspector lives in a dock on the right
+    m_bitInspectorDock = new QDockWidget(tr("Bit Inspector"), this);
+    m_bitInspectorDock->setObjectName("bitInspectorDock");
+    m_bitInspector = new BitInspector(m_bitInspectorDock);
+    m_bitInspectorDock->setWidget(m_bitInspector);
+    addDockWidget(Qt::RightDockWidgetArea, m_bitInspectorDock);
 
     createMenu();
 }
@@ -77,7 +153,8 @@ MainWindow::MainWindow(QWidget* parent, Qt::WindowFlags flags)
 
 MainWindow::~MainWindow()
 {
-    
+    if (m_bitGridWorker)
+        m_bitGridWorker->wait();
 }
 
 
@@ -89,6 +166,10 @@ void MainWindow::createMenu()
     openImageAct->setStatusTip(tr("Open a new die image"));
     connect(openImageAct, &QAction::triggered, this, &MainWindow::openImage);
     
+    QAction* openMosaicAct = new QAction(tr("Open Tile &Mosaic"), this);
+    openMosaicAct->setStatusTip(tr("Open a manifest of overlapping microscope tiles as one die image"));
+    connect(openMosaicAct, &QAction::triggered, this, &MainWindow::openMosaic);
+
     QAction* openDDFAct = new QAction(tr("Open Die &Description JSON"), this);
     openDDFAct->setShortcut(QKeySequence(Qt::CTRL + Qt::SHIFT + Qt::Key_O));
     openDDFAct->setStatusTip(tr("Open a new die description JSON"));
@@ -99,6 +180,10 @@ void MainWindow::createMenu()
     saveDDFAct->setStatusTip(tr("Save the current die description JSON"));
     connect(saveDDFAct, &QAction::triggered, this, &MainWindow::saveDieDescription);
 
+    QAction* transferDDFAct = new QAction(tr("&Transfer Die Description From Another Image"), this);
+    transferDDFAct->setStatusTip(tr("Register another capture of this die and move its die description onto this image"));
+    connect(transferDDFAct, &QAction::triggered, this, &MainWindow::transferDieDescription);
+
     QAction* exportBitImageAct = new QAction(tr("&Export Bit PNG"), this);
     exportBitImageAct->setShortcut(QKeySequence(Qt::CTRL + Qt::Key_E));
     exportBitImageAct->setStatusTip(tr("Export the marked bits to a special bit image PNG"));
@@ -108,20 +193,33 @@ void MainWindow::createMenu()
     exportSlicedImageAct->setStatusTip(tr("Export the marked die to a series of smaller PNGs"));
     connect(exportSlicedImageAct, &QAction::triggered, this, &MainWindow::exportSlicedImage);
 
+    QAction* exportRomAct = new QAction(tr("Export &ROM"), this);
+    exportRomAct->setStatusTip(tr("Export the bit values as ROM bytes using the die description's ROM format"));
+    connect(exportRomAct, &QAction::triggered, this, &MainWindow::exportRom);
+
     QAction* quitAct = new QAction(tr("E&xit"), this);
     quitAct->setShortcuts(QKeySequence::Quit);
     connect(quitAct, &QAction::triggered, this, &MainWindow::close);
 
     QMenu* fileMenu = menuBar()->addMenu(tr("&File"));
     fileMenu->addAction(openImageAct);
+    fileMenu->addAction(openMosaicAct);
     fileMenu->addAction(openDDFAct);
     fileMenu->addAction(saveDDFAct);
+    fileMenu->addAction(transferDDFAct);
     fileMenu->addAction(exportBitImageAct);
     fileMenu->addAction(exportSlicedImageAct);
+    fileMenu->addAction(exportRomAct);
     fileMenu->addAction(quitAct);
 
 
     // Create the edit menu actions and menu item
+    QAction* undoAct = m_undoStack.createUndoAction(this, tr("&Undo"));
+    undoAct->setShortcuts(QKeySequence::Undo);
+    
+    QAction* redoAct = m_undoStack.createRedoAction(this, tr("&Redo"));
+    redoAct->setShortcuts(QKeySequence::Redo);
+    
     QAction* copySlicesAct = new QAction(tr("&Copy slices"), this);
     copySlicesAct->setShortcut(QKeySequence(QKeySequence::Copy));
     copySlicesAct->setStatusTip(tr("Copy slices"));
@@ -132,9 +230,9 @@ void MainWindow::createMenu()
     pasteSlicesAct->setStatusTip(tr("Paste slices"));
     connect(pasteSlicesAct, &QAction::triggered, this, &MainWindow::pasteSlices);
     
-    QAction* deselectSlicesAct = new QAction(tr("&Deselect slices"), this);
+    QAction* deselectSlicesAct = new QAction(tr("&Deselect slices and bits"), this);
     deselectSlicesAct->setShortcut(QKeySequence(Qt::CTRL + Qt::Key_D));
-    deselectSlicesAct->setStatusTip(tr("Deselect selected slices"));
+    deselectSlicesAct->setStatusTip(tr("Deselect selected slices and bits"));
     connect(deselectSlicesAct, &QAction::triggered, this, &MainWindow::deselectSlices);
     
     QAction* deleteSlicesAct = new QAction(tr("&Delete slices"), this);
@@ -142,18 +240,103 @@ void MainWindow::createMenu()
     deleteSlicesAct->setStatusTip(tr("Delete selected slices"));
     connect(deleteSlicesAct, &QAction::triggered, this, &MainWindow::deleteSlices);
     
+    QAction* fillSliceRangeAct = new QAction(tr("&Fill between selected slices..."), this);
+    fillSliceRangeAct->setShortcut(QKeySequence(Qt::CTRL + Qt::Key_R));
+    fillSliceRangeAct->setStatusTip(tr("Evenly fill the range between the outermost selected slices"));
+    connect(fillSliceRangeAct, &QAction::triggered, this, &MainWindow::fillSelectedSliceRange);
+    
+    QAction* fillSliceRangeByPitchAct = new QAction(tr("Fill between selected slices at copied &pitch"), this);
+    fillSliceRangeByPitchAct->setShortcut(QKeySequence(Qt::CTRL + Qt::SHIFT + Qt::Key_R));
+    fillSliceRangeByPitchAct->setStatusTip(tr("Fill the range between the outermost selected slices at the copied slices' pitch"));
+    connect(fillSliceRangeByPitchAct, &QAction::triggered, this, &MainWindow::fillSelectedSliceRangeByPitch);
+    
+    QAction* tileCopiedSlicesAct = new QAction(tr("&Tile copied slices between selected slices"), this);
+    tileCopiedSlicesAct->setShortcut(QKeySequence(Qt::CTRL + Qt::SHIFT + Qt::Key_V));
+    tileCopiedSlicesAct->setStatusTip(tr("Repeat the copied slice pattern across the range between the outermost selected slices"));
+    connect(tileCopiedSlicesAct, &QAction::triggered, this, &MainWindow::tileCopiedSlicesAcrossSelection);
+    
+    QAction* classifyBitsAct = new QAction(tr("C&lassify bits"), this);
+    classifyBitsAct->setShortcut(QKeySequence(Qt::CTRL + Qt::Key_K));
+    classifyBitsAct->setStatusTip(tr("Threshold every bit that wasn't set by hand"));
+    connect(classifyBitsAct, &QAction::triggered, this, &MainWindow::classifyBits);
+    
+    QAction* addTemplateExemplarAct = new QAction(tr("Use bit as &template"), this);
+    addTemplateExemplarAct->setShortcut(QKeySequence(Qt::CTRL + Qt::SHIFT + Qt::Key_T));
+    addTemplateExemplarAct->setStatusTip(tr("Use the bit under the mouse as an example for template detection (up to two)"));
+    connect(addTemplateExemplarAct, &QAction::triggered, this, &MainWindow::addTemplateExemplar);
+    
+    QAction* detectBitsByTemplateAct = new QAction(tr("&Detect bits by template"), this);
+    detectBitsByTemplateAct->setShortcut(QKeySequence(Qt::CTRL + Qt::SHIFT + Qt::Key_K));
+    detectBitsByTemplateAct->setStatusTip(tr("Set every bit that wasn't set by hand by whether it looks like the template bits"));
+    connect(detectBitsByTemplateAct, &QAction::triggered, this, &MainWindow::detectBitsByTemplate);
+    
+    QAction* acceptReviewedBitAct = new QAction(tr("&Accept reviewed bit"), this);
+    acceptReviewedBitAct->setShortcut(QKeySequence(Qt::Key_Space));
+    acceptReviewedBitAct->setStatusTip(tr("Pin the reviewed bit's value and move to the next one"));
+    connect(acceptReviewedBitAct, &QAction::triggered, this, &MainWindow::acceptReviewedBit);
+    
+    QAction* flipReviewedBitAct = new QAction(tr("&Flip reviewed bit"), this);
+    flipReviewedBitAct->setShortcut(QKeySequence(Qt::Key_X));
+    flipReviewedBitAct->setStatusTip(tr("Pin the opposite of the reviewed bit's value and move to the next one"));
+    connect(flipReviewedBitAct, &QAction::triggered, this, &MainWindow::flipReviewedBit);
+    
+    QAction* nextReviewedBitAct = new QAction(tr("&Next bit to review"), this);
+    nextReviewedBitAct->setShortcut(QKeySequence(Qt::Key_Right));
+    nextReviewedBitAct->setStatusTip(tr("Skip to the next bit in the review queue"));
+    connect(nextReviewedBitAct, &QAction::triggered, this, &MainWindow::nextReviewedBit);
+    
+    QAction* previousReviewedBitAct = new QAction(tr("&Previous bit to review"), this);
+    previousReviewedBitAct->setShortcut(QKeySequence(Qt::Key_Left));
+    previousReviewedBitAct->setStatusTip(tr("Go back to the previous bit in the review queue"));
+    connect(previousReviewedBitAct, &QAction::triggered, this, &MainWindow::previousReviewedBit);
+    
+    QAction* setSelectedBitsOneAct = new QAction(tr("Set selected bits to &1"), this);
+    setSelectedBitsOneAct->setShortcut(QKeySequence(Qt::CTRL + Qt::SHIFT + Qt::Key_Up));
+    setSelectedBitsOneAct->setStatusTip(tr("Pin every selected bit (shift+drag or ctrl+shift+drag to select) to 1"));
+    connect(setSelectedBitsOneAct, &QAction::triggered, this, &MainWindow::setSelectedBitsOne);
+    
+    QAction* setSelectedBitsZeroAct = new QAction(tr("Set selected bits to &0"), this);
+    setSelectedBitsZeroAct->setShortcut(QKeySequence(Qt::CTRL + Qt::SHIFT + Qt::Key_Down));
+    setSelectedBitsZeroAct->setStatusTip(tr("Pin every selected bit (shift+drag or ctrl+shift+drag to select) to 0"));
+    connect(setSelectedBitsZeroAct, &QAction::triggered, this, &MainWindow::setSelectedBitsZero);
+    
+    QAction* ignoreSelectedBitsAct = new QAction(tr("&Ignore selected bits"), this);
+    ignoreSelectedBitsAct->setShortcut(QKeySequence(Qt::CTRL + Qt::SHIFT + Qt::Key_I));
+    ignoreSelectedBitsAct->setStatusTip(tr("Ignore every selected bit, or unignore them if they all already are"));
+    connect(ignoreSelectedBitsAct, &QAction::triggered, this, &MainWindow::ignoreSelectedBits);
+    
     QAction* testAct = new QAction(tr("&Test operation"), this);
     testAct->setShortcut(QKeySequence(Qt::CTRL + Qt::Key_T));
     testAct->setStatusTip(tr("Test!"));
     connect(testAct, &QAction::triggered, this, &MainWindow::testOperation);
     
     QMenu* editMenu = menuBar()->addMenu(tr("&Edit"));
+    editMenu->addAction(undoAct);
+    editMenu->addAction(redoAct);
+    editMenu->addSeparator();
     editMenu->addAction(copySlicesAct);
     editMenu->addAction(pasteSlicesAct);
     editMenu->addAction(deselectSlicesAct);
     editMenu->addAction(deleteSlicesAct);
+    editMenu->addAction(fillSliceRangeAct);
+    editMenu->addAction(fillSliceRangeByPitchAct);
+    editMenu->addAction(tileCopiedSlicesAct);
+    editMenu->addSeparator();
+    editMenu->addAction(classifyBitsAct);
+    editMenu->addAction(addTemplateExemplarAct);
+    editMenu->addAction(detectBitsByTemplateAct);
+    editMenu->addAction(setSelectedBitsOneAct);
+    editMenu->addAction(setSelectedBitsZeroAct);
+    editMenu->addAction(ignoreSelectedBitsAct);
     editMenu->addAction(testAct);
     
+    QMenu* reviewMenu = menuBar()->addMenu(tr("&Review"));
+    reviewMenu->addAction(acceptReviewedBitAct);
+    reviewMenu->addAction(flipReviewedBitAct);
+    reviewMenu->addSeparator();
+    reviewMenu->addAction(nextReviewedBitAct);
+    reviewMenu->addAction(previousReviewedBitAct);
+    
     
     // Create the mode menu actions and menu item
     QAction* modeNaviationAct = new QAction(tr("&Naviation mode"), this);
@@ -185,6 +368,12 @@ void MainWindow::createMenu()
     modeBitRegionDisplayAct->setStatusTip(tr("Show bit regions"));
     connect(modeBitRegionDisplayAct, &QAction::triggered, this, &MainWindow::setModeBitRegionDisplay);
     modeBitRegionDisplayAct->setCheckable(true);
+    
+    QAction* modeBitReviewAct = new QAction(tr("Bit re&view mode"), this);
+    modeBitReviewAct->setShortcut(QKeySequence(Qt::Key_6));
+    modeBitReviewAct->setStatusTip(tr("Step through the least certain bits"));
+    connect(modeBitReviewAct, &QAction::triggered, this, &MainWindow::setModeBitReview);
+    modeBitReviewAct->setCheckable(true);
 
     QActionGroup* modeGroup = new QActionGroup(this);
     modeGroup->addAction(modeNaviationAct);
@@ -192,6 +381,7 @@ void MainWindow::createMenu()
     modeGroup->addAction(modeSliceDefineHorizontalAct);
     modeGroup->addAction(modeSliceDefineVerticalAct);
     modeGroup->addAction(modeBitRegionDisplayAct);
+    modeGroup->addAction(modeBitReviewAct);
     modeNaviationAct->setChecked(true);
     
     QMenu* modeMenu = menuBar()->addMenu(tr("&Mode"));
@@ -200,6 +390,7 @@ void MainWindow::createMenu()
     modeMenu->addAction(modeSliceDefineHorizontalAct);
     modeMenu->addAction(modeSliceDefineVerticalAct);
     modeMenu->addAction(modeBitRegionDisplayAct);
+    modeMenu->addAction(modeBitReviewAct);
     
     
     // Create the view menu actions and menu item
@@ -222,6 +413,8 @@ void MainWindow::createMenu()
     viewMenu->addAction(centerImageAct);
     viewMenu->addAction(frameImageAct);
     viewMenu->addAction(resetImageAct);
+    viewMenu->addSeparator();
+    viewMenu->addAction(m_bitInspectorDock->toggleViewAction());
 }
 
 
@@ -233,6 +426,14 @@ void MainWindow::openImage()
 }
 
 
+void MainWindow::openMosaic()
+{
+    QString filename = QFileDialog::getOpenFileName(this, tr("Open Tile Mosaic"), "", tr("Mosaic manifests (*.json)"));
+    if (filename != "")
+        loadMosaic(filename);
+}
+
+
 void MainWindow::openDieDescription()
 {
     QString filename = QFileDialog::getOpenFileName(this, tr("Open Die Description File"), "", tr("ddf (*.ddf)"));
@@ -252,11 +453,19 @@ void MainWindow::saveDieDescription()
 void MainWindow::exportBitImage()
 {
     // Save all bit locations as a condensend image
-    if (m_uiMode == BitRegionDisplay)
+    if (showingBits())
     {
         QString filename = QFileDialog::getSaveFileName(this, tr("Export bit image"), "", tr("png (*.png)"));
         if (filename != "")
-            exportBitsToImage(filename);
+        {
+            // Streams a strip of tiles at a time rather than holding every output image
+            BitImageSink sink(filename);
+            BitPatchStream stream(m_sampler, m_geometry, m_die);
+            stream.setMosaic(m_mosaic.isEmpty() ? NULL : &m_mosaic);
+            stream.setPatchFormats(BitPatchStream::ColorPatches);
+            stream.setOutsideColor(qRgb(255, 0, 0));
+            stream.run(sink);
+        }
     }
     else
     {
@@ -265,14 +474,55 @@ void MainWindow::exportBitImage()
 }
 
 
+void MainWindow::transferDieDescription()
+{
+    if (m_qImage.isNull())
+    {
+        qWarning() << "Load the image to transfer a die description onto first";
+        return;
+    }
+    
+    QString filename = QFileDialog::getOpenFileName(this, tr("Open Die Description File to Transfer"), "", tr("ddf (*.ddf)"));
+    if (filename == "")
+        return;
+    QString sourceImageFilename = QFileDialog::getOpenFileName(this, tr("Open the Image it was Made On"), QFileInfo(filename).path(), tr("Images (*.png *.jpg *.tif)"));
+    if (sourceImageFilename != "")
+        transferDescriptionJson(filename, sourceImageFilename);
+}
+
+
+void MainWindow::exportRom()
+{
+    // Straight from the bit layers, so classify (or set the bits by hand) first
+    const BitLayers& layers = m_die.bitLayers();
+    if (layers.isEmpty() || layers.bitCount() != m_die.bitCount())
+    {
+        qWarning() << "Classify the bits before exporting a ROM";
+        return;
+    }
+    
+    QString filename = QFileDialog::getSaveFileName(this, tr("Export ROM"), "", tr("Binary (*.bin);;Intel HEX (*.hex);;Hex dump (*.txt)"));
+    if (filename == "")
+        return;
+    
+    QByteArray rom;
+    if (m_die.romFormat().assemble(layers.values(), m_die.bitCount(), rom))
+        RomFormat::write(rom, filename, RomFormat::formatFromFilename(filename));
+}
+
+
 void MainWindow::exportSlicedImage()
 {
     // Save a series of images which all come from the original image
-    if (m_uiMode == BitRegionDisplay)
+    if (!m_mosaic.isEmpty())
+    {
+        qWarning() << "Sliced export reads the whole image - it isn't available for a tile mosaic";
+    }
+    else if (showingBits())
     {
         QString filename = QFileDialog::getSaveFileName(this, tr("Export bit image"), "", tr("(*.*)"));
         if (filename != "")
-            exportToSlicedImages(filename);
+            BitExporter::exportSlicedImages(m_sampler, m_bitGrid.locations(), filename);
     }
     else
     {
@@ -283,14 +533,28 @@ void MainWindow::exportSlicedImage()
 
 void MainWindow::copySlices()
 {
-    // Copy selected slice offsets
+    // Copy selected slice offsets (the distance from each to the slice before it)
     m_copiedSliceOffsets.clear();
-    QVector<qreal>& slices = (m_uiMode == SliceDefineHorizontal) ? m_horizSlices : m_vertSlices;
-    for (int i = 0; i < m_activeSlices.size(); i++)
+    if (m_uiMode != SliceDefineHorizontal && m_uiMode != SliceDefineVertical)
+        return;
+    
+    const SliceList& slices = slicesForMode(m_uiMode);
+    const QVector<int> selectedIndices = activeSliceIndices();
+    for (int i = 0; i < selectedIndices.size(); i++)
+    {
+        const int& asli = selectedIndices[i];
+        const qreal previous = (asli == 0) ? 0.0 : slices[asli-1];
+        m_copiedSliceOffsets.push_back(slices[asli] - previous);
+    }
+    
+    // The first offset is the gap that closes the pattern when it's tiled, not the
+    // distance back to whatever came before it - the mean of the pattern's own gaps
+    if (m_copiedSliceOffsets.size() >= 2)
     {
-        const int& asli = m_activeSlices[i];
-        const qreal offset = slices[asli] - slices[asli-1];
-        m_copiedSliceOffsets.push_back(offset);
+        qreal span = 0.0;
+        for (int i = 1; i < m_copiedSliceOffsets.size(); i++)
+            span += m_copiedSliceOffsets[i];
+        m_copiedSliceOffsets[0] = span / (m_copiedSliceOffsets.size() - 1);
     }
 }
 
@@ -298,10 +562,13 @@ void MainWindow::copySlices()
 void MainWindow::pasteSlices()
 {
     // Paste selected slice offsets right where the mouse is
-    QVector<qreal>& slices = (m_uiMode == SliceDefineHorizontal) ? m_horizSlices : m_vertSlices;
+    if (m_uiMode != SliceDefineHorizontal && m_uiMode != SliceDefineVertical)
+        return;
+    
     const QPointF mouseImagePosition = m_drawWidget.window2Image(m_drawWidget.mapFromGlobal(QCursor::pos()));
-    const qreal pushOffset = romDieSpaceFromImagePoint(mouseImagePosition, m_uiMode);
+    const qreal pushOffset = m_geometry.romDieSpaceFromImagePoint(mouseImagePosition, sliceOrientation(m_uiMode));
     
+    QVector<qreal> pastedSlices;
     qreal runningSum = pushOffset;
     for (int i = 0; i < m_copiedSliceOffsets.size(); i++)
     {
@@ -311,18 +578,20 @@ void MainWindow::pasteSlices()
         if (runningSum + offset >= 1.0)
             continue;
         
-        slices.push_back(runningSum + offset);
+        pastedSlices.push_back(runningSum + offset);
         runningSum += offset;
     }
-    recomputeSliceLinesFromHomography();
-    m_drawWidget.update();
+    
+    if (!pastedSlices.isEmpty())
+        m_undoStack.push(new AddSlicesCommand(this, m_uiMode, pastedSlices));
 }
 
 
 void MainWindow::deselectSlices()
 {
-    // Deselect all slices
+    // Deselect all slices and bits
     m_activeSlices.clear();
+    m_selectedBits.clear();
     recomputeSliceLinesFromHomography();
     m_drawWidget.update();
 }
@@ -335,31 +604,235 @@ void MainWindow::deleteSlices()
 }
 
 
+void MainWindow::fillSelectedSliceRange()
+{
+    qreal start, end;
+    if (!selectedSliceRange(start, end))
+        return;
+    
+    bool ok = false;
+    const int count = QInputDialog::getInt(this, tr("Fill between selected slices"), tr("Slices to add:"), 1, 1, 100000, 1, &ok);
+    if (ok)
+        fillSliceRange(m_uiMode, start, end, count);
+}
+
+
+void MainWindow::fillSelectedSliceRangeByPitch()
+{
+    qreal start, end;
+    if (!selectedSliceRange(start, end))
+        return;
+    
+    // The pitch is measured from the copied slices - the gaps between them, ignoring the lead-in
+    if (m_copiedSliceOffsets.size() < 2)
+    {
+        qWarning() << "Copy at least two neighboring slices to measure a pitch";
+        return;
+    }
+    
+    qreal span = 0.0;
+    for (int i = 1; i < m_copiedSliceOffsets.size(); i++)
+    {
+        span += m_copiedSliceOffsets[i];
+    }
+    fillSliceRangeByPitch(m_uiMode, start, end, span / (m_copiedSliceOffsets.size() - 1));
+}
+
+
+void MainWindow::tileCopiedSlicesAcrossSelection()
+{
+    qreal start, end;
+    if (!selectedSliceRange(start, end))
+        return;
+    
+    tileSlicePattern(m_uiMode, start, end, m_copiedSliceOffsets);
+}
+
+
 void MainWindow::testOperation()
 {
     qDebug() << "Executing test operation";
 
     // Debug info
-    const int vertCount = m_vertSlices.size() + 2;
-    const int horizCount = m_horizSlices.size() + 2;
-    qDebug() << "Slice counts" << horizCount << vertCount;
+    const QSize bitCount = m_die.bitCount();
+    qDebug() << "Slice counts" << bitCount.width() << bitCount.height();
 
 
-    // TEST for the point kdtree
-    if (m_bitLocationTree->empty())
+    // TEST for the bit location index
+    if (m_bitGrid.index().isEmpty())
         return;
 
     // Where is the mouse now?
     const QPointF mouseImagePosition = m_drawWidget.window2Image(m_drawWidget.mapFromGlobal(QCursor::pos()));
-    cv::Mat mipVec(1, 2, CV_32F);
-    mipVec.at<float>(0, 0) = mouseImagePosition.x();
-    mipVec.at<float>(0, 1) = mouseImagePosition.y();
+    qDebug() << m_bitGrid.index().nearest(mouseImagePosition);
+}
+
+
+void MainWindow::classifyBits()
+{
+    if (!showingBits() || !hasImage())
+    {
+        qWarning() << "Load an image and switch to bit display mode to classify";
+        return;
+    }
+    
+    BitClassifierSink sink;
+    if (scoreBits(sink))
+        applyClassification(sink);
+}
+
+
+bool MainWindow::scoreBits(BitClassifierSink& sink)
+{
+    // Patch means stream through, only the per-bit results stay around
+    BitPatchStream stream(m_sampler, m_geometry, m_die);
+    stream.setMosaic(m_mosaic.isEmpty() ? NULL : &m_mosaic);
+    return stream.run(sink);
+}
+
+
+void MainWindow::applyClassification(const BitClassifierSink& sink)
+{
+    BitLayers classified = m_die.bitLayers();
+    classified.applyClassification(sink.bits(), BitClassifier::confidences(sink.means(), sink.threshold()));
+    m_undoStack.push(new BitLayersCommand(this, m_die.bitLayers(), classified, tr("Classify bits")));
+    qDebug() << "Classified with threshold" << sink.threshold();
+}
+
+
+void MainWindow::addTemplateExemplar()
+{
+    // Exactly where the mouse is - for these layouts the grid point may well be off the bit
+    const QPointF mouseImagePosition = m_drawWidget.window2Image(m_drawWidget.mapFromGlobal(QCursor::pos()));
+    if (m_qImage.isNull() || !m_qImage.rect().contains(mouseImagePosition.toPoint()))
+        return;
+    
+    if (m_templateExemplars.size() == 2)
+        m_templateExemplars.pop_front();
+    m_templateExemplars.push_back(mouseImagePosition);
+    qDebug() << "Template bits" << m_templateExemplars;
+}
+
+
+void MainWindow::detectBitsByTemplate()
+{
+    if (!showingBits() || m_qImage.isNull() || m_templateExemplars.isEmpty() || m_bitGrid.isEmpty() || !bitGridCurrent())
+    {
+        qWarning() << "Pick a template bit (ctrl+shift+T) in bit display mode to detect bits by template";
+        return;
+    }
+    
+    // Templates a little smaller than the bit pitch, so neighbors don't leak in
+    TemplateBitDetector detector(m_workImage.isNull() ? m_qImage : m_workImage);
+    for (int i = 0; i < m_templateExemplars.size(); i++)
+        detector.addExemplar(m_templateExemplars[i]);
+    detector.setRadius(qMax(2, qRound(m_bitGrid.index().cellSize() * 0.4)));
+    
+    const QVector<TemplateBitDetector::Match> matches = detector.detect(m_geometry.boundsPolygon());
+    const QVector<float> scores = TemplateBitDetector::snapToGrid(matches, m_bitGrid.locations(), m_bitGrid.index());
+    QVector<quint8> values;
+    QVector<quint8> confidences;
+    detector.classify(scores, values, confidences);
+    
+    BitLayers detected = m_die.bitLayers();
+    detected.applyClassification(values, confidences);
+    m_undoStack.push(new BitLayersCommand(this, m_die.bitLayers(), detected, tr("Detect bits by template")));
+    qDebug() << "Template matched" << matches.size() << "places";
+}
+
+
+void MainWindow::acceptReviewedBit()
+{
+    decideReviewedBit(false);
+}
+
+
+void MainWindow::flipReviewedBit()
+{
+    decideReviewedBit(true);
+}
+
+
+void MainWindow::nextReviewedBit()
+{
+    if (m_uiMode != BitReview)
+        return;
+    
+    m_reviewQueue.advance();
+    showReviewedBit();
+}
+
+
+void MainWindow::previousReviewedBit()
+{
+    if (m_uiMode != BitReview)
+        return;
+    
+    m_reviewQueue.retreat();
+    showReviewedBit();
+}
+
+
+void MainWindow::decideReviewedBit(const bool& flip)
+{
+    // Either way the bit gets pinned, so later classifications leave it alone
+    const int bit = m_reviewQueue.current();
+    const BitLayers& layers = m_die.bitLayers();
+    if (m_uiMode != BitReview || bit < 0 || bit >= layers.size())
+        return;
+    
+    const BitStateCommand::BitState before = BitStateCommand::state(layers, bit);
+    BitStateCommand::BitState after = before;
+    after.overridden = true;
+    if (flip)
+        after.value = !before.value;
+    m_undoStack.push(new BitStateCommand(this, bit, before, after, flip ? tr("Flip reviewed bit") : tr("Accept reviewed bit")));
+    
+    if (!m_reviewQueue.advance())
+        qDebug() << "Reached the end of the review queue";
+    showReviewedBit();
+}
+
+
+void MainWindow::showReviewedBit()
+{
+    const int bit = m_reviewQueue.current();
+    m_drawWidget.setHighlightedBit(bit);
+    m_inspectedBit = bit;
+    if (bit < 0 || bit >= m_bitGrid.locations().size())
+    {
+        m_bitInspector->clearPatch();
+        return;
+    }
+    
+    // Close enough in that the neighbors are plainly visible, the inspector shows the detail
+    m_drawWidget.centerOn(m_bitGrid.locations()[bit], 40.0 / qMax(m_bitGrid.index().cellSize(), 1.0));
+    updateBitInspector();
+    QTimer::singleShot(0, this, &MainWindow::prefetchReviewPatches);
+}
+
+
+void MainWindow::prefetchReviewPatches()
+{
+    if (m_uiMode != BitReview || m_reviewQueue.isEmpty())
+        return;
+    
+    // Keep the patches around the cursor (one behind, a handful ahead) and let the rest go
+    QVector<int> wanted = m_reviewQueue.upcoming(8);
+    wanted.push_front(m_reviewQueue.current());
+    if (m_reviewQueue.position() > 0)
+        wanted.push_front(m_reviewQueue.bitAt(m_reviewQueue.position() - 1));
     
-    // Recover K nearest neighbors
-    const int K = 1;
-    cv::Mat results;
-    m_bitLocationTree->findNearest(mipVec, K, results);
-    qDebug() << results.at<float>(0,0);
+    QHash<int, InspectorPatch> kept;
+    for (int i = 0; i < wanted.size(); i++)
+    {
+        const int bit = wanted[i];
+        if (m_reviewPatches.contains(bit))
+            kept.insert(bit, m_reviewPatches.value(bit));
+        else
+            kept.insert(bit, renderInspectorPatch(bit));
+    }
+    m_reviewPatches = kept;
 }
 
 
@@ -368,12 +841,17 @@ void MainWindow::setModeNavigation()
     m_uiMode = Navigation;
     QApplication::setOverrideCursor(Qt::ArrowCursor);
     m_drawWidget.setConvexPolyPointer(&m_boundsPolygons);
-    m_drawWidget.setCircleCoordsPointer(&m_boundsPoints);
+    m_drawWidget.setCircleCoordsPointer(&m_die.boundsPoints());
+    m_drawWidget.setBitLocationsPointer(NULL);
+    m_drawWidget.setHighlightedBit(-1);
+    m_inspectedBit = -1;
+    m_bitInspector->clearPatch();
     disconnect(m_lmbClickedConnection);
     disconnect(m_lmbDraggedConnection);
     disconnect(m_lmbReleasedConnection);
     disconnect(m_rmbClickedConnection);
     disconnect(m_rmbDraggedConnection);
+    disconnect(m_mouseMovedConnection);
     recomputeSliceLinesFromHomography();    
     m_drawWidget.update();
 }
@@ -388,11 +866,17 @@ void MainWindow::setModeBoundsDefine()
     disconnect(m_lmbReleasedConnection);
     disconnect(m_rmbClickedConnection);
     disconnect(m_rmbDraggedConnection);
+    disconnect(m_mouseMovedConnection);
     m_drawWidget.setConvexPolyPointer(&m_boundsPolygons);
-    m_drawWidget.setCircleCoordsPointer(&m_boundsPoints);
+    m_drawWidget.setCircleCoordsPointer(&m_die.boundsPoints());
+    m_drawWidget.setBitLocationsPointer(NULL);
+    m_drawWidget.setHighlightedBit(-1);
+    m_inspectedBit = -1;
+    m_bitInspector->clearPatch();
     m_lmbClickedConnection = connect(&m_drawWidget, &DrawWidget::leftButtonClicked, this, &MainWindow::addOrMoveBoundsPoint);
     m_lmbDraggedConnection = connect(&m_drawWidget, &DrawWidget::leftButtonDragged, this, &MainWindow::dragBoundsPoint);
     m_lmbReleasedConnection = connect(&m_drawWidget, &DrawWidget::leftButtonReleased, this, &MainWindow::stopDraggingBoundsPoint);
+    updateBitPreview();
     m_drawWidget.update();
 }
 
@@ -406,8 +890,13 @@ void MainWindow::setModeSliceDefineHorizontal()
     disconnect(m_lmbReleasedConnection);
     disconnect(m_rmbClickedConnection);
     disconnect(m_rmbDraggedConnection);
+    disconnect(m_mouseMovedConnection);
     m_drawWidget.setConvexPolyPointer(&m_boundsPolygons);
-    m_drawWidget.setCircleCoordsPointer(&m_boundsPoints);
+    m_drawWidget.setCircleCoordsPointer(&m_die.boundsPoints());
+    m_drawWidget.setBitLocationsPointer(NULL);
+    m_drawWidget.setHighlightedBit(-1);
+    m_inspectedBit = -1;
+    m_bitInspector->clearPatch();
     m_lmbClickedConnection = connect(&m_drawWidget, &DrawWidget::leftButtonClicked, this, &MainWindow::addOrMoveSlice);
     m_lmbDraggedConnection = connect(&m_drawWidget, &DrawWidget::leftButtonDragged, this, &MainWindow::dragSlices);
     m_lmbReleasedConnection = connect(&m_drawWidget, &DrawWidget::leftButtonReleased, this, &MainWindow::stopDraggingSlices);
@@ -428,8 +917,13 @@ void MainWindow::setModeSliceDefineVertical()
     disconnect(m_lmbReleasedConnection);
     disconnect(m_rmbClickedConnection);
     disconnect(m_rmbDraggedConnection);
+    disconnect(m_mouseMovedConnection);
     m_drawWidget.setConvexPolyPointer(&m_boundsPolygons);
-    m_drawWidget.setCircleCoordsPointer(&m_boundsPoints);
+    m_drawWidget.setCircleCoordsPointer(&m_die.boundsPoints());
+    m_drawWidget.setBitLocationsPointer(NULL);
+    m_drawWidget.setHighlightedBit(-1);
+    m_inspectedBit = -1;
+    m_bitInspector->clearPatch();
     m_lmbClickedConnection = connect(&m_drawWidget, &DrawWidget::leftButtonClicked, this, &MainWindow::addOrMoveSlice);
     m_lmbDraggedConnection = connect(&m_drawWidget, &DrawWidget::leftButtonDragged, this, &MainWindow::dragSlices);
     m_lmbReleasedConnection = connect(&m_drawWidget, &DrawWidget::leftButtonReleased, this, &MainWindow::stopDraggingSlices);
@@ -450,194 +944,387 @@ void MainWindow::setModeBitRegionDisplay()
     disconnect(m_lmbReleasedConnection);
     disconnect(m_rmbClickedConnection);
     disconnect(m_rmbDraggedConnection);
-    m_sliceLines.clear();
-    m_sliceLineColors.clear();
-    m_drawWidget.setConvexPolyPointer(NULL);
-    m_bitLocations = computeBitLocations();
-    m_drawWidget.setCircleCoordsPointer(&m_bitLocations);
+    disconnect(m_mouseMovedConnection);
+    showBitLocations();
+    m_drawWidget.setHighlightedBit(-1);
+    m_mouseMovedConnection = connect(&m_drawWidget, &DrawWidget::mouseMoved, this, &MainWindow::inspectBitAt);
+    m_lmbClickedConnection = connect(&m_drawWidget, &DrawWidget::leftButtonClicked, this, &MainWindow::toggleBitValue);
+    m_rmbClickedConnection = connect(&m_drawWidget, &DrawWidget::rightButtonClicked, this, &MainWindow::toggleBitIgnored);
     
     m_drawWidget.update();
 }
 
 
-bool MainWindow::loadImage(const QString& filename)
+void MainWindow::setModeBitReview()
 {
-    // Load off disk
-    bool success = m_qImage.load(filename);
-    if (success == false)
+    m_uiMode = BitReview;
+    QApplication::setOverrideCursor(Qt::ArrowCursor);
+    disconnect(m_lmbClickedConnection);
+    disconnect(m_lmbDraggedConnection);
+    disconnect(m_lmbReleasedConnection);
+    disconnect(m_rmbClickedConnection);
+    disconnect(m_rmbDraggedConnection);
+    disconnect(m_mouseMovedConnection);
+    showBitLocations();
+    m_lmbClickedConnection = connect(&m_drawWidget, &DrawWidget::leftButtonClicked, this, &MainWindow::toggleBitValue);
+    m_rmbClickedConnection = connect(&m_drawWidget, &DrawWidget::rightButtonClicked, this, &MainWindow::toggleBitIgnored);
+    
+    // The queue indexes into the grid, so it can't be built on an old one
+    refreshBitGrid(true);
+    
+    // Queue up the least certain bits by their patch scores, most ambiguous first.  The
+    // values already there (template detection, fusion, a loaded DDF) are left alone -
+    // only a die with no values at all gets the threshold classification to review
+    m_reviewQueue.clear();
+    m_reviewPatches.clear();
+    BitClassifierSink sink;
+    if (!hasImage() || m_bitGrid.isEmpty() || !scoreBits(sink))
     {
-        qWarning() << "Error opening image " << filename;
-        return false;
+        qWarning() << "Load an image and define the bit grid to review bits";
+    }
+    else
+    {
+        if (m_die.bitLayers().isBlank())
+            applyClassification(sink);
+        m_reviewQueue.build(sink.means(), sink.contrasts(), sink.threshold(), m_die.bitLayers());
     }
     
-    // Clear current state
-    clearBoundsGeometry();
-    m_boundsPoints.clear();
-    m_activeBoundsPoint = -1;
-    
-    // Scale the image to the viewport if need be
-    if (m_qImage.size().width() > m_drawWidget.size().width() ||
-        m_qImage.size().height() > m_drawWidget.size().height())
-        m_drawWidget.scaleImageToViewport();
+    showReviewedBit();
+    m_drawWidget.update();
+}
 
-    m_drawWidget.centerImage();
-    
-    return true;
+
+void MainWindow::showBitLocations()
+{
+    // The bit grid display shared by the bit modes
+    m_sliceLines.clear();
+    m_sliceLineColors.clear();
+    updateBitPreview();
+    m_drawWidget.setConvexPolyPointer(NULL);
+    refreshBitGrid();
+    fitBitLayersToSlices();
+    m_drawWidget.setCircleCoordsPointer(NULL);
+    m_drawWidget.setBitLocationsPointer(&m_bitGrid.locations(), &m_bitGrid.index());
+    m_inspectedBit = -1;
+    m_reviewPatches.clear();
 }
 
 
-bool MainWindow::saveDescriptionJson(const QString& filename)
+void MainWindow::refreshBitGrid(const bool& wait)
 {
-    // Open the file for writing
-    QFile file;
-    file.setFileName(filename);
-    bool success = file.open(QIODevice::WriteOnly | QIODevice::Text);
-    if (!success)
-        return false;
-    
-    // Write 
-    QJsonObject root;
-    root["fileType"] = "Die Description File";
-    root["version"] = (int)1;
-    
-    // Write the ROM boundary points
-    QJsonArray boundaryArray;
-    for (int i = 0; i < m_boundsPoints.size(); i++)
+    // A computation already on its way is either waited for or picked up when it's done
+    if (m_bitGridWorker)
     {
-        QJsonArray qPointFJson;
-        qPointFJson.append(m_boundsPoints[i].x());
-        qPointFJson.append(m_boundsPoints[i].y());
-        boundaryArray.append(qPointFJson);
+        if (!wait)
+            return;
+        m_bitGridWorker->wait();
+        adoptBitGridWorker();
     }
-    root["romBounds"] = boundaryArray;
+    if (bitGridCurrent())
+        return;
     
-    // Write the horizontal slice offsets
-    QJsonArray horizSliceArray;
-    for (int i = 0; i < m_horizSlices.size(); i++)
+    // Slices nudged since last time only move their own rows and columns
+    const SliceList& horizSlices = m_die.horizontalSlices();
+    const SliceList& vertSlices = m_die.verticalSlices();
+    if (m_bitGrid.update(m_geometry, horizSlices, vertSlices))
     {
-        horizSliceArray.append(m_horizSlices[i]);
+        m_bitGridGeneration = m_gridGeneration;
+        return;
     }
-    root["horizontalSlices"] = horizSliceArray;
-
-    // Write the vertical slice offsets
-    QJsonArray vertSliceArray;
-    for (int i = 0; i < m_vertSlices.size(); i++)
+    
+    // Small grids (or nothing to show in the meantime) aren't worth handing off
+    const qint64 bitCount = (qint64)(horizSlices.size() + 2) * (vertSlices.size() + 2);
+    if (wait || m_bitGrid.isEmpty() || !m_geometry.isValid() || bitCount < BackgroundBitGridSize)
     {
-        vertSliceArray.append(m_vertSlices[i]);
+        m_bitGrid.compute(m_geometry, horizSlices, vertSlices);
+        m_bitGridGeneration = m_gridGeneration;
+        return;
     }
-    root["verticalSlices"] = vertSliceArray;
     
-    // Write, close, and cleanup
-    file.write(QJsonDocument(root).toJson(QJsonDocument::Indented));
-    file.close();
-    
-    return true;
+    m_bitGridWorker = new BitGridWorker(m_geometry, horizSlices, vertSlices, m_gridGeneration, this);
+    connect(m_bitGridWorker, &QThread::finished, this, &MainWindow::bitGridWorkerFinished);
+    m_bitGridWorker->start();
 }
 
 
-bool MainWindow::loadDescriptionJson(const QString& filename)
+void MainWindow::adoptBitGridWorker()
 {
-    // Open and read the file
-    QFile file;
-    file.setFileName(filename);
-    bool success = file.open(QIODevice::ReadOnly | QIODevice::Text);
-    if (!success)
-        return false;
-    
-    // Read the entire file
-    QString jsonString = file.readAll();
-    file.close();
-    
-    // Parse the JSON from the die descriptor file
-    QJsonParseError jError;
-    QJsonDocument jDoc = QJsonDocument::fromJson(jsonString.toUtf8(), &jError);
-    if(jError.error != QJsonParseError::NoError)
-        return false;
+    BitGridWorker* worker = m_bitGridWorker;
+    m_bitGridWorker = NULL;
     
-    // Begin interpreting
-    QJsonObject docObj = jDoc.object();
-    
-    // Make sure we're the correct file type
-    const QString fileType = docObj["fileType"].toString();
-    if (fileType.isEmpty() || fileType != "Die Description File")
+    // Anything edited while it ran makes it stale
+    if (worker->generation() == m_gridGeneration)
     {
-        qWarning() << "Invalid DDF file.  Aborting read";
-        return false;
+        m_bitGrid = worker->grid();
+        m_bitGridGeneration = worker->generation();
+        m_inspectedBit = -1;
+        m_reviewPatches.clear();
     }
+    worker->deleteLater();
+}
 
-    // Check the version
-    const int version = docObj["version"].toInt();
-    if (version > 1 || version == 0)
-    {
-        qWarning() << "Can only read DDF file versions 1 or less";
-        return false;
-    }
+
+void MainWindow::bitGridWorkerFinished()
+{
+    // Already picked up by a refresh that waited for it
+    if (!m_bitGridWorker || !m_bitGridWorker->isFinished())
+        return;
     
-    // Read the bounds points
-    m_boundsPoints.clear();
-    m_activeBoundsPoint = -1;
-    const QJsonArray romBounds = docObj["romBounds"].toArray();
-    for (int i = 0; i < romBounds.size(); i++)
-    {
-        const QJsonArray pointArray = romBounds[i].toArray();
-        m_boundsPoints.push_back(QPointF(pointArray[0].toDouble(), pointArray[1].toDouble()));
-    }
+    // A stale result goes round again
+    adoptBitGridWorker();
+    if (showingBits())
+        showBitLocations();
+    m_drawWidget.update();
+}
+
+
+void MainWindow::gridChanged()
+{
+    // Bit indices don't survive a change to the grid
+    m_gridGeneration++;
+    m_selectedBits.clear();
+    if (showingBits())
+        showBitLocations();
+}
+
+
+void MainWindow::inspectBitAt(const QPointF& position)
+{
+    // The lookup is cheap, the redraw only happens when the bit under the mouse changes
+    // and at most once per pass through the event loop however many moves arrive
+    const int nearestBit = bitGridCurrent() ? m_bitGrid.index().nearest(position) : -1;
+    if (nearestBit == m_inspectedBit)
+        return;
     
-    // Read the horizontal slice offsets
-    m_horizSlices.clear();
-    m_activeSlices.clear();
-    const QJsonArray horizSlices = docObj["horizontalSlices"].toArray();
-    for (int i = 0; i < horizSlices.size(); i++)
+    m_inspectedBit = nearestBit;
+    if (!m_bitInspectorUpdatePending && m_bitInspectorDock->isVisible())
     {
-        m_horizSlices.push_back(horizSlices[i].toDouble());
+        m_bitInspectorUpdatePending = true;
+        QTimer::singleShot(0, this, &MainWindow::updateBitInspector);
     }
-    
-    // Read the vertical slice offsets
-    m_vertSlices.clear();
-    m_activeSlices.clear();
-    const QJsonArray vertSlices = docObj["verticalSlices"].toArray();
-    for (int i = 0; i < vertSlices.size(); i++)
+}
+
+
+void MainWindow::updateBitInspector()
+{
+    m_bitInspectorUpdatePending = false;
+    if (!showingBits() || m_inspectedBit < 0 || m_inspectedBit >= m_bitGrid.locations().size())
     {
-        m_vertSlices.push_back(vertSlices[i].toDouble());
+        m_bitInspector->clearPatch();
+        return;
     }
     
-    // Compute the geometry, and update the view
-    computeBoundsPolyAndHomography();
-    recomputeSliceLinesFromHomography();
-    m_drawWidget.update();
-    
-    m_dieDescriptionFilename = filename;
-            
-    return true;
+    // Reviewed bits have usually been rendered ahead of time
+    const bool prefetched = (m_uiMode == BitReview && m_reviewPatches.contains(m_inspectedBit));
+    const InspectorPatch patch = prefetched ? m_reviewPatches.value(m_inspectedBit) : renderInspectorPatch(m_inspectedBit);
+    QString caption = bitCaption(m_inspectedBit);
+    if (m_uiMode == BitReview && !m_reviewQueue.isEmpty())
+        caption = tr("Review %1/%2  ").arg(m_reviewQueue.position() + 1).arg(m_reviewQueue.size()) + caption;
+    m_bitInspector->setPatch(patch.image, patch.bitCenters, patch.highlightedBit, caption);
 }
 
 
-void MainWindow::addOrMoveBoundsPoint(const QPointF& position)
+MainWindow::InspectorPatch MainWindow::renderInspectorPatch(const int& bit) const
 {
-    // First check to see if a current bounds point is close (you're selecting instead of adding a new)
-    for (int i = 0; i < m_boundsPoints.size(); i++)
+    // A patch about three bits across, cut straight out of the die image
+    const QPointF center = m_bitGrid.locations()[bit];
+    const int radius = qBound(4, qCeil(m_bitGrid.index().cellSize() * 1.5), 256);
+    const QRect patchRect(qFloor(center.x()) - radius, qFloor(center.y()) - radius, radius * 2 + 1, radius * 2 + 1);
+    InspectorPatch patch;
+    patch.image = m_mosaic.isEmpty() ? m_qImage.copy(patchRect) : m_mosaic.region(patchRect);
+    patch.highlightedBit = -1;
+    
+    // Every bit that lands in the patch gets marked
+    const QVector<int> patchBits = m_bitGrid.index().inRect(patchRect);
+    for (int i = 0; i < patchBits.size(); i++)
     {
-        // TODO: Scale selection radius based on drawWidget zoom factor
-        const qreal distance = (m_boundsPoints[i] - position).manhattanLength();
-        if (distance < 10.0f)
-        {
-            m_activeBoundsPoint = i;
-            return;
-        }
+        if (patchBits[i] == bit)
+            patch.highlightedBit = patch.bitCenters.size();
+        patch.bitCenters.push_back(m_bitGrid.locations()[patchBits[i]] - QPointF(patchRect.topLeft()));
     }
+    return patch;
+}
+
+
+QString MainWindow::bitCaption(const int& bit) const
+{
+    const int bitsAcross = m_die.bitCount().width();
+    QString caption = tr("Bit %1  (row %2, col %3)").arg(bit)
+                                                    .arg(bit / bitsAcross)
+                                                    .arg(bit % bitsAcross);
+    const BitLayers& layers = m_die.bitLayers();
+    if (bit < layers.size())
+    {
+        caption += tr("  value %1, confidence %2").arg(layers.value(bit) ? 1 : 0)
+                                                  .arg(layers.confidence(bit));
+        if (layers.isOverridden(bit))
+            caption += tr(", set by hand");
+        if (layers.isIgnored(bit))
+            caption += tr(", ignored");
+    }
+    return caption;
+}
+
+
+void MainWindow::setWorkingImageDepth(const WorkingImageDepth& depth, const bool keepColorImage)
+{
+    // Takes effect immediately (though a discarded color image only comes back on the next load)
+    m_workingImageDepth = depth;
+    m_keepColorImage = keepColorImage;
+    if (!m_qImage.isNull())
+        rebuildWorkingImage();
+}
+
+
+bool MainWindow::loadImage(const QString& filename)
+{
+    // Load off disk - or map it straight out of the decoded image cache if it's been opened before
+    m_workImage = QImage();
+    QVector<QImage> levels;
+    bool success = m_imageCache.load(filename, levels);
+    if (success == false)
+    {
+        qWarning() << "Error opening image " << filename;
+        return false;
+    }
+    m_qImage = levels[0];
+    m_imageReductions = levels.mid(1);
     
-    // Our ROM region can only be 4-sided
-    if (m_boundsPoints.size() < 4)
+    // Build the single-channel copy everything but the display samples from
+    m_mosaic.clear();
+    rebuildWorkingImage();
+    
+    imageReplaced();
+    return true;
+}
+
+
+bool MainWindow::loadMosaic(const QString& filename)
+{
+    if (!m_mosaic.loadManifest(filename) || !m_mosaic.refine())
+        return false;
+    
+    // Nothing is held for the whole die - the view and the bit sampling read through the mosaic
+    m_qImage = QImage();
+    m_imageReductions.clear();
+    m_workImage = QImage();
+    m_sampler = ImageSampler();
+    
+    imageReplaced();
+    return true;
+}
+
+
+void MainWindow::setImageCacheEnabled(const bool enabled)
+{
+    m_imageCache.setDirectory(enabled ? DecodedImageCache().directory() : QString());
+}
+
+
+void MainWindow::imageReplaced()
+{
+    // Clear current state
+    clearBoundsGeometry();
+    m_die.boundsPoints().clear();
+    m_activeBoundsPoint = -1;
+    m_templateExemplars.clear();
+    m_undoStack.clear();
+    gridChanged();
+    
+    // Scale the image to the viewport if need be
+    const QSize imageSize = m_mosaic.isEmpty() ? m_qImage.size() : m_mosaic.size();
+    if (imageSize.width() > m_drawWidget.size().width() ||
+        imageSize.height() > m_drawWidget.size().height())
+        m_drawWidget.scaleImageToViewport();
+
+    m_drawWidget.centerImage();
+}
+
+
+bool MainWindow::saveDescriptionJson(const QString& filename)
+{
+    return m_die.saveJson(filename);
+}
+
+
+bool MainWindow::loadDescriptionJson(const QString& filename)
+{
+    const bool success = m_die.loadJson(filename);
+    if (!success)
+        return false;
+    
+    descriptionReplaced();
+    m_dieDescriptionFilename = filename;
+            
+    return true;
+}
+
+
+bool MainWindow::transferDescriptionJson(const QString& filename, const QString& sourceImageFilename)
+{
+    DieDescription source;
+    if (!source.loadJson(filename))
+        return false;
+    
+    QImage sourceImage;
+    if (!sourceImage.load(sourceImageFilename))
     {
-        m_boundsPoints.push_back(position);
+        qWarning() << "Error opening image " << sourceImageFilename;
+        return false;
+    }
+    
+    // Bounds points move with the registration, everything else carries straight over
+    ImageRegistration registration;
+    if (!registration.align(sourceImage, m_workImage.isNull() ? m_qImage : m_workImage))
+        return false;
+    qDebug() << "Registered with" << registration.inlierCount() << "matching features";
+    
+    m_die = registration.transfer(source);
+    descriptionReplaced();
+    
+    // Saving shouldn't default to overwriting the other image's description
+    m_dieDescriptionFilename = "";
+    
+    return true;
+}
+
 
-        if (m_boundsPoints.size() == 4)
+void MainWindow::descriptionReplaced()
+{
+    // Clear the state referring to the old description
+    m_activeBoundsPoint = -1;
+    m_activeSlices.clear();
+    m_undoStack.clear();
+    
+    // Compute the geometry, and update the view
+    computeBoundsPolyAndHomography();
+    gridChanged();
+    recomputeSliceLinesFromHomography();
+    m_drawWidget.update();
+}
+
+
+void MainWindow::addOrMoveBoundsPoint(const QPointF& position)
+{
+    // First check to see if a current bounds point is close (you're selecting instead of adding a new)
+    for (int i = 0; i < m_die.boundsPoints().size(); i++)
+    {
+        // Within a marker's width on screen, whatever the zoom
+        const qreal distance = (m_die.boundsPoints()[i] - position).manhattanLength();
+        if (distance < m_drawWidget.screenToImage(10.0))
         {
-            computeBoundsPolyAndHomography();
-            recomputeSliceLinesFromHomography();
+            m_activeBoundsPoint = i;
+            m_dragSerial++;
+            return;
         }
-
-        m_drawWidget.update();
+    }
+    
+    // Our ROM region can only be 4-sided
+    if (m_die.boundsPoints().size() < 4)
+    {
+        QVector<QPointF> newBoundsPoints = m_die.boundsPoints();
+        newBoundsPoints.push_back(position);
+        m_undoStack.push(new BoundsPointsCommand(this, m_die.boundsPoints(), newBoundsPoints));
     }
 }
 
@@ -647,14 +1334,9 @@ void MainWindow::dragBoundsPoint(const QPointF& position)
     if (m_activeBoundsPoint < 0)
         return;
     
-    m_boundsPoints[m_activeBoundsPoint] = position;
-    if (m_boundsPoints.size() == 4)
-    {
-        computeBoundsPolyAndHomography();
-        recomputeSliceLinesFromHomography();
-    }
-    
-    m_drawWidget.update();
+    QVector<QPointF> newBoundsPoints = m_die.boundsPoints();
+    newBoundsPoints[m_activeBoundsPoint] = position;
+    m_undoStack.push(new BoundsPointsCommand(this, m_die.boundsPoints(), newBoundsPoints, m_dragSerial));
 }
 
 
@@ -675,26 +1357,24 @@ void MainWindow::addOrMoveSlice(const QPointF& position)
         return;
     
     // Switch the slice we're operating on based on the current ui mode
-    QVector<qreal>& slices = (m_uiMode == SliceDefineHorizontal) ? m_horizSlices : m_vertSlices;
+    const SliceList& slices = slicesForMode(m_uiMode);
 
     // If there are selected lines, maybe you want to drag them
-    for (int i = 0; i < m_activeSlices.size(); i++)
+    const QVector<int> nearSlices = slicesNearPoint(position, m_uiMode);
+    for (int i = 0; i < nearSlices.size(); i++)
     {
-        // TODO: Scale selection distance based on drawWidget zoom factor
-        const qreal distance = linePointDistance(slicePositionToLine(slices[m_activeSlices[i]], m_uiMode), position);
-        if (distance < 5.0f)
+        if (m_activeSlices.contains(slices.id(nearSlices[i])))
         {
             m_sliceDragging = true;
             m_sliceDragOrigin = position;
+            m_dragSerial++;
             return;
         }
     }
     
     // Convert the image-space position into ROM-die-space using the homography
-    slices.push_back(romDieSpaceFromImagePoint(position, m_uiMode));
-
-    recomputeSliceLinesFromHomography();
-    m_drawWidget.update();
+    const QVector<qreal> newSlice(1, m_geometry.romDieSpaceFromImagePoint(position, sliceOrientation(m_uiMode)));
+    m_undoStack.push(new AddSlicesCommand(this, m_uiMode, newSlice));
 }
 
 
@@ -708,30 +1388,120 @@ void MainWindow::selectSlice(const QPointF& position)
     if (!m_boundsPolygons[0].containsPoint(position, Qt::OddEvenFill))
         return;
     
-    // Switch the slice we're operating on based on the current ui mode
-    QVector<qreal>& slices = (m_uiMode == SliceDefineHorizontal) ? m_horizSlices : m_vertSlices;
+    // Toggle the selection of the closest slice line (if it's close enough)
+    const QVector<int> nearSlices = slicesNearPoint(position, m_uiMode);
+    if (nearSlices.isEmpty())
+        return;
+    
+    const quint32 sliceId = slicesForMode(m_uiMode).id(nearSlices[0]);
+    if (m_activeSlices.contains(sliceId))
+        m_activeSlices.remove(sliceId);
+    else
+        m_activeSlices.insert(sliceId);
     
-    // First check to see if a current slice line is close (you're selecting instead of adding a new)
-    for (int i = 0; i < slices.size(); i++)
+    recomputeSliceLinesFromHomography();
+    m_drawWidget.update();
+}
+
+
+void MainWindow::selectRegion(const QPolygonF& region)
+{
+    if (!m_geometry.isValid() || region.size() < 3)
+        return;
+    
+    if (m_uiMode == SliceDefineHorizontal || m_uiMode == SliceDefineVertical)
     {
-        // TODO: Scale selection distance based on drawWidget zoom factor
-        const qreal distance = linePointDistance(slicePositionToLine(slices[i], m_uiMode), position);
-        if (distance < 5.0f)
+        // A slice is a straight line across the die and the region is all one piece, so the
+        // slices crossing it are exactly those within its extent along the slices' axis
+        const SliceOrientation hv = sliceOrientation(m_uiMode);
+        qreal low = 1.0, high = 0.0, acrossLow = 1.0, acrossHigh = 0.0;
+        for (int i = 0; i < region.size(); i++)
         {
-            // TODO: inefficient
-            const int alreadySelected = m_activeSlices.indexOf(i);
-            if (alreadySelected != -1)
-                m_activeSlices.remove(alreadySelected);
-            else
-                m_activeSlices.push_back(i);
-            
-            qSort(m_activeSlices);
-            
-            recomputeSliceLinesFromHomography();
-            m_drawWidget.update();
+            const QPointF r = m_geometry.romDieSpaceFromImagePoint(region[i]);
+            const qreal along = (hv == HorizontalSlice) ? r.x() : r.y();
+            const qreal across = (hv == HorizontalSlice) ? r.y() : r.x();
+            low = qMin(low, along);
+            high = qMax(high, along);
+            acrossLow = qMin(acrossLow, across);
+            acrossHigh = qMax(acrossHigh, across);
+        }
+        if (acrossHigh < 0.0 || acrossLow > 1.0)
             return;
+        
+        const SliceList& slices = slicesForMode(m_uiMode);
+        const int end = slices.upperBound(high);
+        for (int i = slices.lowerBound(low); i < end; i++)
+            m_activeSlices.insert(slices.id(i));
+        recomputeSliceLinesFromHomography();
+    }
+    else if (showingBits() && bitGridCurrent())
+    {
+        // The spatial index narrows it to the region's bounding box, the lasso's shape does the rest
+        const QVector<int> candidates = m_bitGrid.index().inRect(region.boundingRect());
+        QVector<int> hits;
+        hits.reserve(candidates.size());
+        for (int i = 0; i < candidates.size(); i++)
+        {
+            if (region.containsPoint(m_bitGrid.locations()[candidates[i]], Qt::OddEvenFill))
+                hits.push_back(candidates[i]);
         }
+        
+        // Added to what's already selected, kept sorted
+        std::sort(hits.begin(), hits.end());
+        QVector<int> merged(m_selectedBits.size() + hits.size());
+        merged.erase(std::set_union(m_selectedBits.constBegin(), m_selectedBits.constEnd(),
+                                    hits.constBegin(), hits.constEnd(), merged.begin()), merged.end());
+        m_selectedBits = merged;
+        qDebug() << "Selected" << hits.size() << "bits," << m_selectedBits.size() << "in all";
     }
+    m_drawWidget.update();
+}
+
+
+void MainWindow::setSelectedBitsOne()
+{
+    setSelectedBits(true);
+}
+
+
+void MainWindow::setSelectedBitsZero()
+{
+    setSelectedBits(false);
+}
+
+
+void MainWindow::setSelectedBits(const bool& value)
+{
+    const BitLayers& layers = m_die.bitLayers();
+    if (m_selectedBits.isEmpty() || layers.size() != m_bitGrid.locations().size())
+        return;
+    
+    BitStateCommand::BitState after;
+    after.value = value;
+    after.overridden = true;
+    after.ignored = false;
+    m_undoStack.push(new BitStatesCommand(this, m_selectedBits, BitStatesCommand::ValueField | BitStatesCommand::OverriddenField, after,
+                                          value ? tr("Set selected bits to 1") : tr("Set selected bits to 0")));
+}
+
+
+void MainWindow::ignoreSelectedBits()
+{
+    const BitLayers& layers = m_die.bitLayers();
+    if (m_selectedBits.isEmpty() || layers.size() != m_bitGrid.locations().size())
+        return;
+    
+    // Ignore them all, unless they all already are
+    bool allIgnored = true;
+    for (int i = 0; i < m_selectedBits.size() && allIgnored; i++)
+        allIgnored = layers.isIgnored(m_selectedBits[i]);
+    
+    BitStateCommand::BitState after;
+    after.value = false;
+    after.overridden = false;
+    after.ignored = !allIgnored;
+    m_undoStack.push(new BitStatesCommand(this, m_selectedBits, BitStatesCommand::IgnoredField, after,
+                                          allIgnored ? tr("Unignore selected bits") : tr("Ignore selected bits")));
 }
 
 
@@ -745,29 +1515,18 @@ void MainWindow::selectMoreSlices(const QPointF& position)
     if (!m_boundsPolygons[0].containsPoint(position, Qt::OddEvenFill))
         return;
     
-    // Switch the slice we're operating on based on the current ui mode
-    QVector<qreal>& slices = (m_uiMode == SliceDefineHorizontal) ? m_horizSlices : m_vertSlices;
+    // Add the closest slice line to the selection (if it's close enough)
+    const QVector<int> nearSlices = slicesNearPoint(position, m_uiMode);
+    if (nearSlices.isEmpty())
+        return;
     
-    // First check to see if a current slice line is close (you're selecting instead of adding a new)
-    for (int i = 0; i < slices.size(); i++)
-    {
-        // TODO: Scale selection distance based on drawWidget zoom factor
-        const qreal distance = linePointDistance(slicePositionToLine(slices[i], m_uiMode), position);
-        if (distance < 5.0f)
-        {
-            // TODO: inefficient
-            if (!m_activeSlices.contains(i))
-                m_activeSlices.push_back(i);
-            else
-                return;
-            
-            qSort(m_activeSlices);
-            
-            recomputeSliceLinesFromHomography();
-            m_drawWidget.update();
-            return;
-        }
-    }
+    const quint32 sliceId = slicesForMode(m_uiMode).id(nearSlices[0]);
+    if (m_activeSlices.contains(sliceId))
+        return;
+    
+    m_activeSlices.insert(sliceId);
+    recomputeSliceLinesFromHomography();
+    m_drawWidget.update();
 }
 
 
@@ -776,19 +1535,9 @@ void MainWindow::dragSlices(const QPointF& position)
     if (!m_sliceDragging)
         return;
     
-    // Switch the slice we're operating on based on the current ui mode
-    QVector<qreal>& slices = (m_uiMode == SliceDefineHorizontal) ? m_horizSlices : m_vertSlices;
-
-    const qreal dragDelta = romDieSpaceFromImagePoint(position, m_uiMode) - romDieSpaceFromImagePoint(m_sliceDragOrigin, m_uiMode);
-    for (int i = 0; i < m_activeSlices.size(); i++)
-    {
-        const int sliceIndex = m_activeSlices[i];
-        slices[sliceIndex] += dragDelta;
-    }
+    const qreal dragDelta = m_geometry.romDieSpaceFromImagePoint(position, sliceOrientation(m_uiMode)) - m_geometry.romDieSpaceFromImagePoint(m_sliceDragOrigin, sliceOrientation(m_uiMode));
     m_sliceDragOrigin = position;
-
-    recomputeSliceLinesFromHomography();
-    m_drawWidget.update();
+    m_undoStack.push(new MoveSlicesCommand(this, m_uiMode, activeSliceIds(), dragDelta, m_dragSerial));
 }
 
 
@@ -798,423 +1547,340 @@ void MainWindow::stopDraggingSlices(const QPointF& position)
 }
 
 
-void MainWindow::deleteSelectedSlices()
+void MainWindow::toggleBitValue(const QPointF& position)
 {
-    // TODO: SUUUUUPER-inefficient
-    QVector<qreal>& slices = (m_uiMode == SliceDefineHorizontal) ? m_horizSlices : m_vertSlices;
+    // Flips the bit and pins it against reclassification - ctrl unpins it instead
+    const int bit = bitAtPoint(position);
+    BitLayers& layers = m_die.bitLayers();
+    if (!bitGridCurrent() || bit < 0 || bit >= layers.size())
+        return;
     
-    QVector<qreal> newSlices;
-    for (int i = 0; i < slices.size(); i++)
+    const BitStateCommand::BitState before = BitStateCommand::state(layers, bit);
+    BitStateCommand::BitState after = before;
+    if (QApplication::keyboardModifiers() & Qt::ControlModifier)
     {
-        if (!m_activeSlices.contains(i))
-        {
-            newSlices.push_back(slices[i]);
-        }
+        if (!before.overridden)
+            return;
+        after.overridden = false;
+        m_undoStack.push(new BitStateCommand(this, bit, before, after, tr("Clear bit override")));
+    }
+    else
+    {
+        after.value = !before.value;
+        after.overridden = true;
+        m_undoStack.push(new BitStateCommand(this, bit, before, after, tr("Set bit value")));
     }
-    slices = newSlices;
-    m_activeSlices.clear();
-    recomputeSliceLinesFromHomography();
 }
 
 
-void MainWindow::clearBoundsGeometry()
+void MainWindow::toggleBitIgnored(const QPointF& position)
 {
-    m_boundsPolygons.clear();
-    m_romRegionHomography.release();
+    const int bit = bitAtPoint(position);
+    BitLayers& layers = m_die.bitLayers();
+    if (!bitGridCurrent() || bit < 0 || bit >= layers.size())
+        return;
+    
+    const BitStateCommand::BitState before = BitStateCommand::state(layers, bit);
+    BitStateCommand::BitState after = before;
+    after.ignored = !before.ignored;
+    m_undoStack.push(new BitStateCommand(this, bit, before, after, after.ignored ? tr("Ignore bit") : tr("Unignore bit")));
 }
 
 
-void MainWindow::computeBoundsPolyAndHomography()
+int MainWindow::bitAtPoint(const QPointF& position) const
 {
-    clearBoundsGeometry();
-    
-    // Sort the points and create a convex polygon from them
-    m_boundsPoints = sortedRectanglePoints(m_boundsPoints);
-    m_boundsPolygons.push_back(QPolygonF(m_boundsPoints));
-    
-    // Compute a homography mapping the almost-rectangular ROM region to a rectangle
-    std::vector<cv::Point2f> imageSpacePoints;
-    imageSpacePoints.push_back(cv::Point2f(m_boundsPoints[0].x(), m_boundsPoints[0].y()));
-    imageSpacePoints.push_back(cv::Point2f(m_boundsPoints[1].x(), m_boundsPoints[1].y()));
-    imageSpacePoints.push_back(cv::Point2f(m_boundsPoints[2].x(), m_boundsPoints[2].y()));
-    imageSpacePoints.push_back(cv::Point2f(m_boundsPoints[3].x(), m_boundsPoints[3].y()));
-    
-    std::vector<cv::Point2f> romDieSpacePoints;
-    romDieSpacePoints.push_back(cv::Point2f(0.0f, 0.0f));
-    romDieSpacePoints.push_back(cv::Point2f(1.0f, 0.0f));
-    romDieSpacePoints.push_back(cv::Point2f(1.0f, 1.0f));
-    romDieSpacePoints.push_back(cv::Point2f(0.0f, 1.0f));
-    
-    m_romRegionHomography = cv::findHomography(imageSpacePoints, romDieSpacePoints, 0);
+    // Within half a bit pitch of the bit, or a few screen pixels when the bits are tiny on screen
+    const int bit = m_bitGrid.index().nearest(position);
+    if (bit < 0 || bit >= m_bitGrid.locations().size())
+        return -1;
+    
+    const QPointF delta = m_bitGrid.locations()[bit] - position;
+    const qreal tolerance = qMax(m_bitGrid.index().cellSize() * 0.5, m_drawWidget.screenToImage(5.0));
+    if (delta.x() * delta.x() + delta.y() * delta.y() > tolerance * tolerance)
+        return -1;
+    return bit;
 }
 
 
-void MainWindow::recomputeSliceLinesFromHomography()
+void MainWindow::fillSliceRange(const UiMode& hv, const qreal& start, const qreal& end, const int& count)
 {
-    m_sliceLines.clear();
-    m_sliceLineColors.clear();
-    
-    if (m_uiMode == SliceDefineHorizontal || m_uiMode == Navigation || m_uiMode == BoundsDefine)
-    {
-        for (int i = 0; i < m_horizSlices.size(); i++)
-        {
-            // Compute the points for the visible line
-            QLineF pb = slicePositionToLine(m_horizSlices[i], SliceDefineHorizontal);
-            m_sliceLines.push_back(pb);
+    pushSliceFill(hv, SliceList::evenlySpaced(start, end, count), tr("Fill slice range"));
+}
+
+
+void MainWindow::fillSliceRangeByPitch(const UiMode& hv, const qreal& start, const qreal& end, const qreal& pitch)
+{
+    // Round to a whole number of gaps and spread the remainder evenly
+    if (pitch <= 0.0)
+        return;
     
-            if (m_activeSlices.contains(i))
-                m_sliceLineColors.push_back(QColor(255, 255, 0));
-            else
-                m_sliceLineColors.push_back(QColor(0, 0, 255));
-        }
-    }
+    const int gaps = qRound(qAbs(end - start) / pitch);
+    pushSliceFill(hv, SliceList::evenlySpaced(start, end, gaps - 1), tr("Fill slice range"));
+}
 
-    if (m_uiMode == SliceDefineVertical || m_uiMode == Navigation || m_uiMode == BoundsDefine)
-    {
-        for (int i = 0; i < m_vertSlices.size(); i++)
-        {
-            // Compute the points for the visible line
-            QLineF pb = slicePositionToLine(m_vertSlices[i], SliceDefineVertical);
-            m_sliceLines.push_back(pb);
+
+void MainWindow::tileSlicePattern(const UiMode& hv, const qreal& start, const qreal& end, const QVector<qreal>& offsets)
+{
+    pushSliceFill(hv, SliceList::tiledPattern(start, end, offsets), tr("Tile slice pattern"));
+}
+
+
+void MainWindow::deleteSelectedSlices()
+{
+    if (m_activeSlices.isEmpty())
+        return;
     
-            if (m_activeSlices.contains(i))
-                m_sliceLineColors.push_back(QColor(255, 255, 0));
-            else
-                m_sliceLineColors.push_back(QColor(0, 0, 255));
-        }
-    }
+    m_undoStack.push(new DeleteSlicesCommand(this, m_uiMode, activeSliceIds()));
+}
+
+
+SliceOrientation MainWindow::sliceOrientation(const UiMode& hv)
+{
+    return (hv == SliceDefineHorizontal) ? HorizontalSlice : VerticalSlice;
 }
 
 
-void MainWindow::exportBitsToImage(const QString& filename)
+SliceList& MainWindow::slicesForMode(const UiMode& hv)
 {
-    // TODO: These values as parameters
-    const int radius = 6;
-    const int sliceBitWidth = 8;
-    const int sliceBitHeight = 8;
+    return m_die.slices(sliceOrientation(hv));
+}
 
-    const int vertBitCount = m_vertSlices.size() + 2;
-    const int horizBitCount = m_horizSlices.size() + 2;
-    const int numImagesHorizontally = ceilf((float)horizBitCount / (float)sliceBitWidth);
-    const int numImagesVertically = ceilf((float)vertBitCount / (float)sliceBitHeight);
-    const int horizRedBars = (horizBitCount / numImagesHorizontally) + 1;
-    const int vertRedBars = (vertBitCount / numImagesVertically) + 1;
 
-    const int singleDim = radius * 2 + 1;
-    const QSize resultImageSize(singleDim * sliceBitWidth + horizRedBars,
-                                singleDim * sliceBitHeight + vertRedBars);
-    QVector<QImage> resultImages(numImagesHorizontally*numImagesVertically);
-    for (int i = 0; i < resultImages.size(); i++)
+QVector<quint32> MainWindow::activeSliceIds() const
+{
+    QVector<quint32> results;
+    results.reserve(m_activeSlices.size());
+    for (QSet<quint32>::const_iterator it = m_activeSlices.constBegin(); it != m_activeSlices.constEnd(); ++it)
     {
-        resultImages[i] = QImage(resultImageSize, QImage::Format_RGB32);
-        resultImages[i].fill(QColor(255, 0, 0));
+        results.push_back(*it);
     }
+    return results;
+}
+
 
-    // For each marked bit in the original image
-    qDebug() << "Exporting " << numImagesHorizontally << "images by" << numImagesVertically;
-    for (int i = 0; i < m_bitLocations.size(); i++)
+QVector<int> MainWindow::activeSliceIndices()
+{
+    // Ascending indices of the selected slices in the active slice mode
+    const SliceList& slices = slicesForMode(m_uiMode);
+    QVector<int> results;
+    results.reserve(m_activeSlices.size());
+    for (QSet<quint32>::const_iterator it = m_activeSlices.constBegin(); it != m_activeSlices.constEnd(); ++it)
     {
-        // Splat data from the original image to the result image
-        for (int y = 0; y < singleDim; y++)
-        {
-            for (int x = 0; x < singleDim; x++)
-            {
-                // TODO: Bilinear pixel sampling (concatenating bitLocation to an int isn't so cool)
-                const int originalImageX = m_bitLocations[i].x();
-                const int originalImageY = m_bitLocations[i].y();
-                const QColor originalImageColor = m_qImage.pixelColor(originalImageX + x - radius,
-                                                                      originalImageY + y - radius);
-
-                // Compute destination X
-                const int xImageIndex = (i % horizBitCount) / sliceBitWidth;
-                const int xBitIndex = i % sliceBitWidth;
-                const int xRedBarCount = (xBitIndex % sliceBitWidth) + 1;
-                const int xResultOffset = (xBitIndex * singleDim) + xRedBarCount;
-
-                // Compute destination Y
-                const int yImageIndex = (i / horizBitCount) / sliceBitHeight;
-                const int yBitIndex = i / (sliceBitWidth * numImagesHorizontally);
-                const int yRedBarCount = (yBitIndex % sliceBitHeight) + 1;
-                const int yResultOffset = ((yBitIndex % sliceBitHeight) * singleDim) + yRedBarCount;
-
-                // Set
-                const int imageNum = xImageIndex + (yImageIndex * numImagesHorizontally);
-                resultImages[imageNum].setPixelColor(xResultOffset+x, yResultOffset+y, originalImageColor);
-            }
-        }
+        const int index = slices.indexOfId(*it);
+        if (index != -1)
+            results.push_back(index);
     }
+    qSort(results);
+    return results;
+}
+
+
+bool MainWindow::selectedSliceRange(qreal& start, qreal& end)
+{
+    // The outermost selected slices in the active slice mode
+    if (m_uiMode != SliceDefineHorizontal && m_uiMode != SliceDefineVertical)
+        return false;
     
-    // Save the images
-    const int filenameExtensionStart = filename.lastIndexOf(".");
-    for (int i = 0; i < resultImages.size(); i++)
+    const QVector<int> selectedIndices = activeSliceIndices();
+    if (selectedIndices.size() < 2)
     {
-        const int imageX = i % numImagesHorizontally;
-        const int imageY = i / numImagesHorizontally;
-
-        resultImages[i].setText("bitImageWidth", QString::number(singleDim));
-        resultImages[i].setText("bitImageHeight", QString::number(singleDim));
-        resultImages[i].setText("bitImageCountAcross", QString::number(horizBitCount));
-        resultImages[i].setText("bitImageCountDown", QString::number(vertBitCount));
-
-        QString outName = QString("%1_%2_%3%4").arg(filename.left(filenameExtensionStart))
-                                                .arg(imageX, 2, 10, QChar('0'))
-                                                .arg(imageY, 2, 10, QChar('0'))
-                                                .arg(filename.mid(filenameExtensionStart));
-        resultImages[i].save(outName);
+        qWarning() << "Select a start and an end slice first";
+        return false;
     }
+    
+    const SliceList& slices = slicesForMode(m_uiMode);
+    start = slices[selectedIndices.first()];
+    end = slices[selectedIndices.last()];
+    return true;
 }
 
 
-void MainWindow::exportToSlicedImages(const QString& filenamePrefix)
+void MainWindow::pushSliceFill(const UiMode& hv, const QVector<qreal>& positions, const QString& description)
 {
-    // TODO: Dimensions and radius as parameters
-    const int radius = 6;
-    const int sliceBitWidth = 16;
-    const int sliceBitHeight = 32;
+    // One batched insert (and one geometry recompute) for the whole fill
+    if (positions.isEmpty())
+        return;
+    
+    AddSlicesCommand* command = new AddSlicesCommand(this, hv, positions);
+    command->setText(description);
+    m_undoStack.push(command);
+}
 
-    const int vertBitCount = m_vertSlices.size() + 2;
-    const int horizBitCount = m_horizSlices.size() + 2;
-    const int numImagesHorizontally = ceilf((float)horizBitCount / (float)sliceBitWidth);
-    const int numImagesVertically = ceilf((float)vertBitCount / (float)sliceBitHeight);
 
-    qDebug() << "Exporting " << numImagesHorizontally << "images by" << numImagesVertically;
-    for (int y = 0; y < numImagesVertically; y++)
+QVector<int> MainWindow::slicesNearPoint(const QPointF& position, const UiMode& hv)
+{
+    // Slice lines keep their order across the image, so only the two slices bracketing
+    // the click's ROM-die-space position can be the closest ones to it
+    const SliceList& slices = slicesForMode(hv);
+    const int upper = slices.lowerBound(m_geometry.romDieSpaceFromImagePoint(position, sliceOrientation(hv)));
+    
+    QVector<int> results;
+    qreal closestDistance = 0.0;
+    for (int i = upper - 1; i <= upper; i++)
     {
-        for (int x = 0; x < numImagesHorizontally; x++)
-        {
-            const int rowIndex = y * sliceBitHeight;
-            const int colIndex = x * sliceBitWidth;
-            const int bitIndex = (rowIndex * horizBitCount) + colIndex;
-
-            const int lowerX = m_bitLocations[bitIndex].x() - radius;
-            const int upperX = m_bitLocations[bitIndex+sliceBitWidth-1].x() + radius;
-            const int lowerY = m_bitLocations[bitIndex].y() - radius;
-            const int upperY = m_bitLocations[bitIndex+((sliceBitHeight-1)*horizBitCount)].y() + radius;
-            const QRect foo(lowerX, lowerY, upperX-lowerX, upperY-lowerY);
-            const QImage subImage = m_qImage.copy(foo);
-
-            const QString fn = QString("/tmp/foo_%1_%2.png").arg(x, 2, 10, QChar('0')).arg(y, 2, 10, QChar('0'));
-            subImage.save(fn);
-        }
+        if (i < 0 || i >= slices.size())
+            continue;
+        
+        // Within a few screen pixels, whatever the zoom
+        const qreal distance = DieGeometry::linePointDistance(m_geometry.slicePositionToLine(slices[i], sliceOrientation(hv)), position);
+        if (distance >= m_drawWidget.screenToImage(5.0))
+            continue;
+        
+        // Closest first
+        if (!results.isEmpty() && distance < closestDistance)
+            results.push_front(i);
+        else
+            results.push_back(i);
+        if (results.first() == i)
+            closestDistance = distance;
     }
+    return results;
 }
 
 
-QVector<QPointF> MainWindow::computeBitLocations()
+void MainWindow::boundsPointsChanged()
 {
-    // Sort the vectors
-    qSort(m_horizSlices);
-    qSort(m_vertSlices);
+    // Only a full set of bounds points has a homography
+    if (m_die.boundsPoints().size() == 4)
+        computeBoundsPolyAndHomography();
+    else
+        clearBoundsGeometry();
     
-    // Returns a list of image-space points representing where the bits are
-    // These are created in standard image scanline-order (top=[0,0], left->right)
-    QVector<QPointF> results;
+    gridChanged();
+    recomputeSliceLinesFromHomography();
+    m_drawWidget.update();
+}
 
-    // Top line of bits
-    results.push_back(m_boundsPoints[0]);
-    for (int x = 0; x < m_horizSlices.size(); x++)
-    {
-        const QLineF hLine = slicePositionToLine(m_horizSlices[x], SliceDefineHorizontal);
-        results.push_back(hLine.p1());
-    }
-    results.push_back(m_boundsPoints[1]);
 
-    // The bulk of the bits
-    for (int y = 0; y < m_vertSlices.size(); y++)
-    {
-        const QLineF vLine = slicePositionToLine(m_vertSlices[y], SliceDefineVertical);
-        for (int x = -1; x <= m_horizSlices.size(); x++)
-        {
-            const QLineF hLine = slicePositionToLine(m_horizSlices[x], SliceDefineHorizontal);
-            
-            QPointF pusher;
-            if (x == -1)
-            {
-                pusher = vLine.p1();
-            }
-            else if (x == m_horizSlices.size())
-            {
-                pusher = vLine.p2();
-            }
-            else
-            {
-                hLine.intersect(vLine, &pusher);
-            }
-            
-            results.push_back(pusher);
-        }
-    }
-    
-    // Bottom line of bits
-    results.push_back(m_boundsPoints[3]);
-    for (int x = 0; x < m_horizSlices.size(); x++)
-    {
-        const QLineF hLine = slicePositionToLine(m_horizSlices[x], SliceDefineHorizontal);
-        results.push_back(hLine.p2());
-    }
-    results.push_back(m_boundsPoints[2]);
-    
-    // Build the bit location acceleration tree
-    // TODO: Move elsewhere
-    cv::Mat matTrainFeatures(results.size(), 2, CV_32F);
-    cv::Mat matTrainLabels(results.size(), 1, CV_32F);
-    for (int i = 0; i < results.size(); i++)
+void MainWindow::slicesChanged()
+{
+    gridChanged();
+    recomputeSliceLinesFromHomography();
+    m_drawWidget.update();
+}
+
+
+void MainWindow::bitLayersChanged()
+{
+    m_drawWidget.update();
+    if (!m_bitInspectorUpdatePending)
     {
-        matTrainFeatures.at<float>(i, 0) = results[i].x();
-        matTrainFeatures.at<float>(i, 1) = results[i].y();
-        matTrainLabels.at<float>(i, 0) = i;
+        m_bitInspectorUpdatePending = true;
+        QTimer::singleShot(0, this, &MainWindow::updateBitInspector);
     }
-    cv::Ptr<cv::ml::TrainData> trainingData = cv::ml::TrainData::create(matTrainFeatures,
-                                                                        cv::ml::SampleTypes::ROW_SAMPLE,
-                                                                        matTrainLabels);
-    m_bitLocationTree->train(trainingData);
-
-    return results;
 }
 
 
-qreal MainWindow::romDieSpaceFromImagePoint(const QPointF& iPoint, const UiMode& hv)
+void MainWindow::fitBitLayersToSlices()
 {
-    cv::Mat pointMat = cv::Mat(3, 1, CV_64F);
-    pointMat.at<double>(0, 0) = iPoint.x();
-    pointMat.at<double>(1, 0) = iPoint.y();
-    pointMat.at<double>(2, 0) = 1.0;
+    // Layers only mean anything for the bit grid they were made on
+    BitLayers& layers = m_die.bitLayers();
+    if (layers.bitCount() == m_die.bitCount())
+        return;
     
-    // Compute image point to ROM die space
-    const cv::Mat originPointCv = m_romRegionHomography * pointMat;
-    const cv::Mat originPointNormalizedCv = originPointCv / originPointCv.at<double>(0,2);
-    const QPointF romDiePoint(originPointNormalizedCv.at<double>(0,0), originPointNormalizedCv.at<double>(0,1));
-    const qreal pushPoint = (hv == SliceDefineHorizontal) ? romDiePoint.x() : romDiePoint.y();
-    return pushPoint;
+    if (!layers.isEmpty())
+        qWarning() << "The slices changed, so the bit layers no longer fit.  Starting them over";
+    layers.resize(m_die.bitCount());
 }
 
 
-QLineF MainWindow::slicePositionToLine(const qreal& slicePosition, const UiMode& hv)
+void MainWindow::clearBoundsGeometry()
 {
-    // Get the image space position of one extreme of the slice
-    const cv::Mat homographyInverse = m_romRegionHomography.inv();
-    cv::Mat topPointMat = cv::Mat(3, 1, CV_64F);
-    topPointMat.at<double>(0, 0) = (hv == SliceDefineHorizontal) ? slicePosition : 0.0;
-    topPointMat.at<double>(1, 0) = (hv == SliceDefineVertical) ? slicePosition : 0.0;
-    topPointMat.at<double>(2, 0) = 1.0;
-    const cv::Mat topPointCv = homographyInverse * topPointMat;
-    const cv::Mat topPointNormalizedCv = topPointCv / topPointCv.at<double>(0,2);
-    
-    // Get the image space position of the other extreme of the slice
-    cv::Mat bottomPointMat = cv::Mat(3, 1, CV_64F);
-    bottomPointMat.at<double>(0, 0) = (hv == SliceDefineHorizontal) ? slicePosition : 1.0;
-    bottomPointMat.at<double>(1, 0) = (hv == SliceDefineVertical) ? slicePosition : 1.0;
-    bottomPointMat.at<double>(2, 0) = 1.0;
-    const cv::Mat bottomPointCv = homographyInverse * bottomPointMat;
-    const cv::Mat bottomPointNormalizedCv = bottomPointCv / bottomPointCv.at<double>(0,2);
+    m_boundsPolygons.clear();
+    m_geometry = DieGeometry();
+}
+
+
+void MainWindow::computeBoundsPolyAndHomography()
+{
+    clearBoundsGeometry();
     
-    // Construct and return a QLineF from the results
-    QLineF pb(QPointF(topPointNormalizedCv.at<double>(0,0), topPointNormalizedCv.at<double>(0,1)),
-              QPointF(bottomPointNormalizedCv.at<double>(0,0), bottomPointNormalizedCv.at<double>(0,1)));
+    // Sort the points and create a convex polygon and the ROM die homography from them
+    m_geometry = DieGeometry(m_die.boundsPoints());
+    if (!m_geometry.isValid())
+        return;
     
-    return pb;
+    m_die.boundsPoints() = m_geometry.boundsPoints();
+    m_boundsPolygons.push_back(m_geometry.boundsPolygon());
 }
 
 
-QVector<QPointF> MainWindow::sortedRectanglePoints(const QVector<QPointF>& inPoints)
+void MainWindow::recomputeSliceLinesFromHomography()
 {
-    // Get the points' centroid
-    QVector2D centroid;
-    for (int i = 0; i < inPoints.size(); i++)
-    {
-        centroid += QVector2D(inPoints[i]);
-    }
-    centroid /= inPoints.size();
+    m_sliceLines.clear();
+    m_sliceLineColors.clear();
+    updateBitPreview();
     
-    // Now organize each point by their angles compared to this centroid
-    QVector<QPointF> results(4);
-    for (int i = 0; i < inPoints.size(); i++)
+    if (!m_geometry.isValid())
+        return;
+    
+    if (m_uiMode == SliceDefineHorizontal || m_uiMode == Navigation || m_uiMode == BoundsDefine)
     {
-        const qreal pi2 = M_PI / 2.0;
-        const QVector2D normalizedPoint = (QVector2D(inPoints[i]) - centroid).normalized();
-        const qreal angle = atan2(normalizedPoint.y(), normalizedPoint.x());
-        if (angle < 0.0f)
+        for (int i = 0; i < m_die.horizontalSlices().size(); i++)
         {
-            if (angle < -pi2) 
-                results[0] = inPoints[i];
-            else 
-                results[1] = inPoints[i];
+            // Compute the points for the visible line
+            QLineF pb = m_geometry.slicePositionToLine(m_die.horizontalSlices()[i], HorizontalSlice);
+            m_sliceLines.push_back(pb);
+    
+            if (m_uiMode == SliceDefineHorizontal && m_activeSlices.contains(m_die.horizontalSlices().id(i)))
+                m_sliceLineColors.push_back(QColor(255, 255, 0));
+            else
+                m_sliceLineColors.push_back(QColor(0, 0, 255));
         }
-        else
+    }
+
+    if (m_uiMode == SliceDefineVertical || m_uiMode == Navigation || m_uiMode == BoundsDefine)
+    {
+        for (int i = 0; i < m_die.verticalSlices().size(); i++)
         {
-            if (angle < pi2) 
-                results[2] = inPoints[i];
-            else 
-                results[3] = inPoints[i];
+            // Compute the points for the visible line
+            QLineF pb = m_geometry.slicePositionToLine(m_die.verticalSlices()[i], VerticalSlice);
+            m_sliceLines.push_back(pb);
+    
+            if (m_uiMode == SliceDefineVertical && m_activeSlices.contains(m_die.verticalSlices().id(i)))
+                m_sliceLineColors.push_back(QColor(255, 255, 0));
+            else
+                m_sliceLineColors.push_back(QColor(0, 0, 255));
         }
     }
-    
-    return results;
 }
 
 
-qreal MainWindow::linePointDistance(const QLineF& line, const QPointF& point)
+void MainWindow::rebuildWorkingImage()
 {
-    const qreal A = point.x() - line.p1().x();
-    const qreal B = point.y() - line.p1().y();
-    const qreal C = line.p2().x() - line.p1().x();
-    const qreal D = line.p2().y() - line.p1().y();
-    
-    const qreal dot = A * C + B * D;
-    const qreal len_sq = C * C + D * D;
-    const qreal param = dot / len_sq;
+    m_workImage = QImage();
+    m_sampler = ImageSampler(m_qImage);
+    if (m_qImage.isNull() || m_workingImageDepth == WorkingColor)
+        return;
     
-    QPointF result;
-    if(param < 0)
+    const QImage::Format format = (m_workingImageDepth == WorkingGray16) ? QImage::Format_Grayscale16 : QImage::Format_Grayscale8;
+    m_workImage = ImageSampler::luminanceImage(m_qImage, format);
+    if (m_workImage.isNull())
     {
-        result = line.p1();
+        qWarning() << "Unable to allocate the grayscale working image.  Sampling from the color image";
+        m_sampler = ImageSampler(m_qImage);
+        return;
     }
-    else if(param > 1)
+    
+    // Without the color image around the display shares the working image's pixels
+    if (!m_keepColorImage)
     {
-        result = line.p2();
+        m_qImage = m_workImage;
+        m_imageReductions.clear();
     }
-    else
+    m_sampler = ImageSampler(m_workImage);
+}
+
+
+void MainWindow::updateBitPreview()
+{
+    // The slice modes show where the bits would land, but only the ones on screen -
+    // so dragging slices costs what's visible rather than the whole ROM
+    m_bitPreview.clear();
+    if ((m_uiMode == SliceDefineHorizontal || m_uiMode == SliceDefineVertical) && m_geometry.isValid())
     {
-        result.setX(line.p1().x() + param * C);
-        result.setY(line.p1().y() + param * D);
+        m_bitPreview = m_geometry.bitLocationsInRect(m_die.horizontalSlices(), m_die.verticalSlices(),
+                                                     m_drawWidget.visibleImageRect(), MaxBitPreviewPoints);
     }
-     
-    const qreal dist = (point - result).manhattanLength();
-    return dist;
-}
-
-
-QColor MainWindow::qImageBilinear(const QImage& image, const QPointF& pixelCoord)
-{
-    // Some constants
-    const int w = image.width();
-    const int h = image.height();
-    const qreal x = pixelCoord.x();
-    const qreal y = pixelCoord.y();
-
-    // Get the top and bottom coordinates
-    const int x1 = static_cast<int>(floor(x));
-    const int y1 = static_cast<int>(floor(y));
-    const int x2 = x1 + 1;
-    const int y2 = y1 + 1;
-
-    // Boundary conditions
-    if (x2 >= w || y2 >= h) return image.pixel(x1, y1);
-    if (x1 < 0  || y1 < 0)  return QColor(0, 0, 0);
-    
-    // Pixel samples
-    const QColor ltop = image.pixel(x1, y1);
-    const QColor rtop = image.pixel(x1, y2);
-    const QColor lbot = image.pixel(x2, y1);
-    const QColor rbot = image.pixel(x2, y2);
-
-    // Blerp for great success
-    QColor result;
-    result.setRed  (((x2 - x) * (y2 - y) * ltop.redF()   + (x2 - x) * (y - y1) * rtop.redF() + 
-                     (x - x1) * (y2 - y) * lbot.redF()   + (x - x1) * (y - y1) * rbot.redF()) * 255.0);
-    result.setGreen(((x2 - x) * (y2 - y) * ltop.greenF() + (x2 - x) * (y - y1) * rtop.greenF() + 
-                     (x - x1) * (y2 - y) * lbot.greenF() + (x - x1) * (y - y1) * rbot.greenF()) * 255.0);
-    result.setBlue (((x2 - x) * (y2 - y) * ltop.blueF()  + (x2 - x) * (y - y1) * rtop.blueF() + 
-                     (x - x1) * (y2 - y) * lbot.blueF()  + (x - x1) * (y - y1) * rbot.blueF()) * 255.0);
-    return result;
+    m_drawWidget.update();
 }
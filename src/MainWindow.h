@@ -2,23 +2,52 @@
 #define DIETOY_MAIN_WINDOW_H
 
 #include "DrawWidget.h"
+#include "BitInspector.h"
+#include "core/DieGeometry.h"
+#include "core/ImageSampler.h"
+#include "core/DieDescription.h"
+#include "core/BitPatchStream.h"
+#include "core/BitReviewQueue.h"
+#include "core/BitGrid.h"
+#include "core/TileMosaic.h"
+#include "core/DecodedImageCache.h"
 
+#include <QSet>
+#include <QHash>
 #include <QVector>
+#include <QUndoStack>
+#include <QDockWidget>
 #include <QMainWindow>
-#include <opencv2/opencv.hpp>
 
 
 class MainWindow : public QMainWindow
 {
     Q_OBJECT
     
+    friend class BoundsPointsCommand;
+    friend class AddSlicesCommand;
+    friend class DeleteSlicesCommand;
+    friend class MoveSlicesCommand;
+    friend class BitStateCommand;
+    friend class BitStatesCommand;
+    friend class BitLayersCommand;
+    
 public:
     explicit MainWindow(QWidget *parent = Q_NULLPTR, Qt::WindowFlags flags = Qt::WindowFlags());
     ~MainWindow();
 
+    enum WorkingImageDepth { WorkingColor,
+                             WorkingGray8,
+                             WorkingGray16 };
+
+    void setWorkingImageDepth(const WorkingImageDepth& depth, const bool keepColorImage);
+
     bool loadImage(const QString& filename);
+    bool loadMosaic(const QString& filename);
+    void setImageCacheEnabled(const bool enabled);
     bool saveDescriptionJson(const QString& filename);
     bool loadDescriptionJson(const QString& filename);
+    bool transferDescriptionJson(const QString& filename, const QString& sourceImageFilename);
 
     void addOrMoveBoundsPoint(const QPointF& position);
     void dragBoundsPoint(const QPointF& position);
@@ -29,84 +58,184 @@ public:
     void selectMoreSlices(const QPointF& position);
     void dragSlices(const QPointF& position);
     void stopDraggingSlices(const QPointF& position);
+
+    void toggleBitValue(const QPointF& position);
+    void toggleBitIgnored(const QPointF& position);
     
     enum UiMode { Navigation, 
                   BoundsDefine, 
                   SliceDefineHorizontal, 
                   SliceDefineVertical,
-                  BitRegionDisplay };
+                  BitRegionDisplay,
+                  BitReview };
     Q_ENUM(UiMode)
     
+    void fillSliceRange(const UiMode& hv, const qreal& start, const qreal& end, const int& count);
+    void fillSliceRangeByPitch(const UiMode& hv, const qreal& start, const qreal& end, const qreal& pitch);
+    void tileSlicePattern(const UiMode& hv, const qreal& start, const qreal& end, const QVector<qreal>& offsets);
+    
 private slots:
     void openImage();
+    void openMosaic();
     void openDieDescription();
     void saveDieDescription();
+    void transferDieDescription();
     void exportBitImage();
     void exportSlicedImage();
+    void exportRom();
     
     void copySlices();
     void pasteSlices();
     void deselectSlices();
     void deleteSlices();
+    void fillSelectedSliceRange();
+    void fillSelectedSliceRangeByPitch();
+    void tileCopiedSlicesAcrossSelection();
     void testOperation();
+    void classifyBits();
+    void addTemplateExemplar();
+    void detectBitsByTemplate();
+    void selectRegion(const QPolygonF& region);
+    void setSelectedBitsOne();
+    void setSelectedBitsZero();
+    void ignoreSelectedBits();
+    
+    void acceptReviewedBit();
+    void flipReviewedBit();
+    void nextReviewedBit();
+    void previousReviewedBit();
+    void prefetchReviewPatches();
     
     void setModeNavigation();
     void setModeBoundsDefine();
     void setModeSliceDefineHorizontal();
     void setModeSliceDefineVertical();
     void setModeBitRegionDisplay();
+    void setModeBitReview();
+    
+    void inspectBitAt(const QPointF& position);
+    void updateBitInspector();
+    void bitGridWorkerFinished();
     
 private:
+    class BitGridWorker;
+    
+    // A magnified patch of the die image with the bits in it, ready for the inspector
+    struct InspectorPatch
+    {
+        QImage image;
+        QVector<QPointF> bitCenters;
+        int highlightedBit;
+    };
+    
     void createMenu();
     
+    bool showingBits() const { return m_uiMode == BitRegionDisplay || m_uiMode == BitReview; }
+    void showBitLocations();
+    void refreshBitGrid(const bool& wait = false);
+    void adoptBitGridWorker();
+    bool bitGridCurrent() const { return m_bitGridGeneration == m_gridGeneration; }
+    void gridChanged();
+    bool scoreBits(BitClassifierSink& sink);
+    void applyClassification(const BitClassifierSink& sink);
+    InspectorPatch renderInspectorPatch(const int& bit) const;
+    QString bitCaption(const int& bit) const;
+    void showReviewedBit();
+    void decideReviewedBit(const bool& flip);
+    void setSelectedBits(const bool& value);
+    int bitAtPoint(const QPointF& position) const;
+    
+    bool hasImage() const { return !m_sampler.isNull() || !m_mosaic.isEmpty(); }
+    void imageReplaced();
+    void descriptionReplaced();
     void clearBoundsGeometry();
     void computeBoundsPolyAndHomography();
 
     void deleteSelectedSlices();
     void recomputeSliceLinesFromHomography();
-    
-    void exportBitsToImage(const QString& filename);
-    void exportToSlicedImages(const QString& filenamePrefix);
-
-    QVector<QPointF> computeBitLocations();
-    
-    qreal romDieSpaceFromImagePoint(const QPointF& iPoint, const UiMode& hv);
-    QLineF slicePositionToLine(const qreal& slicePosition, const UiMode& hv);
-    QVector<QPointF> sortedRectanglePoints(const QVector<QPointF>& inPoints);
-    qreal linePointDistance(const QLineF& line, const QPointF& point);
-    QColor qImageBilinear(const QImage& image, const QPointF& pixelCoord);
+    void updateBitPreview();
+    
+    static SliceOrientation sliceOrientation(const UiMode& hv);
+    SliceList& slicesForMode(const UiMode& hv);
+    QVector<quint32> activeSliceIds() const;
+    QVector<int> activeSliceIndices();
+    QVector<int> slicesNearPoint(const QPointF& position, const UiMode& hv);
+    bool selectedSliceRange(qreal& start, qreal& end);
+    void pushSliceFill(const UiMode& hv, const QVector<qreal>& positions, const QString& description);
+    void boundsPointsChanged();
+    void slicesChanged();
+    void bitLayersChanged();
+    void fitBitLayersToSlices();
+    
+    void rebuildWorkingImage();
     
 private:
     UiMode m_uiMode;
     DrawWidget m_drawWidget;
     
-    // The full die image displayed
+    // The full die image displayed, and its halvings for drawing it zoomed out
+    // (empty when they'd no longer match it)
     QImage m_qImage;
+    QVector<QImage> m_imageReductions;
+    DecodedImageCache m_imageCache;
     QString m_dieDescriptionFilename;
     
-    // ROM die region markers, the geometry that they create
+    // Single-channel luminance copy of the die image used for sampling and export
+    // (null when working in color)
+    QImage m_workImage;
+    WorkingImageDepth m_workingImageDepth;
+    bool m_keepColorImage;
+    ImageSampler m_sampler;
+    
+    // A tiled die image read on demand, used in place of the image when it isn't empty
+    TileMosaic m_mosaic;
+    
+    // ROM die region markers and slice offsets
+    DieDescription m_die;
+    
+    // The geometry that they create
     int m_activeBoundsPoint;
-    QVector<QPointF> m_boundsPoints;
     QVector<QPolygonF> m_boundsPolygons;
-    cv::Mat m_romRegionHomography;
-    
-    // Slice offsets in the ROM die
-    QVector<qreal> m_horizSlices;
-    QVector<qreal> m_vertSlices;
+    DieGeometry m_geometry;
 
-    // Selection mask for the active slice mode
-    QVector<int> m_activeSlices;
+    // Ids of the selected slices in the active slice mode
+    QSet<quint32> m_activeSlices;
     bool m_sliceDragging;
     QPointF m_sliceDragOrigin;
     
-    // The locations of every bit in the image
-    QVector<QPointF> m_bitLocations;
-    cv::Ptr<cv::ml::KNearest> m_bitLocationTree;
+    // The locations of every bit in the image.  Bounds and slice edits bump the
+    // grid generation, and the bit grid is brought up to it only when it's shown -
+    // big recomputations in the background, with the old grid up until they land
+    BitGrid m_bitGrid;
+    quint64 m_gridGeneration;
+    quint64 m_bitGridGeneration;
+    BitGridWorker* m_bitGridWorker;
+    
+    // Bits picked with a rubber band or lasso, sorted
+    QVector<int> m_selectedBits;
+    
+    // Magnified view of the bit under the mouse
+    QDockWidget* m_bitInspectorDock;
+    BitInspector* m_bitInspector;
+    int m_inspectedBit;
+    bool m_bitInspectorUpdatePending;
+    
+    // Hand-picked example bits for template detection
+    QVector<QPointF> m_templateExemplars;
+    
+    // Bits queued for a second look, and the inspector patches rendered ahead of the cursor
+    BitReviewQueue m_reviewQueue;
+    QHash<int, InspectorPatch> m_reviewPatches;
     
     // Generated data used solely for display
     QVector<QLineF> m_sliceLines;
     QVector<QColor> m_sliceLineColors;
+    QVector<QPointF> m_bitPreview;
 
+    // Edit history, and a counter identifying the current mouse drag (so its moves merge)
+    QUndoStack m_undoStack;
+    int m_dragSerial;
+    
     // A copy buffer for ctrl+C | ctrl+V
     QVector<qreal> m_copiedSliceOffsets;
     
@@ -117,6 +246,8 @@ private:
     
     QMetaObject::Connection m_rmbClickedConnection;
     QMetaObject::Connection m_rmbDraggedConnection;
+    
+    QMetaObject::Connection m_mouseMovedConnection;
 };
 
 #endif // DIETOY_MAIN_WINDOW_H
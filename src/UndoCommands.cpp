@@ -0,0 +1,409 @@
+#include "UndoCommands.h"
+
+#include <algorithm>
+
+
+// The bit layers are only remapped when they fit the grid being edited - otherwise
+// they get started over the next time the bits are shown
+static bool bitLayersFitGrid(const DieDescription& die)
+{
+    return !die.bitLayers().isEmpty() && die.bitLayers().bitCount() == die.bitCount();
+}
+
+
+// The bit grid lines on the given slices, ascending - columns for horizontal
+// slices and rows for vertical ones, one past the slice index for the bounds edge
+static QVector<int> bitLinesOfSlices(const SliceList& slices, const QVector<quint32>& ids)
+{
+    QVector<int> lines;
+    lines.reserve(ids.size());
+    for (int i = 0; i < ids.size(); i++)
+    {
+        if (slices.containsId(ids[i]))
+            lines.push_back(slices.indexOfId(ids[i]) + 1);
+    }
+    std::sort(lines.begin(), lines.end());
+    return lines;
+}
+
+
+/// ROM bounds points /////////////////////////////////////////////////////////
+
+BoundsPointsCommand::BoundsPointsCommand(MainWindow* window,
+                                         const QVector<QPointF>& before,
+                                         const QVector<QPointF>& after,
+                                         const int& dragSerial,
+                                         QUndoCommand* parent)
+    : QUndoCommand(parent)
+    , m_window(window)
+    , m_before(before)
+    , m_after(after)
+    , m_dragSerial(dragSerial)
+{
+    if (dragSerial < 0)
+        setText(QObject::tr("Add bounds point"));
+    else
+        setText(QObject::tr("Move bounds point"));
+}
+
+
+void BoundsPointsCommand::undo()
+{
+    m_window->m_die.boundsPoints() = m_before;
+    m_window->boundsPointsChanged();
+}
+
+
+void BoundsPointsCommand::redo()
+{
+    m_window->m_die.boundsPoints() = m_after;
+    m_window->boundsPointsChanged();
+}
+
+
+bool BoundsPointsCommand::mergeWith(const QUndoCommand* other)
+{
+    const BoundsPointsCommand* otherCommand = static_cast<const BoundsPointsCommand*>(other);
+    if (m_dragSerial < 0 || otherCommand->m_dragSerial != m_dragSerial)
+        return false;
+    
+    m_after = otherCommand->m_after;
+    return true;
+}
+
+
+/// Slice additions ///////////////////////////////////////////////////////////
+
+AddSlicesCommand::AddSlicesCommand(MainWindow* window,
+                                   const MainWindow::UiMode& hv,
+                                   const QVector<qreal>& positions,
+                                   QUndoCommand* parent)
+    : QUndoCommand(parent)
+    , m_window(window)
+    , m_hv(hv)
+    , m_positions(positions)
+    , m_ids()
+    , m_lineLayers()
+{
+    setText(QObject::tr("Add %n slice(s)", "", positions.size()));
+}
+
+
+void AddSlicesCommand::undo()
+{
+    SliceList& slices = m_window->slicesForMode(m_hv);
+    const bool columns = (MainWindow::sliceOrientation(m_hv) == HorizontalSlice);
+    if (bitLayersFitGrid(m_window->m_die))
+    {
+        m_lineLayers = m_window->m_die.bitLayers().takeLines(columns, bitLinesOfSlices(slices, m_ids));
+        m_window->bitLayersChanged();
+    }
+    
+    slices.remove(m_ids);
+    for (int i = 0; i < m_ids.size(); i++)
+    {
+        m_window->m_activeSlices.remove(m_ids[i]);
+    }
+    m_window->slicesChanged();
+}
+
+
+void AddSlicesCommand::redo()
+{
+    SliceList& slices = m_window->slicesForMode(m_hv);
+    const bool fitted = bitLayersFitGrid(m_window->m_die);
+    if (m_ids.isEmpty())
+        m_ids = slices.insert(m_positions);
+    else
+        slices.insert(m_positions, m_ids);
+    
+    if (fitted)
+    {
+        const bool columns = (MainWindow::sliceOrientation(m_hv) == HorizontalSlice);
+        m_window->m_die.bitLayers().insertLines(columns, bitLinesOfSlices(slices, m_ids), m_lineLayers);
+        m_window->bitLayersChanged();
+    }
+    m_window->slicesChanged();
+}
+
+
+/// Slice deletions ///////////////////////////////////////////////////////////
+
+DeleteSlicesCommand::DeleteSlicesCommand(MainWindow* window,
+                                         const MainWindow::UiMode& hv,
+                                         const QVector<quint32>& ids,
+                                         QUndoCommand* parent)
+    : QUndoCommand(parent)
+    , m_window(window)
+    , m_hv(hv)
+    , m_ids(ids)
+    , m_positions()
+    , m_lineLayers()
+{
+    const SliceList& slices = m_window->slicesForMode(m_hv);
+    m_positions.reserve(m_ids.size());
+    for (int i = 0; i < m_ids.size(); i++)
+    {
+        m_positions.push_back(slices.positionOfId(m_ids[i]));
+    }
+    setText(QObject::tr("Delete %n slice(s)", "", m_ids.size()));
+}
+
+
+void DeleteSlicesCommand::undo()
+{
+    // Put everyone back, bits and all, and leave them selected
+    SliceList& slices = m_window->slicesForMode(m_hv);
+    const bool fitted = bitLayersFitGrid(m_window->m_die);
+    slices.insert(m_positions, m_ids);
+    if (fitted)
+    {
+        const bool columns = (MainWindow::sliceOrientation(m_hv) == HorizontalSlice);
+        m_window->m_die.bitLayers().insertLines(columns, bitLinesOfSlices(slices, m_ids), m_lineLayers);
+        m_window->bitLayersChanged();
+    }
+    
+    m_window->m_activeSlices.clear();
+    if (m_window->m_uiMode == m_hv)
+    {
+        for (int i = 0; i < m_ids.size(); i++)
+        {
+            m_window->m_activeSlices.insert(m_ids[i]);
+        }
+    }
+    m_window->slicesChanged();
+}
+
+
+void DeleteSlicesCommand::redo()
+{
+    SliceList& slices = m_window->slicesForMode(m_hv);
+    const bool columns = (MainWindow::sliceOrientation(m_hv) == HorizontalSlice);
+    m_lineLayers = BitLayers();
+    if (bitLayersFitGrid(m_window->m_die))
+    {
+        m_lineLayers = m_window->m_die.bitLayers().takeLines(columns, bitLinesOfSlices(slices, m_ids));
+        m_window->bitLayersChanged();
+    }
+    
+    slices.remove(m_ids);
+    for (int i = 0; i < m_ids.size(); i++)
+    {
+        m_window->m_activeSlices.remove(m_ids[i]);
+    }
+    m_window->slicesChanged();
+}
+
+
+/// Slice moves ///////////////////////////////////////////////////////////////
+
+MoveSlicesCommand::MoveSlicesCommand(MainWindow* window,
+                                     const MainWindow::UiMode& hv,
+                                     const QVector<quint32>& ids,
+                                     const qreal& delta,
+                                     const int& dragSerial,
+                                     QUndoCommand* parent)
+    : QUndoCommand(parent)
+    , m_window(window)
+    , m_hv(hv)
+    , m_ids(ids)
+    , m_before()
+    , m_after()
+    , m_dragSerial(dragSerial)
+{
+    const SliceList& slices = m_window->slicesForMode(m_hv);
+    m_before.reserve(m_ids.size());
+    m_after.reserve(m_ids.size());
+    for (int i = 0; i < m_ids.size(); i++)
+    {
+        m_before.push_back(slices.positionOfId(m_ids[i]));
+        m_after.push_back(m_before[i] + delta);
+    }
+    setText(QObject::tr("Move %n slice(s)", "", ids.size()));
+}
+
+
+void MoveSlicesCommand::undo()
+{
+    moveSlices(m_before);
+}
+
+
+void MoveSlicesCommand::redo()
+{
+    moveSlices(m_after);
+}
+
+
+bool MoveSlicesCommand::mergeWith(const QUndoCommand* other)
+{
+    const MoveSlicesCommand* otherCommand = static_cast<const MoveSlicesCommand*>(other);
+    if (m_dragSerial < 0 || otherCommand->m_dragSerial != m_dragSerial || otherCommand->m_ids != m_ids)
+        return false;
+    
+    m_after = otherCommand->m_after;
+    return true;
+}
+
+
+void MoveSlicesCommand::moveSlices(const QVector<qreal>& positions)
+{
+    SliceList& slices = m_window->slicesForMode(m_hv);
+    const bool fitted = bitLayersFitGrid(m_window->m_die);
+    const QVector<int> linesBefore = bitLinesOfSlices(slices, m_ids);
+    slices.move(m_ids, positions);
+    
+    // Slices carried past a neighbor change places in the grid, so their bits' lines
+    // move with them.  They all move together and keep their order among themselves.
+    const QVector<int> linesAfter = bitLinesOfSlices(slices, m_ids);
+    if (fitted && linesAfter != linesBefore)
+    {
+        const bool columns = (MainWindow::sliceOrientation(m_hv) == HorizontalSlice);
+        BitLayers& layers = m_window->m_die.bitLayers();
+        layers.insertLines(columns, linesAfter, layers.takeLines(columns, linesBefore));
+        m_window->bitLayersChanged();
+    }
+    m_window->slicesChanged();
+}
+
+
+/// Bit layer edits ///////////////////////////////////////////////////////////
+
+BitStateCommand::BitStateCommand(MainWindow* window,
+                                 const int& bit,
+                                 const BitState& before,
+                                 const BitState& after,
+                                 const QString& text,
+                                 QUndoCommand* parent)
+    : QUndoCommand(parent)
+    , m_window(window)
+    , m_bit(bit)
+    , m_before(before)
+    , m_after(after)
+{
+    setText(text);
+}
+
+
+BitStateCommand::BitState BitStateCommand::state(const BitLayers& layers, const int& bit)
+{
+    BitState result;
+    result.value = layers.value(bit);
+    result.overridden = layers.isOverridden(bit);
+    result.ignored = layers.isIgnored(bit);
+    return result;
+}
+
+
+void BitStateCommand::undo()
+{
+    apply(m_before);
+}
+
+
+void BitStateCommand::redo()
+{
+    apply(m_after);
+}
+
+
+void BitStateCommand::apply(const BitState& state)
+{
+    BitLayers& layers = m_window->m_die.bitLayers();
+    if (m_bit >= layers.size())
+        return;
+    
+    layers.setValue(m_bit, state.value);
+    layers.setOverridden(m_bit, state.overridden);
+    layers.setIgnored(m_bit, state.ignored);
+    m_window->bitLayersChanged();
+}
+
+
+BitStatesCommand::BitStatesCommand(MainWindow* window,
+                                   const QVector<int>& bits,
+                                   const int& fields,
+                                   const BitStateCommand::BitState& after,
+                                   const QString& text,
+                                   QUndoCommand* parent)
+    : QUndoCommand(parent)
+    , m_window(window)
+    , m_bits(bits)
+    , m_fields(fields)
+    , m_after(after)
+    , m_before(bits.size(), 0)
+{
+    // Every flag of every bit, packed a byte each
+    const BitLayers& layers = m_window->m_die.bitLayers();
+    for (int i = 0; i < m_bits.size(); i++)
+    {
+        if (m_bits[i] >= layers.size())
+            continue;
+        m_before[i] = (layers.value(m_bits[i]) ? ValueField : 0) |
+                      (layers.isOverridden(m_bits[i]) ? OverriddenField : 0) |
+                      (layers.isIgnored(m_bits[i]) ? IgnoredField : 0);
+    }
+    setText(text);
+}
+
+
+void BitStatesCommand::undo()
+{
+    BitLayers& layers = m_window->m_die.bitLayers();
+    for (int i = 0; i < m_bits.size(); i++)
+    {
+        if (m_bits[i] >= layers.size())
+            continue;
+        const int before = m_before[i];
+        layers.setValue(m_bits[i], before & ValueField);
+        layers.setOverridden(m_bits[i], before & OverriddenField);
+        layers.setIgnored(m_bits[i], before & IgnoredField);
+    }
+    m_window->bitLayersChanged();
+}
+
+
+void BitStatesCommand::redo()
+{
+    BitLayers& layers = m_window->m_die.bitLayers();
+    for (int i = 0; i < m_bits.size(); i++)
+    {
+        if (m_bits[i] >= layers.size())
+            continue;
+        if (m_fields & ValueField)
+            layers.setValue(m_bits[i], m_after.value);
+        if (m_fields & OverriddenField)
+            layers.setOverridden(m_bits[i], m_after.overridden);
+        if (m_fields & IgnoredField)
+            layers.setIgnored(m_bits[i], m_after.ignored);
+    }
+    m_window->bitLayersChanged();
+}
+
+
+BitLayersCommand::BitLayersCommand(MainWindow* window,
+                                   const BitLayers& before,
+                                   const BitLayers& after,
+                                   const QString& text,
+                                   QUndoCommand* parent)
+    : QUndoCommand(parent)
+    , m_window(window)
+    , m_before(before)
+    , m_after(after)
+{
+    setText(text);
+}
+
+
+void BitLayersCommand::undo()
+{
+    m_window->m_die.bitLayers() = m_before;
+    m_window->bitLayersChanged();
+}
+
+
+void BitLayersCommand::redo()
+{
+    m_window->m_die.bitLayers() = m_after;
+    m_window->bitLayersChanged();
+}
@@ -0,0 +1,212 @@
+#ifndef DIETOY_UNDO_COMMANDS_H
+#define DIETOY_UNDO_COMMANDS_H
+
+#include "MainWindow.h"
+
+#include <QVector>
+#include <QByteArray>
+#include <QPointF>
+#include <QUndoCommand>
+
+
+/// Undo command ids (for merging drags) //////////////////////////////////////
+
+enum UndoCommandId { BoundsPointsCommandId = 1,
+                     MoveSlicesCommandId };
+
+
+/// ROM bounds points /////////////////////////////////////////////////////////
+
+// Stores the (at most 4) bounds points before and after an edit.
+// Commands sharing a drag serial collapse into one on the stack.
+class BoundsPointsCommand : public QUndoCommand
+{
+public:
+    BoundsPointsCommand(MainWindow* window,
+                        const QVector<QPointF>& before,
+                        const QVector<QPointF>& after,
+                        const int& dragSerial = -1,
+                        QUndoCommand* parent = Q_NULLPTR);
+
+    void undo() Q_DECL_OVERRIDE;
+    void redo() Q_DECL_OVERRIDE;
+    int id() const Q_DECL_OVERRIDE { return BoundsPointsCommandId; }
+    bool mergeWith(const QUndoCommand* other) Q_DECL_OVERRIDE;
+
+private:
+    MainWindow* m_window;
+    QVector<QPointF> m_before;
+    QVector<QPointF> m_after;
+    int m_dragSerial;
+};
+
+
+/// Slice additions ///////////////////////////////////////////////////////////
+
+// Stores the added offsets, and the ids they were given the first time around
+// so later commands referring to those ids still find them after a redo.
+// The bit layers gain a blank column (or row) per slice, and keep whatever the
+// new lines held when the addition is undone, for the redo.
+class AddSlicesCommand : public QUndoCommand
+{
+public:
+    AddSlicesCommand(MainWindow* window,
+                     const MainWindow::UiMode& hv,
+                     const QVector<qreal>& positions,
+                     QUndoCommand* parent = Q_NULLPTR);
+
+    void undo() Q_DECL_OVERRIDE;
+    void redo() Q_DECL_OVERRIDE;
+
+private:
+    MainWindow* m_window;
+    MainWindow::UiMode m_hv;
+    QVector<qreal> m_positions;
+    QVector<quint32> m_ids;
+    BitLayers m_lineLayers;
+};
+
+
+/// Slice deletions ///////////////////////////////////////////////////////////
+
+// Stores the ids and offsets of the removed slices only, and the bit layers'
+// columns (or rows) on them so an undo puts the bits' state back too.
+class DeleteSlicesCommand : public QUndoCommand
+{
+public:
+    DeleteSlicesCommand(MainWindow* window,
+                        const MainWindow::UiMode& hv,
+                        const QVector<quint32>& ids,
+                        QUndoCommand* parent = Q_NULLPTR);
+
+    void undo() Q_DECL_OVERRIDE;
+    void redo() Q_DECL_OVERRIDE;
+
+private:
+    MainWindow* m_window;
+    MainWindow::UiMode m_hv;
+    QVector<quint32> m_ids;
+    QVector<qreal> m_positions;
+    BitLayers m_lineLayers;
+};
+
+
+/// Slice moves ///////////////////////////////////////////////////////////////
+
+// A list of slice ids and their ROM-die-space positions before and after a move
+// of all of them by the same offset.  Every mouse move of one drag merges into the
+// same command, and undo puts back the exact positions from before the drag.
+// A slice carried past its neighbor takes its column (or row) of bit layers along.
+class MoveSlicesCommand : public QUndoCommand
+{
+public:
+    MoveSlicesCommand(MainWindow* window,
+                      const MainWindow::UiMode& hv,
+                      const QVector<quint32>& ids,
+                      const qreal& delta,
+                      const int& dragSerial = -1,
+                      QUndoCommand* parent = Q_NULLPTR);
+
+    void undo() Q_DECL_OVERRIDE;
+    void redo() Q_DECL_OVERRIDE;
+    int id() const Q_DECL_OVERRIDE { return MoveSlicesCommandId; }
+    bool mergeWith(const QUndoCommand* other) Q_DECL_OVERRIDE;
+
+private:
+    void moveSlices(const QVector<qreal>& positions);
+
+    MainWindow* m_window;
+    MainWindow::UiMode m_hv;
+    QVector<quint32> m_ids;
+    QVector<qreal> m_before;
+    QVector<qreal> m_after;
+    int m_dragSerial;
+};
+
+
+/// Bit layer edits ///////////////////////////////////////////////////////////
+
+// A single bit's value, override and ignore flags before and after a click.
+class BitStateCommand : public QUndoCommand
+{
+public:
+    struct BitState
+    {
+        bool value;
+        bool overridden;
+        bool ignored;
+    };
+
+    BitStateCommand(MainWindow* window,
+                    const int& bit,
+                    const BitState& before,
+                    const BitState& after,
+                    const QString& text,
+                    QUndoCommand* parent = Q_NULLPTR);
+
+    static BitState state(const BitLayers& layers, const int& bit);
+
+    void undo() Q_DECL_OVERRIDE;
+    void redo() Q_DECL_OVERRIDE;
+
+private:
+    void apply(const BitState& state);
+
+    MainWindow* m_window;
+    int m_bit;
+    BitState m_before;
+    BitState m_after;
+};
+
+
+// The same change to many bits at once (a selection set to a value or ignored).
+// Holds the bit indices, which flags the change sets, and each bit's flags before
+// it - about 5 bytes a bit rather than copies of the whole layers.
+class BitStatesCommand : public QUndoCommand
+{
+public:
+    enum Field { ValueField = 0x1,
+                 OverriddenField = 0x2,
+                 IgnoredField = 0x4 };
+
+    BitStatesCommand(MainWindow* window,
+                     const QVector<int>& bits,
+                     const int& fields,
+                     const BitStateCommand::BitState& after,
+                     const QString& text,
+                     QUndoCommand* parent = Q_NULLPTR);
+
+    void undo() Q_DECL_OVERRIDE;
+    void redo() Q_DECL_OVERRIDE;
+
+private:
+    MainWindow* m_window;
+    QVector<int> m_bits;
+    int m_fields;
+    BitStateCommand::BitState m_after;
+    QByteArray m_before;
+};
+
+
+// Whole layer sets, for edits touching every bit (classification).
+// The planes are implicitly shared, so only what changed is ever duplicated.
+class BitLayersCommand : public QUndoCommand
+{
+public:
+    BitLayersCommand(MainWindow* window,
+                     const BitLayers& before,
+                     const BitLayers& after,
+                     const QString& text,
+                     QUndoCommand* parent = Q_NULLPTR);
+
+    void undo() Q_DECL_OVERRIDE;
+    void redo() Q_DECL_OVERRIDE;
+
+private:
+    MainWindow* m_window;
+    BitLayers m_before;
+    BitLayers m_after;
+};
+
+
+#endif // DIETOY_UNDO_COMMANDS_H
@@ -0,0 +1,658 @@
+#include "core/DdfJson.h"
+#include "core/RomFormat.h"
+#include "core/DieGeometry.h"
+#include "core/ImageSampler.h"
+#include "core/SyntheticDie.h"
+#include "core/DieDescription.h"
+#include "core/BitPatchStream.h"
+#include "core/BitClassifier.h"
+
+#include <QDir>
+#include <QFile>
+#include <QDebug>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QTextStream>
+#include <QJsonDocument>
+#include <QTemporaryDir>
+#include <QElapsedTimer>
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QCommandLineOption>
+
+#include <QtMath>
+
+#include <random>
+
+#ifdef Q_OS_UNIX
+#include <sys/resource.h>
+#endif
+
+
+// Stages quicker than this are too noisy to call a slowdown on
+static const qint64 TimingNoiseMsecs = 20;
+
+
+// One step of the chain, timed, with the most memory the process held during it
+struct StageResult
+{
+    QString name;
+    qint64 msecs;
+    qint64 peakRssKiB;
+};
+
+
+struct CaseResult
+{
+    QString name;
+    int bitCount;
+    int bitErrors;
+    qreal meanLocationError;
+    qreal maxLocationError;
+    bool hasLocationError;
+    bool ddfRoundTrip;
+    QVector<StageResult> stages;
+};
+
+
+// Restarts the peak resident set size from the current one, where the kernel allows it (Linux)
+static void resetPeakRss()
+{
+    QFile clearRefs("/proc/self/clear_refs");
+    if (clearRefs.open(QIODevice::WriteOnly))
+        clearRefs.write("5");
+}
+
+
+// Peak resident set size in KiB - since the last reset on Linux, since the start elsewhere
+static qint64 peakRss()
+{
+    QFile status("/proc/self/status");
+    if (status.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+        const QList<QByteArray> lines = status.readAll().split('\n');
+        for (int i = 0; i < lines.size(); i++)
+        {
+            if (lines[i].startsWith("VmHWM:"))
+                return lines[i].mid(6).trimmed().split(' ').first().toLongLong();
+        }
+    }
+#ifdef Q_OS_UNIX
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0)
+    {
+#ifdef Q_OS_MACOS
+        return usage.ru_maxrss / 1024;
+#else
+        return usage.ru_maxrss;
+#endif
+    }
+#endif
+    return 0;
+}
+
+
+// Times a stage from construction to finish()
+class StageTimer
+{
+public:
+    StageTimer(const QString& name, QVector<StageResult>& stages)
+        : m_name(name)
+        , m_stages(stages)
+        , m_timer()
+    {
+        resetPeakRss();
+        m_timer.start();
+    }
+
+    void finish()
+    {
+        StageResult stage;
+        stage.name = m_name;
+        stage.msecs = m_timer.elapsed();
+        stage.peakRssKiB = peakRss();
+        m_stages.push_back(stage);
+    }
+
+private:
+    QString m_name;
+    QVector<StageResult>& m_stages;
+    QElapsedTimer m_timer;
+};
+
+
+// The DDF as QJsonDocument wrote it before saveJson streamed it - what saveJson still has to match byte for byte
+static QByteArray documentDdfJson(const DieDescription& die)
+{
+    QJsonObject root;
+    root["fileType"] = "Die Description File";
+    root["version"] = (int)1;
+
+    QJsonArray boundaryArray;
+    for (int i = 0; i < die.boundsPoints().size(); i++)
+    {
+        QJsonArray qPointFJson;
+        qPointFJson.append(die.boundsPoints()[i].x());
+        qPointFJson.append(die.boundsPoints()[i].y());
+        boundaryArray.append(qPointFJson);
+    }
+    root["romBounds"] = boundaryArray;
+
+    QJsonArray horizSliceArray;
+    for (int i = 0; i < die.horizontalSlices().size(); i++)
+        horizSliceArray.append(die.horizontalSlices()[i]);
+    root["horizontalSlices"] = horizSliceArray;
+
+    QJsonArray vertSliceArray;
+    for (int i = 0; i < die.verticalSlices().size(); i++)
+        vertSliceArray.append(die.verticalSlices()[i]);
+    root["verticalSlices"] = vertSliceArray;
+
+    if (!die.bitLayers().isEmpty())
+        root["bitLayers"] = die.bitLayers().toJson();
+    if (!die.romFormat().isDefault())
+        root["romFormat"] = die.romFormat().toJson();
+
+    return QJsonDocument(root).toJson(QJsonDocument::Indented);
+}
+
+
+// Where two texts first differ, for the failure message
+static int firstDifference(const QByteArray& a, const QByteArray& b)
+{
+    const int common = qMin(a.size(), b.size());
+    for (int i = 0; i < common; i++)
+    {
+        if (a[i] != b[i])
+            return i;
+    }
+    return common;
+}
+
+
+// saveJson's streamed text against QJsonDocument's, then what it wrote read back
+// by the streaming reader and by QJsonDocument, each written out again to compare
+static bool checkDdfRoundTrip(const DieDescription& die, const QString& filename)
+{
+    if (!die.saveJson(filename))
+    {
+        qWarning() << "Unable to write " << filename;
+        return false;
+    }
+
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+        qWarning() << "Unable to read " << filename;
+        return false;
+    }
+    const QByteArray streamed = file.readAll();
+    const QByteArray document = documentDdfJson(die);
+    if (streamed != document)
+    {
+        qWarning() << "The streamed DDF differs from QJsonDocument's at byte" << firstDifference(streamed, document);
+        return false;
+    }
+
+    // The streaming reader has to take saveJson's text itself, not leave it to the fallback
+    DdfContents contents;
+    if (!DdfJsonReader(streamed.constData(), streamed.constData() + streamed.size()).read(contents))
+    {
+        qWarning() << "The streaming DDF reader turned down saveJson's text";
+        return false;
+    }
+    DieDescription reloaded;
+    if (!reloaded.loadJson(filename) || documentDdfJson(reloaded) != document)
+    {
+        qWarning() << "The DDF changed on its way back through the streaming reader";
+        return false;
+    }
+
+    if (QJsonDocument::fromJson(streamed).toJson(QJsonDocument::Indented) != document)
+    {
+        qWarning() << "The DDF changed on its way back through QJsonDocument";
+        return false;
+    }
+    return true;
+}
+
+
+// Runs the whole chain on one ground truth die.  A case either names an image with
+// the description under test and the true bits (and optionally the true description),
+// or has a "synthetic" object of dieToySynth's settings to make its die from (plus
+// boundsError, how far off its corners are in the description under test).
+static bool runCase(const QJsonObject& caseObj, const QDir& manifestDir, CaseResult& result)
+{
+    result.name = caseObj["name"].toString();
+    result.bitCount = 0;
+    result.bitErrors = 0;
+    result.meanLocationError = 0.0;
+    result.maxLocationError = 0.0;
+    result.hasLocationError = false;
+    result.ddfRoundTrip = false;
+    result.stages.clear();
+
+    QTemporaryDir scratch;
+    if (!scratch.isValid())
+    {
+        qWarning() << "Unable to make a scratch directory";
+        return false;
+    }
+
+    QImage image;
+    QString ddfFilename;
+    QString truthDdfFilename;
+    QVector<quint8> truthBits;
+    if (caseObj.contains("synthetic"))
+    {
+        const QJsonObject synthObj = caseObj["synthetic"].toObject();
+        SyntheticDie synth;
+        if (synthObj.contains("size"))
+            synth.setImageSize(SyntheticDie::parseSize(synthObj["size"].toString()));
+        if (synthObj.contains("bitCount"))
+            synth.setBitCount(SyntheticDie::parseSize(synthObj["bitCount"].toString()));
+        if (synthObj.contains("margin"))
+            synth.setMargin(synthObj["margin"].toDouble());
+        if (synthObj.contains("skew"))
+            synth.setSkew(synthObj["skew"].toDouble());
+        if (synthObj.contains("sliceJitter"))
+            synth.setSliceJitter(synthObj["sliceJitter"].toDouble());
+        if (synthObj.contains("bitRadius"))
+            synth.setBitRadius(synthObj["bitRadius"].toDouble());
+        if (synthObj.contains("noise"))
+            synth.setNoise(synthObj["noise"].toDouble());
+        if (synthObj.contains("distortion"))
+            synth.setDistortion(synthObj["distortion"].toDouble());
+        if (synthObj.contains("seed"))
+            synth.setSeed(synthObj["seed"].toInt());
+        if (!synth.generate())
+            return false;
+
+        StageTimer timer("render", result.stages);
+        image = synth.render();
+        timer.finish();
+        if (image.isNull())
+            return false;
+
+        // Through a file, so the load is measured like any other description's
+        truthDdfFilename = scratch.filePath("truth.ddf");
+        if (!synth.dieDescription().saveJson(truthDdfFilename))
+        {
+            qWarning() << "Unable to write " << truthDdfFilename;
+            return false;
+        }
+        truthBits = synth.bits();
+
+        // Measured against itself the true description would always be exact, so without a
+        // description of its own the case tests the true one with each corner nudged by up
+        // to boundsError pixels, the way one placed by hand would be off
+        if (caseObj.contains("dieDescription"))
+        {
+            ddfFilename = manifestDir.absoluteFilePath(caseObj["dieDescription"].toString());
+        }
+        else
+        {
+            const qreal boundsError = synthObj.contains("boundsError") ? synthObj["boundsError"].toDouble() : 0.3;
+            std::mt19937 random(synthObj.contains("seed") ? synthObj["seed"].toInt() + 1 : 2);
+            std::uniform_real_distribution<double> nudge(-boundsError, boundsError);
+
+            DieDescription placed = synth.dieDescription();
+            for (int i = 0; i < placed.boundsPoints().size(); i++)
+                placed.boundsPoints()[i] += QPointF(nudge(random), nudge(random));
+
+            ddfFilename = scratch.filePath("placed.ddf");
+            if (!placed.saveJson(ddfFilename))
+            {
+                qWarning() << "Unable to write " << ddfFilename;
+                return false;
+            }
+        }
+    }
+    else
+    {
+        StageTimer timer("image", result.stages);
+        const QString imageFilename = manifestDir.absoluteFilePath(caseObj["image"].toString());
+        if (!image.load(imageFilename))
+        {
+            qWarning() << "Unable to load image file " << imageFilename;
+            return false;
+        }
+        timer.finish();
+
+        ddfFilename = manifestDir.absoluteFilePath(caseObj["dieDescription"].toString());
+        if (caseObj.contains("truthDieDescription"))
+            truthDdfFilename = manifestDir.absoluteFilePath(caseObj["truthDieDescription"].toString());
+        if (!RomFormat::readBitRows(manifestDir.absoluteFilePath(caseObj["bits"].toString()), truthBits))
+            return false;
+    }
+
+    DieDescription die;
+    {
+        StageTimer timer("ddf", result.stages);
+        if (!die.loadJson(ddfFilename))
+        {
+            qWarning() << "Unable to load die description file " << ddfFilename;
+            return false;
+        }
+        timer.finish();
+    }
+
+    const DieGeometry geometry(die.boundsPoints());
+    if (!geometry.isValid())
+    {
+        qWarning() << "The die description needs exactly 4 bounds points";
+        return false;
+    }
+
+    BitLocationStore locations;
+    {
+        StageTimer timer("locations", result.stages);
+        locations = geometry.computeBitLocations(die.horizontalSlices(), die.verticalSlices());
+        timer.finish();
+    }
+
+    const ImageSampler sampler(image);
+    BitClassifierSink classifier;
+    {
+        StageTimer timer("classify", result.stages);
+        BitPatchStream stream(sampler, geometry, die);
+        if (!stream.run(classifier))
+            return false;
+        timer.finish();
+    }
+
+    {
+        StageTimer timer("export", result.stages);
+        BitImageSink sink(scratch.filePath("bits.png"));
+        BitPatchStream stream(sampler, geometry, die);
+        stream.setPatchFormats(BitPatchStream::ColorPatches);
+        stream.setOutsideColor(qRgb(255, 0, 0));
+        if (!stream.run(sink))
+            return false;
+        timer.finish();
+    }
+
+    // Accuracy against the ground truth
+    if (truthBits.size() != classifier.bits().size())
+    {
+        qWarning() << result.name << "has" << truthBits.size() << "true bits but the description has" << classifier.bits().size();
+        return false;
+    }
+    result.bitCount = truthBits.size();
+    for (int i = 0; i < truthBits.size(); i++)
+    {
+        if (truthBits[i] != classifier.bits()[i])
+            result.bitErrors++;
+    }
+
+    // The description, with the classified bits in its layers, through the DDF writer and readers
+    if (die.bitLayers().bitCount() != die.bitCount())
+        die.bitLayers().resize(die.bitCount());
+    die.bitLayers().applyClassification(classifier.bits(), BitClassifier::confidences(classifier.means(), classifier.threshold()));
+    result.ddfRoundTrip = checkDdfRoundTrip(die, scratch.filePath("roundTrip.ddf"));
+
+    if (!truthDdfFilename.isEmpty())
+    {
+        DieDescription truthDie;
+        if (!truthDie.loadJson(truthDdfFilename))
+        {
+            qWarning() << "Unable to load die description file " << truthDdfFilename;
+            return false;
+        }
+        const DieGeometry truthGeometry(truthDie.boundsPoints());
+        const BitLocationStore truthLocations = truthGeometry.computeBitLocations(truthDie.horizontalSlices(), truthDie.verticalSlices());
+        if (truthLocations.bitCount() != locations.bitCount())
+        {
+            qWarning() << result.name << "has a different bit grid than its true die description";
+            return false;
+        }
+
+        qreal sum = 0.0;
+        for (int i = 0; i < locations.size(); i++)
+        {
+            const QPointF delta = locations[i] - truthLocations[i];
+            const qreal error = qSqrt(delta.x() * delta.x() + delta.y() * delta.y());
+            sum += error;
+            result.maxLocationError = qMax(result.maxLocationError, error);
+        }
+        result.meanLocationError = locations.isEmpty() ? 0.0 : sum / locations.size();
+        result.hasLocationError = true;
+    }
+    return true;
+}
+
+
+static QJsonObject resultToJson(const CaseResult& result)
+{
+    QJsonObject caseObj;
+    caseObj["name"] = result.name;
+    caseObj["bits"] = result.bitCount;
+    caseObj["bitErrors"] = result.bitErrors;
+    caseObj["ddfRoundTrip"] = result.ddfRoundTrip;
+    if (result.hasLocationError)
+    {
+        caseObj["meanLocationError"] = result.meanLocationError;
+        caseObj["maxLocationError"] = result.maxLocationError;
+    }
+
+    QJsonArray stageArray;
+    for (int i = 0; i < result.stages.size(); i++)
+    {
+        QJsonObject stageObj;
+        stageObj["name"] = result.stages[i].name;
+        stageObj["msecs"] = result.stages[i].msecs;
+        stageObj["peakRssKiB"] = result.stages[i].peakRssKiB;
+        stageArray.append(stageObj);
+    }
+    caseObj["stages"] = stageArray;
+    return caseObj;
+}
+
+
+// Every stage of every case that's in both runs, checked for slowing down or growing
+static bool compareToBaseline(const QJsonArray& cases, const QString& baselineFilename,
+                              const qreal& maxSlowdown, const qreal& maxMemoryGrowth)
+{
+    QFile file(baselineFilename);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        qWarning() << "Unable to open baseline " << baselineFilename;
+        return false;
+    }
+    const QJsonArray baselineCases = QJsonDocument::fromJson(file.readAll()).object()["cases"].toArray();
+
+    bool passed = true;
+    for (int c = 0; c < cases.size(); c++)
+    {
+        const QJsonObject caseObj = cases[c].toObject();
+        for (int b = 0; b < baselineCases.size(); b++)
+        {
+            const QJsonObject baselineObj = baselineCases[b].toObject();
+            if (baselineObj["name"] != caseObj["name"])
+                continue;
+
+            const QJsonArray stages = caseObj["stages"].toArray();
+            const QJsonArray baselineStages = baselineObj["stages"].toArray();
+            for (int s = 0; s < stages.size() && s < baselineStages.size(); s++)
+            {
+                const QJsonObject stageObj = stages[s].toObject();
+                const QJsonObject baselineStageObj = baselineStages[s].toObject();
+                if (stageObj["name"] != baselineStageObj["name"])
+                    continue;
+
+                const qint64 msecs = stageObj["msecs"].toVariant().toLongLong();
+                const qint64 baselineMsecs = baselineStageObj["msecs"].toVariant().toLongLong();
+                if (msecs > baselineMsecs * (1.0 + maxSlowdown) && msecs - baselineMsecs > TimingNoiseMsecs)
+                {
+                    qWarning() << "FAIL" << caseObj["name"].toString() << stageObj["name"].toString()
+                               << "took" << msecs << "ms against a baseline of" << baselineMsecs << "ms";
+                    passed = false;
+                }
+
+                const qint64 rss = stageObj["peakRssKiB"].toVariant().toLongLong();
+                const qint64 baselineRss = baselineStageObj["peakRssKiB"].toVariant().toLongLong();
+                if (baselineRss > 0 && rss > baselineRss * (1.0 + maxMemoryGrowth))
+                {
+                    qWarning() << "FAIL" << caseObj["name"].toString() << stageObj["name"].toString()
+                               << "peaked at" << rss << "KiB against a baseline of" << baselineRss << "KiB";
+                    passed = false;
+                }
+            }
+        }
+    }
+    return passed;
+}
+
+
+int main(int argc, char *argv[])
+{
+    // Create and name our app
+    QCoreApplication app(argc, argv);
+    app.setApplicationName("DieToyBench");
+    app.setApplicationVersion("0.6");
+
+    // -- Begin arg parsing -- //
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("DieToyBench : Accuracy and speed of the extraction chain on ground truth dies.");
+    parser.addHelpOption();
+    parser.addVersionOption();
+
+    QCommandLineOption manifestOption(QStringList() << "m" << "manifest",
+                                      QCoreApplication::translate("main", "Ground truth cases to run (a single default synthetic die without one)."),
+                                      QCoreApplication::translate("main", "manifest"));
+    QCommandLineOption resultsOption(QStringList() << "results",
+                                     QCoreApplication::translate("main", "Write the results here (usable as a later --baseline)."),
+                                     QCoreApplication::translate("main", "filename"));
+    QCommandLineOption baselineOption(QStringList() << "baseline",
+                                      QCoreApplication::translate("main", "Fail when a stage is slower or bigger than in these earlier results."),
+                                      QCoreApplication::translate("main", "filename"));
+    QCommandLineOption maxBitErrorRateOption(QStringList() << "max-bit-error-rate",
+                                             QCoreApplication::translate("main", "Fail above this fraction of wrong bits (default 0.001)."),
+                                             QCoreApplication::translate("main", "fraction"));
+    QCommandLineOption maxLocationErrorOption(QStringList() << "max-location-error",
+                                              QCoreApplication::translate("main", "Fail when the mean bit location error is above this (default 0.5)."),
+                                              QCoreApplication::translate("main", "pixels"));
+    QCommandLineOption maxSlowdownOption(QStringList() << "max-slowdown",
+                                         QCoreApplication::translate("main", "Fail when a stage takes this fraction longer than the baseline (default 0.25)."),
+                                         QCoreApplication::translate("main", "fraction"));
+    QCommandLineOption maxMemoryGrowthOption(QStringList() << "max-memory-growth",
+                                             QCoreApplication::translate("main", "Fail when a stage peaks this fraction higher than the baseline (default 0.25)."),
+                                             QCoreApplication::translate("main", "fraction"));
+    parser.addOption(manifestOption);
+    parser.addOption(resultsOption);
+    parser.addOption(baselineOption);
+    parser.addOption(maxBitErrorRateOption);
+    parser.addOption(maxLocationErrorOption);
+    parser.addOption(maxSlowdownOption);
+    parser.addOption(maxMemoryGrowthOption);
+
+    parser.process(app);
+
+    // -- End arg parsing -- //
+
+
+    const qreal maxBitErrorRate = parser.isSet(maxBitErrorRateOption) ? parser.value(maxBitErrorRateOption).toDouble() : 0.001;
+    const qreal maxLocationError = parser.isSet(maxLocationErrorOption) ? parser.value(maxLocationErrorOption).toDouble() : 0.5;
+    const qreal maxSlowdown = parser.isSet(maxSlowdownOption) ? parser.value(maxSlowdownOption).toDouble() : 0.25;
+    const qreal maxMemoryGrowth = parser.isSet(maxMemoryGrowthOption) ? parser.value(maxMemoryGrowthOption).toDouble() : 0.25;
+
+    // The cases, relative paths being relative to the manifest
+    QJsonArray caseArray;
+    QDir manifestDir = QDir::current();
+    if (parser.isSet(manifestOption))
+    {
+        QFile file(parser.value(manifestOption));
+        if (!file.open(QIODevice::ReadOnly))
+        {
+            qWarning() << "Unable to open bench manifest " << file.fileName();
+            return 1;
+        }
+
+        QJsonParseError jError;
+        const QJsonDocument jDoc = QJsonDocument::fromJson(file.readAll(), &jError);
+        if (jDoc.isNull())
+        {
+            qWarning() << "Unable to parse bench manifest " << file.fileName() << ":" << jError.errorString();
+            return 1;
+        }
+        if (jDoc.object()["version"].toInt() > 1)
+        {
+            qWarning() << "Can only read bench manifest versions 1 or less";
+            return 1;
+        }
+        caseArray = jDoc.object()["cases"].toArray();
+        manifestDir = QFileInfo(file.fileName()).absoluteDir();
+    }
+    else
+    {
+        QJsonObject caseObj;
+        caseObj["name"] = "synthetic";
+        caseObj["synthetic"] = QJsonObject();
+        caseArray.append(caseObj);
+    }
+
+    bool passed = true;
+    QJsonArray resultArray;
+    QTextStream out(stdout);
+    for (int i = 0; i < caseArray.size(); i++)
+    {
+        CaseResult result;
+        if (!runCase(caseArray[i].toObject(), manifestDir, result))
+        {
+            qWarning() << "FAIL" << result.name << "didn't run";
+            passed = false;
+            continue;
+        }
+        resultArray.append(resultToJson(result));
+
+        const qreal bitErrorRate = result.bitCount ? (qreal)result.bitErrors / result.bitCount : 0.0;
+        out << result.name << ": " << result.bitErrors << " of " << result.bitCount << " bits wrong";
+        if (result.hasLocationError)
+            out << ", locations off by " << result.meanLocationError << " px (at most " << result.maxLocationError << ")";
+        out << ", DDF round trip " << (result.ddfRoundTrip ? "exact" : "FAILED") << "\n";
+        for (int s = 0; s < result.stages.size(); s++)
+        {
+            out << "    " << result.stages[s].name << " " << result.stages[s].msecs << " ms, peak "
+                << result.stages[s].peakRssKiB / 1024 << " MiB\n";
+        }
+        out.flush();
+
+        if (bitErrorRate > maxBitErrorRate)
+        {
+            qWarning() << "FAIL" << result.name << "bit error rate" << bitErrorRate << "is above" << maxBitErrorRate;
+            passed = false;
+        }
+        if (!result.ddfRoundTrip)
+        {
+            qWarning() << "FAIL" << result.name << "DDF didn't survive saving and reloading unchanged";
+            passed = false;
+        }
+        if (result.hasLocationError && result.meanLocationError > maxLocationError)
+        {
+            qWarning() << "FAIL" << result.name << "mean location error" << result.meanLocationError << "is above" << maxLocationError;
+            passed = false;
+        }
+    }
+
+    if (parser.isSet(baselineOption))
+        passed &= compareToBaseline(resultArray, parser.value(baselineOption), maxSlowdown, maxMemoryGrowth);
+
+    if (parser.isSet(resultsOption))
+    {
+        QJsonObject docObj;
+        docObj["version"] = 1;
+        docObj["cases"] = resultArray;
+
+        QFile file(parser.value(resultsOption));
+        if (!file.open(QIODevice::WriteOnly))
+        {
+            qWarning() << "Unable to write " << file.fileName();
+            return 1;
+        }
+        file.write(QJsonDocument(docObj).toJson());
+    }
+
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,371 @@
+#include "core/BitExporter.h"
+#include "core/BitClassifier.h"
+#include "core/DieGeometry.h"
+#include "core/ImageSampler.h"
+#include "core/DieDescription.h"
+#include "core/BatchProcessor.h"
+#include "core/BitPatchStream.h"
+#include "core/TileMosaic.h"
+#include "core/DecodedImageCache.h"
+#include "core/RomFormat.h"
+#include "core/ImageRegistration.h"
+#include "core/BitFusion.h"
+
+#include <QFile>
+#include <QDebug>
+#include <QTextStream>
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QCommandLineOption>
+
+
+// Writes each bit's location as the stream passes it
+class BitLocationCsvSink : public BitPatchSink
+{
+public:
+    explicit BitLocationCsvSink(QTextStream& out)
+        : m_out(out)
+    {
+        
+    }
+
+    bool begin(const QSize& bitCount, const int& patchDim)
+    {
+        Q_UNUSED(bitCount);
+        Q_UNUSED(patchDim);
+        m_out << "bit,row,col,x,y\n";
+        return true;
+    }
+
+    bool consume(const BitPatchBatch& batch)
+    {
+        for (int i = 0; i < batch.count(); i++)
+        {
+            const int bit = batch.firstBit() + i;
+            m_out << bit << "," << bit / batch.columns << "," << bit % batch.columns << ","
+                  << batch.xs[i] << "," << batch.ys[i] << "\n";
+        }
+        return true;
+    }
+
+private:
+    QTextStream& m_out;
+};
+
+
+int main(int argc, char *argv[])
+{
+    // Create and name our app
+    QCoreApplication app(argc, argv);
+    app.setApplicationName("DieToyCli");
+    app.setApplicationVersion("0.6");
+
+    // -- Begin arg parsing -- //
+    
+    QCommandLineParser parser;
+    parser.setApplicationDescription("DieToyCli : Headless bit extraction from chip die images.");
+    parser.addHelpOption();
+    parser.addVersionOption();
+
+    QCommandLineOption dieImageOption(QStringList() << "i" << "image",
+                                      QCoreApplication::translate("main", "Die image to load."),
+                                      QCoreApplication::translate("main", "filename"));
+    QCommandLineOption mosaicOption(QStringList() << "mosaic",
+                                    QCoreApplication::translate("main", "Stitch the tiles in a mosaic manifest and sample the bits from it instead of an -i image."),
+                                    QCoreApplication::translate("main", "manifest"));
+    QCommandLineOption ddfOption(QStringList() << "d" << "dieDescription",
+                                 QCoreApplication::translate("main", "Die description file to load."),
+                                 QCoreApplication::translate("main", "filename"));
+    QCommandLineOption grayscaleOption(QStringList() << "g" << "grayscale",
+                                       QCoreApplication::translate("main", "Sample from a grayscale working image of <bits> (8 or 16) per pixel."),
+                                       QCoreApplication::translate("main", "bits"));
+    QCommandLineOption registerFromOption(QStringList() << "register-from",
+                                          QCoreApplication::translate("main", "The die description was made on this image - register it onto the -i image first."),
+                                          QCoreApplication::translate("main", "filename"));
+    QCommandLineOption saveDescriptionOption(QStringList() << "save-description",
+                                             QCoreApplication::translate("main", "Write the (registered) die description here."),
+                                             QCoreApplication::translate("main", "filename"));
+    QCommandLineOption exportBitsOption(QStringList() << "export-bits",
+                                        QCoreApplication::translate("main", "Export the bits to condensed bit PNGs."),
+                                        QCoreApplication::translate("main", "filename"));
+    QCommandLineOption exportSlicedOption(QStringList() << "export-sliced",
+                                          QCoreApplication::translate("main", "Export the die to a series of smaller PNGs."),
+                                          QCoreApplication::translate("main", "filename"));
+    QCommandLineOption bitLocationsOption(QStringList() << "bit-locations",
+                                          QCoreApplication::translate("main", "Write the image-space bit locations to a CSV file."),
+                                          QCoreApplication::translate("main", "filename"));
+    QCommandLineOption classifyOption(QStringList() << "classify",
+                                      QCoreApplication::translate("main", "Threshold the bits and write them as rows of 0s and 1s."),
+                                      QCoreApplication::translate("main", "filename"));
+    QCommandLineOption romOption(QStringList() << "rom",
+                                 QCoreApplication::translate("main", "Write the bits as ROM bytes (.bin, Intel HEX .hex, or a .txt hex dump)."),
+                                 QCoreApplication::translate("main", "filename"));
+    QCommandLineOption fuseOption(QStringList() << "fuse",
+                                  QCoreApplication::translate("main", "Classify the bits from every capture in a fusion manifest instead of the -i image."),
+                                  QCoreApplication::translate("main", "manifest"));
+    QCommandLineOption disagreementsOption(QStringList() << "disagreements",
+                                           QCoreApplication::translate("main", "Write the bits the --fuse captures disagree on to a CSV file."),
+                                           QCoreApplication::translate("main", "filename"));
+    QCommandLineOption batchOption(QStringList() << "batch",
+                                   QCoreApplication::translate("main", "Run every job in a batch manifest."),
+                                   QCoreApplication::translate("main", "manifest"));
+    QCommandLineOption threadsOption(QStringList() << "threads",
+                                     QCoreApplication::translate("main", "Worker threads for --batch (defaults to the core count)."),
+                                     QCoreApplication::translate("main", "count"));
+    QCommandLineOption memoryLimitOption(QStringList() << "memory-limit",
+                                         QCoreApplication::translate("main", "Decoded image memory for --batch and --fuse to stay under (default 2048)."),
+                                         QCoreApplication::translate("main", "MiB"));
+    QCommandLineOption checkpointOption(QStringList() << "checkpoint",
+                                        QCoreApplication::translate("main", "Record finished --batch jobs here and skip the ones already in it."),
+                                        QCoreApplication::translate("main", "filename"));
+    QCommandLineOption noImageCacheOption(QStringList() << "no-image-cache",
+                                          QCoreApplication::translate("main", "Always decode the -i image instead of mapping (and storing) its decoded pixels in the image cache."));
+    parser.addOption(dieImageOption);
+    parser.addOption(mosaicOption);
+    parser.addOption(noImageCacheOption);
+    parser.addOption(ddfOption);
+    parser.addOption(grayscaleOption);
+    parser.addOption(registerFromOption);
+    parser.addOption(saveDescriptionOption);
+    parser.addOption(exportBitsOption);
+    parser.addOption(exportSlicedOption);
+    parser.addOption(bitLocationsOption);
+    parser.addOption(classifyOption);
+    parser.addOption(romOption);
+    parser.addOption(fuseOption);
+    parser.addOption(disagreementsOption);
+    parser.addOption(batchOption);
+    parser.addOption(threadsOption);
+    parser.addOption(memoryLimitOption);
+    parser.addOption(checkpointOption);
+   
+    parser.process(app);
+    
+    // -- End arg parsing -- //
+    
+    
+    // Batches bring their own images and descriptions
+    if (parser.isSet(batchOption))
+    {
+        BatchProcessor batch;
+        if (!batch.loadManifest(parser.value(batchOption)))
+            return 1;
+        
+        if (parser.isSet(threadsOption))
+            batch.setThreadCount(parser.value(threadsOption).toInt());
+        if (parser.isSet(memoryLimitOption))
+            batch.setMemoryLimit(parser.value(memoryLimitOption).toLongLong() * 1024 * 1024);
+        batch.setCheckpointFilename(parser.value(checkpointOption));
+        batch.setGrayscaleBits(parser.value(grayscaleOption).toInt());
+        return batch.run() ? 0 : 1;
+    }
+    
+    // The description is always needed, the image only for the exports
+    DieDescription die;
+    if (!die.loadJson(parser.value(ddfOption)))
+    {
+        qWarning() << "Unable to load die description file " << parser.value(ddfOption);
+        return 1;
+    }
+    
+    // Move a description made on another capture of the die onto this one
+    if (parser.isSet(registerFromOption))
+    {
+        QImage sourceImage;
+        QImage image;
+        if (!sourceImage.load(parser.value(registerFromOption)) || !image.load(parser.value(dieImageOption)))
+        {
+            qWarning() << "Registration needs both the -i image and the image the description was made on";
+            return 1;
+        }
+        
+        ImageRegistration registration;
+        if (!registration.align(sourceImage, image))
+            return 1;
+        qDebug() << "Registered with" << registration.inlierCount() << "matching features";
+        die = registration.transfer(die);
+    }
+    if (parser.isSet(saveDescriptionOption) && !die.saveJson(parser.value(saveDescriptionOption)))
+    {
+        qWarning() << "Unable to write " << parser.value(saveDescriptionOption);
+        return 1;
+    }
+    
+    const DieGeometry geometry(die.boundsPoints());
+    if (!geometry.isValid())
+    {
+        qWarning() << "The die description needs exactly 4 bounds points";
+        return 1;
+    }
+    
+    qDebug() << "Bits across" << die.bitCount().width() << "down" << die.bitCount().height();
+    
+    // Locations alone don't need the image
+    if (parser.isSet(bitLocationsOption))
+    {
+        QFile file(parser.value(bitLocationsOption));
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Text))
+        {
+            qWarning() << "Unable to write " << file.fileName();
+            return 1;
+        }
+        
+        QTextStream out(&file);
+        BitLocationCsvSink sink(out);
+        const ImageSampler noImage;
+        BitPatchStream stream(noImage, geometry, die);
+        stream.setPatchFormats(0);
+        stream.run(sink);
+    }
+    
+    // Fused captures classify the bits in place of the single image
+    const bool fused = parser.isSet(fuseOption);
+    if (fused)
+    {
+        BitFusion fusion;
+        if (parser.isSet(memoryLimitOption))
+            fusion.setMemoryLimit(parser.value(memoryLimitOption).toLongLong() * 1024 * 1024);
+        if (!fusion.loadManifest(parser.value(fuseOption)) || !fusion.run())
+            return 1;
+        if (fusion.bitCount() != die.bitCount())
+        {
+            qWarning() << "The fused captures have a different bit grid than" << parser.value(ddfOption);
+            return 1;
+        }
+        
+        if (die.bitLayers().bitCount() != die.bitCount())
+            die.bitLayers().resize(die.bitCount());
+        die.bitLayers().applyClassification(fusion.bits(), fusion.confidences());
+        if (parser.isSet(classifyOption) && !RomFormat::writeBitRows(parser.value(classifyOption), fusion.bits(), die.bitCount().width()))
+            return 1;
+        
+        if (parser.isSet(disagreementsOption))
+        {
+            QFile file(parser.value(disagreementsOption));
+            if (!file.open(QIODevice::WriteOnly | QIODevice::Text))
+            {
+                qWarning() << "Unable to write " << file.fileName();
+                return 1;
+            }
+            
+            // One vote column per capture, in manifest order
+            QTextStream out(&file);
+            const int bitsAcross = die.bitCount().width();
+            const int bitCount = fusion.bits().size();
+            out << "bit,row,col,fused";
+            for (int layer = 0; layer < fusion.layers().size(); layer++)
+                out << ",layer" << layer;
+            out << "\n";
+            for (int i = 0; i < fusion.disagreements().size(); i++)
+            {
+                const int bit = fusion.disagreements()[i];
+                out << bit << "," << bit / bitsAcross << "," << bit % bitsAcross << "," << (int)fusion.bits()[bit];
+                for (int layer = 0; layer < fusion.layers().size(); layer++)
+                    out << "," << (int)fusion.votes()[layer * bitCount + bit];
+                out << "\n";
+            }
+        }
+    }
+    
+    // A ROM is read from the saved bit layers, reclassified around the hand-set bits when there's an image
+    const bool classifyForRom = parser.isSet(romOption) && (parser.isSet(dieImageOption) || parser.isSet(mosaicOption)) && !fused;
+    const bool classifyImage = parser.isSet(classifyOption) && !fused;
+    if (parser.isSet(exportBitsOption) || parser.isSet(exportSlicedOption) || classifyImage || classifyForRom)
+    {
+        // A mosaic is never assembled whole - the streams read the tiles around each chunk of bits
+        QImage image;
+        TileMosaic mosaic;
+        DecodedImageCache imageCache;
+        if (parser.isSet(noImageCacheOption))
+            imageCache.setDirectory(QString());
+        QVector<QImage> levels;
+        if (parser.isSet(mosaicOption))
+        {
+            if (!mosaic.loadManifest(parser.value(mosaicOption)) || !mosaic.refine())
+                return 1;
+        }
+        else if (!imageCache.load(parser.value(dieImageOption), levels))
+        {
+            qWarning() << "Unable to load image file " << parser.value(dieImageOption);
+            return 1;
+        }
+        else
+        {
+            image = levels[0];
+        }
+        
+        const int bits = parser.value(grayscaleOption).toInt();
+        if (bits == 8 && !image.isNull())
+            image = ImageSampler::luminanceImage(image, QImage::Format_Grayscale8);
+        else if (bits == 16 && !image.isNull())
+            image = ImageSampler::luminanceImage(image, QImage::Format_Grayscale16);
+        const ImageSampler sampler(image);
+        const TileMosaic* streamMosaic = mosaic.isEmpty() ? NULL : &mosaic;
+        
+        // The bit images and classification stream through a few rows at a time
+        bool success = true;
+        if (parser.isSet(exportBitsOption))
+        {
+            BitImageSink sink(parser.value(exportBitsOption));
+            BitPatchStream stream(sampler, geometry, die);
+            stream.setMosaic(streamMosaic);
+            stream.setPatchFormats(BitPatchStream::ColorPatches);
+            stream.setOutsideColor(qRgb(255, 0, 0));
+            success &= stream.run(sink);
+        }
+        if (classifyImage || classifyForRom)
+        {
+            BitClassifierSink sink;
+            BitPatchStream stream(sampler, geometry, die);
+            stream.setMosaic(streamMosaic);
+            success &= stream.run(sink);
+            
+            if (success && classifyForRom)
+            {
+                if (die.bitLayers().bitCount() != die.bitCount())
+                    die.bitLayers().resize(die.bitCount());
+                die.bitLayers().applyClassification(sink.bits(), BitClassifier::confidences(sink.means(), sink.threshold()));
+            }
+            
+            if (success)
+                qDebug() << "Classified with threshold" << sink.threshold();
+            if (success && classifyImage)
+                success &= RomFormat::writeBitRows(parser.value(classifyOption), sink.bits(), die.bitCount().width());
+        }
+        if (parser.isSet(exportSlicedOption) && streamMosaic)
+        {
+            qWarning() << "--export-sliced reads the whole image - it isn't available with --mosaic";
+            success = false;
+        }
+        else if (parser.isSet(exportSlicedOption))
+        {
+            const BitLocationStore bitLocations = geometry.computeBitLocations(die.horizontalSlices(), die.verticalSlices());
+            success &= BitExporter::exportSlicedImages(sampler, bitLocations, parser.value(exportSlicedOption));
+        }
+        if (!success)
+        {
+            qWarning() << "Export failed";
+            return 1;
+        }
+    }
+    
+    if (parser.isSet(romOption))
+    {
+        if (die.bitLayers().isEmpty())
+        {
+            qWarning() << "The die description has no bit values to make a ROM from - pass an image to classify them";
+            return 1;
+        }
+        
+        QByteArray rom;
+        if (!die.romFormat().assemble(die.bitLayers().values(), die.bitCount(), rom))
+            return 1;
+        
+        const QString romFilename = parser.value(romOption);
+        if (!RomFormat::write(rom, romFilename, RomFormat::formatFromFilename(romFilename)))
+            return 1;
+        qDebug() << "Wrote" << rom.size() << "ROM bytes";
+    }
+    
+    return 0;
+}
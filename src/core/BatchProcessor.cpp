@@ -0,0 +1,317 @@
+#include "BatchProcessor.h"
+#include "BitExporter.h"
+#include "DieGeometry.h"
+#include "ImageSampler.h"
+#include "DieDescription.h"
+#include "WorkStealingPool.h"
+
+#include <QDir>
+#include <QDebug>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QTextStream>
+#include <QJsonObject>
+#include <QImageReader>
+#include <QMutexLocker>
+#include <QJsonDocument>
+
+
+// Everything one die carries through its tasks
+struct BatchProcessor::DieState
+{
+    BatchJob job;
+    qint64 reservedBytes;
+    
+    DieDescription die;
+    ImageSampler sampler;
+    BitLocationStore bitLocations;
+    
+    QAtomicInt remainingTasks;
+    QAtomicInt failed;
+};
+
+
+BatchProcessor::BatchProcessor()
+    : m_jobs()
+    , m_threadCount(QThread::idealThreadCount())
+    , m_memoryLimit(2048LL * 1024 * 1024)
+    , m_checkpointFilename()
+    , m_grayscaleBits(0)
+    , m_radius(6)
+    , m_pool(NULL)
+    , m_memoryInUse(0)
+    , m_completedCount(0)
+    , m_failedCount(0)
+    , m_skippedCount(0)
+{
+    
+}
+
+
+BatchProcessor::~BatchProcessor()
+{
+    
+}
+
+
+bool BatchProcessor::loadManifest(const QString& filename)
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+        qWarning() << "Unable to open manifest " << filename;
+        return false;
+    }
+    
+    QJsonParseError jError;
+    const QJsonDocument jDoc = QJsonDocument::fromJson(file.readAll(), &jError);
+    if (jError.error != QJsonParseError::NoError)
+    {
+        qWarning() << "Unable to parse manifest " << filename << ":" << jError.errorString();
+        return false;
+    }
+    
+    const QJsonObject docObj = jDoc.object();
+    const int version = docObj["version"].toInt();
+    if (version > 1 || version == 0)
+    {
+        qWarning() << "Can only read manifest versions 1 or less";
+        return false;
+    }
+    
+    // Relative paths are relative to the manifest
+    const QDir manifestDir = QFileInfo(filename).absoluteDir();
+    const QJsonArray jobArray = docObj["jobs"].toArray();
+    m_jobs.clear();
+    for (int i = 0; i < jobArray.size(); i++)
+    {
+        const QJsonObject jobObj = jobArray[i].toObject();
+        BatchJob job;
+        job.image = manifestDir.absoluteFilePath(jobObj["image"].toString());
+        job.dieDescription = manifestDir.absoluteFilePath(jobObj["dieDescription"].toString());
+        if (jobObj.contains("bits"))
+            job.bitsOutput = manifestDir.absoluteFilePath(jobObj["bits"].toString());
+        if (jobObj.contains("sliced"))
+            job.slicedOutput = manifestDir.absoluteFilePath(jobObj["sliced"].toString());
+        
+        if (jobObj["image"].toString().isEmpty() || jobObj["dieDescription"].toString().isEmpty())
+        {
+            qWarning() << "Manifest job" << i << "needs an image and a dieDescription";
+            return false;
+        }
+        m_jobs.push_back(job);
+    }
+    
+    return true;
+}
+
+
+bool BatchProcessor::run()
+{
+    m_completedCount = 0;
+    m_failedCount = 0;
+    m_skippedCount = 0;
+    m_memoryInUse = 0;
+    
+    // Skip whatever the checkpoint says is done, then keep appending to it
+    QSet<QString> finishedKeys;
+    if (!m_checkpointFilename.isEmpty())
+    {
+        QFile previous(m_checkpointFilename);
+        if (previous.open(QIODevice::ReadOnly | QIODevice::Text))
+        {
+            QTextStream in(&previous);
+            while (!in.atEnd())
+            {
+                const QString line = in.readLine();
+                if (!line.isEmpty())
+                    finishedKeys.insert(line);
+            }
+        }
+        
+        m_checkpointFile.setFileName(m_checkpointFilename);
+        if (!m_checkpointFile.open(QIODevice::Append | QIODevice::Text))
+        {
+            qWarning() << "Unable to write checkpoint file " << m_checkpointFilename;
+            return false;
+        }
+    }
+    
+    // Hand dies to the pool as the memory limit allows
+    WorkStealingPool pool(m_threadCount);
+    m_pool = &pool;
+    for (int i = 0; i < m_jobs.size(); i++)
+    {
+        if (finishedKeys.contains(m_jobs[i].key()))
+        {
+            m_skippedCount++;
+            continue;
+        }
+        
+        DieStatePtr state(new DieState);
+        state->job = m_jobs[i];
+        state->reservedBytes = estimateMemory(m_jobs[i]);
+        state->remainingTasks = 0;
+        state->failed = 0;
+        
+        reserveMemory(state->reservedBytes);
+        pool.submit([this, state]() { decodeTask(state); });
+    }
+    pool.waitForDone();
+    m_pool = NULL;
+    
+    if (m_checkpointFile.isOpen())
+        m_checkpointFile.close();
+    
+    qDebug() << "Batch finished:" << m_completedCount.load() << "done," << m_failedCount.load() << "failed,"
+             << m_skippedCount << "already checkpointed";
+    return m_failedCount.load() == 0;
+}
+
+
+qint64 BatchProcessor::estimateMemory(const BatchJob& job) const
+{
+    // The decoded color image plus the grayscale working copy, if any
+    const QSize size = QImageReader(job.image).size();
+    if (!size.isValid())
+        return 0;
+    
+    const qint64 pixels = (qint64)size.width() * size.height();
+    return pixels * 4 + pixels * (m_grayscaleBits / 8);
+}
+
+
+void BatchProcessor::reserveMemory(const qint64& bytes)
+{
+    // A die bigger than the whole limit still runs, just on its own
+    QMutexLocker lock(&m_memoryMutex);
+    while (m_memoryInUse > 0 && m_memoryInUse + bytes > m_memoryLimit)
+        m_memoryReleased.wait(&m_memoryMutex);
+    m_memoryInUse += bytes;
+}
+
+
+void BatchProcessor::releaseMemory(const qint64& bytes)
+{
+    QMutexLocker lock(&m_memoryMutex);
+    m_memoryInUse -= bytes;
+    m_memoryReleased.wakeAll();
+}
+
+
+void BatchProcessor::decodeTask(const DieStatePtr& state)
+{
+    if (!state->die.loadJson(state->job.dieDescription))
+    {
+        qWarning() << "Unable to load die description file " << state->job.dieDescription;
+        state->failed = 1;
+        finishDie(state);
+        return;
+    }
+    
+    QImage image;
+    if (!image.load(state->job.image))
+    {
+        qWarning() << "Unable to load image file " << state->job.image;
+        state->failed = 1;
+        finishDie(state);
+        return;
+    }
+    
+    // The color image goes as soon as the grayscale one exists
+    if (m_grayscaleBits == 8)
+        image = ImageSampler::luminanceImage(image, QImage::Format_Grayscale8);
+    else if (m_grayscaleBits == 16)
+        image = ImageSampler::luminanceImage(image, QImage::Format_Grayscale16);
+    state->sampler = ImageSampler(image);
+    
+    m_pool->submit([this, state]() { locateTask(state); });
+}
+
+
+void BatchProcessor::locateTask(const DieStatePtr& state)
+{
+    const DieGeometry geometry(state->die.boundsPoints());
+    if (!geometry.isValid())
+    {
+        qWarning() << "The die description needs exactly 4 bounds points: " << state->job.dieDescription;
+        state->failed = 1;
+        finishDie(state);
+        return;
+    }
+    state->bitLocations = geometry.computeBitLocations(state->die.horizontalSlices(), state->die.verticalSlices());
+    
+    // One task per output tile - all of them counted before any can finish
+    const QSize bitCount = state->die.bitCount();
+    const QSize bitTiles = state->job.bitsOutput.isEmpty() ? QSize(0, 0) : BitExporter::tileCount(bitCount, QSize(8, 8));
+    const QSize slicedTiles = state->job.slicedOutput.isEmpty() ? QSize(0, 0) : BitExporter::tileCount(bitCount, QSize(16, 32));
+    state->remainingTasks = bitTiles.width() * bitTiles.height() + slicedTiles.width() * slicedTiles.height();
+    if (state->remainingTasks.load() == 0)
+    {
+        finishDie(state);
+        return;
+    }
+    
+    for (int y = 0; y < bitTiles.height(); y++)
+        for (int x = 0; x < bitTiles.width(); x++)
+            m_pool->submit([this, state, x, y]() { exportTask(state, false, x, y); });
+    for (int y = 0; y < slicedTiles.height(); y++)
+        for (int x = 0; x < slicedTiles.width(); x++)
+            m_pool->submit([this, state, x, y]() { exportTask(state, true, x, y); });
+}
+
+
+void BatchProcessor::exportTask(const DieStatePtr& state, const bool& sliced, const int& tileX, const int& tileY)
+{
+    const QPoint tile(tileX, tileY);
+    
+    bool success;
+    if (sliced)
+    {
+        const QImage result = BitExporter::renderSlicedImage(state->sampler, state->bitLocations, tile, m_radius);
+        success = result.save(BitExporter::tileFilename(state->job.slicedOutput, tile, ".png"));
+    }
+    else
+    {
+        const QImage result = BitExporter::renderBitImage(state->sampler, state->bitLocations, tile, m_radius);
+        success = result.save(BitExporter::tileFilename(state->job.bitsOutput, tile));
+    }
+    
+    if (!success)
+    {
+        qWarning() << "Unable to write tile" << tileX << tileY << "of" << state->job.image;
+        state->failed = 1;
+    }
+    
+    finishTask(state);
+}
+
+
+void BatchProcessor::finishTask(const DieStatePtr& state)
+{
+    if (!state->remainingTasks.deref())
+        finishDie(state);
+}
+
+
+void BatchProcessor::finishDie(const DieStatePtr& state)
+{
+    // Drop the pixels before handing their budget to the next die
+    state->sampler = ImageSampler();
+    state->bitLocations = BitLocationStore();
+    releaseMemory(state->reservedBytes);
+    
+    if (state->failed.load())
+    {
+        m_failedCount.ref();
+        return;
+    }
+    
+    m_completedCount.ref();
+    if (m_checkpointFile.isOpen())
+    {
+        QMutexLocker lock(&m_checkpointMutex);
+        m_checkpointFile.write((state->job.key() + "\n").toUtf8());
+        m_checkpointFile.flush();
+    }
+}
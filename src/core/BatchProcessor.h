@@ -0,0 +1,101 @@
+#ifndef DIETOY_BATCH_PROCESSOR_H
+#define DIETOY_BATCH_PROCESSOR_H
+
+#include <QSet>
+#include <QFile>
+#include <QMutex>
+#include <QString>
+#include <QVector>
+#include <QAtomicInt>
+#include <QWaitCondition>
+#include <QSharedPointer>
+
+class WorkStealingPool;
+
+
+/// Batch processing //////////////////////////////////////////////////////////
+
+// One die of a campaign: its image, its DDF and where its exports go
+// (either output may be empty)
+struct BatchJob
+{
+    QString image;
+    QString dieDescription;
+    QString bitsOutput;
+    QString slicedOutput;
+    
+    // Identifies the job in the checkpoint file
+    QString key() const { return image + "\t" + dieDescription; }
+};
+
+
+// Runs the bit exports for every die in a manifest on a work-stealing pool.
+// Each die becomes a decode task (DDF + image), a bit location task and a task per
+// export tile, so big dies spread over every core while small ones fill the gaps.
+// Dies are only started while their decoded images fit the memory limit, and each
+// finished die is appended to the checkpoint file so an interrupted run picks up
+// where it stopped.
+class BatchProcessor
+{
+public:
+    BatchProcessor();
+    ~BatchProcessor();
+
+    // JSON manifest - { "version": 1, "jobs": [ { "image", "dieDescription", "bits", "sliced" } ] }
+    // with relative paths taken from the manifest's directory
+    bool loadManifest(const QString& filename);
+    const QVector<BatchJob>& jobs() const { return m_jobs; }
+    void setJobs(const QVector<BatchJob>& jobs) { m_jobs = jobs; }
+
+    void setThreadCount(const int& threadCount) { m_threadCount = threadCount; }
+    void setMemoryLimit(const qint64& bytes) { m_memoryLimit = bytes; }
+    void setCheckpointFilename(const QString& filename) { m_checkpointFilename = filename; }
+    void setGrayscaleBits(const int& bits) { m_grayscaleBits = bits; }
+    void setRadius(const int& radius) { m_radius = radius; }
+
+    // True when every job not already in the checkpoint succeeded
+    bool run();
+
+    int completedCount() const { return m_completedCount.load(); }
+    int failedCount() const { return m_failedCount.load(); }
+    int skippedCount() const { return m_skippedCount; }
+
+private:
+    struct DieState;
+    typedef QSharedPointer<DieState> DieStatePtr;
+
+    qint64 estimateMemory(const BatchJob& job) const;
+    void reserveMemory(const qint64& bytes);
+    void releaseMemory(const qint64& bytes);
+
+    void decodeTask(const DieStatePtr& state);
+    void locateTask(const DieStatePtr& state);
+    void exportTask(const DieStatePtr& state, const bool& sliced, const int& tileX, const int& tileY);
+    void finishTask(const DieStatePtr& state);
+    void finishDie(const DieStatePtr& state);
+
+    QVector<BatchJob> m_jobs;
+
+    int m_threadCount;
+    qint64 m_memoryLimit;
+    QString m_checkpointFilename;
+    int m_grayscaleBits;
+    int m_radius;
+
+    WorkStealingPool* m_pool;
+
+    // Decoded image bytes of the dies in flight
+    QMutex m_memoryMutex;
+    QWaitCondition m_memoryReleased;
+    qint64 m_memoryInUse;
+
+    QMutex m_checkpointMutex;
+    QFile m_checkpointFile;
+
+    QAtomicInt m_completedCount;
+    QAtomicInt m_failedCount;
+    int m_skippedCount;
+};
+
+
+#endif // DIETOY_BATCH_PROCESSOR_H
@@ -0,0 +1,144 @@
+#include "BitClassifier.h"
+
+#include <QtGlobal>
+
+#include <cmath>
+
+
+QVector<float> BitClassifier::patchMeans(const float* patches, const int& count, const int& patchSize)
+{
+    QVector<float> means(count);
+    float* meanData = means.data();
+    
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < count; i++)
+    {
+        const float* patch = patches + (qint64)i * patchSize;
+        double sum = 0.0;
+        for (int p = 0; p < patchSize; p++)
+            sum += patch[p];
+        meanData[i] = (patchSize > 0) ? static_cast<float>(sum / patchSize) : 0.0f;
+    }
+    
+    return means;
+}
+
+
+QVector<float> BitClassifier::patchContrasts(const float* patches, const int& count, const int& patchSize)
+{
+    QVector<float> contrasts(count);
+    float* contrastData = contrasts.data();
+    
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < count; i++)
+    {
+        const float* patch = patches + (qint64)i * patchSize;
+        double sum = 0.0;
+        double sumSq = 0.0;
+        for (int p = 0; p < patchSize; p++)
+        {
+            sum += patch[p];
+            sumSq += patch[p] * patch[p];
+        }
+        const double mean = (patchSize > 0) ? sum / patchSize : 0.0;
+        const double variance = (patchSize > 0) ? sumSq / patchSize - mean * mean : 0.0;
+        contrastData[i] = static_cast<float>(std::sqrt(qMax(variance, 0.0)));
+    }
+    
+    return contrasts;
+}
+
+
+float BitClassifier::otsuThreshold(const QVector<float>& values)
+{
+    if (values.isEmpty())
+        return 0.5f;
+    
+    // Histogram
+    const int binCount = 256;
+    QVector<int> histogram(binCount, 0);
+    double total = 0.0;
+    for (int i = 0; i < values.size(); i++)
+    {
+        const int bin = qBound(0, static_cast<int>(values[i] * (binCount - 1) + 0.5f), binCount - 1);
+        histogram[bin]++;
+        total += bin;
+    }
+    
+    // Maximize the between-class variance
+    const double n = values.size();
+    double backgroundSum = 0.0;
+    double backgroundWeight = 0.0;
+    double bestVariance = -1.0;
+    int bestBin = binCount / 2;
+    for (int t = 0; t < binCount; t++)
+    {
+        backgroundWeight += histogram[t];
+        if (backgroundWeight == 0.0)
+            continue;
+        const double foregroundWeight = n - backgroundWeight;
+        if (foregroundWeight == 0.0)
+            break;
+        
+        backgroundSum += (double)t * histogram[t];
+        const double backgroundMean = backgroundSum / backgroundWeight;
+        const double foregroundMean = (total - backgroundSum) / foregroundWeight;
+        const double variance = backgroundWeight * foregroundWeight *
+                                (backgroundMean - foregroundMean) * (backgroundMean - foregroundMean);
+        if (variance > bestVariance)
+        {
+            bestVariance = variance;
+            bestBin = t;
+        }
+    }
+    
+    // Split halfway between the last background bin and the next one
+    return (bestBin + 0.5f) / (binCount - 1);
+}
+
+
+QVector<quint8> BitClassifier::classify(const float* patches,
+                                        const int& count,
+                                        const int& patchSize,
+                                        const bool& darkIsOne,
+                                        const float& threshold,
+                                        float* usedThreshold)
+{
+    return classifyMeans(patchMeans(patches, count, patchSize), darkIsOne, threshold, usedThreshold);
+}
+
+
+QVector<quint8> BitClassifier::classifyMeans(const QVector<float>& means,
+                                             const bool& darkIsOne,
+                                             const float& threshold,
+                                             float* usedThreshold)
+{
+    const float cut = (threshold < 0.0f) ? otsuThreshold(means) : threshold;
+    if (usedThreshold)
+        *usedThreshold = cut;
+    
+    QVector<quint8> bits(means.size());
+    for (int i = 0; i < means.size(); i++)
+    {
+        const bool bright = means[i] > cut;
+        bits[i] = (bright != darkIsOne) ? 1 : 0;
+    }
+    
+    return bits;
+}
+
+
+QVector<quint8> BitClassifier::confidences(const QVector<float>& means, const float& threshold)
+{
+    QVector<quint8> results(means.size());
+    const float brightRange = qMax(1.0f - threshold, 1e-6f);
+    const float darkRange = qMax(threshold, 1e-6f);
+    for (int i = 0; i < means.size(); i++)
+    {
+        const float distance = means[i] - threshold;
+        const float relative = (distance > 0.0f) ? distance / brightRange : -distance / darkRange;
+        results[i] = static_cast<quint8>(qBound(0.0f, relative * 255.0f + 0.5f, 255.0f));
+    }
+    
+    return results;
+}
@@ -0,0 +1,44 @@
+#ifndef DIETOY_BIT_CLASSIFIER_H
+#define DIETOY_BIT_CLASSIFIER_H
+
+#include <QVector>
+
+
+/// Classifier ////////////////////////////////////////////////////////////////
+
+// Turns bit patches into bit values by thresholding each patch's mean luminance.
+// Patches are packed luminance values in [0, 1] as ImageSampler::luminancePatches
+// writes them.  Stateless like BitExporter.
+class BitClassifier
+{
+public:
+    // Mean of each patchSize-float patch
+    static QVector<float> patchMeans(const float* patches, const int& count, const int& patchSize);
+
+    // Standard deviation of each patchSize-float patch - how much contrast it has
+    static QVector<float> patchContrasts(const float* patches, const int& count, const int& patchSize);
+
+    // Otsu's threshold over values in [0, 1] (256 histogram bins)
+    static float otsuThreshold(const QVector<float>& values);
+
+    // 1 for bright bits, 0 for dark ones (inverted when darkIsOne).  The Otsu threshold
+    // is used unless one is given, and is handed back through usedThreshold.
+    static QVector<quint8> classify(const float* patches,
+                                    const int& count,
+                                    const int& patchSize,
+                                    const bool& darkIsOne = false,
+                                    const float& threshold = -1.0f,
+                                    float* usedThreshold = NULL);
+
+    // 0-255 per bit - how far each mean sits from the threshold, relative to the furthest it could be
+    static QVector<quint8> confidences(const QVector<float>& means, const float& threshold);
+
+    // The same from precomputed patch means
+    static QVector<quint8> classifyMeans(const QVector<float>& means,
+                                         const bool& darkIsOne = false,
+                                         const float& threshold = -1.0f,
+                                         float* usedThreshold = NULL);
+};
+
+
+#endif // DIETOY_BIT_CLASSIFIER_H
@@ -0,0 +1,159 @@
+#include "BitExporter.h"
+
+#include <QDebug>
+#include <QRect>
+
+#include <cmath>
+
+
+bool BitExporter::exportBitImages(const ImageSampler& sampler,
+                                  const BitLocationStore& bitLocations,
+                                  const QString& filename,
+                                  const int& radius,
+                                  const QSize& bitsPerImage)
+{
+    const QSize tiles = tileCount(bitLocations.bitCount(), bitsPerImage);
+    qDebug() << "Exporting " << tiles.width() << "images by" << tiles.height();
+    
+    bool success = true;
+    for (int y = 0; y < tiles.height(); y++)
+    {
+        for (int x = 0; x < tiles.width(); x++)
+        {
+            const QImage result = renderBitImage(sampler, bitLocations, QPoint(x, y), radius, bitsPerImage);
+            success &= result.save(tileFilename(filename, QPoint(x, y)));
+        }
+    }
+    
+    return success;
+}
+
+
+bool BitExporter::exportSlicedImages(const ImageSampler& sampler,
+                                     const BitLocationStore& bitLocations,
+                                     const QString& filenamePrefix,
+                                     const int& radius,
+                                     const QSize& bitsPerImage)
+{
+    const QSize tiles = tileCount(bitLocations.bitCount(), bitsPerImage);
+    qDebug() << "Exporting " << tiles.width() << "images by" << tiles.height();
+    
+    bool success = true;
+    for (int y = 0; y < tiles.height(); y++)
+    {
+        for (int x = 0; x < tiles.width(); x++)
+        {
+            const QImage subImage = renderSlicedImage(sampler, bitLocations, QPoint(x, y), radius, bitsPerImage);
+            success &= subImage.save(tileFilename(filenamePrefix, QPoint(x, y), ".png"));
+        }
+    }
+    
+    return success;
+}
+
+
+QSize BitExporter::tileCount(const QSize& bitCount, const QSize& bitsPerImage)
+{
+    return QSize(ceilf((float)bitCount.width() / (float)bitsPerImage.width()),
+                 ceilf((float)bitCount.height() / (float)bitsPerImage.height()));
+}
+
+
+QImage BitExporter::renderBitImage(const ImageSampler& sampler,
+                                   const BitLocationStore& bitLocations,
+                                   const QPoint& tile,
+                                   const int& radius,
+                                   const QSize& bitsPerImage)
+{
+    const int sliceBitWidth = bitsPerImage.width();
+    const int sliceBitHeight = bitsPerImage.height();
+    const int vertBitCount = bitLocations.rows();
+    const int horizBitCount = bitLocations.columns();
+
+    // Every image has room for a full tile, with a red bar before and after each bit
+    const int singleDim = radius * 2 + 1;
+    const QSize resultImageSize(singleDim * sliceBitWidth + sliceBitWidth + 1,
+                                singleDim * sliceBitHeight + sliceBitHeight + 1);
+    QImage result(resultImageSize, QImage::Format_RGB32);
+    result.fill(QColor(255, 0, 0));
+
+    // The bits in this tile (the last tile in each direction may be short)
+    const int firstRow = tile.y() * sliceBitHeight;
+    const int firstCol = tile.x() * sliceBitWidth;
+    const int endRow = qMin(firstRow + sliceBitHeight, vertBitCount);
+    const int endCol = qMin(firstCol + sliceBitWidth, horizBitCount);
+    for (int row = firstRow; row < endRow; row++)
+    {
+        for (int col = firstCol; col < endCol; col++)
+        {
+            const int i = row * horizBitCount + col;
+            const QPointF location = bitLocations[i];
+            
+            // Destination of this bit's patch
+            const int xBitIndex = col - firstCol;
+            const int yBitIndex = row - firstRow;
+            const int xResultOffset = (xBitIndex * singleDim) + xBitIndex + 1;
+            const int yResultOffset = (yBitIndex * singleDim) + yBitIndex + 1;
+            
+            // Splat data from the original image to the result image
+            for (int y = 0; y < singleDim; y++)
+            {
+                for (int x = 0; x < singleDim; x++)
+                {
+                    // TODO: Bilinear pixel sampling (concatenating bitLocation to an int isn't so cool)
+                    const int originalImageX = location.x() + x - radius;
+                    const int originalImageY = location.y() + y - radius;
+                    if (!sampler.valid(originalImageX, originalImageY))
+                        continue;
+                    result.setPixel(xResultOffset+x, yResultOffset+y, sampler.pixel(originalImageX, originalImageY));
+                }
+            }
+        }
+    }
+
+    result.setText("bitImageWidth", QString::number(singleDim));
+    result.setText("bitImageHeight", QString::number(singleDim));
+    result.setText("bitImageCountAcross", QString::number(horizBitCount));
+    result.setText("bitImageCountDown", QString::number(vertBitCount));
+    return result;
+}
+
+
+QImage BitExporter::renderSlicedImage(const ImageSampler& sampler,
+                                      const BitLocationStore& bitLocations,
+                                      const QPoint& tile,
+                                      const int& radius,
+                                      const QSize& bitsPerImage)
+{
+    const int vertBitCount = bitLocations.rows();
+    const int horizBitCount = bitLocations.columns();
+
+    // The last image in each direction may cover fewer bits
+    const int rowIndex = tile.y() * bitsPerImage.height();
+    const int colIndex = tile.x() * bitsPerImage.width();
+    const int lastRowIndex = qMin(rowIndex + bitsPerImage.height(), vertBitCount) - 1;
+    const int lastColIndex = qMin(colIndex + bitsPerImage.width(), horizBitCount) - 1;
+    const int bitIndex = (rowIndex * horizBitCount) + colIndex;
+
+    const int lowerX = bitLocations[bitIndex].x() - radius;
+    const int upperX = bitLocations[(rowIndex * horizBitCount) + lastColIndex].x() + radius;
+    const int lowerY = bitLocations[bitIndex].y() - radius;
+    const int upperY = bitLocations[(lastRowIndex * horizBitCount) + colIndex].y() + radius;
+    return sampler.image().copy(QRect(lowerX, lowerY, upperX-lowerX, upperY-lowerY));
+}
+
+
+QString BitExporter::tileFilename(const QString& filename, const QPoint& tile, const QString& extension)
+{
+    // Only a dot in the last path component starts an extension
+    const int filenameExtensionStart = filename.lastIndexOf(".");
+    const bool hasExtension = filenameExtensionStart > filename.lastIndexOf("/");
+    const QString filenameBase = hasExtension ? filename.left(filenameExtensionStart) : filename;
+    const QString filenameExtension = !extension.isEmpty() ? extension
+                                    : hasExtension ? filename.mid(filenameExtensionStart)
+                                    : QString(".png");
+    return QString("%1_%2_%3%4").arg(filenameBase)
+                                .arg(tile.x(), 2, 10, QChar('0'))
+                                .arg(tile.y(), 2, 10, QChar('0'))
+                                .arg(filenameExtension);
+}
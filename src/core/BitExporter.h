@@ -0,0 +1,56 @@
+#ifndef DIETOY_BIT_EXPORTER_H
+#define DIETOY_BIT_EXPORTER_H
+
+#include "ImageSampler.h"
+#include "BitLocationStore.h"
+
+#include <QSize>
+#include <QPoint>
+#include <QImage>
+#include <QString>
+
+
+/// Exporter //////////////////////////////////////////////////////////////////
+
+// Writes die bits out to images.  Stateless - concurrent exports of different
+// dies only share what they're handed.  Both exports cut the die into tiles of
+// bitsPerImage bits, and each tile can be rendered on its own.
+class BitExporter
+{
+public:
+    // Condensed bit images: a (radius*2+1)^2 patch per bit, bitsPerImage bits to an image,
+    // separated by red bars.  Images are named <filename base>_XX_YY<extension>.
+    static bool exportBitImages(const ImageSampler& sampler,
+                                const BitLocationStore& bitLocations,
+                                const QString& filename,
+                                const int& radius = 6,
+                                const QSize& bitsPerImage = QSize(8, 8));
+
+    // Plain crops of the die image covering bitsPerImage bits each, named <filename base>_XX_YY.png
+    static bool exportSlicedImages(const ImageSampler& sampler,
+                                   const BitLocationStore& bitLocations,
+                                   const QString& filenamePrefix,
+                                   const int& radius = 6,
+                                   const QSize& bitsPerImage = QSize(16, 32));
+
+    // Tiles across and down
+    static QSize tileCount(const QSize& bitCount, const QSize& bitsPerImage);
+
+    // Single tiles of the two exports
+    static QImage renderBitImage(const ImageSampler& sampler,
+                                 const BitLocationStore& bitLocations,
+                                 const QPoint& tile,
+                                 const int& radius = 6,
+                                 const QSize& bitsPerImage = QSize(8, 8));
+    static QImage renderSlicedImage(const ImageSampler& sampler,
+                                    const BitLocationStore& bitLocations,
+                                    const QPoint& tile,
+                                    const int& radius = 6,
+                                    const QSize& bitsPerImage = QSize(16, 32));
+
+    // <filename base>_XX_YY<extension>, keeping filename's own extension when extension is empty
+    static QString tileFilename(const QString& filename, const QPoint& tile, const QString& extension = QString());
+};
+
+
+#endif // DIETOY_BIT_EXPORTER_H
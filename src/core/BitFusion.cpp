@@ -0,0 +1,255 @@
+#include "BitFusion.h"
+#include "DieGeometry.h"
+#include "ImageSampler.h"
+#include "BitClassifier.h"
+
+#include <QDir>
+#include <QFile>
+#include <QDebug>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QImageReader>
+#include <QJsonDocument>
+
+#include <cmath>
+
+
+BitFusion::BitFusion()
+    : m_layers()
+    , m_radius(2)
+    , m_bandRows(32)
+    , m_memoryLimit(2048LL * 1024 * 1024)
+    , m_bitCount(0, 0)
+    , m_bits()
+    , m_confidences()
+    , m_votes()
+    , m_disagreements()
+    , m_memoryMutex()
+    , m_memoryReleased()
+    , m_memoryInUse(0)
+{
+    
+}
+
+
+bool BitFusion::loadManifest(const QString& filename)
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+        qWarning() << "Unable to open manifest " << filename;
+        return false;
+    }
+    
+    QJsonParseError jError;
+    const QJsonDocument jDoc = QJsonDocument::fromJson(file.readAll(), &jError);
+    if (jError.error != QJsonParseError::NoError)
+    {
+        qWarning() << "Unable to parse manifest " << filename << ":" << jError.errorString();
+        return false;
+    }
+    
+    const QJsonObject docObj = jDoc.object();
+    const int version = docObj["version"].toInt();
+    if (version > 1 || version == 0)
+    {
+        qWarning() << "Can only read manifest versions 1 or less";
+        return false;
+    }
+    
+    // Relative paths are relative to the manifest
+    const QDir manifestDir = QFileInfo(filename).absoluteDir();
+    const QJsonArray layerArray = docObj["layers"].toArray();
+    m_layers.clear();
+    for (int i = 0; i < layerArray.size(); i++)
+    {
+        const QJsonObject layerObj = layerArray[i].toObject();
+        if (layerObj["image"].toString().isEmpty() || layerObj["dieDescription"].toString().isEmpty())
+        {
+            qWarning() << "Manifest layer" << i << "needs an image and a dieDescription";
+            return false;
+        }
+        
+        FusionLayer layer;
+        layer.image = manifestDir.absoluteFilePath(layerObj["image"].toString());
+        layer.dieDescription = manifestDir.absoluteFilePath(layerObj["dieDescription"].toString());
+        layer.weight = layerObj["weight"].toDouble(1.0);
+        layer.darkIsOne = layerObj["darkIsOne"].toBool();
+        m_layers.push_back(layer);
+    }
+    
+    return true;
+}
+
+
+bool BitFusion::sampleLayer(const int& layer, QVector<float>& means) const
+{
+    DieDescription die;
+    if (!die.loadJson(m_layers[layer].dieDescription))
+    {
+        qWarning() << "Unable to load die description file " << m_layers[layer].dieDescription;
+        return false;
+    }
+    if (die.bitCount() != m_bitCount)
+    {
+        qWarning() << m_layers[layer].dieDescription << "has a different bit grid than the first layer";
+        return false;
+    }
+    
+    const DieGeometry geometry(die.boundsPoints());
+    if (!geometry.isValid())
+    {
+        qWarning() << m_layers[layer].dieDescription << "needs exactly 4 bounds points";
+        return false;
+    }
+    
+    // Decoded once - a clip rect per band would decode a JPEG from the top again for
+    // every band, and most other formats can't clip at all.  run() keeps the layers
+    // decoded at once inside the memory limit.
+    QImage image;
+    if (!image.load(m_layers[layer].image))
+    {
+        qWarning() << "Unable to load image file " << m_layers[layer].image;
+        return false;
+    }
+    const ImageSampler sampler(image);
+    
+    const int columns = m_bitCount.width();
+    const int rows = m_bitCount.height();
+    const int patchDim = m_radius * 2 + 1;
+    means.resize(columns * rows);
+    QVector<float> xs;
+    QVector<float> ys;
+    QVector<float> patches;
+    for (int firstRow = 0; firstRow < rows; firstRow += m_bandRows)
+    {
+        const int rowCount = qMin(m_bandRows, rows - firstRow);
+        const int count = rowCount * columns;
+        xs.resize(count);
+        ys.resize(count);
+        geometry.computeBitLocationRows(die.horizontalSlices(), die.verticalSlices(), firstRow, rowCount, xs.data(), ys.data());
+        
+        patches.resize(count * patchDim * patchDim);
+        sampler.luminancePatches(xs.constData(), ys.constData(), count, m_radius, patches.data());
+        const QVector<float> bandMeans = BitClassifier::patchMeans(patches.constData(), count, patchDim * patchDim);
+        std::copy(bandMeans.constBegin(), bandMeans.constEnd(), means.begin() + firstRow * columns);
+    }
+    
+    return true;
+}
+
+
+qint64 BitFusion::estimateMemory(const FusionLayer& layer) const
+{
+    // The decoded image at 32 bits a pixel
+    const QSize size = QImageReader(layer.image).size();
+    if (!size.isValid())
+        return 0;
+    
+    return (qint64)size.width() * size.height() * 4;
+}
+
+
+void BitFusion::reserveMemory(const qint64& bytes)
+{
+    // A layer bigger than the whole limit still runs, just on its own
+    QMutexLocker lock(&m_memoryMutex);
+    while (m_memoryInUse > 0 && m_memoryInUse + bytes > m_memoryLimit)
+        m_memoryReleased.wait(&m_memoryMutex);
+    m_memoryInUse += bytes;
+}
+
+
+void BitFusion::releaseMemory(const qint64& bytes)
+{
+    QMutexLocker lock(&m_memoryMutex);
+    m_memoryInUse -= bytes;
+    m_memoryReleased.wakeAll();
+}
+
+
+bool BitFusion::run()
+{
+    m_bits.clear();
+    m_confidences.clear();
+    m_votes.clear();
+    m_disagreements.clear();
+    if (m_layers.isEmpty())
+    {
+        qWarning() << "Nothing to fuse";
+        return false;
+    }
+    
+    // The first layer's grid is the one everybody has to match
+    DieDescription firstDie;
+    if (!firstDie.loadJson(m_layers[0].dieDescription))
+    {
+        qWarning() << "Unable to load die description file " << m_layers[0].dieDescription;
+        return false;
+    }
+    m_bitCount = firstDie.bitCount();
+    const int bitCount = m_bitCount.width() * m_bitCount.height();
+    
+    // As many layers at once as the memory limit holds decoded
+    const int layerCount = m_layers.size();
+    QVector<QVector<quint8> > layerBits(layerCount);
+    QVector<QVector<quint8> > layerConfidences(layerCount);
+    bool success = true;
+    
+    m_memoryInUse = 0;
+    #pragma omp parallel for schedule(dynamic)
+    for (int layer = 0; layer < layerCount; layer++)
+    {
+        const qint64 bytes = estimateMemory(m_layers[layer]);
+        reserveMemory(bytes);
+        QVector<float> means;
+        const bool sampled = sampleLayer(layer, means);
+        releaseMemory(bytes);
+        if (!sampled)
+        {
+            #pragma omp critical
+            success = false;
+            continue;
+        }
+        
+        float threshold = 0.0f;
+        layerBits[layer] = BitClassifier::classifyMeans(means, m_layers[layer].darkIsOne, -1.0f, &threshold);
+        layerConfidences[layer] = BitClassifier::confidences(means, threshold);
+    }
+    if (!success)
+        return false;
+    
+    // Weighted, confidence-scaled vote
+    m_bits.resize(bitCount);
+    m_confidences.resize(bitCount);
+    m_votes.resize(layerCount * bitCount);
+    float totalWeight = 0.0f;
+    for (int layer = 0; layer < layerCount; layer++)
+        totalWeight += qMax(m_layers[layer].weight, 0.0f);
+    
+    for (int bit = 0; bit < bitCount; bit++)
+    {
+        float score = 0.0f;
+        for (int layer = 0; layer < layerCount; layer++)
+        {
+            const float vote = qMax(m_layers[layer].weight, 0.0f) * layerConfidences[layer][bit];
+            score += layerBits[layer][bit] ? vote : -vote;
+            m_votes[layer * bitCount + bit] = layerBits[layer][bit];
+        }
+        
+        m_bits[bit] = (score > 0.0f) ? 1 : 0;
+        m_confidences[bit] = (totalWeight > 0.0f) ? static_cast<quint8>(qBound(0.0f, std::fabs(score) / totalWeight + 0.5f, 255.0f)) : 0;
+        for (int layer = 0; layer < layerCount; layer++)
+        {
+            if (layerBits[layer][bit] != m_bits[bit])
+            {
+                m_disagreements.push_back(bit);
+                break;
+            }
+        }
+    }
+    
+    qDebug() << "Fused" << layerCount << "layers," << m_disagreements.size() << "bits where they disagree";
+    return true;
+}
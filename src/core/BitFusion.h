@@ -0,0 +1,82 @@
+#ifndef DIETOY_BIT_FUSION_H
+#define DIETOY_BIT_FUSION_H
+
+#include "DieDescription.h"
+
+#include <QSize>
+#include <QMutex>
+#include <QString>
+#include <QVector>
+#include <QWaitCondition>
+
+
+/// Multi-capture bit fusion //////////////////////////////////////////////////
+
+// One capture of the die: its image, the description placing the bit grid on
+// it, how much its vote counts and whether its bits read dark-as-one
+struct FusionLayer
+{
+    QString image;
+    QString dieDescription;
+    float weight;
+    bool darkIsOne;
+};
+
+
+// Classifies every bit from several captures of the same die at once.  Each
+// layer decodes its image once and samples its own bit positions a band of rows
+// at a time, and the layers run concurrently while their decoded images fit the
+// memory limit.  Each layer's Otsu vote counts for its weight times its
+// confidence, and bits where any layer voted against the result are reported
+// as disagreements.  Every layer's description has to have the same bit grid.
+class BitFusion
+{
+public:
+    BitFusion();
+
+    // JSON manifest - { "version": 1, "layers": [ { "image", "dieDescription", "weight", "darkIsOne" } ] }
+    // with relative paths taken from the manifest's directory
+    bool loadManifest(const QString& filename);
+    const QVector<FusionLayer>& layers() const { return m_layers; }
+    void setLayers(const QVector<FusionLayer>& layers) { m_layers = layers; }
+
+    void setRadius(const int& radius) { m_radius = radius; }
+    void setBandRows(const int& rows) { m_bandRows = rows; }
+    void setMemoryLimit(const qint64& bytes) { m_memoryLimit = bytes; }
+
+    bool run();
+
+    QSize bitCount() const { return m_bitCount; }
+    const QVector<quint8>& bits() const { return m_bits; }
+    const QVector<quint8>& confidences() const { return m_confidences; }
+
+    // Every layer's vote, layer-major (votes[layer * bitCount + bit])
+    const QVector<quint8>& votes() const { return m_votes; }
+    const QVector<int>& disagreements() const { return m_disagreements; }
+
+private:
+    bool sampleLayer(const int& layer, QVector<float>& means) const;
+
+    qint64 estimateMemory(const FusionLayer& layer) const;
+    void reserveMemory(const qint64& bytes);
+    void releaseMemory(const qint64& bytes);
+
+    QVector<FusionLayer> m_layers;
+    int m_radius;
+    int m_bandRows;
+    qint64 m_memoryLimit;
+
+    QSize m_bitCount;
+    QVector<quint8> m_bits;
+    QVector<quint8> m_confidences;
+    QVector<quint8> m_votes;
+    QVector<int> m_disagreements;
+
+    // Decoded image bytes of the layers in flight
+    QMutex m_memoryMutex;
+    QWaitCondition m_memoryReleased;
+    qint64 m_memoryInUse;
+};
+
+
+#endif // DIETOY_BIT_FUSION_H
@@ -0,0 +1,85 @@
+#include "BitGrid.h"
+
+
+BitGrid::BitGrid()
+    : m_locations()
+    , m_index()
+    , m_boundsPoints()
+    , m_horizontalSlices()
+    , m_verticalSlices()
+{
+
+}
+
+
+void BitGrid::clear()
+{
+    m_locations = BitLocationStore();
+    m_index.clear();
+    m_boundsPoints.clear();
+    m_horizontalSlices.clear();
+    m_verticalSlices.clear();
+}
+
+
+void BitGrid::compute(const DieGeometry& geometry, const SliceList& horizSlices, const SliceList& vertSlices)
+{
+    m_locations = geometry.computeBitLocations(horizSlices, vertSlices);
+    m_index.build(m_locations);
+    m_boundsPoints = geometry.boundsPoints();
+    m_horizontalSlices = horizSlices.positions();
+    m_verticalSlices = vertSlices.positions();
+}
+
+
+bool BitGrid::update(const DieGeometry& geometry, const SliceList& horizSlices, const SliceList& vertSlices)
+{
+    if (!geometry.isValid() || m_locations.isEmpty() || geometry.boundsPoints() != m_boundsPoints ||
+        horizSlices.size() != m_horizontalSlices.size() || vertSlices.size() != m_verticalSlices.size())
+        return false;
+
+    const QVector<int> rows = movedLines(m_verticalSlices, vertSlices.positions());
+    const QVector<int> columns = movedLines(m_horizontalSlices, horizSlices.positions());
+    if (rows.isEmpty() && columns.isEmpty())
+        return true;
+
+    // Written in place, so every copy of the store sees it: this grid's index, which only
+    // re-buckets the bits that moved, and for a moment after MainWindow adopts a background
+    // compute, the finished worker's grid, which is only waiting to be deleted
+    geometry.updateBitLocations(horizSlices, vertSlices, rows, columns, m_locations);
+    m_index.update(lineBits(rows, columns));
+    m_horizontalSlices = horizSlices.positions();
+    m_verticalSlices = vertSlices.positions();
+    return true;
+}
+
+
+QVector<int> BitGrid::movedLines(const QVector<qreal>& before, const QVector<qreal>& after)
+{
+    QVector<int> moved;
+    for (int i = 0; i < after.size(); i++)
+    {
+        if (before[i] != after[i])
+            moved.push_back(i + 1);
+    }
+    return moved;
+}
+
+
+QVector<int> BitGrid::lineBits(const QVector<int>& rows, const QVector<int>& columns) const
+{
+    const int columnCount = m_locations.columns();
+    QVector<int> bits;
+    bits.reserve(rows.size() * columnCount + columns.size() * m_locations.rows());
+    for (int r = 0; r < rows.size(); r++)
+    {
+        for (int x = 0; x < columnCount; x++)
+            bits.push_back(rows[r] * columnCount + x);
+    }
+    for (int c = 0; c < columns.size(); c++)
+    {
+        for (int y = 0; y < m_locations.rows(); y++)
+            bits.push_back(y * columnCount + columns[c]);
+    }
+    return bits;
+}
@@ -0,0 +1,51 @@
+#ifndef DIETOY_BIT_GRID_H
+#define DIETOY_BIT_GRID_H
+
+#include "SliceList.h"
+#include "DieGeometry.h"
+#include "BitLocationIndex.h"
+#include "BitLocationStore.h"
+
+#include <QVector>
+#include <QPointF>
+
+
+/// Bit grid //////////////////////////////////////////////////////////////////
+
+// The bit locations and their spatial index, along with the bounds and slice
+// positions they were computed from.  When only some slices have moved since,
+// update() recomputes just the rows and columns on those slices; anything that
+// changes the bit count or the homography needs a full compute().
+class BitGrid
+{
+public:
+    BitGrid();
+
+    const BitLocationStore& locations() const { return m_locations; }
+    const BitLocationIndex& index() const { return m_index; }
+    bool isEmpty() const { return m_locations.isEmpty(); }
+    void clear();
+
+    void compute(const DieGeometry& geometry, const SliceList& horizSlices, const SliceList& vertSlices);
+
+    // False (leaving the grid as it was) when a full compute is needed instead
+    bool update(const DieGeometry& geometry, const SliceList& horizSlices, const SliceList& vertSlices);
+
+private:
+    // Row or column indices (1-based, after the bounds edge) of the slices that moved
+    static QVector<int> movedLines(const QVector<qreal>& before, const QVector<qreal>& after);
+
+    // Every bit on those rows and columns (the crossings twice)
+    QVector<int> lineBits(const QVector<int>& rows, const QVector<int>& columns) const;
+
+    BitLocationStore m_locations;
+    BitLocationIndex m_index;
+
+    // What the locations were computed from
+    QVector<QPointF> m_boundsPoints;
+    QVector<qreal> m_horizontalSlices;
+    QVector<qreal> m_verticalSlices;
+};
+
+
+#endif // DIETOY_BIT_GRID_H
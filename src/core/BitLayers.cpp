@@ -0,0 +1,206 @@
+#include "BitLayers.h"
+
+#include <QDebug>
+
+
+BitLayers::BitLayers()
+    : m_bitCount(0, 0)
+    , m_values()
+    , m_confidence()
+    , m_overrides()
+    , m_ignore()
+{
+    
+}
+
+
+void BitLayers::resize(const QSize& bitCount)
+{
+    m_bitCount = bitCount;
+    const int count = size();
+    const int packedBytes = (count + 7) / 8;
+    m_values.fill(0, packedBytes);
+    m_confidence.fill(0, count);
+    m_overrides.fill(0, packedBytes);
+    m_ignore.fill(0, packedBytes);
+}
+
+
+bool BitLayers::isBlank() const
+{
+    return m_values.count('\0') == m_values.size() && m_confidence.count('\0') == m_confidence.size() &&
+           m_overrides.count('\0') == m_overrides.size();
+}
+
+
+QVector<quint8> BitLayers::values() const
+{
+    // Unpacked to a byte per bit
+    QVector<quint8> unpacked(size());
+    for (int i = 0; i < unpacked.size(); i++)
+        unpacked[i] = value(i) ? 1 : 0;
+    return unpacked;
+}
+
+
+void BitLayers::applyClassification(const QVector<quint8>& values, const QVector<quint8>& confidences)
+{
+    const int count = qMin(size(), values.size());
+    for (int i = 0; i < count; i++)
+    {
+        if (isOverridden(i))
+            continue;
+        
+        setValue(i, values[i] != 0);
+        setConfidence(i, (i < confidences.size()) ? confidences[i] : 0);
+    }
+}
+
+
+BitLayers BitLayers::takeLines(const bool& columns, const QVector<int>& lines)
+{
+    // Where each line goes - a line of the kept grid, or (-1 - i) for line i of the taken one
+    const int lineCount = columns ? m_bitCount.width() : m_bitCount.height();
+    QVector<int> destination(lineCount);
+    int taken = 0;
+    for (int line = 0; line < lineCount; line++)
+    {
+        if (taken < lines.size() && lines[taken] == line)
+            destination[line] = -1 - taken++;
+        else
+            destination[line] = line - taken;
+    }
+    if (taken != lines.size())
+    {
+        qWarning() << "Bit layer lines to take are out of order or outside the grid";
+        return BitLayers();
+    }
+    
+    const QSize lineSize = columns ? QSize(1, m_bitCount.height()) : QSize(m_bitCount.width(), 1);
+    BitLayers kept;
+    BitLayers removed;
+    kept.resize(columns ? QSize(lineCount - taken, lineSize.height()) : QSize(lineSize.width(), lineCount - taken));
+    removed.resize(columns ? QSize(taken, lineSize.height()) : QSize(lineSize.width(), taken));
+    for (int row = 0; row < m_bitCount.height(); row++)
+    {
+        for (int col = 0; col < m_bitCount.width(); col++)
+        {
+            const int to = destination[columns ? col : row];
+            BitLayers& target = (to >= 0) ? kept : removed;
+            const int toLine = (to >= 0) ? to : -1 - to;
+            target.copyBit(*this, index(row, col), columns ? target.index(row, toLine) : target.index(toLine, col));
+        }
+    }
+    
+    *this = kept;
+    return removed;
+}
+
+
+void BitLayers::insertLines(const bool& columns, const QVector<int>& lines, const BitLayers& contents)
+{
+    // Where each line of the grown grid comes from - an old line, or (-1 - i) for inserted line i
+    const int lineCount = (columns ? m_bitCount.width() : m_bitCount.height()) + lines.size();
+    QVector<int> source(lineCount);
+    int inserted = 0;
+    for (int line = 0; line < lineCount; line++)
+    {
+        if (inserted < lines.size() && lines[inserted] == line)
+            source[line] = -1 - inserted++;
+        else
+            source[line] = line - inserted;
+    }
+    if (inserted != lines.size())
+    {
+        qWarning() << "Bit layer lines to insert are out of order or outside the grid";
+        return;
+    }
+    
+    const QSize grownCount = columns ? QSize(lineCount, m_bitCount.height()) : QSize(m_bitCount.width(), lineCount);
+    const QSize insertedCount = columns ? QSize(inserted, m_bitCount.height()) : QSize(m_bitCount.width(), inserted);
+    const bool restore = (contents.bitCount() == insertedCount);
+    BitLayers grown;
+    grown.resize(grownCount);
+    for (int row = 0; row < grownCount.height(); row++)
+    {
+        for (int col = 0; col < grownCount.width(); col++)
+        {
+            const int from = source[columns ? col : row];
+            if (from >= 0)
+                grown.copyBit(*this, columns ? index(row, from) : index(from, col), grown.index(row, col));
+            else if (restore)
+                grown.copyBit(contents, columns ? contents.index(row, -1 - from) : contents.index(-1 - from, col), grown.index(row, col));
+        }
+    }
+    
+    *this = grown;
+}
+
+
+void BitLayers::copyBit(const BitLayers& from, const int& fromBit, const int& toBit)
+{
+    setValue(toBit, from.value(fromBit));
+    setConfidence(toBit, from.confidence(fromBit));
+    setOverridden(toBit, from.isOverridden(fromBit));
+    setIgnored(toBit, from.isIgnored(fromBit));
+}
+
+
+int BitLayers::countBits(const QByteArray& plane)
+{
+    int count = 0;
+    for (int i = 0; i < plane.size(); i++)
+    {
+        // Kernighan - one step per set bit
+        quint8 byte = static_cast<quint8>(plane[i]);
+        for (; byte; count++)
+            byte &= byte - 1;
+    }
+    return count;
+}
+
+
+QJsonObject BitLayers::toJson() const
+{
+    QJsonObject json;
+    json["columns"] = m_bitCount.width();
+    json["rows"] = m_bitCount.height();
+    json["values"] = QString::fromLatin1(m_values.toBase64());
+    json["confidence"] = QString::fromLatin1(m_confidence.toBase64());
+    json["overrides"] = QString::fromLatin1(m_overrides.toBase64());
+    json["ignore"] = QString::fromLatin1(m_ignore.toBase64());
+    return json;
+}
+
+
+bool BitLayers::fromJson(const QJsonObject& json)
+{
+    return setPlanes(QSize(json["columns"].toInt(), json["rows"].toInt()),
+                     QByteArray::fromBase64(json["values"].toString().toLatin1()),
+                     QByteArray::fromBase64(json["confidence"].toString().toLatin1()),
+                     QByteArray::fromBase64(json["overrides"].toString().toLatin1()),
+                     QByteArray::fromBase64(json["ignore"].toString().toLatin1()));
+}
+
+
+bool BitLayers::setPlanes(const QSize& bitCount, const QByteArray& values, const QByteArray& confidence,
+                          const QByteArray& overrides, const QByteArray& ignore)
+{
+    resize(bitCount);
+    const int packedBytes = (size() + 7) / 8;
+    
+    // Every plane has to be exactly as big as the bit count says
+    if (values.size() != packedBytes || confidence.size() != size() ||
+        overrides.size() != packedBytes || ignore.size() != packedBytes)
+    {
+        qWarning() << "Bit layers don't match their bit count.  Ignoring them";
+        clear();
+        return false;
+    }
+    
+    m_values = values;
+    m_confidence = confidence;
+    m_overrides = overrides;
+    m_ignore = ignore;
+    return true;
+}
@@ -0,0 +1,98 @@
+#ifndef DIETOY_BIT_LAYERS_H
+#define DIETOY_BIT_LAYERS_H
+
+#include <QSize>
+#include <QVector>
+#include <QByteArray>
+#include <QJsonObject>
+
+
+/// Per-bit state /////////////////////////////////////////////////////////////
+
+// Dense per-bit layers for a die, in the same row-major order as its bit locations:
+//   values     - the bit's value, packed 8 bits to a byte
+//   confidence - how sure the classifier was (0-255)
+//   overrides  - packed, set when the value was chosen by hand (classification leaves it alone)
+//   ignore     - packed, set for bits that shouldn't be read at all
+// About 1.4 bytes per bit, so a megabit ROM costs well under 2MB.
+class BitLayers
+{
+public:
+    BitLayers();
+
+    // Empties every layer and sizes it for bitCount (columns x rows)
+    void resize(const QSize& bitCount);
+    void clear() { resize(QSize(0, 0)); }
+
+    QSize bitCount() const { return m_bitCount; }
+    int size() const { return m_bitCount.width() * m_bitCount.height(); }
+    bool isEmpty() const { return size() == 0; }
+
+    // Nothing set yet - no values, confidences or overrides (a freshly sized grid)
+    bool isBlank() const;
+    int index(const int& row, const int& col) const { return row * m_bitCount.width() + col; }
+
+    bool value(const int& i) const { return testBit(m_values, i); }
+    bool value(const int& row, const int& col) const { return value(index(row, col)); }
+    void setValue(const int& i, const bool& on) { setBit(m_values, i, on); }
+    QVector<quint8> values() const;
+
+    quint8 confidence(const int& i) const { return static_cast<quint8>(m_confidence[i]); }
+    quint8 confidence(const int& row, const int& col) const { return confidence(index(row, col)); }
+    void setConfidence(const int& i, const quint8& confidence) { m_confidence[i] = static_cast<char>(confidence); }
+
+    bool isOverridden(const int& i) const { return testBit(m_overrides, i); }
+    bool isOverridden(const int& row, const int& col) const { return isOverridden(index(row, col)); }
+    void setOverridden(const int& i, const bool& on) { setBit(m_overrides, i, on); }
+
+    bool isIgnored(const int& i) const { return testBit(m_ignore, i); }
+    bool isIgnored(const int& row, const int& col) const { return isIgnored(index(row, col)); }
+    void setIgnored(const int& i, const bool& on) { setBit(m_ignore, i, on); }
+
+    // Takes classified values and confidences for every bit that wasn't set by hand
+    void applyClassification(const QVector<quint8>& values, const QVector<quint8>& confidences);
+
+    // Grid edits that keep every other bit's state.  lines are indices of whole columns
+    // (or rows) in the grid that has them, ascending.  takeLines() removes them and
+    // returns what they held; insertLines() puts in blank ones, or what takeLines() returned
+    BitLayers takeLines(const bool& columns, const QVector<int>& lines);
+    void insertLines(const bool& columns, const QVector<int>& lines, const BitLayers& contents = BitLayers());
+
+    int overriddenCount() const { return countBits(m_overrides); }
+    int ignoredCount() const { return countBits(m_ignore); }
+
+    // DDF representation - the packed planes as base64 strings
+    QJsonObject toJson() const;
+    bool fromJson(const QJsonObject& json);
+
+    // The raw planes, for the streaming DDF reader and writer.  setPlanes() sizes the
+    // layers for bitCount and fails (leaving them empty) if a plane doesn't fit it
+    const QByteArray& valuesPlane() const { return m_values; }
+    const QByteArray& confidencePlane() const { return m_confidence; }
+    const QByteArray& overridesPlane() const { return m_overrides; }
+    const QByteArray& ignorePlane() const { return m_ignore; }
+    bool setPlanes(const QSize& bitCount, const QByteArray& values, const QByteArray& confidence,
+                   const QByteArray& overrides, const QByteArray& ignore);
+
+private:
+    static bool testBit(const QByteArray& plane, const int& i)
+    {
+        return (static_cast<quint8>(plane.constData()[i >> 3]) >> (i & 7)) & 1;
+    }
+    static void setBit(QByteArray& plane, const int& i, const bool& on)
+    {
+        char& byte = plane.data()[i >> 3];
+        byte = on ? (byte | (1 << (i & 7))) : (byte & ~(1 << (i & 7)));
+    }
+    static int countBits(const QByteArray& plane);
+    void copyBit(const BitLayers& from, const int& fromBit, const int& toBit);
+
+    QSize m_bitCount;
+    QByteArray m_values;
+    QByteArray m_confidence;
+    QByteArray m_overrides;
+    QByteArray m_ignore;
+};
+
+
+#endif // DIETOY_BIT_LAYERS_H
@@ -0,0 +1,206 @@
+#include "BitLocationIndex.h"
+
+#include <cmath>
+
+
+BitLocationIndex::BitLocationIndex()
+    : m_points()
+    , m_origin(0.0, 0.0)
+    , m_cellSize(1.0)
+    , m_columns(0)
+    , m_rows(0)
+    , m_cellStarts()
+    , m_cellCounts()
+    , m_cellEntries()
+    , m_cellOfPoint()
+{
+    
+}
+
+
+void BitLocationIndex::build(const BitLocationStore& points)
+{
+    clear();
+    if (points.isEmpty())
+        return;
+    
+    // Shares the store's block - no copy of the locations is made
+    m_points = points;
+    const float* xs = points.xs();
+    const float* ys = points.ys();
+    
+    // Size the cells so there's about one bit in each
+    const QRectF bounds = points.boundingRect();
+    const qreal area = qMax(bounds.width() * bounds.height(), 1.0);
+    m_cellSize = qMax(std::sqrt(area / points.size()), 1.0);
+    m_origin = bounds.topLeft();
+    m_columns = static_cast<int>(bounds.width() / m_cellSize) + 1;
+    m_rows = static_cast<int>(bounds.height() / m_cellSize) + 1;
+    
+    // Counting sort of the bits into their cells, leaving each cell room for one more
+    // so nudged slices can move bits between neighbouring cells without a rebuild
+    const int cellCount = m_columns * m_rows;
+    m_cellOfPoint.resize(points.size());
+    m_cellCounts.fill(0, cellCount);
+    for (int i = 0; i < points.size(); i++)
+    {
+        m_cellOfPoint[i] = cellRow(ys[i]) * m_columns + cellColumn(xs[i]);
+        m_cellCounts[m_cellOfPoint[i]]++;
+    }
+    m_cellStarts.resize(cellCount + 1);
+    m_cellStarts[0] = 0;
+    for (int c = 0; c < cellCount; c++)
+    {
+        m_cellStarts[c + 1] = m_cellStarts[c] + m_cellCounts[c] + 1;
+    }
+    
+    m_cellCounts.fill(0);
+    m_cellEntries.resize(m_cellStarts[cellCount]);
+    for (int i = 0; i < points.size(); i++)
+    {
+        const int cell = m_cellOfPoint[i];
+        m_cellEntries[m_cellStarts[cell] + m_cellCounts[cell]++] = i;
+    }
+}
+
+
+void BitLocationIndex::update(const QVector<int>& bits)
+{
+    if (m_points.isEmpty())
+        return;
+    
+    const float* xs = m_points.xs();
+    const float* ys = m_points.ys();
+    for (int b = 0; b < bits.size(); b++)
+    {
+        const int i = bits[b];
+        const int from = m_cellOfPoint[i];
+        const int to = cellRow(ys[i]) * m_columns + cellColumn(xs[i]);
+        if (from == to)
+            continue;
+        
+        if (m_cellStarts[to] + m_cellCounts[to] == m_cellStarts[to + 1])
+        {
+            // build() clears m_points first, so hand it its own reference to the block
+            const BitLocationStore points = m_points;
+            build(points);
+            return;
+        }
+        
+        // Out of its old cell (the last entry fills the gap) and onto the end of the new one
+        const int first = m_cellStarts[from];
+        const int last = first + m_cellCounts[from] - 1;
+        for (int e = first; e <= last; e++)
+        {
+            if (m_cellEntries[e] == i)
+            {
+                m_cellEntries[e] = m_cellEntries[last];
+                break;
+            }
+        }
+        m_cellCounts[from]--;
+        m_cellEntries[m_cellStarts[to] + m_cellCounts[to]++] = i;
+        m_cellOfPoint[i] = to;
+    }
+}
+
+
+void BitLocationIndex::clear()
+{
+    m_points = BitLocationStore();
+    m_cellStarts.clear();
+    m_cellCounts.clear();
+    m_cellEntries.clear();
+    m_cellOfPoint.clear();
+    m_columns = 0;
+    m_rows = 0;
+}
+
+
+int BitLocationIndex::nearest(const QPointF& point) const
+{
+    if (m_points.isEmpty())
+        return -1;
+    
+    // Walk outward in square rings of cells until nothing further out can be closer
+    const int cx = cellColumn(point.x());
+    const int cy = cellRow(point.y());
+    const int maxRing = qMax(m_columns, m_rows);
+    
+    int best = -1;
+    qreal bestDistanceSq = 0.0;
+    for (int ring = 0; ring <= maxRing; ring++)
+    {
+        for (int y = cy - ring; y <= cy + ring; y++)
+        {
+            if (y < 0 || y >= m_rows)
+                continue;
+            
+            // Interior rows of the ring only contribute their two end cells
+            const bool edgeRow = (y == cy - ring || y == cy + ring);
+            const int step = edgeRow ? 1 : qMax(ring * 2, 1);
+            for (int x = cx - ring; x <= cx + ring; x += step)
+            {
+                if (x < 0 || x >= m_columns)
+                    continue;
+                
+                const int cell = y * m_columns + x;
+                for (int e = m_cellStarts[cell]; e < m_cellStarts[cell] + m_cellCounts[cell]; e++)
+                {
+                    const QPointF delta = m_points[m_cellEntries[e]] - point;
+                    const qreal distanceSq = delta.x() * delta.x() + delta.y() * delta.y();
+                    if (best == -1 || distanceSq < bestDistanceSq)
+                    {
+                        best = m_cellEntries[e];
+                        bestDistanceSq = distanceSq;
+                    }
+                }
+            }
+        }
+        
+        const qreal ringReach = ring * m_cellSize;
+        if (best != -1 && bestDistanceSq <= ringReach * ringReach)
+            break;
+    }
+    
+    return best;
+}
+
+
+QVector<int> BitLocationIndex::inRect(const QRectF& rect) const
+{
+    QVector<int> results;
+    if (m_points.isEmpty())
+        return results;
+    
+    const int x0 = cellColumn(rect.left());
+    const int x1 = cellColumn(rect.right());
+    const int y0 = cellRow(rect.top());
+    const int y1 = cellRow(rect.bottom());
+    for (int y = y0; y <= y1; y++)
+    {
+        for (int x = x0; x <= x1; x++)
+        {
+            const int cell = y * m_columns + x;
+            for (int e = m_cellStarts[cell]; e < m_cellStarts[cell] + m_cellCounts[cell]; e++)
+            {
+                if (rect.contains(m_points[m_cellEntries[e]]))
+                    results.push_back(m_cellEntries[e]);
+            }
+        }
+    }
+    
+    return results;
+}
+
+
+int BitLocationIndex::cellColumn(const qreal& x) const
+{
+    return qBound(0, static_cast<int>(std::floor((x - m_origin.x()) / m_cellSize)), m_columns - 1);
+}
+
+
+int BitLocationIndex::cellRow(const qreal& y) const
+{
+    return qBound(0, static_cast<int>(std::floor((y - m_origin.y()) / m_cellSize)), m_rows - 1);
+}
@@ -0,0 +1,57 @@
+#ifndef DIETOY_BIT_LOCATION_INDEX_H
+#define DIETOY_BIT_LOCATION_INDEX_H
+
+#include "BitLocationStore.h"
+
+#include <QRectF>
+#include <QVector>
+#include <QPointF>
+
+
+/// Uniform-grid spatial index over image-space bit locations /////////////////
+
+// Bits sit on a roughly regular grid, so bucketing them into cells about one bit
+// pitch across leaves ~1 bit per cell and nearest-bit queries only ever have to
+// look at the handful of cells around the query point.
+class BitLocationIndex
+{
+public:
+    BitLocationIndex();
+
+    void build(const BitLocationStore& points);
+    void clear();
+
+    // Re-buckets just these bits after their locations were changed in the shared
+    // store, falling back to a full build if a cell runs out of room
+    void update(const QVector<int>& bits);
+    bool isEmpty() const { return m_points.isEmpty(); }
+
+    // Roughly the bit pitch in image pixels
+    const qreal& cellSize() const { return m_cellSize; }
+
+    // Index of the closest bit, -1 if there are none
+    int nearest(const QPointF& point) const;
+    
+    // Indices of every bit inside the rectangle
+    QVector<int> inRect(const QRectF& rect) const;
+
+private:
+    int cellColumn(const qreal& x) const;
+    int cellRow(const qreal& y) const;
+
+    BitLocationStore m_points;
+    QPointF m_origin;
+    qreal m_cellSize;
+    int m_columns;
+    int m_rows;
+    
+    // Bit indices bucketed by cell - cell c owns m_cellEntries[m_cellStarts[c] .. m_cellStarts[c+1]),
+    // the first m_cellCounts[c] of them in use and the rest room for bits moving in
+    QVector<int> m_cellStarts;
+    QVector<int> m_cellCounts;
+    QVector<int> m_cellEntries;
+    QVector<int> m_cellOfPoint;
+};
+
+
+#endif // DIETOY_BIT_LOCATION_INDEX_H
@@ -0,0 +1,63 @@
+#include "BitLocationStore.h"
+
+#include <QtGlobal>
+
+
+// Planes start on cache lines so both can be walked with vector loads
+static const size_t PlaneAlignment = 64;
+
+
+BitLocationStore::Block::Block(const int& rows, const int& columns)
+    : rows(rows)
+    , columns(columns)
+    , memory(NULL)
+    , xs(NULL)
+    , ys(NULL)
+{
+    const size_t count = (size_t)rows * columns;
+    const size_t planeBytes = ((count * sizeof(float) + PlaneAlignment - 1) / PlaneAlignment) * PlaneAlignment;
+    memory = qMallocAligned(qMax(planeBytes * 2, PlaneAlignment), PlaneAlignment);
+    Q_CHECK_PTR(memory);
+    xs = reinterpret_cast<float*>(memory);
+    ys = reinterpret_cast<float*>(reinterpret_cast<char*>(memory) + planeBytes);
+}
+
+
+BitLocationStore::Block::~Block()
+{
+    qFreeAligned(memory);
+}
+
+
+BitLocationStore::BitLocationStore()
+    : d()
+{
+    
+}
+
+
+BitLocationStore::BitLocationStore(const int& rows, const int& columns)
+    : d(new Block(qMax(rows, 0), qMax(columns, 0)))
+{
+    
+}
+
+
+QRectF BitLocationStore::boundingRect() const
+{
+    const int count = size();
+    if (count == 0)
+        return QRectF();
+    
+    float minX = d->xs[0], maxX = d->xs[0];
+    float minY = d->ys[0], maxY = d->ys[0];
+    for (int i = 1; i < count; i++)
+    {
+        minX = qMin(minX, d->xs[i]);
+        maxX = qMax(maxX, d->xs[i]);
+        minY = qMin(minY, d->ys[i]);
+        maxY = qMax(maxY, d->ys[i]);
+    }
+    
+    return QRectF(QPointF(minX, minY), QPointF(maxX, maxY));
+}
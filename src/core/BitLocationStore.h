@@ -0,0 +1,60 @@
+#ifndef DIETOY_BIT_LOCATION_STORE_H
+#define DIETOY_BIT_LOCATION_STORE_H
+
+#include <QSize>
+#include <QRectF>
+#include <QPointF>
+#include <QSharedData>
+
+
+/// Bit location storage //////////////////////////////////////////////////////
+
+// Image-space bit centres for a rows x columns die, row-major, as separate x and
+// y float planes carved out of one aligned block sized exactly for the die.
+// Copies share the block, so the view, spatial index, exporters and classifier
+// all read the same memory.  Written while the locations are generated, and in
+// place when BitGrid::update() moves the rows and columns on nudged slices.
+class BitLocationStore
+{
+public:
+    BitLocationStore();
+    BitLocationStore(const int& rows, const int& columns);
+
+    int rows() const { return d ? d->rows : 0; }
+    int columns() const { return d ? d->columns : 0; }
+    int size() const { return rows() * columns(); }
+    bool isEmpty() const { return size() == 0; }
+    QSize bitCount() const { return QSize(columns(), rows()); }
+
+    const float* xs() const { return d ? d->xs : NULL; }
+    const float* ys() const { return d ? d->ys : NULL; }
+    float* xs() { return d ? d->xs : NULL; }
+    float* ys() { return d ? d->ys : NULL; }
+
+    // Bytes from the x plane to the y plane
+    qptrdiff planeStride() const { return d ? reinterpret_cast<const char*>(d->ys) - reinterpret_cast<const char*>(d->xs) : 0; }
+
+    QPointF operator[](const int& i) const { return QPointF(d->xs[i], d->ys[i]); }
+    QPointF at(const int& row, const int& column) const { return (*this)[row * d->columns + column]; }
+    void set(const int& i, const QPointF& point) { d->xs[i] = point.x(); d->ys[i] = point.y(); }
+
+    QRectF boundingRect() const;
+
+private:
+    struct Block : public QSharedData
+    {
+        Block(const int& rows, const int& columns);
+        ~Block();
+
+        int rows;
+        int columns;
+        void* memory;
+        float* xs;
+        float* ys;
+    };
+
+    QExplicitlySharedDataPointer<Block> d;
+};
+
+
+#endif // DIETOY_BIT_LOCATION_STORE_H
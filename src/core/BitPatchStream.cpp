@@ -0,0 +1,371 @@
+#include "BitPatchStream.h"
+#include "BitExporter.h"
+#include "BitClassifier.h"
+#include "TileMosaic.h"
+
+#include <QDebug>
+#include <QtMath>
+#include <QThread>
+#include <QAtomicInt>
+#include <QSemaphore>
+
+#include <cstring>
+
+
+/// Stream ////////////////////////////////////////////////////////////////////
+
+// Fills the ring ahead of the sink.  free counts the slots the sink is done with,
+// filled the ones waiting for it.
+class BitPatchStream::Producer : public QThread
+{
+public:
+    Producer(const BitPatchStream* stream, QVector<Chunk>& ring, const int& rows,
+             QSemaphore& free, QSemaphore& filled, QAtomicInt& aborted)
+        : m_stream(stream)
+        , m_ring(ring)
+        , m_rows(rows)
+        , m_free(free)
+        , m_filled(filled)
+        , m_aborted(aborted)
+    {
+        
+    }
+
+protected:
+    void run()
+    {
+        int slot = 0;
+        for (int row = 0; row < m_rows; row += m_stream->m_chunkRows)
+        {
+            m_free.acquire();
+            if (m_aborted.load())
+                return;
+            
+            m_stream->fillChunk(m_ring[slot], row);
+            m_filled.release();
+            slot = (slot + 1) % m_ring.size();
+        }
+    }
+
+private:
+    const BitPatchStream* m_stream;
+    QVector<Chunk>& m_ring;
+    int m_rows;
+    QSemaphore& m_free;
+    QSemaphore& m_filled;
+    QAtomicInt& m_aborted;
+};
+
+
+BitPatchStream::BitPatchStream(const ImageSampler& sampler, const DieGeometry& geometry, const DieDescription& die)
+    : m_sampler(sampler)
+    , m_geometry(geometry)
+    , m_die(die)
+    , m_mosaic(NULL)
+    , m_radius(6)
+    , m_chunkRows(8)
+    , m_ringSize(2)
+    , m_patchFormats(LuminancePatches)
+    , m_outsideColor(qRgb(0, 0, 0))
+{
+    
+}
+
+
+qint64 BitPatchStream::bufferBytes() const
+{
+    const qint64 patchSize = (m_radius * 2 + 1) * (m_radius * 2 + 1);
+    qint64 bytesPerBit = 2 * sizeof(float);
+    if (m_patchFormats & LuminancePatches)
+        bytesPerBit += patchSize * sizeof(float);
+    if (m_patchFormats & ColorPatches)
+        bytesPerBit += patchSize * sizeof(QRgb);
+    
+    const int rows = qMin(m_chunkRows, m_die.bitCount().height());
+    return (qint64)m_ringSize * rows * m_die.bitCount().width() * bytesPerBit;
+}
+
+
+bool BitPatchStream::run(BitPatchSink& sink)
+{
+    if (!m_geometry.isValid())
+    {
+        qWarning() << "Can't stream bits without 4 bounds points";
+        return false;
+    }
+    
+    const QSize bitCount = m_die.bitCount();
+    const int patchDim = m_radius * 2 + 1;
+    if (!sink.begin(bitCount, patchDim))
+        return false;
+    
+    // The ring is sized once up front and reused for every chunk
+    const int chunkRows = qMin(m_chunkRows, bitCount.height());
+    const int chunkBits = chunkRows * bitCount.width();
+    QVector<Chunk> ring(m_ringSize);
+    for (int i = 0; i < ring.size(); i++)
+    {
+        ring[i].locations = BitLocationStore(chunkRows, bitCount.width());
+        if (m_patchFormats & LuminancePatches)
+            ring[i].luminance.resize(chunkBits * patchDim * patchDim);
+        if (m_patchFormats & ColorPatches)
+            ring[i].color.resize(chunkBits * patchDim * patchDim);
+    }
+    
+    QSemaphore free(ring.size());
+    QSemaphore filled(0);
+    QAtomicInt aborted(0);
+    Producer producer(this, ring, bitCount.height(), free, filled, aborted);
+    producer.start();
+    
+    bool success = true;
+    int slot = 0;
+    try
+    {
+        for (int row = 0; row < bitCount.height(); row += m_chunkRows)
+        {
+            filled.acquire();
+            const Chunk& chunk = ring[slot];
+        
+            BitPatchBatch batch;
+            batch.firstRow = chunk.firstRow;
+            batch.rowCount = chunk.rowCount;
+            batch.columns = bitCount.width();
+            batch.patchDim = patchDim;
+            batch.xs = chunk.locations.xs();
+            batch.ys = chunk.locations.ys();
+            batch.luminance = (m_patchFormats & LuminancePatches) ? chunk.luminance.constData() : NULL;
+            batch.color = (m_patchFormats & ColorPatches) ? chunk.color.constData() : NULL;
+            if (!sink.consume(batch))
+            {
+                // Let the producer see it's over whichever slot it's waiting on
+                success = false;
+                aborted = 1;
+                free.release(ring.size());
+                break;
+            }
+            
+            free.release();
+            slot = (slot + 1) % ring.size();
+        }
+    }
+    catch (...)
+    {
+        // The producer still has to finish before the ring goes away under it
+        aborted = 1;
+        free.release(ring.size());
+        producer.wait();
+        throw;
+    }
+    
+    producer.wait();
+    return sink.finish() && success;
+}
+
+
+void BitPatchStream::fillChunk(Chunk& chunk, const int& firstRow) const
+{
+    const int columns = m_die.bitCount().width();
+    chunk.firstRow = firstRow;
+    chunk.rowCount = qMin(m_chunkRows, m_die.bitCount().height() - firstRow);
+    m_geometry.computeBitLocationRows(m_die.horizontalSlices(), m_die.verticalSlices(),
+                                      firstRow, chunk.rowCount, chunk.locations.xs(), chunk.locations.ys());
+    
+    // The last chunk may be short - the rest of its buffers just go unused
+    const int count = chunk.rowCount * columns;
+    const int patchSize = (m_radius * 2 + 1) * (m_radius * 2 + 1);
+    const float* xs = chunk.locations.xs();
+    const float* ys = chunk.locations.ys();
+    const ImageSampler* sampler = &m_sampler;
+    
+    // A mosaic is composited over just this chunk's patches and sampled in that region's coordinates
+    ImageSampler regionSampler;
+    QVector<float> regionXs;
+    QVector<float> regionYs;
+    if (m_mosaic && count > 0 && m_patchFormats != 0)
+    {
+        float left = xs[0], right = xs[0], top = ys[0], bottom = ys[0];
+        for (int i = 1; i < count; i++)
+        {
+            left = qMin(left, xs[i]);
+            right = qMax(right, xs[i]);
+            top = qMin(top, ys[i]);
+            bottom = qMax(bottom, ys[i]);
+        }
+        const QRect area(QPoint(qFloor(left) - m_radius - 1, qFloor(top) - m_radius - 1),
+                         QPoint(qCeil(right) + m_radius + 1, qCeil(bottom) + m_radius + 1));
+        regionSampler = ImageSampler(m_mosaic->region(area));
+        
+        regionXs.resize(count);
+        regionYs.resize(count);
+        for (int i = 0; i < count; i++)
+        {
+            regionXs[i] = xs[i] - area.x();
+            regionYs[i] = ys[i] - area.y();
+        }
+        xs = regionXs.constData();
+        ys = regionYs.constData();
+        sampler = &regionSampler;
+    }
+    
+    if (m_patchFormats & LuminancePatches)
+    {
+        sampler->luminancePatches(xs, ys, count, m_radius, chunk.luminance.data());
+    }
+    if (m_patchFormats & ColorPatches)
+    {
+        QRgb* out = chunk.color.data();
+        #pragma omp parallel for schedule(static)
+        for (int i = 0; i < count; i++)
+            sampler->colorPatch(QPointF(xs[i], ys[i]), m_radius, out + (qint64)i * patchSize, m_outsideColor);
+    }
+}
+
+
+
+/// Bit image sink ////////////////////////////////////////////////////////////
+
+BitImageSink::BitImageSink(const QString& filename, const QSize& bitsPerImage)
+    : m_filename(filename)
+    , m_bitsPerImage(bitsPerImage)
+    , m_bitCount()
+    , m_patchDim(0)
+    , m_stripRow(-1)
+    , m_strip()
+{
+    
+}
+
+
+bool BitImageSink::begin(const QSize& bitCount, const int& patchDim)
+{
+    m_bitCount = bitCount;
+    m_patchDim = patchDim;
+    m_stripRow = -1;
+    
+    const QSize tiles = BitExporter::tileCount(bitCount, m_bitsPerImage);
+    qDebug() << "Exporting " << tiles.width() << "images by" << tiles.height();
+    m_strip.resize(tiles.width());
+    return true;
+}
+
+
+bool BitImageSink::consume(const BitPatchBatch& batch)
+{
+    if (!batch.color)
+        return false;
+    
+    const int sliceBitWidth = m_bitsPerImage.width();
+    const int sliceBitHeight = m_bitsPerImage.height();
+    for (int r = 0; r < batch.rowCount; r++)
+    {
+        // Rows arrive in order, so a new strip means the last one is complete
+        const int row = batch.firstRow + r;
+        if (row / sliceBitHeight != m_stripRow)
+        {
+            if (!saveStrip())
+                return false;
+            
+            // Same layout as BitExporter::renderBitImage
+            m_stripRow = row / sliceBitHeight;
+            const QSize resultImageSize(m_patchDim * sliceBitWidth + sliceBitWidth + 1,
+                                        m_patchDim * sliceBitHeight + sliceBitHeight + 1);
+            for (int i = 0; i < m_strip.size(); i++)
+            {
+                m_strip[i] = QImage(resultImageSize, QImage::Format_RGB32);
+                m_strip[i].fill(QColor(255, 0, 0));
+            }
+        }
+        
+        const int yBitIndex = row % sliceBitHeight;
+        const int yResultOffset = (yBitIndex * m_patchDim) + yBitIndex + 1;
+        for (int col = 0; col < batch.columns; col++)
+        {
+            const int xBitIndex = col % sliceBitWidth;
+            const int xResultOffset = (xBitIndex * m_patchDim) + xBitIndex + 1;
+            const QRgb* patch = batch.colorPatch(r * batch.columns + col);
+            QImage& result = m_strip[col / sliceBitWidth];
+            for (int y = 0; y < m_patchDim; y++)
+            {
+                QRgb* line = reinterpret_cast<QRgb*>(result.scanLine(yResultOffset + y)) + xResultOffset;
+                memcpy(line, patch + y * m_patchDim, m_patchDim * sizeof(QRgb));
+            }
+        }
+    }
+    
+    return true;
+}
+
+
+bool BitImageSink::finish()
+{
+    const bool success = saveStrip();
+    m_strip.clear();
+    return success;
+}
+
+
+bool BitImageSink::saveStrip()
+{
+    if (m_stripRow < 0)
+        return true;
+    
+    bool success = true;
+    for (int i = 0; i < m_strip.size(); i++)
+    {
+        m_strip[i].setText("bitImageWidth", QString::number(m_patchDim));
+        m_strip[i].setText("bitImageHeight", QString::number(m_patchDim));
+        m_strip[i].setText("bitImageCountAcross", QString::number(m_bitCount.width()));
+        m_strip[i].setText("bitImageCountDown", QString::number(m_bitCount.height()));
+        success &= m_strip[i].save(BitExporter::tileFilename(m_filename, QPoint(i, m_stripRow)));
+        m_strip[i] = QImage();
+    }
+    
+    m_stripRow = -1;
+    return success;
+}
+
+
+
+/// Classifier sink ///////////////////////////////////////////////////////////
+
+BitClassifierSink::BitClassifierSink(const bool& darkIsOne, const float& threshold)
+    : m_darkIsOne(darkIsOne)
+    , m_threshold(threshold)
+    , m_usedThreshold(threshold)
+    , m_means()
+    , m_contrasts()
+    , m_bits()
+{
+    
+}
+
+
+bool BitClassifierSink::begin(const QSize& bitCount, const int& patchDim)
+{
+    Q_UNUSED(patchDim);
+    m_means.clear();
+    m_means.reserve(bitCount.width() * bitCount.height());
+    m_contrasts.clear();
+    m_contrasts.reserve(bitCount.width() * bitCount.height());
+    m_bits.clear();
+    return true;
+}
+
+
+bool BitClassifierSink::consume(const BitPatchBatch& batch)
+{
+    if (!batch.luminance)
+        return false;
+    
+    m_means += BitClassifier::patchMeans(batch.luminance, batch.count(), batch.patchSize());
+    m_contrasts += BitClassifier::patchContrasts(batch.luminance, batch.count(), batch.patchSize());
+    return true;
+}
+
+
+bool BitClassifierSink::finish()
+{
+    m_bits = BitClassifier::classifyMeans(m_means, m_darkIsOne, m_threshold, &m_usedThreshold);
+    return true;
+}
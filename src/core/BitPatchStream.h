@@ -0,0 +1,170 @@
+#ifndef DIETOY_BIT_PATCH_STREAM_H
+#define DIETOY_BIT_PATCH_STREAM_H
+
+#include "DieGeometry.h"
+#include "ImageSampler.h"
+#include "DieDescription.h"
+
+class TileMosaic;
+
+#include <QRgb>
+#include <QSize>
+#include <QImage>
+#include <QString>
+#include <QVector>
+#include <QPointF>
+
+
+/// Patch batches /////////////////////////////////////////////////////////////
+
+// rowCount full rows of bits starting at firstRow, with their image-space locations
+// and (patchDim x patchDim, row-major) patches.  Only valid during the sink call.
+struct BitPatchBatch
+{
+    int firstRow;
+    int rowCount;
+    int columns;
+    int patchDim;
+
+    const float* xs;
+    const float* ys;
+    const float* luminance;     // NULL unless the stream makes luminance patches
+    const QRgb* color;          // NULL unless the stream makes color patches
+
+    int firstBit() const { return firstRow * columns; }
+    int count() const { return rowCount * columns; }
+    int patchSize() const { return patchDim * patchDim; }
+    QPointF location(const int& i) const { return QPointF(xs[i], ys[i]); }
+    const float* luminancePatch(const int& i) const { return luminance + (qint64)i * patchSize(); }
+    const QRgb* colorPatch(const int& i) const { return color + (qint64)i * patchSize(); }
+};
+
+
+// Where a stream's batches go.  Returning false from any call stops the stream.
+class BitPatchSink
+{
+public:
+    virtual ~BitPatchSink() {}
+
+    virtual bool begin(const QSize& bitCount, const int& patchDim) { Q_UNUSED(bitCount); Q_UNUSED(patchDim); return true; }
+    virtual bool consume(const BitPatchBatch& batch) = 0;
+    virtual bool finish() { return true; }
+};
+
+
+/// Stream ////////////////////////////////////////////////////////////////////
+
+// Walks a die's bits in row-major order a chunk of rows at a time.  Bit locations
+// and patches for upcoming chunks are produced on a second thread into a fixed ring
+// of reused buffers while the sink works on the current one, so peak memory is
+// ringSize chunks no matter how many rows the ROM has.
+class BitPatchStream
+{
+public:
+    enum PatchFormat
+    {
+        LuminancePatches = 0x1,
+        ColorPatches = 0x2
+    };
+
+    BitPatchStream(const ImageSampler& sampler, const DieGeometry& geometry, const DieDescription& die);
+
+    void setRadius(const int& radius) { m_radius = radius; }
+    void setChunkRows(const int& rows) { m_chunkRows = qMax(rows, 1); }
+    void setRingSize(const int& size) { m_ringSize = qMax(size, 1); }
+    void setPatchFormats(const int& formats) { m_patchFormats = formats; }
+    void setOutsideColor(const QRgb& color) { m_outsideColor = color; }
+
+    // Sample a tile mosaic instead of the sampler's image - each chunk composites
+    // just the part of the mosaic under its patches
+    void setMosaic(const TileMosaic* mosaic) { m_mosaic = mosaic; }
+
+    QSize bitCount() const { return m_die.bitCount(); }
+
+    // Bytes the ring holds at once
+    qint64 bufferBytes() const;
+
+    // Feeds every chunk to sink - false if the die has no geometry or the sink gave up.
+    // An exception out of the sink stops the stream and is rethrown once the producer is done.
+    bool run(BitPatchSink& sink);
+
+private:
+    struct Chunk
+    {
+        int firstRow;
+        int rowCount;
+        BitLocationStore locations;
+        QVector<float> luminance;
+        QVector<QRgb> color;
+    };
+
+    class Producer;
+    friend class Producer;
+
+    void fillChunk(Chunk& chunk, const int& firstRow) const;
+
+    const ImageSampler& m_sampler;
+    const DieGeometry& m_geometry;
+    const DieDescription& m_die;
+    const TileMosaic* m_mosaic;
+
+    int m_radius;
+    int m_chunkRows;
+    int m_ringSize;
+    int m_patchFormats;
+    QRgb m_outsideColor;
+};
+
+
+/// Sinks /////////////////////////////////////////////////////////////////////
+
+// The condensed bit image export (see BitExporter::exportBitImages), holding just
+// one strip of tile images at a time.  Needs ColorPatches with a red outside color.
+class BitImageSink : public BitPatchSink
+{
+public:
+    explicit BitImageSink(const QString& filename, const QSize& bitsPerImage = QSize(8, 8));
+
+    bool begin(const QSize& bitCount, const int& patchDim);
+    bool consume(const BitPatchBatch& batch);
+    bool finish();
+
+private:
+    bool saveStrip();
+
+    QString m_filename;
+    QSize m_bitsPerImage;
+    QSize m_bitCount;
+    int m_patchDim;
+    int m_stripRow;
+    QVector<QImage> m_strip;
+};
+
+
+// Per-bit mean luminance and contrast, the means thresholded into bits once the stream is done
+// (see BitClassifier).  Needs LuminancePatches.
+class BitClassifierSink : public BitPatchSink
+{
+public:
+    explicit BitClassifierSink(const bool& darkIsOne = false, const float& threshold = -1.0f);
+
+    bool begin(const QSize& bitCount, const int& patchDim);
+    bool consume(const BitPatchBatch& batch);
+    bool finish();
+
+    const QVector<float>& means() const { return m_means; }
+    const QVector<float>& contrasts() const { return m_contrasts; }
+    const QVector<quint8>& bits() const { return m_bits; }
+    float threshold() const { return m_usedThreshold; }
+
+private:
+    bool m_darkIsOne;
+    float m_threshold;
+    float m_usedThreshold;
+    QVector<float> m_means;
+    QVector<float> m_contrasts;
+    QVector<quint8> m_bits;
+};
+
+
+#endif // DIETOY_BIT_PATCH_STREAM_H
@@ -0,0 +1,94 @@
+#include "BitReviewQueue.h"
+
+#include <QtGlobal>
+
+#include <cmath>
+#include <algorithm>
+
+
+BitReviewQueue::BitReviewQueue()
+    : m_bits()
+    , m_separations()
+    , m_position(0)
+{
+    
+}
+
+
+void BitReviewQueue::build(const QVector<float>& means,
+                           const QVector<float>& contrasts,
+                           const float& threshold,
+                           const BitLayers& layers,
+                           const int& limit)
+{
+    clear();
+    
+    // Score every bit that's still up for debate
+    const bool useLayers = (layers.size() == means.size());
+    QVector<QPair<float, int> > scored;
+    scored.reserve(means.size());
+    for (int i = 0; i < means.size(); i++)
+    {
+        if (useLayers && (layers.isIgnored(i) || layers.isOverridden(i)))
+            continue;
+        
+        const float contrast = (i < contrasts.size()) ? contrasts[i] : 0.0f;
+        scored.push_back(qMakePair(separation(means[i], contrast, threshold), i));
+    }
+    
+    // Only the head of the order matters when there's a limit
+    const int keep = (limit < 0) ? scored.size() : qMin(limit, scored.size());
+    std::partial_sort(scored.begin(), scored.begin() + keep, scored.end());
+    
+    m_bits.resize(keep);
+    m_separations.resize(keep);
+    for (int i = 0; i < keep; i++)
+    {
+        m_separations[i] = scored[i].first;
+        m_bits[i] = scored[i].second;
+    }
+}
+
+
+void BitReviewQueue::clear()
+{
+    m_bits.clear();
+    m_separations.clear();
+    m_position = 0;
+}
+
+
+float BitReviewQueue::separation(const float& mean, const float& contrast, const float& threshold)
+{
+    // A floor on the contrast keeps perfectly flat patches from dividing by zero
+    return std::fabs(mean - threshold) / qMax(contrast, 1.0f / 255.0f);
+}
+
+
+bool BitReviewQueue::advance()
+{
+    if (m_position + 1 >= m_bits.size())
+        return false;
+    
+    m_position++;
+    return true;
+}
+
+
+bool BitReviewQueue::retreat()
+{
+    if (m_position <= 0)
+        return false;
+    
+    m_position--;
+    return true;
+}
+
+
+QVector<int> BitReviewQueue::upcoming(const int& count) const
+{
+    QVector<int> results;
+    for (int i = m_position + 1; i < m_bits.size() && results.size() < count; i++)
+        results.push_back(m_bits[i]);
+    return results;
+}
@@ -0,0 +1,50 @@
+#ifndef DIETOY_BIT_REVIEW_QUEUE_H
+#define DIETOY_BIT_REVIEW_QUEUE_H
+
+#include "BitLayers.h"
+
+#include <QVector>
+
+
+/// Review queue //////////////////////////////////////////////////////////////
+
+// The bits most worth a human look, most ambiguous first, with a cursor.
+// A bit's separation is how far its patch mean sits from the threshold in units
+// of the patch's own contrast - a faint bit right at the threshold scores lowest.
+class BitReviewQueue
+{
+public:
+    BitReviewQueue();
+
+    // Ignored and hand-set bits are left out, and only the limit most ambiguous are kept (all when negative)
+    void build(const QVector<float>& means,
+               const QVector<float>& contrasts,
+               const float& threshold,
+               const BitLayers& layers,
+               const int& limit = -1);
+    void clear();
+
+    static float separation(const float& mean, const float& contrast, const float& threshold);
+
+    int size() const { return m_bits.size(); }
+    bool isEmpty() const { return m_bits.isEmpty(); }
+    int bitAt(const int& i) const { return m_bits[i]; }
+    float separationAt(const int& i) const { return m_separations[i]; }
+
+    // The cursor - current() is -1 when the queue is empty
+    int position() const { return m_position; }
+    int current() const { return isEmpty() ? -1 : m_bits[m_position]; }
+    bool advance();
+    bool retreat();
+
+    // The count bits after the cursor, for rendering ahead
+    QVector<int> upcoming(const int& count) const;
+
+private:
+    QVector<int> m_bits;
+    QVector<float> m_separations;
+    int m_position;
+};
+
+
+#endif // DIETOY_BIT_REVIEW_QUEUE_H
@@ -0,0 +1,593 @@
+#include "DdfJson.h"
+
+#include <QLocale>
+#include <QJsonArray>
+#include <QJsonDocument>
+
+#include <limits>
+
+
+// Text is handed to the device once this much has built up
+static const int WriteBufferBytes = 1 << 20;
+
+// Deeper than any DDF nests - past this the reader gives up rather than recurse further
+static const int MaxSkipDepth = 256;
+
+
+static bool isSpace(const char& c)
+{
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+
+static bool isDigit(const char& c)
+{
+    return c >= '0' && c <= '9';
+}
+
+
+DdfContents::DdfContents()
+    : fileType()
+    , version(0)
+    , boundsPoints()
+    , horizSlices()
+    , vertSlices()
+    , hasBitLayers(false)
+    , bitLayerCount(0, 0)
+    , values()
+    , confidence()
+    , overrides()
+    , ignore()
+    , hasRomFormat(false)
+    , romFormat()
+{
+
+}
+
+
+/// Streaming DDF reader //////////////////////////////////////////////////////
+
+DdfJsonReader::DdfJsonReader(const char* begin, const char* end)
+    : m_pos(begin)
+    , m_end(end)
+{
+    // QJsonDocument skips a UTF-8 byte order mark too
+    if (m_end - m_pos >= 3 && qstrncmp(m_pos, "\xef\xbb\xbf", 3) == 0)
+        m_pos += 3;
+}
+
+
+bool DdfJsonReader::read(DdfContents& contents)
+{
+    if (!expect('{'))
+        return false;
+
+    if (!expect('}'))
+    {
+        do
+        {
+            const char* key = NULL;
+            int keyLength = 0;
+            if (!stringSpan(key, keyLength) || !expect(':'))
+                return false;
+
+            const QByteArray name = QByteArray::fromRawData(key, keyLength);
+            bool ok = false;
+            if (name == "fileType")
+            {
+                const char* start = NULL;
+                int length = 0;
+                ok = stringSpan(start, length);
+                if (ok)
+                    contents.fileType = QString::fromUtf8(start, length);
+            }
+            else if (name == "version")
+            {
+                ok = integer(contents.version);
+            }
+            else if (name == "romBounds")
+            {
+                ok = pointArray(contents.boundsPoints);
+            }
+            else if (name == "horizontalSlices")
+            {
+                ok = numberArray(contents.horizSlices);
+            }
+            else if (name == "verticalSlices")
+            {
+                ok = numberArray(contents.vertSlices);
+            }
+            else if (name == "bitLayers")
+            {
+                ok = bitLayers(contents);
+            }
+            else if (name == "romFormat")
+            {
+                // A handful of values - not worth reading by hand
+                skipSpace();
+                const char* start = m_pos;
+                ok = (m_pos < m_end && *m_pos == '{') && skipValue(0);
+                if (ok)
+                {
+                    contents.romFormat = QJsonDocument::fromJson(QByteArray(start, m_pos - start)).object();
+                    contents.hasRomFormat = true;
+                }
+            }
+            else
+            {
+                ok = skipValue(0);
+            }
+
+            if (!ok)
+                return false;
+        } while (expect(','));
+
+        if (!expect('}'))
+            return false;
+    }
+
+    // Nothing may follow the document
+    skipSpace();
+    return m_pos == m_end;
+}
+
+
+void DdfJsonReader::skipSpace()
+{
+    while (m_pos < m_end && isSpace(*m_pos))
+        m_pos++;
+}
+
+
+bool DdfJsonReader::expect(const char& c)
+{
+    skipSpace();
+    if (m_pos >= m_end || *m_pos != c)
+        return false;
+    m_pos++;
+    return true;
+}
+
+
+bool DdfJsonReader::stringSpan(const char*& start, int& length)
+{
+    if (!expect('"'))
+        return false;
+
+    start = m_pos;
+    while (m_pos < m_end && *m_pos != '"')
+    {
+        if (*m_pos == '\\' || static_cast<uchar>(*m_pos) < 0x20)
+            return false;
+        m_pos++;
+    }
+    if (m_pos >= m_end)
+        return false;
+
+    length = m_pos - start;
+    m_pos++;
+    return true;
+}
+
+
+bool DdfJsonReader::number(double& value)
+{
+    // Strictly JSON's number grammar, then the same conversion QJsonDocument uses
+    skipSpace();
+    const char* p = m_pos;
+    if (p < m_end && *p == '-')
+        p++;
+    if (p >= m_end || !isDigit(*p))
+        return false;
+    if (*p == '0')
+        p++;
+    else
+        while (p < m_end && isDigit(*p))
+            p++;
+    if (p < m_end && *p == '.')
+    {
+        p++;
+        if (p >= m_end || !isDigit(*p))
+            return false;
+        while (p < m_end && isDigit(*p))
+            p++;
+    }
+    if (p < m_end && (*p == 'e' || *p == 'E'))
+    {
+        p++;
+        if (p < m_end && (*p == '+' || *p == '-'))
+            p++;
+        if (p >= m_end || !isDigit(*p))
+            return false;
+        while (p < m_end && isDigit(*p))
+            p++;
+    }
+
+    bool ok = false;
+    value = QByteArray::fromRawData(m_pos, p - m_pos).toDouble(&ok);
+    m_pos = p;
+    return ok;
+}
+
+
+bool DdfJsonReader::integer(int& value)
+{
+    // As QJsonValue::toInt() - a number that isn't a whole int reads as 0
+    double parsed = 0.0;
+    if (!number(parsed))
+        return false;
+    const bool whole = parsed >= std::numeric_limits<int>::min() && parsed <= std::numeric_limits<int>::max() &&
+                       static_cast<int>(parsed) == parsed;
+    value = whole ? static_cast<int>(parsed) : 0;
+    return true;
+}
+
+
+bool DdfJsonReader::numberArray(QVector<qreal>& values)
+{
+    if (!expect('['))
+        return false;
+
+    // Counted first, so the numbers go straight into place
+    int commas = 0;
+    bool empty = true;
+    for (const char* p = m_pos; p < m_end && *p != ']'; p++)
+    {
+        if (*p == ',')
+            commas++;
+        else if (!isSpace(*p))
+            empty = false;
+    }
+    values.resize(empty ? 0 : commas + 1);
+
+    for (int i = 0; i < values.size(); i++)
+    {
+        double value = 0.0;
+        if ((i > 0 && !expect(',')) || !number(value))
+            return false;
+        values[i] = value;
+    }
+    return expect(']');
+}
+
+
+bool DdfJsonReader::pointArray(QVector<QPointF>& points)
+{
+    if (!expect('['))
+        return false;
+
+    points.clear();
+    if (expect(']'))
+        return true;
+
+    do
+    {
+        double x = 0.0;
+        double y = 0.0;
+        if (!expect('[') || !number(x) || !expect(',') || !number(y) || !expect(']'))
+            return false;
+        points.push_back(QPointF(x, y));
+    } while (expect(','));
+    return expect(']');
+}
+
+
+bool DdfJsonReader::bitLayers(DdfContents& contents)
+{
+    if (!expect('{'))
+        return false;
+
+    contents.hasBitLayers = true;
+    contents.bitLayerCount = QSize(0, 0);
+    contents.values.clear();
+    contents.confidence.clear();
+    contents.overrides.clear();
+    contents.ignore.clear();
+    if (expect('}'))
+        return true;
+
+    do
+    {
+        const char* key = NULL;
+        int keyLength = 0;
+        if (!stringSpan(key, keyLength) || !expect(':'))
+            return false;
+
+        // The planes are decoded straight out of the text
+        const QByteArray name = QByteArray::fromRawData(key, keyLength);
+        QByteArray* plane = NULL;
+        if (name == "values")
+            plane = &contents.values;
+        else if (name == "confidence")
+            plane = &contents.confidence;
+        else if (name == "overrides")
+            plane = &contents.overrides;
+        else if (name == "ignore")
+            plane = &contents.ignore;
+
+        bool ok = false;
+        if (plane)
+        {
+            const char* start = NULL;
+            int length = 0;
+            ok = stringSpan(start, length);
+            if (ok)
+                *plane = QByteArray::fromBase64(QByteArray::fromRawData(start, length));
+        }
+        else if (name == "columns" || name == "rows")
+        {
+            int count = 0;
+            ok = integer(count);
+            if (name == "columns")
+                contents.bitLayerCount.setWidth(count);
+            else
+                contents.bitLayerCount.setHeight(count);
+        }
+        else
+        {
+            ok = skipValue(1);
+        }
+
+        if (!ok)
+            return false;
+    } while (expect(','));
+    return expect('}');
+}
+
+
+bool DdfJsonReader::skipValue(const int& depth)
+{
+    skipSpace();
+    if (m_pos >= m_end || depth > MaxSkipDepth)
+        return false;
+
+    switch (*m_pos)
+    {
+        case '"':
+        {
+            // Escapes are fine here - the string is only passed over
+            m_pos++;
+            while (m_pos < m_end && *m_pos != '"')
+            {
+                if (static_cast<uchar>(*m_pos) < 0x20)
+                    return false;
+                if (*m_pos == '\\')
+                    m_pos++;
+                m_pos++;
+            }
+            if (m_pos >= m_end)
+                return false;
+            m_pos++;
+            return true;
+        }
+        case '{':
+        {
+            m_pos++;
+            if (expect('}'))
+                return true;
+            do
+            {
+                skipSpace();
+                if (m_pos >= m_end || *m_pos != '"' || !skipValue(depth + 1) || !expect(':') || !skipValue(depth + 1))
+                    return false;
+            } while (expect(','));
+            return expect('}');
+        }
+        case '[':
+        {
+            m_pos++;
+            if (expect(']'))
+                return true;
+            do
+            {
+                if (!skipValue(depth + 1))
+                    return false;
+            } while (expect(','));
+            return expect(']');
+        }
+        case 't':
+        case 'f':
+        case 'n':
+        {
+            static const char* const literals[] = { "true", "false", "null" };
+            for (int i = 0; i < 3; i++)
+            {
+                const int length = qstrlen(literals[i]);
+                if (m_end - m_pos >= length && qstrncmp(m_pos, literals[i], length) == 0)
+                {
+                    m_pos += length;
+                    return true;
+                }
+            }
+            return false;
+        }
+        default:
+        {
+            double value = 0.0;
+            return number(value);
+        }
+    }
+}
+
+
+/// Streaming JSON writer /////////////////////////////////////////////////////
+
+JsonTextWriter::JsonTextWriter(QIODevice& device)
+    : m_device(device)
+    , m_buffer()
+    , m_indent(0)
+    , m_first(true)
+    , m_afterKey(false)
+    , m_ok(true)
+{
+    m_buffer.reserve(WriteBufferBytes);
+}
+
+
+void JsonTextWriter::key(const char* name)
+{
+    prefix();
+    m_buffer += '"';
+    m_buffer += name;
+    m_buffer += "\": ";
+    m_afterKey = true;
+}
+
+
+void JsonTextWriter::number(const double& value)
+{
+    // Whole numbers without an exponent, the rest as short as round-trips - as QJsonDocument does
+    prefix();
+    if (qIsFinite(value))
+    {
+        const double magnitude = qAbs(value);
+        const bool whole = magnitude < 18446744073709551616.0 && magnitude == static_cast<double>(static_cast<quint64>(magnitude));
+        m_buffer += QByteArray::number(value, whole ? 'f' : 'g', QLocale::FloatingPointShortest);
+    }
+    else
+    {
+        m_buffer += "null";
+    }
+    flushIfFull();
+}
+
+
+void JsonTextWriter::string(const QByteArray& utf8)
+{
+    static const char hexDigits[] = "0123456789abcdef";
+
+    prefix();
+    m_buffer += '"';
+    for (int i = 0; i < utf8.size(); i++)
+    {
+        const uchar c = static_cast<uchar>(utf8[i]);
+        if (c >= 0x20 && c != '"' && c != '\\')
+        {
+            m_buffer += static_cast<char>(c);
+            continue;
+        }
+
+        m_buffer += '\\';
+        switch (c)
+        {
+            case '"':  m_buffer += '"'; break;
+            case '\\': m_buffer += '\\'; break;
+            case '\b': m_buffer += 'b'; break;
+            case '\f': m_buffer += 'f'; break;
+            case '\n': m_buffer += 'n'; break;
+            case '\r': m_buffer += 'r'; break;
+            case '\t': m_buffer += 't'; break;
+            default:
+                m_buffer += "u00";
+                m_buffer += hexDigits[c >> 4];
+                m_buffer += hexDigits[c & 0xf];
+                break;
+        }
+    }
+    m_buffer += '"';
+    flushIfFull();
+}
+
+
+void JsonTextWriter::value(const QJsonValue& value)
+{
+    switch (value.type())
+    {
+        case QJsonValue::Bool:
+            prefix();
+            m_buffer += value.toBool() ? "true" : "false";
+            break;
+        case QJsonValue::Double:
+            number(value.toDouble());
+            break;
+        case QJsonValue::String:
+            string(value.toString().toUtf8());
+            break;
+        case QJsonValue::Array:
+        {
+            const QJsonArray array = value.toArray();
+            beginArray();
+            for (int i = 0; i < array.size(); i++)
+                this->value(array[i]);
+            endArray();
+            break;
+        }
+        case QJsonValue::Object:
+        {
+            // QJsonObject iterates in key order, as the writer needs
+            const QJsonObject object = value.toObject();
+            beginObject();
+            for (QJsonObject::const_iterator it = object.constBegin(); it != object.constEnd(); ++it)
+            {
+                key(it.key().toUtf8().constData());
+                this->value(it.value());
+            }
+            endObject();
+            break;
+        }
+        default:
+            prefix();
+            m_buffer += "null";
+            break;
+    }
+}
+
+
+bool JsonTextWriter::finish()
+{
+    m_buffer += '\n';
+    if (m_device.write(m_buffer) != m_buffer.size())
+        m_ok = false;
+    m_buffer.resize(0);
+    return m_ok;
+}
+
+
+void JsonTextWriter::open(const char& bracket)
+{
+    prefix();
+    m_buffer += bracket;
+    m_buffer += '\n';
+    m_indent++;
+    m_first = true;
+}
+
+
+void JsonTextWriter::close(const char& bracket)
+{
+    // An empty container closes on the line after it opened
+    if (!m_first)
+        m_buffer += '\n';
+    m_indent--;
+    m_buffer.append(4 * m_indent, ' ');
+    m_buffer += bracket;
+    m_first = false;
+    flushIfFull();
+}
+
+
+void JsonTextWriter::prefix()
+{
+    // A value after a key stays on the key's line
+    if (m_afterKey)
+    {
+        m_afterKey = false;
+        return;
+    }
+
+    if (!m_first)
+        m_buffer += ",\n";
+    m_first = false;
+    m_buffer.append(4 * m_indent, ' ');
+}
+
+
+void JsonTextWriter::flushIfFull()
+{
+    // resize() rather than clear() keeps the reserved capacity
+    if (m_buffer.size() < WriteBufferBytes)
+        return;
+    if (m_device.write(m_buffer) != m_buffer.size())
+        m_ok = false;
+    m_buffer.resize(0);
+}
@@ -0,0 +1,112 @@
+#ifndef DIETOY_DDF_JSON_H
+#define DIETOY_DDF_JSON_H
+
+#include <QSize>
+#include <QString>
+#include <QVector>
+#include <QPointF>
+#include <QIODevice>
+#include <QByteArray>
+#include <QJsonValue>
+#include <QJsonObject>
+
+
+/// DDF contents //////////////////////////////////////////////////////////////
+
+// Everything read from a DDF, before DieDescription checks it and takes it on.
+// Filled either by DdfJsonReader or, for files it won't take, a QJsonDocument.
+struct DdfContents
+{
+    DdfContents();
+
+    QString fileType;
+    int version;
+    QVector<QPointF> boundsPoints;
+    QVector<qreal> horizSlices;
+    QVector<qreal> vertSlices;
+
+    // The bit layers' planes, decoded from base64
+    bool hasBitLayers;
+    QSize bitLayerCount;
+    QByteArray values;
+    QByteArray confidence;
+    QByteArray overrides;
+    QByteArray ignore;
+
+    bool hasRomFormat;
+    QJsonObject romFormat;
+};
+
+
+/// Streaming DDF reader //////////////////////////////////////////////////////
+
+// Reads DDF text in one pass without building a document: the slice arrays are
+// counted and then parsed straight into vectors of the right size, and the bit
+// layer planes are decoded from the text in place.  Files the way saveJson
+// writes them are always taken; anything it isn't sure of (escaped strings,
+// values of unexpected types) makes read() fail without a warning, and the
+// file is then left to QJsonDocument, which does know every corner of JSON.
+class DdfJsonReader
+{
+public:
+    DdfJsonReader(const char* begin, const char* end);
+
+    bool read(DdfContents& contents);
+
+private:
+    void skipSpace();
+    bool expect(const char& c);
+
+    // Strings come back as spans of the text, so they can't hold escapes
+    bool stringSpan(const char*& start, int& length);
+    bool number(double& value);
+    bool integer(int& value);
+    bool numberArray(QVector<qreal>& values);
+    bool pointArray(QVector<QPointF>& points);
+    bool bitLayers(DdfContents& contents);
+    bool skipValue(const int& depth);
+
+    const char* m_pos;
+    const char* m_end;
+};
+
+
+/// Streaming JSON writer /////////////////////////////////////////////////////
+
+// Writes JSON laid out exactly as QJsonDocument::Indented lays it out (keys must
+// be given in sorted order, as a QJsonObject keeps them), handing the text to the
+// device a buffer at a time instead of building a document first.
+class JsonTextWriter
+{
+public:
+    explicit JsonTextWriter(QIODevice& device);
+
+    void beginObject() { open('{'); }
+    void endObject() { close('}'); }
+    void beginArray() { open('['); }
+    void endArray() { close(']'); }
+
+    void key(const char* name);
+    void number(const double& value);
+    void string(const QByteArray& utf8);
+    void value(const QJsonValue& value);
+
+    // Ends the document and writes what's left - false if any write failed
+    bool finish();
+
+private:
+    void open(const char& bracket);
+    void close(const char& bracket);
+    void prefix();
+    void flushIfFull();
+
+    QIODevice& m_device;
+    QByteArray m_buffer;
+    int m_indent;
+    bool m_first;
+    bool m_afterKey;
+    bool m_ok;
+};
+
+
+#endif // DIETOY_DDF_JSON_H
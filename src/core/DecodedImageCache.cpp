@@ -0,0 +1,245 @@
+#include "DecodedImageCache.h"
+
+#include <QDir>
+#include <QFile>
+#include <QDebug>
+#include <QDateTime>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QAtomicInt>
+#include <QStandardPaths>
+#include <QCryptographicHash>
+
+#include <cstring>
+
+
+// A cache file is this header, a table with one entry per level, and then each
+// level's scanlines exactly as QImage lays them out, starting on 64 byte boundaries
+static const char CacheMagic[4] = { 'D', 'T', 'R', 'C' };
+static const quint32 CacheVersion = 1;
+static const qint64 LevelAlignment = 64;
+
+struct CacheHeader
+{
+    char magic[4];
+    quint32 version;
+    quint32 levelCount;
+    quint32 reserved;
+};
+
+struct CacheLevel
+{
+    quint32 format;
+    quint32 width;
+    quint32 height;
+    quint32 bytesPerLine;
+    quint64 offset;
+};
+
+
+// The open cache file behind a set of mapped levels - it (and with it the
+// mapping) goes away when the last image using it does
+struct SharedMapping
+{
+    QFile file;
+    QAtomicInt references;
+};
+
+static void releaseMapping(void* info)
+{
+    SharedMapping* mapping = static_cast<SharedMapping*>(info);
+    if (!mapping->references.deref())
+        delete mapping;
+}
+
+
+static qint64 alignLevel(const qint64& offset)
+{
+    return (offset + LevelAlignment - 1) / LevelAlignment * LevelAlignment;
+}
+
+
+DecodedImageCache::DecodedImageCache()
+    : m_directory(QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation) + "/dietoy/decoded")
+    , m_sizeLimit(16LL * 1024 * 1024 * 1024)
+    , m_smallestLevel(1024)
+{
+
+}
+
+
+QString DecodedImageCache::cacheFilename(const QString& filename) const
+{
+    // Keyed by where the file is and which version of it this is - hashing the
+    // contents would cost nearly as much as decoding them
+    const QFileInfo info(filename);
+    if (m_directory.isEmpty() || !info.exists())
+        return QString();
+
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(info.absoluteFilePath().toUtf8());
+    hash.addData(QByteArray::number(info.size()));
+    hash.addData(QByteArray::number(info.lastModified().toMSecsSinceEpoch()));
+    return QDir(m_directory).filePath(QString::fromLatin1(hash.result().toHex()) + ".raw");
+}
+
+
+bool DecodedImageCache::contains(const QString& filename) const
+{
+    const QString cacheFile = cacheFilename(filename);
+    return !cacheFile.isEmpty() && QFile::exists(cacheFile);
+}
+
+
+bool DecodedImageCache::load(const QString& filename, QVector<QImage>& levels) const
+{
+    levels.clear();
+    const QString cacheFile = cacheFilename(filename);
+    if (!cacheFile.isEmpty() && QFile::exists(cacheFile) && mapCacheFile(cacheFile, levels))
+        return true;
+
+    QImage image;
+    if (!image.load(filename))
+        return false;
+
+    // Color tables don't survive as raw pixels
+    if (image.colorCount() > 0)
+        image = image.convertToFormat(image.allGray() ? QImage::Format_Grayscale8 : QImage::Format_RGB32);
+
+    levels = buildPyramid(image, m_smallestLevel);
+    if (!cacheFile.isEmpty() && QDir().mkpath(m_directory) && writeCacheFile(cacheFile, levels))
+        trim();
+    return true;
+}
+
+
+QVector<QImage> DecodedImageCache::buildPyramid(const QImage& image, const int& smallestLevel)
+{
+    QVector<QImage> levels;
+    levels.push_back(image);
+    while (!levels.last().isNull() && (levels.last().width() > smallestLevel || levels.last().height() > smallestLevel))
+    {
+        const QImage& finer = levels.last();
+        const QImage halved = finer.scaled((finer.width() + 1) / 2, (finer.height() + 1) / 2, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+        levels.push_back(halved);
+    }
+    return levels;
+}
+
+
+bool DecodedImageCache::mapCacheFile(const QString& cacheFile, QVector<QImage>& levels) const
+{
+    SharedMapping* mapping = new SharedMapping;
+    mapping->file.setFileName(cacheFile);
+    if (!mapping->file.open(QIODevice::ReadOnly))
+    {
+        delete mapping;
+        return false;
+    }
+
+    const qint64 fileSize = mapping->file.size();
+    const uchar* data = (fileSize >= (qint64)sizeof(CacheHeader)) ? mapping->file.map(0, fileSize) : NULL;
+    const CacheHeader* header = reinterpret_cast<const CacheHeader*>(data);
+    if (!data || std::memcmp(header->magic, CacheMagic, sizeof(CacheMagic)) != 0 || header->version != CacheVersion ||
+        header->levelCount == 0 || (qint64)(sizeof(CacheHeader) + header->levelCount * sizeof(CacheLevel)) > fileSize)
+    {
+        qWarning() << "Ignoring unreadable image cache file " << cacheFile;
+        delete mapping;
+        return false;
+    }
+
+    // Check every level lies inside the file before handing any of it out
+    const CacheLevel* table = reinterpret_cast<const CacheLevel*>(data + sizeof(CacheHeader));
+    for (quint32 i = 0; i < header->levelCount; i++)
+    {
+        const CacheLevel& level = table[i];
+        const bool knownFormat = level.format > QImage::Format_Invalid && level.format < QImage::NImageFormats;
+        const qint64 minimumLine = knownFormat ? ((qint64)level.width * QImage::toPixelFormat((QImage::Format)level.format).bitsPerPixel() + 7) / 8 : 0;
+        if (!knownFormat || level.width == 0 || level.height == 0 || level.bytesPerLine < minimumLine ||
+            level.bytesPerLine % 4 != 0 || level.offset % LevelAlignment != 0 ||
+            (qint64)level.offset + (qint64)level.bytesPerLine * level.height > fileSize)
+        {
+            qWarning() << "Ignoring unreadable image cache file " << cacheFile;
+            delete mapping;
+            return false;
+        }
+    }
+
+    // Most recently used is what survives trimming
+    mapping->file.setFileTime(QDateTime::currentDateTime(), QFileDevice::FileModificationTime);
+
+    // The images read the mapping in place - nothing is copied unless someone writes to one
+    mapping->references = header->levelCount;
+    for (quint32 i = 0; i < header->levelCount; i++)
+    {
+        const CacheLevel& level = table[i];
+        levels.push_back(QImage(data + level.offset, level.width, level.height, level.bytesPerLine,
+                                (QImage::Format)level.format, releaseMapping, mapping));
+    }
+    return true;
+}
+
+
+bool DecodedImageCache::writeCacheFile(const QString& cacheFile, const QVector<QImage>& levels) const
+{
+    // Written under a temporary name and renamed into place, so other processes
+    // only ever map complete files
+    QSaveFile file(cacheFile);
+    if (!file.open(QIODevice::WriteOnly))
+    {
+        qWarning() << "Unable to write image cache file " << cacheFile;
+        return false;
+    }
+
+    CacheHeader header;
+    std::memcpy(header.magic, CacheMagic, sizeof(CacheMagic));
+    header.version = CacheVersion;
+    header.levelCount = levels.size();
+    header.reserved = 0;
+
+    QVector<CacheLevel> table(levels.size());
+    qint64 offset = alignLevel(sizeof(CacheHeader) + sizeof(CacheLevel) * levels.size());
+    for (int i = 0; i < levels.size(); i++)
+    {
+        table[i].format = levels[i].format();
+        table[i].width = levels[i].width();
+        table[i].height = levels[i].height();
+        table[i].bytesPerLine = levels[i].bytesPerLine();
+        table[i].offset = offset;
+        offset = alignLevel(offset + (qint64)levels[i].bytesPerLine() * levels[i].height());
+    }
+
+    bool success = file.write(reinterpret_cast<const char*>(&header), sizeof(header)) == sizeof(header);
+    success &= file.write(reinterpret_cast<const char*>(table.constData()), sizeof(CacheLevel) * table.size()) == (qint64)(sizeof(CacheLevel) * table.size());
+    for (int i = 0; i < levels.size() && success; i++)
+    {
+        const QByteArray padding(table[i].offset - file.pos(), '\0');
+        const qint64 levelBytes = (qint64)levels[i].bytesPerLine() * levels[i].height();
+        success &= file.write(padding) == padding.size();
+        success &= file.write(reinterpret_cast<const char*>(levels[i].constBits()), levelBytes) == levelBytes;
+    }
+
+    if (!success)
+        file.cancelWriting();
+    if (!file.commit())
+    {
+        qWarning() << "Unable to write image cache file " << cacheFile;
+        return false;
+    }
+    return true;
+}
+
+
+void DecodedImageCache::trim() const
+{
+    // Newest first - whatever pushes the total over the limit goes (processes
+    // with one of them mapped keep their pages until they let go)
+    const QFileInfoList files = QDir(m_directory).entryInfoList(QStringList() << "*.raw", QDir::Files, QDir::Time);
+    qint64 total = 0;
+    for (int i = 0; i < files.size(); i++)
+    {
+        total += files[i].size();
+        if (i > 0 && total > m_sizeLimit)
+            QFile::remove(files[i].absoluteFilePath());
+    }
+}
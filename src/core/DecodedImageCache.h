@@ -0,0 +1,52 @@
+#ifndef DIETOY_DECODED_IMAGE_CACHE_H
+#define DIETOY_DECODED_IMAGE_CACHE_H
+
+#include <QImage>
+#include <QString>
+#include <QVector>
+
+
+/// Decoded image cache ///////////////////////////////////////////////////////
+
+// Keeps the decoded pixels of every die image opened, plus a pyramid of halved
+// copies, in raw files under a cache directory.  A file that's been seen before
+// (same path, size and modification time) is memory-mapped instead of decoded,
+// and the returned images point straight at the read-only mapping - so reopening
+// costs no decode or copy, and every process with the same die open shares the
+// same pages.  Cache files are written atomically, so a half-written one is never
+// mapped, and the oldest are removed once the directory passes its size limit.
+class DecodedImageCache
+{
+public:
+    // The shared cache directory (used by both the GUI and the command line tool)
+    DecodedImageCache();
+
+    // An empty directory turns the cache off - load() just decodes
+    void setDirectory(const QString& path) { m_directory = path; }
+    QString directory() const { return m_directory; }
+    void setSizeLimit(const qint64& bytes) { m_sizeLimit = bytes; }
+
+    // Pyramid levels stop once both sides are at most this many pixels
+    void setSmallestLevel(const int& pixels) { m_smallestLevel = pixels; }
+
+    // The image in levels[0] and each halving of it after that.  Mapped from the
+    // cache if it's there, otherwise decoded and then stored
+    bool load(const QString& filename, QVector<QImage>& levels) const;
+    bool contains(const QString& filename) const;
+
+    // Level 0 and its halvings down to smallestLevel
+    static QVector<QImage> buildPyramid(const QImage& image, const int& smallestLevel);
+
+private:
+    QString cacheFilename(const QString& filename) const;
+    bool mapCacheFile(const QString& cacheFile, QVector<QImage>& levels) const;
+    bool writeCacheFile(const QString& cacheFile, const QVector<QImage>& levels) const;
+    void trim() const;
+
+    QString m_directory;
+    qint64 m_sizeLimit;
+    int m_smallestLevel;
+};
+
+
+#endif // DIETOY_DECODED_IMAGE_CACHE_H
@@ -0,0 +1,230 @@
+#include "DieDescription.h"
+#include "DdfJson.h"
+
+#include <QFile>
+#include <QDebug>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QJsonDocument>
+
+
+DieDescription::DieDescription()
+    : m_boundsPoints()
+    , m_horizSlices()
+    , m_vertSlices()
+    , m_bitLayers()
+    , m_romFormat()
+{
+    
+}
+
+
+void DieDescription::clear()
+{
+    m_boundsPoints.clear();
+    m_horizSlices.clear();
+    m_vertSlices.clear();
+    m_bitLayers.clear();
+    m_romFormat = RomFormat();
+}
+
+
+bool DieDescription::saveJson(const QString& filename) const
+{
+    // Open the file for writing
+    QFile file;
+    file.setFileName(filename);
+    bool success = file.open(QIODevice::WriteOnly | QIODevice::Text);
+    if (!success)
+        return false;
+    
+    // Streamed out in the exact layout QJsonDocument::Indented gives, keys in sorted order
+    JsonTextWriter json(file);
+    json.beginObject();
+    
+    // Per-bit layers are optional, so version 1 readers that don't know them are unaffected
+    if (!m_bitLayers.isEmpty())
+    {
+        json.key("bitLayers");
+        json.beginObject();
+        json.key("columns");
+        json.number(m_bitLayers.bitCount().width());
+        json.key("confidence");
+        json.string(m_bitLayers.confidencePlane().toBase64());
+        json.key("ignore");
+        json.string(m_bitLayers.ignorePlane().toBase64());
+        json.key("overrides");
+        json.string(m_bitLayers.overridesPlane().toBase64());
+        json.key("rows");
+        json.number(m_bitLayers.bitCount().height());
+        json.key("values");
+        json.string(m_bitLayers.valuesPlane().toBase64());
+        json.endObject();
+    }
+    
+    json.key("fileType");
+    json.string("Die Description File");
+    
+    // Write the horizontal slice offsets (in ascending order)
+    json.key("horizontalSlices");
+    json.beginArray();
+    for (int i = 0; i < m_horizSlices.size(); i++)
+        json.number(m_horizSlices[i]);
+    json.endArray();
+    
+    // Write the ROM boundary points
+    json.key("romBounds");
+    json.beginArray();
+    for (int i = 0; i < m_boundsPoints.size(); i++)
+    {
+        json.beginArray();
+        json.number(m_boundsPoints[i].x());
+        json.number(m_boundsPoints[i].y());
+        json.endArray();
+    }
+    json.endArray();
+    
+    if (!m_romFormat.isDefault())
+    {
+        json.key("romFormat");
+        json.value(m_romFormat.toJson());
+    }
+    
+    json.key("version");
+    json.number(1);
+    
+    // Write the vertical slice offsets
+    json.key("verticalSlices");
+    json.beginArray();
+    for (int i = 0; i < m_vertSlices.size(); i++)
+        json.number(m_vertSlices[i]);
+    json.endArray();
+    
+    // Write, close, and cleanup
+    json.endObject();
+    success = json.finish();
+    file.close();
+    
+    return success;
+}
+
+
+bool DieDescription::loadJson(const QString& filename)
+{
+    // Open the file, mapping it where possible so the text is never copied
+    QFile file;
+    file.setFileName(filename);
+    bool success = file.open(QIODevice::ReadOnly);
+    if (!success)
+        return false;
+    
+    const qint64 fileSize = file.size();
+    const uchar* mapped = (fileSize > 0) ? file.map(0, fileSize) : NULL;
+    const QByteArray text = mapped ? QByteArray::fromRawData(reinterpret_cast<const char*>(mapped), fileSize) : file.readAll();
+    
+    // Read in one pass, or through a full document for anything the streaming reader won't take
+    DdfContents contents;
+    DdfJsonReader reader(text.constData(), text.constData() + text.size());
+    if (!reader.read(contents))
+    {
+        contents = DdfContents();
+        if (!readJsonDocument(text, contents))
+            return false;
+    }
+    
+    // Make sure we're the correct file type
+    if (contents.fileType.isEmpty() || contents.fileType != "Die Description File")
+    {
+        qWarning() << "Invalid DDF file.  Aborting read";
+        return false;
+    }
+
+    // Check the version
+    if (contents.version > 1 || contents.version == 0)
+    {
+        qWarning() << "Can only read DDF file versions 1 or less";
+        return false;
+    }
+    
+    m_boundsPoints = contents.boundsPoints;
+    m_horizSlices.clear();
+    m_horizSlices.insert(contents.horizSlices);
+    m_vertSlices.clear();
+    m_vertSlices.insert(contents.vertSlices);
+    
+    // Take the per-bit layers, if there are any and they still fit the slices
+    m_bitLayers.clear();
+    if (contents.hasBitLayers)
+    {
+        m_bitLayers.setPlanes(contents.bitLayerCount, contents.values, contents.confidence, contents.overrides, contents.ignore);
+        if (!m_bitLayers.isEmpty() && m_bitLayers.bitCount() != bitCount())
+        {
+            qWarning() << "Bit layers are for a different number of bits than the slices make.  Ignoring them";
+            m_bitLayers.clear();
+        }
+    }
+    
+    // And the ROM format (a bad one falls back to the default with a warning)
+    m_romFormat = RomFormat();
+    if (contents.hasRomFormat)
+        m_romFormat.fromJson(contents.romFormat);
+    
+    return true;
+}
+
+
+bool DieDescription::readJsonDocument(const QByteArray& text, DdfContents& contents)
+{
+    // Parse the JSON from the die descriptor file
+    QJsonParseError jError;
+    QJsonDocument jDoc = QJsonDocument::fromJson(text, &jError);
+    if(jError.error != QJsonParseError::NoError)
+        return false;
+    
+    // Begin interpreting
+    QJsonObject docObj = jDoc.object();
+    contents.fileType = docObj["fileType"].toString();
+    contents.version = docObj["version"].toInt();
+    
+    // Read the bounds points
+    const QJsonArray romBounds = docObj["romBounds"].toArray();
+    for (int i = 0; i < romBounds.size(); i++)
+    {
+        const QJsonArray pointArray = romBounds[i].toArray();
+        contents.boundsPoints.push_back(QPointF(pointArray[0].toDouble(), pointArray[1].toDouble()));
+    }
+    
+    // Read the horizontal slice offsets
+    const QJsonArray horizSlices = docObj["horizontalSlices"].toArray();
+    contents.horizSlices.resize(horizSlices.size());
+    for (int i = 0; i < horizSlices.size(); i++)
+    {
+        contents.horizSlices[i] = horizSlices[i].toDouble();
+    }
+    
+    // Read the vertical slice offsets
+    const QJsonArray vertSlices = docObj["verticalSlices"].toArray();
+    contents.vertSlices.resize(vertSlices.size());
+    for (int i = 0; i < vertSlices.size(); i++)
+    {
+        contents.vertSlices[i] = vertSlices[i].toDouble();
+    }
+    
+    // The per-bit layers' planes
+    contents.hasBitLayers = docObj.contains("bitLayers");
+    if (contents.hasBitLayers)
+    {
+        const QJsonObject layers = docObj["bitLayers"].toObject();
+        contents.bitLayerCount = QSize(layers["columns"].toInt(), layers["rows"].toInt());
+        contents.values = QByteArray::fromBase64(layers["values"].toString().toLatin1());
+        contents.confidence = QByteArray::fromBase64(layers["confidence"].toString().toLatin1());
+        contents.overrides = QByteArray::fromBase64(layers["overrides"].toString().toLatin1());
+        contents.ignore = QByteArray::fromBase64(layers["ignore"].toString().toLatin1());
+    }
+    
+    contents.hasRomFormat = docObj.contains("romFormat");
+    if (contents.hasRomFormat)
+        contents.romFormat = docObj["romFormat"].toObject();
+    
+    return true;
+}
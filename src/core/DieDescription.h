@@ -0,0 +1,67 @@
+#ifndef DIETOY_DIE_DESCRIPTION_H
+#define DIETOY_DIE_DESCRIPTION_H
+
+#include "BitLayers.h"
+#include "RomFormat.h"
+#include "SliceList.h"
+
+#include <QSize>
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+#include <QPointF>
+
+struct DdfContents;
+
+
+/// Die model /////////////////////////////////////////////////////////////////
+
+// Everything a die description file (DDF) holds: the four image-space points
+// bounding the ROM region, the ROM-die-space slice offsets inside it and any
+// per-bit layers and how the bits read out as ROM bytes.
+// A plain value type - independent dies can be worked on from separate threads.
+class DieDescription
+{
+public:
+    DieDescription();
+
+    void clear();
+
+    QVector<QPointF>& boundsPoints() { return m_boundsPoints; }
+    const QVector<QPointF>& boundsPoints() const { return m_boundsPoints; }
+
+    SliceList& horizontalSlices() { return m_horizSlices; }
+    const SliceList& horizontalSlices() const { return m_horizSlices; }
+    SliceList& verticalSlices() { return m_vertSlices; }
+    const SliceList& verticalSlices() const { return m_vertSlices; }
+    SliceList& slices(const SliceOrientation& hv) { return (hv == HorizontalSlice) ? m_horizSlices : m_vertSlices; }
+    const SliceList& slices(const SliceOrientation& hv) const { return (hv == HorizontalSlice) ? m_horizSlices : m_vertSlices; }
+
+    // Bits across (columns) and down (rows) - the slices plus the two bounds edges
+    QSize bitCount() const { return QSize(m_horizSlices.size() + 2, m_vertSlices.size() + 2); }
+
+    // Per-bit values and annotations - empty until something fills them
+    BitLayers& bitLayers() { return m_bitLayers; }
+    const BitLayers& bitLayers() const { return m_bitLayers; }
+
+    // Bit grid to ROM word mapping
+    RomFormat& romFormat() { return m_romFormat; }
+    const RomFormat& romFormat() const { return m_romFormat; }
+
+    // JSON DDF reading and writing (version 1)
+    bool loadJson(const QString& filename);
+    bool saveJson(const QString& filename) const;
+
+private:
+    // The QJsonDocument route, for files the streaming reader won't take
+    static bool readJsonDocument(const QByteArray& text, DdfContents& contents);
+
+    QVector<QPointF> m_boundsPoints;
+    SliceList m_horizSlices;
+    SliceList m_vertSlices;
+    BitLayers m_bitLayers;
+    RomFormat m_romFormat;
+};
+
+
+#endif // DIETOY_DIE_DESCRIPTION_H
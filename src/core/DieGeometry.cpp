@@ -0,0 +1,332 @@
+#include "DieGeometry.h"
+
+#include <QVector2D>
+
+#include <cmath>
+
+
+DieGeometry::DieGeometry()
+    : m_valid(false)
+    , m_boundsPoints()
+    , m_homography()
+{
+    for (int i = 0; i < 9; i++)
+    {
+        m_toRomDie[i] = (i % 4 == 0) ? 1.0 : 0.0;
+        m_toImage[i] = m_toRomDie[i];
+    }
+}
+
+
+DieGeometry::DieGeometry(const QVector<QPointF>& boundsPoints)
+    : DieGeometry()
+{
+    if (boundsPoints.size() != 4)
+        return;
+    
+    // Sort the points so they run clockwise around the ROM region
+    m_boundsPoints = sortedRectanglePoints(boundsPoints);
+    
+    // Compute a homography mapping the almost-rectangular ROM region to a rectangle
+    std::vector<cv::Point2f> imageSpacePoints;
+    imageSpacePoints.push_back(cv::Point2f(m_boundsPoints[0].x(), m_boundsPoints[0].y()));
+    imageSpacePoints.push_back(cv::Point2f(m_boundsPoints[1].x(), m_boundsPoints[1].y()));
+    imageSpacePoints.push_back(cv::Point2f(m_boundsPoints[2].x(), m_boundsPoints[2].y()));
+    imageSpacePoints.push_back(cv::Point2f(m_boundsPoints[3].x(), m_boundsPoints[3].y()));
+    
+    std::vector<cv::Point2f> romDieSpacePoints;
+    romDieSpacePoints.push_back(cv::Point2f(0.0f, 0.0f));
+    romDieSpacePoints.push_back(cv::Point2f(1.0f, 0.0f));
+    romDieSpacePoints.push_back(cv::Point2f(1.0f, 1.0f));
+    romDieSpacePoints.push_back(cv::Point2f(0.0f, 1.0f));
+    
+    m_homography = cv::findHomography(imageSpacePoints, romDieSpacePoints, 0);
+    if (m_homography.empty())
+        return;
+    
+    const cv::Mat homographyInverse = m_homography.inv();
+    for (int i = 0; i < 9; i++)
+    {
+        m_toRomDie[i] = m_homography.at<double>(i / 3, i % 3);
+        m_toImage[i] = homographyInverse.at<double>(i / 3, i % 3);
+    }
+    m_valid = true;
+}
+
+
+QPointF DieGeometry::romDieSpaceFromImagePoint(const QPointF& iPoint) const
+{
+    return project(m_toRomDie, iPoint);
+}
+
+
+qreal DieGeometry::romDieSpaceFromImagePoint(const QPointF& iPoint, const SliceOrientation& hv) const
+{
+    const QPointF romDiePoint = project(m_toRomDie, iPoint);
+    return (hv == HorizontalSlice) ? romDiePoint.x() : romDiePoint.y();
+}
+
+
+QPointF DieGeometry::imagePointFromRomDieSpace(const QPointF& rPoint) const
+{
+    return project(m_toImage, rPoint);
+}
+
+
+QLineF DieGeometry::slicePositionToLine(const qreal& slicePosition, const SliceOrientation& hv) const
+{
+    // The image space positions of both extremes of the slice
+    const QPointF top((hv == HorizontalSlice) ? slicePosition : 0.0,
+                      (hv == VerticalSlice) ? slicePosition : 0.0);
+    const QPointF bottom((hv == HorizontalSlice) ? slicePosition : 1.0,
+                         (hv == VerticalSlice) ? slicePosition : 1.0);
+    return QLineF(project(m_toImage, top), project(m_toImage, bottom));
+}
+
+
+BitLocationStore DieGeometry::computeBitLocations(const SliceList& horizSlices, const SliceList& vertSlices) const
+{
+    if (!m_valid)
+        return BitLocationStore();
+    
+    const int rows = vertSlices.size() + 2;
+    BitLocationStore results(rows, horizSlices.size() + 2);
+    computeBitLocationRows(horizSlices, vertSlices, 0, rows, results.xs(), results.ys());
+    return results;
+}
+
+
+void DieGeometry::computeBitLocationRows(const SliceList& horizSlices,
+                                         const SliceList& vertSlices,
+                                         const int& firstRow,
+                                         const int& rowCount,
+                                         float* xs,
+                                         float* ys) const
+{
+    if (!m_valid)
+        return;
+    
+    // ROM-die-space coordinates of every column and of the requested rows - the bounds edges plus the slices
+    const int columns = horizSlices.size() + 2;
+    const int rows = vertSlices.size() + 2;
+    QVector<qreal> us(columns);
+    QVector<qreal> vs(rowCount);
+    us[0] = 0.0;
+    for (int x = 0; x < horizSlices.size(); x++)
+        us[x + 1] = horizSlices[x];
+    us[columns - 1] = 1.0;
+    for (int y = 0; y < rowCount; y++)
+    {
+        const int row = firstRow + y;
+        vs[y] = (row == 0) ? 0.0 : (row == rows - 1) ? 1.0 : vertSlices[row - 1];
+    }
+    
+    // A homography maps lines to lines, so each slice intersection is just the
+    // inverse mapping of its (u, v) pair - every row can be done independently
+    const qreal* u = us.constData();
+    const qreal* v = vs.constData();
+    #pragma omp parallel for schedule(static)
+    for (int y = 0; y < rowCount; y++)
+    {
+        for (int x = 0; x < columns; x++)
+        {
+            const QPointF p = project(m_toImage, QPointF(u[x], v[y]));
+            xs[y * columns + x] = p.x();
+            ys[y * columns + x] = p.y();
+        }
+    }
+    
+    // The corners are exactly the bounds points
+    const int corners[4] = { 0, columns - 1, rowCount * columns - 1, (rowCount - 1) * columns };
+    for (int c = 0; c < 4; c++)
+    {
+        const bool topCorner = (c < 2);
+        if ((topCorner && firstRow != 0) || (!topCorner && firstRow + rowCount != rows))
+            continue;
+        xs[corners[c]] = m_boundsPoints[c].x();
+        ys[corners[c]] = m_boundsPoints[c].y();
+    }
+}
+
+
+void DieGeometry::updateBitLocations(const SliceList& horizSlices,
+                                     const SliceList& vertSlices,
+                                     const QVector<int>& rows,
+                                     const QVector<int>& columns,
+                                     BitLocationStore& locations) const
+{
+    const int columnCount = horizSlices.size() + 2;
+    const int rowCount = vertSlices.size() + 2;
+    if (!m_valid || locations.columns() != columnCount || locations.rows() != rowCount)
+        return;
+    
+    // Interior rows and columns sit on slices - the bounds edges never move with them
+    QVector<qreal> us(columnCount);
+    QVector<qreal> vs(rowCount);
+    us[0] = 0.0;
+    for (int x = 0; x < horizSlices.size(); x++)
+        us[x + 1] = horizSlices[x];
+    us[columnCount - 1] = 1.0;
+    vs[0] = 0.0;
+    for (int y = 0; y < vertSlices.size(); y++)
+        vs[y + 1] = vertSlices[y];
+    vs[rowCount - 1] = 1.0;
+    
+    float* xs = locations.xs();
+    float* ys = locations.ys();
+    #pragma omp parallel for schedule(static)
+    for (int r = 0; r < rows.size(); r++)
+    {
+        const int y = rows[r];
+        for (int x = 0; x < columnCount; x++)
+        {
+            const QPointF p = project(m_toImage, QPointF(us[x], vs[y]));
+            xs[y * columnCount + x] = p.x();
+            ys[y * columnCount + x] = p.y();
+        }
+    }
+    #pragma omp parallel for schedule(static)
+    for (int y = 0; y < rowCount; y++)
+    {
+        for (int c = 0; c < columns.size(); c++)
+        {
+            const int x = columns[c];
+            const QPointF p = project(m_toImage, QPointF(us[x], vs[y]));
+            xs[y * columnCount + x] = p.x();
+            ys[y * columnCount + x] = p.y();
+        }
+    }
+}
+
+
+// The ROM die space positions of the grid lines (the two bounds edges and the
+// slices between them) falling within [low, high]
+static QVector<qreal> gridLinesInRange(const SliceList& slices, const qreal& low, const qreal& high)
+{
+    QVector<qreal> lines;
+    if (low <= 0.0)
+        lines.push_back(0.0);
+    for (int i = slices.lowerBound(low); i < slices.upperBound(high); i++)
+        lines.push_back(slices[i]);
+    if (high >= 1.0)
+        lines.push_back(1.0);
+    return lines;
+}
+
+
+QVector<QPointF> DieGeometry::bitLocationsInRect(const SliceList& horizSlices,
+                                                 const SliceList& vertSlices,
+                                                 const QRectF& rect,
+                                                 const int& maxCount) const
+{
+    QVector<QPointF> results;
+    if (!m_valid || rect.isEmpty())
+        return results;
+    
+    // Lines map to lines, so the rectangle's corners bound the ROM die space it covers
+    const QPointF corners[4] = { rect.topLeft(), rect.topRight(), rect.bottomRight(), rect.bottomLeft() };
+    qreal uLow = 1.0, uHigh = 0.0, vLow = 1.0, vHigh = 0.0;
+    for (int c = 0; c < 4; c++)
+    {
+        const QPointF r = project(m_toRomDie, corners[c]);
+        uLow = qMin(uLow, r.x());
+        uHigh = qMax(uHigh, r.x());
+        vLow = qMin(vLow, r.y());
+        vHigh = qMax(vHigh, r.y());
+    }
+    if (uHigh < 0.0 || uLow > 1.0 || vHigh < 0.0 || vLow > 1.0)
+        return results;
+    
+    const QVector<qreal> us = gridLinesInRange(horizSlices, uLow, uHigh);
+    const QVector<qreal> vs = gridLinesInRange(vertSlices, vLow, vHigh);
+    if ((qint64)us.size() * vs.size() > maxCount)
+        return results;
+    
+    results.reserve(us.size() * vs.size());
+    for (int y = 0; y < vs.size(); y++)
+    {
+        for (int x = 0; x < us.size(); x++)
+        {
+            const QPointF p = project(m_toImage, QPointF(us[x], vs[y]));
+            if (rect.contains(p))
+                results.push_back(p);
+        }
+    }
+    return results;
+}
+
+
+QVector<QPointF> DieGeometry::sortedRectanglePoints(const QVector<QPointF>& inPoints)
+{
+    // Get the points' centroid
+    QVector2D centroid;
+    for (int i = 0; i < inPoints.size(); i++)
+    {
+        centroid += QVector2D(inPoints[i]);
+    }
+    centroid /= inPoints.size();
+    
+    // Now organize each point by their angles compared to this centroid
+    QVector<QPointF> results(4);
+    for (int i = 0; i < inPoints.size(); i++)
+    {
+        const qreal pi2 = M_PI / 2.0;
+        const QVector2D normalizedPoint = (QVector2D(inPoints[i]) - centroid).normalized();
+        const qreal angle = atan2(normalizedPoint.y(), normalizedPoint.x());
+        if (angle < 0.0f)
+        {
+            if (angle < -pi2) 
+                results[0] = inPoints[i];
+            else 
+                results[1] = inPoints[i];
+        }
+        else
+        {
+            if (angle < pi2) 
+                results[2] = inPoints[i];
+            else 
+                results[3] = inPoints[i];
+        }
+    }
+    
+    return results;
+}
+
+
+qreal DieGeometry::linePointDistance(const QLineF& line, const QPointF& point)
+{
+    const qreal A = point.x() - line.p1().x();
+    const qreal B = point.y() - line.p1().y();
+    const qreal C = line.p2().x() - line.p1().x();
+    const qreal D = line.p2().y() - line.p1().y();
+    
+    const qreal dot = A * C + B * D;
+    const qreal len_sq = C * C + D * D;
+    const qreal param = dot / len_sq;
+    
+    QPointF result;
+    if(param < 0)
+    {
+        result = line.p1();
+    }
+    else if(param > 1)
+    {
+        result = line.p2();
+    }
+    else
+    {
+        result.setX(line.p1().x() + param * C);
+        result.setY(line.p1().y() + param * D);
+    }
+     
+    const qreal dist = (point - result).manhattanLength();
+    return dist;
+}
+
+
+QPointF DieGeometry::project(const double* h, const QPointF& point)
+{
+    const double w = h[6] * point.x() + h[7] * point.y() + h[8];
+    return QPointF((h[0] * point.x() + h[1] * point.y() + h[2]) / w,
+                   (h[3] * point.x() + h[4] * point.y() + h[5]) / w);
+}
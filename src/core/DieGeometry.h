@@ -0,0 +1,83 @@
+#ifndef DIETOY_DIE_GEOMETRY_H
+#define DIETOY_DIE_GEOMETRY_H
+
+#include "SliceList.h"
+#include "BitLocationStore.h"
+
+#include <QLineF>
+#include <QVector>
+#include <QPointF>
+#include <QPolygonF>
+#include <opencv2/opencv.hpp>
+
+
+/// Geometry engine ///////////////////////////////////////////////////////////
+
+// The mapping between image space and ROM die space (the unit square spanned by
+// the four bounds points) and everything derived from it.  Immutable once built,
+// so one instance can be shared by any number of threads.
+class DieGeometry
+{
+public:
+    DieGeometry();
+    explicit DieGeometry(const QVector<QPointF>& boundsPoints);
+
+    // Only valid when built from exactly four bounds points
+    bool isValid() const { return m_valid; }
+
+    // The bounds points sorted clockwise from the top left
+    const QVector<QPointF>& boundsPoints() const { return m_boundsPoints; }
+    QPolygonF boundsPolygon() const { return QPolygonF(m_boundsPoints); }
+    
+    // Image space -> ROM die space
+    const cv::Mat& homography() const { return m_homography; }
+
+    QPointF romDieSpaceFromImagePoint(const QPointF& iPoint) const;
+    qreal romDieSpaceFromImagePoint(const QPointF& iPoint, const SliceOrientation& hv) const;
+    QPointF imagePointFromRomDieSpace(const QPointF& rPoint) const;
+    QLineF slicePositionToLine(const qreal& slicePosition, const SliceOrientation& hv) const;
+
+    // Image-space bit locations in scanline order (top=[0,0], left->right), in a store
+    // sized from the slice counts before any are generated
+    BitLocationStore computeBitLocations(const SliceList& horizSlices, const SliceList& vertSlices) const;
+
+    // Just rowCount rows of them, starting at firstRow, into xs and ys (rowCount * columns each)
+    void computeBitLocationRows(const SliceList& horizSlices,
+                                const SliceList& vertSlices,
+                                const int& firstRow,
+                                const int& rowCount,
+                                float* xs,
+                                float* ys) const;
+
+    // Recompute just the listed interior rows and columns of an existing store
+    // (sized for these slices) in place - the bits on the slices that moved
+    void updateBitLocations(const SliceList& horizSlices,
+                            const SliceList& vertSlices,
+                            const QVector<int>& rows,
+                            const QVector<int>& columns,
+                            BitLocationStore& locations) const;
+
+    // Just the bit locations inside an image-space rectangle, found from the slices
+    // crossing it rather than the whole grid.  Empty if there'd be more than maxCount
+    QVector<QPointF> bitLocationsInRect(const SliceList& horizSlices,
+                                        const SliceList& vertSlices,
+                                        const QRectF& rect,
+                                        const int& maxCount) const;
+
+    static QVector<QPointF> sortedRectanglePoints(const QVector<QPointF>& inPoints);
+    static qreal linePointDistance(const QLineF& line, const QPointF& point);
+
+private:
+    static QPointF project(const double* h, const QPointF& point);
+
+    bool m_valid;
+    QVector<QPointF> m_boundsPoints;
+    cv::Mat m_homography;
+    
+    // Row-major copies of the homography and its inverse for per-point mapping
+    double m_toRomDie[9];
+    double m_toImage[9];
+};
+
+
+#endif // DIETOY_DIE_GEOMETRY_H
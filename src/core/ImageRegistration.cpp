@@ -0,0 +1,165 @@
+#include "ImageRegistration.h"
+#include "ImageSampler.h"
+
+#include <QDebug>
+
+#include <vector>
+
+
+ImageRegistration::ImageRegistration()
+    : m_coarseSize(1024)
+    , m_fineSize(4096)
+    , m_maxFeatures(5000)
+    , m_valid(false)
+    , m_inlierCount(0)
+    , m_homography()
+{
+    
+}
+
+
+// A level's homography expressed in full resolution image coordinates, and back
+static cv::Mat scaleHomography(const cv::Mat& homography, const double& scale)
+{
+    const cv::Mat toLevel = (cv::Mat_<double>(3, 3) << scale, 0.0, 0.0, 0.0, scale, 0.0, 0.0, 0.0, 1.0);
+    return toLevel * homography * toLevel.inv();
+}
+
+
+bool ImageRegistration::align(const QImage& from, const QImage& to)
+{
+    m_valid = false;
+    m_inlierCount = 0;
+    m_homography = cv::Mat();
+    
+    // Features only need luminance
+    const QImage fromGray = ImageSampler::luminanceImage(from, QImage::Format_Grayscale8);
+    const QImage toGray = ImageSampler::luminanceImage(to, QImage::Format_Grayscale8);
+    if (fromGray.isNull() || toGray.isNull())
+    {
+        qWarning() << "Registration needs two images";
+        return false;
+    }
+    const cv::Mat fromImage(fromGray.height(), fromGray.width(), CV_8UC1, const_cast<uchar*>(fromGray.constBits()), fromGray.bytesPerLine());
+    const cv::Mat toImage(toGray.height(), toGray.width(), CV_8UC1, const_cast<uchar*>(toGray.constBits()), toGray.bytesPerLine());
+    
+    // Pyramid scales, coarsest first, doubling up to the finest
+    const int longest = qMax(qMax(fromGray.width(), fromGray.height()), qMax(toGray.width(), toGray.height()));
+    const double coarsest = qMin(1.0, (double)m_coarseSize / longest);
+    const double finest = qMax(coarsest, qMin(1.0, (double)m_fineSize / longest));
+    std::vector<double> scales(1, coarsest);
+    while (scales.back() * 2.0 < finest)
+        scales.push_back(scales.back() * 2.0);
+    if (scales.back() < finest)
+        scales.push_back(finest);
+    
+    cv::Ptr<cv::ORB> orb = cv::ORB::create(m_maxFeatures);
+    cv::BFMatcher matcher(cv::NORM_HAMMING);
+    cv::Mat homography;
+    for (size_t level = 0; level < scales.size(); level++)
+    {
+        const double scale = scales[level];
+        cv::Mat fromLevel = fromImage;
+        cv::Mat toLevel = toImage;
+        if (scale < 1.0)
+        {
+            cv::resize(fromImage, fromLevel, cv::Size(), scale, scale, cv::INTER_AREA);
+            cv::resize(toImage, toLevel, cv::Size(), scale, scale, cv::INTER_AREA);
+        }
+        
+        std::vector<cv::KeyPoint> fromKeys;
+        std::vector<cv::KeyPoint> toKeys;
+        cv::Mat fromDescriptors;
+        cv::Mat toDescriptors;
+        orb->detectAndCompute(fromLevel, cv::noArray(), fromKeys, fromDescriptors);
+        orb->detectAndCompute(toLevel, cv::noArray(), toKeys, toDescriptors);
+        if (fromDescriptors.empty() || toDescriptors.empty())
+        {
+            qWarning() << "No features found to register the images on";
+            return false;
+        }
+        
+        // The coarse level trusts a ratio test, later ones pick the best candidate
+        // near where the previous estimate puts it
+        std::vector<std::vector<cv::DMatch> > candidates;
+        matcher.knnMatch(fromDescriptors, toDescriptors, candidates, (level == 0) ? 2 : 8);
+        const cv::Mat predicted = homography.empty() ? cv::Mat() : scaleHomography(homography, scale);
+        const double guideRadius = 8.0;
+        
+        std::vector<cv::Point2f> fromPoints;
+        std::vector<cv::Point2f> toPoints;
+        for (size_t i = 0; i < candidates.size(); i++)
+        {
+            const std::vector<cv::DMatch>& c = candidates[i];
+            if (c.empty())
+                continue;
+            
+            const cv::Point2f fromPoint = fromKeys[c[0].queryIdx].pt;
+            if (predicted.empty())
+            {
+                if (c.size() < 2 || c[0].distance > 0.8f * c[1].distance)
+                    continue;
+                fromPoints.push_back(fromPoint);
+                toPoints.push_back(toKeys[c[0].trainIdx].pt);
+                continue;
+            }
+            
+            std::vector<cv::Point2f> source(1, fromPoint);
+            std::vector<cv::Point2f> expected;
+            cv::perspectiveTransform(source, expected, predicted);
+            for (size_t j = 0; j < c.size(); j++)
+            {
+                const cv::Point2f toPoint = toKeys[c[j].trainIdx].pt;
+                if (cv::norm(toPoint - expected[0]) <= guideRadius)
+                {
+                    fromPoints.push_back(fromPoint);
+                    toPoints.push_back(toPoint);
+                    break;
+                }
+            }
+        }
+        
+        if (fromPoints.size() < 8)
+        {
+            qWarning() << "Too few matching features to register the images at scale" << scale;
+            return false;
+        }
+        
+        std::vector<uchar> inliers;
+        const cv::Mat levelHomography = cv::findHomography(fromPoints, toPoints, cv::RANSAC, (level == 0) ? 3.0 : 2.0, inliers);
+        if (levelHomography.empty())
+        {
+            qWarning() << "No consistent homography between the images at scale" << scale;
+            return false;
+        }
+        
+        homography = scaleHomography(levelHomography, 1.0 / scale);
+        m_inlierCount = cv::countNonZero(inliers);
+    }
+    
+    m_homography = homography;
+    m_valid = true;
+    return true;
+}
+
+
+QPointF ImageRegistration::map(const QPointF& point) const
+{
+    if (!m_valid)
+        return point;
+    
+    const cv::Mat_<double> h = m_homography;
+    const double w = h(2, 0) * point.x() + h(2, 1) * point.y() + h(2, 2);
+    return QPointF((h(0, 0) * point.x() + h(0, 1) * point.y() + h(0, 2)) / w,
+                   (h(1, 0) * point.x() + h(1, 1) * point.y() + h(1, 2)) / w);
+}
+
+
+DieDescription ImageRegistration::transfer(const DieDescription& die) const
+{
+    DieDescription transferred = die;
+    QVector<QPointF>& boundsPoints = transferred.boundsPoints();
+    for (int i = 0; i < boundsPoints.size(); i++)
+        boundsPoints[i] = map(boundsPoints[i]);
+    return transferred;
+}
@@ -0,0 +1,50 @@
+#ifndef DIETOY_IMAGE_REGISTRATION_H
+#define DIETOY_IMAGE_REGISTRATION_H
+
+#include "DieDescription.h"
+
+#include <QImage>
+#include <QPointF>
+#include <opencv2/opencv.hpp>
+
+
+/// Capture to capture registration ///////////////////////////////////////////
+
+// The homography between two captures of the same die (other lighting, another
+// delayering stage).  ORB features are matched with a ratio test and RANSAC on a
+// small copy of both images first, then each finer pyramid level only accepts
+// matches that land near where the previous estimate predicts, so the
+// expensive levels start from a good guess and just tighten it.
+class ImageRegistration
+{
+public:
+    ImageRegistration();
+
+    // The coarsest level's longest side, and the finest level's (full resolution when the image is smaller)
+    void setCoarseSize(const int& pixels) { m_coarseSize = pixels; }
+    void setFineSize(const int& pixels) { m_fineSize = pixels; }
+    void setMaxFeatures(const int& count) { m_maxFeatures = count; }
+
+    // Finds the mapping from image points in 'from' to image points in 'to'
+    bool align(const QImage& from, const QImage& to);
+
+    bool isValid() const { return m_valid; }
+    int inlierCount() const { return m_inlierCount; }
+    const cv::Mat& homography() const { return m_homography; }
+    QPointF map(const QPointF& point) const;
+
+    // The description moved onto the 'to' image.  The slices live in ROM die
+    // space, so only the bounds points need mapping
+    DieDescription transfer(const DieDescription& die) const;
+
+private:
+    int m_coarseSize;
+    int m_fineSize;
+    int m_maxFeatures;
+    bool m_valid;
+    int m_inlierCount;
+    cv::Mat m_homography;
+};
+
+
+#endif // DIETOY_IMAGE_REGISTRATION_H
@@ -0,0 +1,232 @@
+#include "ImageSampler.h"
+
+#include <cmath>
+
+
+ImageSampler::ImageSampler()
+    : m_image()
+{
+    
+}
+
+
+ImageSampler::ImageSampler(const QImage& image)
+    : m_image(image)
+{
+    
+}
+
+
+QRgb ImageSampler::pixel(const int& x, const int& y) const
+{
+    // Reads straight from the scanlines when the image is single-channel
+    switch (m_image.format())
+    {
+        case QImage::Format_Grayscale8:
+        {
+            const int v = m_image.constScanLine(y)[x];
+            return qRgb(v, v, v);
+        }
+        case QImage::Format_Grayscale16:
+        {
+            const int v = reinterpret_cast<const quint16*>(m_image.constScanLine(y))[x] >> 8;
+            return qRgb(v, v, v);
+        }
+        default:
+            return m_image.pixel(x, y);
+    }
+}
+
+
+QColor ImageSampler::bilinear(const QPointF& pixelCoord) const
+{
+    // Some constants
+    const int w = m_image.width();
+    const int h = m_image.height();
+    const qreal x = pixelCoord.x();
+    const qreal y = pixelCoord.y();
+
+    // Get the top and bottom coordinates
+    const int x1 = static_cast<int>(floor(x));
+    const int y1 = static_cast<int>(floor(y));
+    const int x2 = x1 + 1;
+    const int y2 = y1 + 1;
+
+    // Boundary conditions
+    if (x1 < 0  || y1 < 0)  return QColor(0, 0, 0);
+    if (x1 >= w || y1 >= h) return QColor(0, 0, 0);
+    if (x2 >= w || y2 >= h) return pixel(x1, y1);
+    
+    // Pixel samples
+    const QColor ltop = pixel(x1, y1);
+    const QColor rtop = pixel(x1, y2);
+    const QColor lbot = pixel(x2, y1);
+    const QColor rbot = pixel(x2, y2);
+
+    // Blerp for great success
+    QColor result;
+    result.setRed  (((x2 - x) * (y2 - y) * ltop.redF()   + (x2 - x) * (y - y1) * rtop.redF() + 
+                     (x - x1) * (y2 - y) * lbot.redF()   + (x - x1) * (y - y1) * rbot.redF()) * 255.0);
+    result.setGreen(((x2 - x) * (y2 - y) * ltop.greenF() + (x2 - x) * (y - y1) * rtop.greenF() + 
+                     (x - x1) * (y2 - y) * lbot.greenF() + (x - x1) * (y - y1) * rbot.greenF()) * 255.0);
+    result.setBlue (((x2 - x) * (y2 - y) * ltop.blueF()  + (x2 - x) * (y - y1) * rtop.blueF() + 
+                     (x - x1) * (y2 - y) * lbot.blueF()  + (x - x1) * (y - y1) * rbot.blueF()) * 255.0);
+    return result;
+}
+
+
+qreal ImageSampler::bilinearLuminance(const QPointF& pixelCoord) const
+{
+    // Same as bilinear(), but for a single channel normalized to [0, 1]
+    const int w = m_image.width();
+    const int h = m_image.height();
+    const qreal x = pixelCoord.x();
+    const qreal y = pixelCoord.y();
+
+    const int x1 = static_cast<int>(floor(x));
+    const int y1 = static_cast<int>(floor(y));
+    const int x2 = x1 + 1;
+    const int y2 = y1 + 1;
+
+    // Boundary conditions
+    if (x1 < 0  || y1 < 0)  return 0.0;
+    if (x1 >= w || y1 >= h) return 0.0;
+    if (x2 >= w || y2 >= h) return luminance(x1, y1);
+
+    return (x2 - x) * (y2 - y) * luminance(x1, y1) + (x2 - x) * (y - y1) * luminance(x1, y2) +
+           (x - x1) * (y2 - y) * luminance(x2, y1) + (x - x1) * (y - y1) * luminance(x2, y2);
+}
+
+
+void ImageSampler::luminancePatch(const QPointF& pixelCoord, const int& radius, float* out) const
+{
+    const int singleDim = radius * 2 + 1;
+    const int cx = static_cast<int>(floor(pixelCoord.x()));
+    const int cy = static_cast<int>(floor(pixelCoord.y()));
+    
+    for (int y = 0; y < singleDim; y++)
+    {
+        for (int x = 0; x < singleDim; x++)
+        {
+            const int ix = cx + x - radius;
+            const int iy = cy + y - radius;
+            *out++ = m_image.valid(ix, iy) ? static_cast<float>(luminance(ix, iy)) : 0.0f;
+        }
+    }
+}
+
+
+void ImageSampler::colorPatch(const QPointF& pixelCoord, const int& radius, QRgb* out, const QRgb& outside) const
+{
+    const int singleDim = radius * 2 + 1;
+    const int cx = static_cast<int>(floor(pixelCoord.x()));
+    const int cy = static_cast<int>(floor(pixelCoord.y()));
+    
+    for (int y = 0; y < singleDim; y++)
+    {
+        for (int x = 0; x < singleDim; x++)
+        {
+            const int ix = cx + x - radius;
+            const int iy = cy + y - radius;
+            *out++ = m_image.valid(ix, iy) ? pixel(ix, iy) : outside;
+        }
+    }
+}
+
+
+void ImageSampler::luminancePatches(const float* xs, const float* ys, const int& count, const int& radius, float* out) const
+{
+    const int singleDim = radius * 2 + 1;
+    const qint64 patchSize = singleDim * singleDim;
+    
+    // Every patch has its own slice of the output, so the bits can be split freely
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < count; i++)
+    {
+        luminancePatch(QPointF(xs[i], ys[i]), radius, out + i * patchSize);
+    }
+}
+
+
+qreal ImageSampler::luminance(const int& x, const int& y) const
+{
+    // A single luminance value in [0, 1] regardless of the image format
+    switch (m_image.format())
+    {
+        case QImage::Format_Grayscale8:
+            return m_image.constScanLine(y)[x] / 255.0;
+        case QImage::Format_Grayscale16:
+            return reinterpret_cast<const quint16*>(m_image.constScanLine(y))[x] / 65535.0;
+        default:
+            return qGray(m_image.pixel(x, y)) / 255.0;
+    }
+}
+
+
+QImage ImageSampler::luminanceImage(const QImage& image, const QImage::Format& format)
+{
+    // Nothing to do if the image is already what was asked for
+    if (image.format() == format)
+        return image;
+    
+    // RGB32 and RGBX64 scanlines are read directly.  Anything else is converted to one
+    // of them a strip of rows at a time, so no full-size copy is made next to the source.
+    const bool wideSource = (image.format() == QImage::Format_RGBX64 ||
+                             image.format() == QImage::Format_RGBA64 ||
+                             image.format() == QImage::Format_RGBA64_Premultiplied ||
+                             image.format() == QImage::Format_Grayscale16);
+    const bool direct = (image.format() == QImage::Format_RGB32 || image.format() == QImage::Format_ARGB32 ||
+                         image.format() == QImage::Format_RGBX64 || image.format() == QImage::Format_RGBA64);
+    const QImage::Format stripFormat = wideSource ? QImage::Format_RGBX64 : QImage::Format_RGB32;
+    
+    QImage result(image.size(), format);
+    if (result.isNull())
+        return result;
+    
+    // Grab raw pointers up front - scanLine() detaches, which isn't safe across threads
+    uchar* dstBits = result.bits();
+    const int dstBpl = result.bytesPerLine();
+    const int w = image.width();
+    const int h = image.height();
+    const int stripRows = direct ? h : 256;
+    const bool wideResult = (format == QImage::Format_Grayscale16);
+    
+    for (int y0 = 0; y0 < h; y0 += stripRows)
+    {
+        const int rows = qMin(stripRows, h - y0);
+        const QImage source = direct ? image : image.copy(0, y0, w, rows).convertToFormat(stripFormat);
+        if (source.isNull())
+            return QImage();
+        const uchar* srcBits = source.constBits();
+        const int srcBpl = source.bytesPerLine();
+        
+        // Rec. 601 luma in 8-bit fixed point, one scanline per task
+        #pragma omp parallel for schedule(static)
+        for (int r = 0; r < rows; r++)
+        {
+            const uchar* srcLine = srcBits + (qint64)r * srcBpl;
+            uchar* dstLine = dstBits + (qint64)(y0 + r) * dstBpl;
+            for (int x = 0; x < w; x++)
+            {
+                quint32 luma16;
+                if (wideSource)
+                {
+                    const QRgba64& p = reinterpret_cast<const QRgba64*>(srcLine)[x];
+                    luma16 = (p.red() * 77 + p.green() * 150 + p.blue() * 29) >> 8;
+                }
+                else
+                {
+                    const QRgb p = reinterpret_cast<const QRgb*>(srcLine)[x];
+                    luma16 = ((qRed(p) * 77 + qGreen(p) * 150 + qBlue(p) * 29) * 257) >> 8;
+                }
+                
+                if (wideResult)
+                    reinterpret_cast<quint16*>(dstLine)[x] = luma16;
+                else
+                    dstLine[x] = luma16 >> 8;
+            }
+        }
+    }
+    
+    return result;
+}
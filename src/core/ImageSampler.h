@@ -0,0 +1,53 @@
+#ifndef DIETOY_IMAGE_SAMPLER_H
+#define DIETOY_IMAGE_SAMPLER_H
+
+#include <QImage>
+#include <QColor>
+#include <QPointF>
+
+
+/// Pixel sampler /////////////////////////////////////////////////////////////
+
+// Read-only pixel access over a die image (color or single-channel grayscale).
+// Holds an implicitly shared QImage and only ever reads through const scanlines,
+// so copies can be handed to worker threads freely.
+class ImageSampler
+{
+public:
+    ImageSampler();
+    explicit ImageSampler(const QImage& image);
+
+    const QImage& image() const { return m_image; }
+    bool isNull() const { return m_image.isNull(); }
+    QSize size() const { return m_image.size(); }
+    bool valid(const int& x, const int& y) const { return m_image.valid(x, y); }
+
+    // Nearest pixel (must be valid)
+    QRgb pixel(const int& x, const int& y) const;
+    
+    // Bilinear samples - black outside the image
+    QColor bilinear(const QPointF& pixelCoord) const;
+    qreal bilinearLuminance(const QPointF& pixelCoord) const;
+
+    // (2*radius+1)^2 luminance patch in [0, 1] around the pixel containing pixelCoord,
+    // row-major into out and black outside the image
+    void luminancePatch(const QPointF& pixelCoord, const int& radius, float* out) const;
+
+    // The same patch in color, with pixels outside the image set to outside
+    void colorPatch(const QPointF& pixelCoord, const int& radius, QRgb* out, const QRgb& outside = qRgb(0, 0, 0)) const;
+
+    // One patch per (xs[i], ys[i]) location, packed back to back into out (count * (2*radius+1)^2 floats)
+    void luminancePatches(const float* xs, const float* ys, const int& count, const int& radius, float* out) const;
+
+    // Rec. 601 luma copy of an image as Format_Grayscale8 or Format_Grayscale16, converted in parallel.
+    // Needs no more memory than the source and the result (plus a strip of rows).
+    static QImage luminanceImage(const QImage& image, const QImage::Format& format);
+
+private:
+    qreal luminance(const int& x, const int& y) const;
+
+    QImage m_image;
+};
+
+
+#endif // DIETOY_IMAGE_SAMPLER_H
@@ -0,0 +1,334 @@
+#include "RomFormat.h"
+
+#include <QFile>
+#include <QDebug>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QTextStream>
+
+
+RomFormat::RomFormat()
+    : m_wordBits(8)
+    , m_transpose(false)
+    , m_flipRows(false)
+    , m_flipColumns(false)
+    , m_bitLayout(GroupedColumns)
+    , m_addressOrder(RowMajor)
+    , m_bitOrder()
+    , m_invert(false)
+    , m_bigEndian(false)
+{
+    
+}
+
+
+bool RomFormat::isDefault() const
+{
+    return m_wordBits == 8 && !m_transpose && !m_flipRows && !m_flipColumns &&
+           m_bitLayout == GroupedColumns && m_addressOrder == RowMajor &&
+           m_bitOrder.isEmpty() && !m_invert && !m_bigEndian;
+}
+
+
+bool RomFormat::isValid() const
+{
+    if (m_wordBits != 8 && m_wordBits != 16 && m_wordBits != 32)
+        return false;
+    
+    // The bit order has to name every word bit exactly once
+    if (m_bitOrder.isEmpty())
+        return true;
+    if (m_bitOrder.size() != m_wordBits)
+        return false;
+    QVector<bool> seen(m_wordBits, false);
+    for (int i = 0; i < m_bitOrder.size(); i++)
+    {
+        if (m_bitOrder[i] < 0 || m_bitOrder[i] >= m_wordBits || seen[m_bitOrder[i]])
+            return false;
+        seen[m_bitOrder[i]] = true;
+    }
+    return true;
+}
+
+
+bool RomFormat::buildTable(const QSize& bitCount, QVector<qint32>& table) const
+{
+    table.clear();
+    if (!isValid())
+    {
+        qWarning() << "Invalid ROM format - words must be 8, 16 or 32 bits and the bit order a permutation of them";
+        return false;
+    }
+    
+    // Dimensions after reorientation
+    const int gridColumns = bitCount.width();
+    const int rows = m_transpose ? bitCount.width() : bitCount.height();
+    const int columns = m_transpose ? bitCount.height() : bitCount.width();
+    if (columns % m_wordBits != 0)
+    {
+        qWarning() << "The" << columns << "bit columns don't split evenly into" << m_wordBits << "bit words";
+        return false;
+    }
+    
+    const int planeColumns = columns / m_wordBits;
+    const int wordCount = rows * planeColumns;
+    QVector<int> wordBitOfPlane(m_wordBits);
+    for (int k = 0; k < m_wordBits; k++)
+        wordBitOfPlane[k] = m_bitOrder.isEmpty() ? (m_wordBits - 1 - k) : m_bitOrder[k];
+    
+    table.resize(wordCount * m_wordBits);
+    qint32* tableData = table.data();
+    
+    #pragma omp parallel for schedule(static)
+    for (int r = 0; r < rows; r++)
+    {
+        for (int c = 0; c < columns; c++)
+        {
+            // Back to the grid's own row and column
+            const int orientedRow = m_flipRows ? (rows - 1 - r) : r;
+            const int orientedColumn = m_flipColumns ? (columns - 1 - c) : c;
+            const int gridRow = m_transpose ? orientedColumn : orientedRow;
+            const int gridColumn = m_transpose ? orientedRow : orientedColumn;
+            
+            // Which plane the column belongs to, and where in it
+            const int plane = (m_bitLayout == GroupedColumns) ? (c / planeColumns) : (c % m_wordBits);
+            const int planeColumn = (m_bitLayout == GroupedColumns) ? (c % planeColumns) : (c / m_wordBits);
+            const int address = (m_addressOrder == RowMajor) ? (r * planeColumns + planeColumn) : (planeColumn * rows + r);
+            
+            tableData[address * m_wordBits + wordBitOfPlane[plane]] = gridRow * gridColumns + gridColumn;
+        }
+    }
+    
+    return true;
+}
+
+
+bool RomFormat::assemble(const QVector<quint8>& bits, const QSize& bitCount, QByteArray& rom) const
+{
+    rom.clear();
+    if (bits.size() != bitCount.width() * bitCount.height())
+    {
+        qWarning() << "Have" << bits.size() << "bits for a" << bitCount << "bit grid";
+        return false;
+    }
+    
+    QVector<qint32> table;
+    if (!buildTable(bitCount, table))
+        return false;
+    
+    // Gather each word's bits through the table, then lay its bytes out in order
+    const int wordCount = table.size() / m_wordBits;
+    const int bytesPerWord = m_wordBits / 8;
+    const quint32 invertMask = m_invert ? (m_wordBits == 32 ? 0xffffffffu : ((1u << m_wordBits) - 1)) : 0u;
+    rom.resize(wordCount * bytesPerWord);
+    
+    const quint8* bitData = bits.constData();
+    const qint32* tableData = table.constData();
+    char* romData = rom.data();
+    
+    #pragma omp parallel for schedule(static)
+    for (int w = 0; w < wordCount; w++)
+    {
+        const qint32* wordTable = tableData + (qint64)w * m_wordBits;
+        quint32 word = 0;
+        for (int b = 0; b < m_wordBits; b++)
+            word |= (quint32)(bitData[wordTable[b]] & 1) << b;
+        word ^= invertMask;
+        
+        char* wordBytes = romData + (qint64)w * bytesPerWord;
+        for (int i = 0; i < bytesPerWord; i++)
+            wordBytes[m_bigEndian ? (bytesPerWord - 1 - i) : i] = static_cast<char>((word >> (8 * i)) & 0xff);
+    }
+    
+    return true;
+}
+
+
+QJsonObject RomFormat::toJson() const
+{
+    QJsonObject json;
+    json["wordBits"] = m_wordBits;
+    json["transpose"] = m_transpose;
+    json["flipRows"] = m_flipRows;
+    json["flipColumns"] = m_flipColumns;
+    json["bitLayout"] = (m_bitLayout == GroupedColumns) ? "grouped" : "interleaved";
+    json["addressOrder"] = (m_addressOrder == RowMajor) ? "rowMajor" : "columnMajor";
+    if (!m_bitOrder.isEmpty())
+    {
+        QJsonArray bitOrderArray;
+        for (int i = 0; i < m_bitOrder.size(); i++)
+            bitOrderArray.append(m_bitOrder[i]);
+        json["bitOrder"] = bitOrderArray;
+    }
+    json["invert"] = m_invert;
+    json["bigEndian"] = m_bigEndian;
+    return json;
+}
+
+
+bool RomFormat::fromJson(const QJsonObject& json)
+{
+    *this = RomFormat();
+    
+    m_wordBits = json["wordBits"].toInt(8);
+    m_transpose = json["transpose"].toBool();
+    m_flipRows = json["flipRows"].toBool();
+    m_flipColumns = json["flipColumns"].toBool();
+    m_bitLayout = (json["bitLayout"].toString() == "interleaved") ? InterleavedColumns : GroupedColumns;
+    m_addressOrder = (json["addressOrder"].toString() == "columnMajor") ? ColumnMajor : RowMajor;
+    const QJsonArray bitOrderArray = json["bitOrder"].toArray();
+    for (int i = 0; i < bitOrderArray.size(); i++)
+        m_bitOrder.push_back(bitOrderArray[i].toInt(-1));
+    m_invert = json["invert"].toBool();
+    m_bigEndian = json["bigEndian"].toBool();
+    
+    if (!isValid())
+    {
+        qWarning() << "Invalid ROM format in die description.  Using the default";
+        *this = RomFormat();
+        return false;
+    }
+    return true;
+}
+
+
+/// Output files //////////////////////////////////////////////////////////////
+
+RomFormat::OutputFormat RomFormat::formatFromFilename(const QString& filename)
+{
+    const QString suffix = QFileInfo(filename).suffix().toLower();
+    if (suffix == "hex" || suffix == "ihex")
+        return IntelHex;
+    if (suffix == "txt")
+        return HexDump;
+    return Binary;
+}
+
+
+bool RomFormat::write(const QByteArray& rom, const QString& filename, const OutputFormat& format)
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::WriteOnly))
+    {
+        qWarning() << "Unable to write " << filename;
+        return false;
+    }
+    
+    QByteArray contents;
+    if (format == HexDump)
+        contents = hexDump(rom);
+    else if (format == IntelHex)
+        contents = intelHex(rom);
+    else
+        contents = rom;
+    
+    return file.write(contents) == contents.size();
+}
+
+
+bool RomFormat::writeBitRows(const QString& filename, const QVector<quint8>& bits, const int& bitsAcross)
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text))
+    {
+        qWarning() << "Unable to write " << file.fileName();
+        return false;
+    }
+    
+    QTextStream out(&file);
+    for (int i = 0; i < bits.size(); i++)
+    {
+        out << (int)bits[i];
+        if (i % bitsAcross == bitsAcross - 1)
+            out << "\n";
+    }
+    return true;
+}
+
+
+bool RomFormat::readBitRows(const QString& filename, QVector<quint8>& bits)
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+        qWarning() << "Unable to read " << filename;
+        return false;
+    }
+    
+    bits.clear();
+    const QByteArray text = file.readAll();
+    for (int i = 0; i < text.size(); i++)
+    {
+        if (text[i] == '0' || text[i] == '1')
+            bits.push_back(text[i] == '1');
+    }
+    return true;
+}
+
+
+static void appendHexByte(QByteArray& out, const quint8& byte)
+{
+    static const char digits[] = "0123456789ABCDEF";
+    out.append(digits[byte >> 4]);
+    out.append(digits[byte & 0xf]);
+}
+
+
+QByteArray RomFormat::hexDump(const QByteArray& rom)
+{
+    // "00000000: 00 01 02 ..." sixteen bytes to a line
+    QByteArray out;
+    out.reserve(rom.size() * 3 + (rom.size() / 16 + 1) * 11);
+    for (int i = 0; i < rom.size(); i++)
+    {
+        if (i % 16 == 0)
+        {
+            for (int shift = 24; shift >= 0; shift -= 8)
+                appendHexByte(out, (i >> shift) & 0xff);
+            out.append(':');
+        }
+        out.append(' ');
+        appendHexByte(out, static_cast<quint8>(rom[i]));
+        if (i % 16 == 15 || i == rom.size() - 1)
+            out.append('\n');
+    }
+    return out;
+}
+
+
+static void appendIntelHexRecord(QByteArray& out, const quint8& type, const quint16& address, const char* data, const int& count)
+{
+    // Checksum is the two's complement of the byte sum of everything after the colon
+    quint8 sum = count + (address >> 8) + (address & 0xff) + type;
+    out.append(':');
+    appendHexByte(out, count);
+    appendHexByte(out, address >> 8);
+    appendHexByte(out, address & 0xff);
+    appendHexByte(out, type);
+    for (int i = 0; i < count; i++)
+    {
+        appendHexByte(out, static_cast<quint8>(data[i]));
+        sum += static_cast<quint8>(data[i]);
+    }
+    appendHexByte(out, static_cast<quint8>(-sum));
+    out.append('\n');
+}
+
+
+QByteArray RomFormat::intelHex(const QByteArray& rom)
+{
+    QByteArray out;
+    out.reserve(rom.size() * 3);
+    for (int offset = 0; offset < rom.size(); offset += 16)
+    {
+        // A new upper address every 64KB
+        if (offset > 0 && (offset & 0xffff) == 0)
+        {
+            const char upper[2] = { static_cast<char>((offset >> 24) & 0xff), static_cast<char>((offset >> 16) & 0xff) };
+            appendIntelHexRecord(out, 0x04, 0, upper, 2);
+        }
+        appendIntelHexRecord(out, 0x00, offset & 0xffff, rom.constData() + offset, qMin(16, rom.size() - offset));
+    }
+    appendIntelHexRecord(out, 0x01, 0, NULL, 0);
+    return out;
+}
@@ -0,0 +1,90 @@
+#ifndef DIETOY_ROM_FORMAT_H
+#define DIETOY_ROM_FORMAT_H
+
+#include <QSize>
+#include <QString>
+#include <QVector>
+#include <QByteArray>
+#include <QJsonObject>
+
+
+/// Bit grid to ROM bytes /////////////////////////////////////////////////////
+
+// How the physical bit grid of a die reads out as ROM words.  The grid is first
+// reoriented (transpose, then row and column flips), its columns are split into
+// wordBits planes - contiguous groups, or every wordBits'th column - and each
+// plane supplies one bit of every word, in row- or column-major address order.
+// bitOrder says which word bit each plane is (msb first when empty).
+//
+// The settings compile to a table of one source bit per output bit, so turning a
+// bit array into bytes is a single gather over it.
+class RomFormat
+{
+public:
+    RomFormat();
+
+    enum BitLayout { GroupedColumns,
+                     InterleavedColumns };
+    enum AddressOrder { RowMajor,
+                        ColumnMajor };
+    enum OutputFormat { Binary,
+                        HexDump,
+                        IntelHex };
+
+    int wordBits() const { return m_wordBits; }
+    void setWordBits(const int& bits) { m_wordBits = bits; }
+    bool transpose() const { return m_transpose; }
+    void setTranspose(const bool& on) { m_transpose = on; }
+    bool flipRows() const { return m_flipRows; }
+    void setFlipRows(const bool& on) { m_flipRows = on; }
+    bool flipColumns() const { return m_flipColumns; }
+    void setFlipColumns(const bool& on) { m_flipColumns = on; }
+    BitLayout bitLayout() const { return m_bitLayout; }
+    void setBitLayout(const BitLayout& layout) { m_bitLayout = layout; }
+    AddressOrder addressOrder() const { return m_addressOrder; }
+    void setAddressOrder(const AddressOrder& order) { m_addressOrder = order; }
+    const QVector<int>& bitOrder() const { return m_bitOrder; }
+    void setBitOrder(const QVector<int>& order) { m_bitOrder = order; }
+    bool invert() const { return m_invert; }
+    void setInvert(const bool& on) { m_invert = on; }
+    bool bigEndian() const { return m_bigEndian; }
+    void setBigEndian(const bool& on) { m_bigEndian = on; }
+
+    bool isDefault() const;
+    bool isValid() const;
+
+    // table[word * wordBits + wordBit] is the row-major index of the grid bit it comes from
+    bool buildTable(const QSize& bitCount, QVector<qint32>& table) const;
+
+    // One byte per bit in, wordBits / 8 bytes per word out
+    bool assemble(const QVector<quint8>& bits, const QSize& bitCount, QByteArray& rom) const;
+
+    // DDF representation
+    QJsonObject toJson() const;
+    bool fromJson(const QJsonObject& json);
+
+    // Output files - Intel HEX switches to extended linear addresses past 64KB
+    static OutputFormat formatFromFilename(const QString& filename);
+    static bool write(const QByteArray& rom, const QString& filename, const OutputFormat& format);
+    static QByteArray hexDump(const QByteArray& rom);
+    static QByteArray intelHex(const QByteArray& rom);
+
+    // Bits as rows of 0s and 1s, bitsAcross to a row (what dieToyCli --classify and
+    // dieToySynth --bits write), and every 0 and 1 of such a file back in order
+    static bool writeBitRows(const QString& filename, const QVector<quint8>& bits, const int& bitsAcross);
+    static bool readBitRows(const QString& filename, QVector<quint8>& bits);
+
+private:
+    int m_wordBits;
+    bool m_transpose;
+    bool m_flipRows;
+    bool m_flipColumns;
+    BitLayout m_bitLayout;
+    AddressOrder m_addressOrder;
+    QVector<int> m_bitOrder;
+    bool m_invert;
+    bool m_bigEndian;
+};
+
+
+#endif // DIETOY_ROM_FORMAT_H
@@ -0,0 +1,229 @@
+#include "SliceList.h"
+
+#include <QPair>
+#include <QSet>
+#include <QtAlgorithms>
+
+#include <algorithm>
+
+
+SliceList::SliceList()
+    : m_positions()
+    , m_ids()
+    , m_positionById()
+    , m_nextId(0)
+{
+    
+}
+
+
+void SliceList::clear()
+{
+    m_positions.clear();
+    m_ids.clear();
+    m_positionById.clear();
+}
+
+
+int SliceList::indexOfId(const quint32& id) const
+{
+    if (!m_positionById.contains(id))
+        return -1;
+    
+    // Find the run of (usually one) slices at the id's position, then the id itself
+    const qreal position = m_positionById.value(id);
+    for (int i = lowerBound(position); i < m_positions.size() && m_positions[i] == position; i++)
+    {
+        if (m_ids[i] == id)
+            return i;
+    }
+    return -1;
+}
+
+
+int SliceList::lowerBound(const qreal& position) const
+{
+    return std::lower_bound(m_positions.constBegin(), m_positions.constEnd(), position) - m_positions.constBegin();
+}
+
+
+int SliceList::upperBound(const qreal& position) const
+{
+    return std::upper_bound(m_positions.constBegin(), m_positions.constEnd(), position) - m_positions.constBegin();
+}
+
+
+int SliceList::nearestIndex(const qreal& position) const
+{
+    if (m_positions.isEmpty())
+        return -1;
+    
+    const int upper = lowerBound(position);
+    if (upper == 0)
+        return 0;
+    if (upper == m_positions.size())
+        return upper - 1;
+    
+    const int lower = upper - 1;
+    return (position - m_positions[lower] <= m_positions[upper] - position) ? lower : upper;
+}
+
+
+quint32 SliceList::insert(const qreal& position)
+{
+    const quint32 newId = m_nextId;
+    insert(QVector<qreal>(1, position), QVector<quint32>(1, newId));
+    return newId;
+}
+
+
+QVector<quint32> SliceList::insert(const QVector<qreal>& positions)
+{
+    QVector<quint32> ids(positions.size());
+    for (int i = 0; i < ids.size(); i++)
+    {
+        ids[i] = m_nextId + i;
+    }
+    insert(positions, ids);
+    return ids;
+}
+
+
+void SliceList::insert(const QVector<qreal>& positions, const QVector<quint32>& ids)
+{
+    // Sort the newcomers, then merge both sorted runs in place starting from the back
+    QVector< QPair<qreal, quint32> > incoming(positions.size());
+    for (int i = 0; i < positions.size(); i++)
+    {
+        incoming[i] = qMakePair(positions[i], ids[i]);
+        m_positionById.insert(ids[i], positions[i]);
+        m_nextId = qMax(m_nextId, ids[i] + 1);
+    }
+    std::sort(incoming.begin(), incoming.end());
+    
+    int read = m_positions.size() - 1;
+    int in = incoming.size() - 1;
+    int write = m_positions.size() + incoming.size() - 1;
+    m_positions.resize(write + 1);
+    m_ids.resize(write + 1);
+    while (in >= 0)
+    {
+        const bool existingIsLarger = (read >= 0) &&
+                                      (m_positions[read] > incoming[in].first ||
+                                       (m_positions[read] == incoming[in].first && m_ids[read] > incoming[in].second));
+        if (existingIsLarger)
+        {
+            m_positions[write] = m_positions[read];
+            m_ids[write] = m_ids[read];
+            read--;
+        }
+        else
+        {
+            m_positions[write] = incoming[in].first;
+            m_ids[write] = incoming[in].second;
+            in--;
+        }
+        write--;
+    }
+}
+
+
+void SliceList::remove(const QVector<quint32>& ids)
+{
+    // Compact the survivors in a single pass
+    QSet<quint32> doomed;
+    doomed.reserve(ids.size());
+    for (int i = 0; i < ids.size(); i++)
+    {
+        if (m_positionById.remove(ids[i]))
+            doomed.insert(ids[i]);
+    }
+    if (doomed.isEmpty())
+        return;
+    
+    int write = 0;
+    for (int i = 0; i < m_positions.size(); i++)
+    {
+        if (doomed.contains(m_ids[i]))
+            continue;
+        
+        m_positions[write] = m_positions[i];
+        m_ids[write] = m_ids[i];
+        write++;
+    }
+    m_positions.resize(write);
+    m_ids.resize(write);
+}
+
+
+void SliceList::offset(const QVector<quint32>& ids, const qreal& delta)
+{
+    QVector<qreal> positions(ids.size());
+    for (int i = 0; i < ids.size(); i++)
+    {
+        positions[i] = m_positionById.value(ids[i]) + delta;
+    }
+    move(ids, positions);
+}
+
+
+void SliceList::move(const QVector<quint32>& ids, const QVector<qreal>& positions)
+{
+    // Moved slices can pass over their neighbors, so pull them out and merge them back in
+    QVector<quint32> movedIds;
+    QVector<qreal> movedPositions;
+    movedIds.reserve(ids.size());
+    movedPositions.reserve(ids.size());
+    for (int i = 0; i < ids.size(); i++)
+    {
+        if (!m_positionById.contains(ids[i]))
+            continue;
+        
+        movedIds.push_back(ids[i]);
+        movedPositions.push_back(positions[i]);
+    }
+    
+    remove(movedIds);
+    insert(movedPositions, movedIds);
+}
+
+
+QVector<qreal> SliceList::evenlySpaced(const qreal& start, const qreal& end, const int& count)
+{
+    QVector<qreal> results(qMax(count, 0));
+    const qreal pitch = (end - start) / (results.size() + 1);
+    for (int i = 0; i < results.size(); i++)
+    {
+        results[i] = start + pitch * (i + 1);
+    }
+    return results;
+}
+
+
+QVector<qreal> SliceList::tiledPattern(const qreal& start, const qreal& end, const QVector<qreal>& offsets)
+{
+    // The offsets are gaps to the previous slice, so the first one is the gap that
+    // closes each repetition of the pattern - start with the second
+    QVector<qreal> results;
+    qreal smallestOffset = 0.0;
+    for (int i = 0; i < offsets.size(); i++)
+    {
+        if (offsets[i] <= 0.0)
+            return results;
+        smallestOffset = (i == 0) ? offsets[i] : qMin(smallestOffset, offsets[i]);
+    }
+    if (offsets.isEmpty() || end <= start)
+        return results;
+    
+    // Stop short of the end slice rather than doubling it up
+    const qreal stop = end - smallestOffset * 0.5;
+    qreal runningSum = start;
+    for (int i = 1; ; i++)
+    {
+        runningSum += offsets[i % offsets.size()];
+        if (runningSum >= stop)
+            break;
+        results.push_back(runningSum);
+    }
+    return results;
+}
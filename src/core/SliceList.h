@@ -0,0 +1,65 @@
+#ifndef DIETOY_SLICE_LIST_H
+#define DIETOY_SLICE_LIST_H
+
+#include <QHash>
+#include <QVector>
+
+
+// Horizontal slices are offsets across the ROM (they mark bit columns),
+// vertical slices are offsets down it (they mark bit rows)
+enum SliceOrientation { HorizontalSlice,
+                        VerticalSlice };
+
+
+/// Sorted ROM-die-space slice offsets ////////////////////////////////////////
+
+// Slice positions are kept in ascending order so lookups are binary searches.
+// Every slice also gets an id which survives sorting, moves, and removal followed
+// by re-insertion (undo), so selections and edit history can refer to slices by id.
+class SliceList
+{
+public:
+    SliceList();
+
+    int size() const { return m_positions.size(); }
+    bool isEmpty() const { return m_positions.isEmpty(); }
+    void clear();
+
+    const qreal& operator[](const int& index) const { return m_positions[index]; }
+    const QVector<qreal>& positions() const { return m_positions; }
+    const quint32& id(const int& index) const { return m_ids[index]; }
+
+    bool containsId(const quint32& id) const { return m_positionById.contains(id); }
+    qreal positionOfId(const quint32& id) const { return m_positionById.value(id); }
+    int indexOfId(const quint32& id) const;
+    
+    // First index whose position is >= (or >) the given position
+    int lowerBound(const qreal& position) const;
+    int upperBound(const qreal& position) const;
+    
+    // Index of the slice closest to the position, -1 if empty
+    int nearestIndex(const qreal& position) const;
+    
+    // Batch edits - each is a single merge or compaction pass over the list
+    quint32 insert(const qreal& position);
+    QVector<quint32> insert(const QVector<qreal>& positions);
+    void insert(const QVector<qreal>& positions, const QVector<quint32>& ids);
+    void remove(const QVector<quint32>& ids);
+    void offset(const QVector<quint32>& ids, const qreal& delta);
+    void move(const QVector<quint32>& ids, const QVector<qreal>& positions);
+    
+    // Positions strictly between start and end - evenly spaced, or a repeating run of offsets.
+    // Each offset is the gap to the slice before; offsets[0] is the gap between the last slice
+    // of one repetition and the first of the next, so a pattern's period is the sum of them all
+    static QVector<qreal> evenlySpaced(const qreal& start, const qreal& end, const int& count);
+    static QVector<qreal> tiledPattern(const qreal& start, const qreal& end, const QVector<qreal>& offsets);
+
+private:
+    QVector<qreal> m_positions;
+    QVector<quint32> m_ids;
+    QHash<quint32, qreal> m_positionById;
+    quint32 m_nextId;
+};
+
+
+#endif // DIETOY_SLICE_LIST_H
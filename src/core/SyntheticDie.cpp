@@ -0,0 +1,214 @@
+#include "SyntheticDie.h"
+
+#include <QDebug>
+#include <QStringList>
+#include <QtMath>
+
+#include <random>
+
+
+// Gray levels of the die's parts before noise
+static const qreal BackgroundLevel = 40.0;
+static const qreal SubstrateLevel = 90.0;
+static const qreal BitLevel = 200.0;
+
+
+// A well-mixed 64 bit hash (splitmix64's finalizer) - the noise at a pixel only
+// depends on the seed and where the pixel is
+static quint64 mixBits(quint64 value)
+{
+    value = (value ^ (value >> 30)) * Q_UINT64_C(0xbf58476d1ce4e5b9);
+    value = (value ^ (value >> 27)) * Q_UINT64_C(0x94d049bb133111eb);
+    return value ^ (value >> 31);
+}
+
+
+// Roughly unit normal noise for a pixel: four 16 bit uniforms out of the hash, summed and rescaled
+static qreal pixelNoise(const quint32& seed, const int& x, const int& y)
+{
+    const quint64 hash = mixBits((((quint64)(quint32)y << 32) | (quint32)x) ^ ((quint64)seed * Q_UINT64_C(0x9e3779b97f4a7c15)));
+    qreal sum = 0.0;
+    for (int i = 0; i < 4; i++)
+        sum += ((hash >> (16 * i)) & 0xffff) / 65536.0;
+    return (sum - 2.0) * 1.7320508;
+}
+
+
+SyntheticDie::SyntheticDie()
+    : m_imageSize(4096, 4096)
+    , m_bitCount(256, 256)
+    , m_margin(0.05)
+    , m_skew(0.01)
+    , m_sliceJitter(0.05)
+    , m_bitRadius(0.3)
+    , m_noise(8.0)
+    , m_distortion(0.0)
+    , m_seed(1)
+    , m_die()
+    , m_geometry()
+    , m_bits()
+    , m_columns()
+    , m_rows()
+    , m_edgeWidth(0.1)
+{
+
+}
+
+
+bool SyntheticDie::generate()
+{
+    if (m_imageSize.isEmpty() || m_bitCount.width() < 2 || m_bitCount.height() < 2)
+    {
+        qWarning() << "A synthetic die needs an image size and at least 2 x 2 bits";
+        return false;
+    }
+
+    std::mt19937 random(m_seed);
+    std::uniform_real_distribution<double> unit(-1.0, 1.0);
+
+    // The ROM's rectangle inside the margin, each corner pushed about for the perspective
+    const QRectF rom(m_imageSize.width() * m_margin, m_imageSize.height() * m_margin,
+                     m_imageSize.width() * (1.0 - 2.0 * m_margin), m_imageSize.height() * (1.0 - 2.0 * m_margin));
+    QVector<QPointF> corners;
+    corners << rom.topLeft() << rom.topRight() << rom.bottomRight() << rom.bottomLeft();
+    for (int c = 0; c < corners.size(); c++)
+        corners[c] += QPointF(unit(random) * m_skew * rom.width(), unit(random) * m_skew * rom.height());
+
+    m_geometry = DieGeometry(corners);
+    if (!m_geometry.isValid())
+    {
+        qWarning() << "The synthetic die's corners don't make a usable ROM region - try less skew";
+        return false;
+    }
+    m_die = DieDescription();
+    m_die.boundsPoints() = m_geometry.boundsPoints();
+
+    // Evenly spaced slices, each nudged by less than half a pitch so they keep their order
+    const qreal jitter = qBound(0.0, m_sliceJitter, 0.45);
+    m_columns.resize(m_bitCount.width());
+    m_rows.resize(m_bitCount.height());
+    QVector<qreal> horizSlices;
+    QVector<qreal> vertSlices;
+    for (int c = 0; c < m_columns.size(); c++)
+    {
+        const qreal pitch = 1.0 / (m_columns.size() - 1);
+        const bool edge = (c == 0 || c == m_columns.size() - 1);
+        m_columns[c] = c * pitch + (edge ? 0.0 : unit(random) * jitter * pitch);
+        if (!edge)
+            horizSlices.push_back(m_columns[c]);
+    }
+    for (int r = 0; r < m_rows.size(); r++)
+    {
+        const qreal pitch = 1.0 / (m_rows.size() - 1);
+        const bool edge = (r == 0 || r == m_rows.size() - 1);
+        m_rows[r] = r * pitch + (edge ? 0.0 : unit(random) * jitter * pitch);
+        if (!edge)
+            vertSlices.push_back(m_rows[r]);
+    }
+    m_die.horizontalSlices().insert(horizSlices);
+    m_die.verticalSlices().insert(vertSlices);
+
+    // The contents, recorded in the description as certain
+    const int bitCount = m_bitCount.width() * m_bitCount.height();
+    m_bits.resize(bitCount);
+    for (int i = 0; i < bitCount; i++)
+        m_bits[i] = (random() >> 16) & 1;
+    m_die.bitLayers().resize(m_die.bitCount());
+    m_die.bitLayers().applyClassification(m_bits, QVector<quint8>(bitCount, 255));
+
+    // A pixel in bit pitches, near enough, for the dots' antialiased edges
+    const qreal pitchPixels = qMin(rom.width() / (m_bitCount.width() - 1), rom.height() / (m_bitCount.height() - 1));
+    m_edgeWidth = 1.0 / qMax(pitchPixels, 1.0);
+    return true;
+}
+
+
+QSize SyntheticDie::parseSize(const QString& text)
+{
+    const QStringList parts = text.split('x');
+    if (parts.size() != 2)
+        return QSize();
+    bool okW = false;
+    bool okH = false;
+    const QSize size(parts[0].toInt(&okW), parts[1].toInt(&okH));
+    return (okW && okH) ? size : QSize();
+}
+
+
+int SyntheticDie::nearestLine(const QVector<qreal>& lines, const qreal& position)
+{
+    // The lines are nearly even, so the right one is next to where even spacing puts it
+    const int last = lines.size() - 1;
+    const int guess = qBound(0, qRound(position * last), last);
+    int nearest = guess;
+    for (int i = qMax(0, guess - 1); i <= qMin(last, guess + 1); i++)
+    {
+        if (qAbs(lines[i] - position) < qAbs(lines[nearest] - position))
+            nearest = i;
+    }
+    return nearest;
+}
+
+
+quint8 SyntheticDie::renderPixel(const int& x, const int& y) const
+{
+    // Where the lens puts this pixel's view of the die
+    const QPointF center(m_imageSize.width() * 0.5, m_imageSize.height() * 0.5);
+    const QPointF offset = QPointF(x + 0.5, y + 0.5) - center;
+    const qreal radius2 = (offset.x() * offset.x() + offset.y() * offset.y()) /
+                          (center.x() * center.x() + center.y() * center.y());
+    const QPointF scene = center + offset * (1.0 + m_distortion * radius2);
+
+    // Half a pitch of substrate around the outer bits, background beyond that
+    const QPointF romDie = m_geometry.romDieSpaceFromImagePoint(scene);
+    const qreal pitchU = 1.0 / (m_columns.size() - 1);
+    const qreal pitchV = 1.0 / (m_rows.size() - 1);
+    qreal level = BackgroundLevel;
+    if (romDie.x() > -0.5 * pitchU && romDie.x() < 1.0 + 0.5 * pitchU &&
+        romDie.y() > -0.5 * pitchV && romDie.y() < 1.0 + 0.5 * pitchV)
+    {
+        level = SubstrateLevel;
+        const int column = nearestLine(m_columns, romDie.x());
+        const int row = nearestLine(m_rows, romDie.y());
+        if (m_bits[row * m_columns.size() + column])
+        {
+            const qreal du = (romDie.x() - m_columns[column]) / pitchU;
+            const qreal dv = (romDie.y() - m_rows[row]) / pitchV;
+            const qreal coverage = qBound(0.0, (m_bitRadius - qSqrt(du * du + dv * dv)) / m_edgeWidth + 0.5, 1.0);
+            level += coverage * (BitLevel - SubstrateLevel);
+        }
+    }
+
+    if (m_noise > 0.0)
+        level += m_noise * pixelNoise(m_seed, x, y);
+    return (quint8)qBound(0, qRound(level), 255);
+}
+
+
+QImage SyntheticDie::render(const QRect& region) const
+{
+    if (m_bits.isEmpty())
+    {
+        qWarning() << "Generate the synthetic die before rendering it";
+        return QImage();
+    }
+
+    QImage image(region.size(), QImage::Format_Grayscale8);
+    if (image.isNull())
+    {
+        qWarning() << "Unable to allocate a" << region.size() << "synthetic die image";
+        return image;
+    }
+
+    // Grab the raw pointer up front - scanLine() detaches, which isn't safe across threads
+    uchar* bits = image.bits();
+    const qint64 bytesPerLine = image.bytesPerLine();
+    #pragma omp parallel for schedule(dynamic, 16)
+    for (int y = 0; y < region.height(); y++)
+    {
+        uchar* line = bits + y * bytesPerLine;
+        for (int x = 0; x < region.width(); x++)
+            line[x] = renderPixel(region.x() + x, region.y() + y);
+    }
+    return image;
+}
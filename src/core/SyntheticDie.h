@@ -0,0 +1,90 @@
+#ifndef DIETOY_SYNTHETIC_DIE_H
+#define DIETOY_SYNTHETIC_DIE_H
+
+#include "DieGeometry.h"
+#include "DieDescription.h"
+
+#include <QRect>
+#include <QSize>
+#include <QImage>
+#include <QString>
+#include <QVector>
+
+
+/// Synthetic ROM dies ////////////////////////////////////////////////////////
+
+// Makes up a ROM die with known contents: a grid of bits (a bright dot for a 1,
+// bare substrate for a 0) seen through a perspective skew, slightly uneven
+// slice spacing, radial lens distortion and sensor noise.  The die description
+// placing the grid and the bit values are the ground truth to check extraction
+// against - the description's homography knows nothing of the lens distortion,
+// just as one made by hand wouldn't.
+//
+// Everything is decided by the seed: generate() lays the die out, and any region
+// of the image renders the same however it's split up or however many threads
+// render it, so gigapixel dies can be rendered a tile at a time.
+class SyntheticDie
+{
+public:
+    SyntheticDie();
+
+    void setImageSize(const QSize& size) { m_imageSize = size; }
+    void setBitCount(const QSize& bitCount) { m_bitCount = bitCount; }
+
+    // The image border around the ROM, as a fraction of each side
+    void setMargin(const qreal& fraction) { m_margin = fraction; }
+
+    // How far each ROM corner may wander, as a fraction of the ROM's size
+    void setSkew(const qreal& fraction) { m_skew = fraction; }
+
+    // How far each slice may stray from even spacing, and the bit dots' radius - both in bit pitches
+    void setSliceJitter(const qreal& fraction) { m_sliceJitter = fraction; }
+    void setBitRadius(const qreal& fraction) { m_bitRadius = fraction; }
+
+    // Gaussian noise standard deviation in gray levels, and the radial distortion at the image corners
+    void setNoise(const qreal& sigma) { m_noise = sigma; }
+    void setDistortion(const qreal& k1) { m_distortion = k1; }
+
+    void setSeed(const quint32& seed) { m_seed = seed; }
+
+    // "WxH" (as --size and --bit-count take them) to a size - invalid if it doesn't parse
+    static QSize parseSize(const QString& text);
+
+    // Lays out the bounds, slices and bits
+    bool generate();
+
+    QSize imageSize() const { return m_imageSize; }
+    const DieDescription& dieDescription() const { return m_die; }
+    const QVector<quint8>& bits() const { return m_bits; }
+
+    // Any part of the image as 8-bit grayscale, rendered in parallel
+    QImage render(const QRect& region) const;
+    QImage render() const { return render(QRect(QPoint(0, 0), m_imageSize)); }
+
+private:
+    quint8 renderPixel(const int& x, const int& y) const;
+    static int nearestLine(const QVector<qreal>& lines, const qreal& position);
+
+    QSize m_imageSize;
+    QSize m_bitCount;
+    qreal m_margin;
+    qreal m_skew;
+    qreal m_sliceJitter;
+    qreal m_bitRadius;
+    qreal m_noise;
+    qreal m_distortion;
+    quint32 m_seed;
+
+    DieDescription m_die;
+    DieGeometry m_geometry;
+    QVector<quint8> m_bits;
+
+    // ROM die space positions of every column and row (bounds edges included),
+    // and a pixel's width in bit pitches for antialiasing the dots
+    QVector<qreal> m_columns;
+    QVector<qreal> m_rows;
+    qreal m_edgeWidth;
+};
+
+
+#endif // DIETOY_SYNTHETIC_DIE_H
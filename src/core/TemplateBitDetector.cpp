@@ -0,0 +1,162 @@
+#include "TemplateBitDetector.h"
+#include "ImageSampler.h"
+
+#include <QDebug>
+#include <QLineF>
+
+#include <cmath>
+#include <algorithm>
+#include <opencv2/opencv.hpp>
+
+
+TemplateBitDetector::TemplateBitDetector(const QImage& image)
+    : m_image(ImageSampler::luminanceImage(image, QImage::Format_Grayscale8))
+    , m_exemplars()
+    , m_radius(4)
+    , m_matchThreshold(0.6f)
+    , m_tileSize(512)
+{
+    
+}
+
+
+void TemplateBitDetector::addExemplar(const QPointF& center)
+{
+    if (m_exemplars.size() == 2)
+        m_exemplars.pop_front();
+    m_exemplars.push_back(center);
+}
+
+
+static bool matchOrder(const TemplateBitDetector::Match& a, const TemplateBitDetector::Match& b)
+{
+    if (a.position.y() != b.position.y())
+        return a.position.y() < b.position.y();
+    return a.position.x() < b.position.x();
+}
+
+
+QVector<TemplateBitDetector::Match> TemplateBitDetector::detect(const QPolygonF& region) const
+{
+    QVector<Match> matches;
+    if (m_image.isNull() || m_exemplars.isEmpty())
+    {
+        qWarning() << "Template detection needs an image and at least one exemplar bit";
+        return matches;
+    }
+    
+    // Wrap the image without copying it, and cut the templates straight out of it
+    const cv::Mat image(m_image.height(), m_image.width(), CV_8UC1, const_cast<uchar*>(m_image.constBits()), m_image.bytesPerLine());
+    const int templateSize = m_radius * 2 + 1;
+    const QRect imageRect = m_image.rect();
+    std::vector<cv::Mat> templates;
+    for (int i = 0; i < m_exemplars.size(); i++)
+    {
+        const QRect templateRect(qRound(m_exemplars[i].x()) - m_radius, qRound(m_exemplars[i].y()) - m_radius, templateSize, templateSize);
+        if (!imageRect.contains(templateRect))
+        {
+            qWarning() << "Exemplar bit at" << m_exemplars[i] << "is too close to the edge of the image";
+            continue;
+        }
+        templates.push_back(image(cv::Rect(templateRect.x(), templateRect.y(), templateSize, templateSize)));
+    }
+    if (templates.empty())
+        return matches;
+    
+    // Tiles own the match centers in their core, and read a template radius plus
+    // a suppression radius around it so neither the correlation nor the
+    // local-maximum test sees a seam
+    const QRect centerArea = region.boundingRect().toAlignedRect() & imageRect;
+    const int margin = m_radius * 2;
+    const int tileSize = qMax(m_tileSize, templateSize);
+    QVector<QRect> tiles;
+    for (int y = centerArea.top(); y <= centerArea.bottom(); y += tileSize)
+        for (int x = centerArea.left(); x <= centerArea.right(); x += tileSize)
+            tiles.push_back(QRect(x, y, tileSize, tileSize) & centerArea);
+    
+    const cv::Mat suppressionKernel = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(m_radius * 2 + 1, m_radius * 2 + 1));
+    
+    #pragma omp parallel for schedule(dynamic)
+    for (int t = 0; t < tiles.size(); t++)
+    {
+        const QRect& core = tiles[t];
+        const QRect input = core.adjusted(-margin, -margin, margin, margin) & imageRect;
+        if (input.width() < templateSize || input.height() < templateSize)
+            continue;
+        
+        // The best of the exemplars' responses - response (x, y) is the template centered at input + (x, y) + radius
+        const cv::Mat tile = image(cv::Rect(input.x(), input.y(), input.width(), input.height()));
+        cv::Mat response;
+        for (size_t i = 0; i < templates.size(); i++)
+        {
+            cv::Mat exemplarResponse;
+            cv::matchTemplate(tile, templates[i], exemplarResponse, cv::TM_CCOEFF_NORMED);
+            if (response.empty())
+                response = exemplarResponse;
+            else
+                response = cv::max(response, exemplarResponse);
+        }
+        
+        // Non-maximum suppression - a match has to be the best within a template radius
+        cv::Mat neighborhoodMax;
+        cv::dilate(response, neighborhoodMax, suppressionKernel);
+        
+        QVector<Match> tileMatches;
+        for (int y = 0; y < response.rows; y++)
+        {
+            const float* responseRow = response.ptr<float>(y);
+            const float* maxRow = neighborhoodMax.ptr<float>(y);
+            for (int x = 0; x < response.cols; x++)
+            {
+                if (responseRow[x] < m_matchThreshold || responseRow[x] < maxRow[x])
+                    continue;
+                
+                const QPoint center(input.x() + x + m_radius, input.y() + y + m_radius);
+                if (!core.contains(center) || !region.containsPoint(center, Qt::OddEvenFill))
+                    continue;
+                
+                Match match;
+                match.position = center;
+                match.score = responseRow[x];
+                tileMatches.push_back(match);
+            }
+        }
+        
+        #pragma omp critical
+        matches += tileMatches;
+    }
+    
+    std::sort(matches.begin(), matches.end(), matchOrder);
+    return matches;
+}
+
+
+QVector<float> TemplateBitDetector::snapToGrid(const QVector<Match>& matches, const BitLocationStore& locations, const BitLocationIndex& index)
+{
+    QVector<float> scores(locations.size(), 0.0f);
+    const qreal snapDistance = index.cellSize() * 0.5;
+    for (int i = 0; i < matches.size(); i++)
+    {
+        const int bit = index.nearest(matches[i].position);
+        if (bit < 0 || QLineF(locations[bit], matches[i].position).length() > snapDistance)
+            continue;
+        scores[bit] = qMax(scores[bit], matches[i].score);
+    }
+    return scores;
+}
+
+
+void TemplateBitDetector::classify(const QVector<float>& scores, QVector<quint8>& values, QVector<quint8>& confidences) const
+{
+    values.resize(scores.size());
+    confidences.resize(scores.size());
+    const float aboveRange = qMax(1.0f - m_matchThreshold, 1e-3f);
+    const float belowRange = qMax(m_matchThreshold, 1e-3f);
+    for (int i = 0; i < scores.size(); i++)
+    {
+        const bool matched = (scores[i] >= m_matchThreshold);
+        const float distance = std::fabs(scores[i] - m_matchThreshold) / (matched ? aboveRange : belowRange);
+        values[i] = matched ? 1 : 0;
+        confidences[i] = static_cast<quint8>(qBound(0, qRound(distance * 255.0f), 255));
+    }
+}
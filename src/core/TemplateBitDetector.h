@@ -0,0 +1,60 @@
+#ifndef DIETOY_TEMPLATE_BIT_DETECTOR_H
+#define DIETOY_TEMPLATE_BIT_DETECTOR_H
+
+#include "BitLocationIndex.h"
+#include "BitLocationStore.h"
+
+#include <QImage>
+#include <QVector>
+#include <QPointF>
+#include <QPolygonF>
+
+
+/// Exemplar bit detection ////////////////////////////////////////////////////
+
+// Finds bits that look like one or two hand-picked exemplars, for ROMs whose bits
+// don't sit on every slice intersection (via and implant programmed parts).
+// Normalized cross-correlation runs over the region in overlapping tiles on every
+// core, and only local maxima over the match threshold survive - so matches are
+// at least one template radius apart.
+class TemplateBitDetector
+{
+public:
+    struct Match
+    {
+        QPointF position;
+        float score;
+    };
+
+    explicit TemplateBitDetector(const QImage& image);
+
+    // A third exemplar replaces the oldest
+    void addExemplar(const QPointF& center);
+    void clearExemplars() { m_exemplars.clear(); }
+    const QVector<QPointF>& exemplars() const { return m_exemplars; }
+
+    // Templates are (2 * radius + 1) pixels square
+    void setRadius(const int& radius) { m_radius = radius; }
+    void setMatchThreshold(const float& threshold) { m_matchThreshold = threshold; }
+    void setTileSize(const int& size) { m_tileSize = size; }
+    const float& matchThreshold() const { return m_matchThreshold; }
+
+    // Matches whose centers fall inside the region, sorted top to bottom
+    QVector<Match> detect(const QPolygonF& region) const;
+
+    // The best match score for every bit of the grid (0 where none landed within half a bit pitch)
+    static QVector<float> snapToGrid(const QVector<Match>& matches, const BitLocationStore& locations, const BitLocationIndex& index);
+
+    // A bit is 1 where it matched - confidence is how far the score is from the threshold
+    void classify(const QVector<float>& scores, QVector<quint8>& values, QVector<quint8>& confidences) const;
+
+private:
+    QImage m_image;
+    QVector<QPointF> m_exemplars;
+    int m_radius;
+    float m_matchThreshold;
+    int m_tileSize;
+};
+
+
+#endif // DIETOY_TEMPLATE_BIT_DETECTOR_H
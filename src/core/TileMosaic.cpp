@@ -0,0 +1,273 @@
+#include "TileMosaic.h"
+#include "ImageSampler.h"
+
+#include <QDir>
+#include <QFile>
+#include <QDebug>
+#include <QPainter>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QImageReader>
+#include <QJsonDocument>
+#include <QMutexLocker>
+
+#include <cmath>
+#include <opencv2/opencv.hpp>
+
+
+TileMosaic::TileMosaic()
+    : m_tiles()
+    , m_size(0, 0)
+    , m_maxCorrection(64)
+    , m_cacheMutex()
+    , m_cache(512 * 1024)
+{
+    
+}
+
+
+bool TileMosaic::loadManifest(const QString& filename)
+{
+    clear();
+    
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+        qWarning() << "Unable to open mosaic manifest " << filename;
+        return false;
+    }
+    
+    QJsonParseError jError;
+    const QJsonDocument jDoc = QJsonDocument::fromJson(file.readAll(), &jError);
+    if (jError.error != QJsonParseError::NoError)
+    {
+        qWarning() << "Unable to parse mosaic manifest " << filename << ":" << jError.errorString();
+        return false;
+    }
+    
+    const QJsonObject docObj = jDoc.object();
+    const int version = docObj["version"].toInt();
+    if (version > 1 || version == 0)
+    {
+        qWarning() << "Can only read mosaic manifest versions 1 or less";
+        return false;
+    }
+    
+    // Relative paths are relative to the manifest
+    const QDir manifestDir = QFileInfo(filename).absoluteDir();
+    const QJsonArray tileArray = docObj["tiles"].toArray();
+    QVector<QPointF> positions;
+    for (int i = 0; i < tileArray.size(); i++)
+    {
+        const QJsonObject tileObj = tileArray[i].toObject();
+        MosaicTile tile;
+        tile.image = manifestDir.absoluteFilePath(tileObj["image"].toString());
+        tile.stagePosition = QPointF(tileObj["x"].toDouble(), tileObj["y"].toDouble());
+        
+        // Just the header - the pixels wait until something looks at them
+        tile.size = QImageReader(tile.image).size();
+        if (tileObj["image"].toString().isEmpty() || !tile.size.isValid())
+        {
+            qWarning() << "Mosaic tile" << i << "has no readable image";
+            clear();
+            return false;
+        }
+        
+        m_tiles.push_back(tile);
+        positions.push_back(tile.stagePosition);
+    }
+    
+    placeTiles(positions);
+    return true;
+}
+
+
+void TileMosaic::clear()
+{
+    m_tiles.clear();
+    m_size = QSize(0, 0);
+    
+    QMutexLocker locker(&m_cacheMutex);
+    m_cache.clear();
+}
+
+
+void TileMosaic::setCacheLimit(const qint64& bytes)
+{
+    QMutexLocker locker(&m_cacheMutex);
+    m_cache.setMaxCost(qMax(bytes / 1024, (qint64)1));
+}
+
+
+void TileMosaic::placeTiles(const QVector<QPointF>& positions)
+{
+    // Rounded to whole pixels and shifted so the mosaic starts at the origin
+    QPointF topLeft = positions.isEmpty() ? QPointF() : positions[0];
+    for (int i = 1; i < positions.size(); i++)
+        topLeft = QPointF(qMin(topLeft.x(), positions[i].x()), qMin(topLeft.y(), positions[i].y()));
+    
+    QRect bounds;
+    for (int i = 0; i < m_tiles.size(); i++)
+    {
+        m_tiles[i].position = (positions[i] - topLeft).toPoint();
+        bounds |= QRect(m_tiles[i].position, m_tiles[i].size);
+    }
+    m_size = bounds.size();
+}
+
+
+bool TileMosaic::refine()
+{
+    if (m_tiles.size() < 2)
+        return true;
+    
+    // Every pair the stage says overlaps by a usable amount
+    const int minOverlap = 32;
+    QVector<QPair<int, int> > pairs;
+    for (int a = 0; a < m_tiles.size(); a++)
+    {
+        const QRect rectA(m_tiles[a].stagePosition.toPoint(), m_tiles[a].size);
+        for (int b = a + 1; b < m_tiles.size(); b++)
+        {
+            const QRect overlap = rectA & QRect(m_tiles[b].stagePosition.toPoint(), m_tiles[b].size);
+            if (overlap.width() >= minOverlap && overlap.height() >= minOverlap)
+                pairs.push_back(qMakePair(a, b));
+        }
+    }
+    
+    // Phase correlate each overlap - the shift is how far b's copy of the overlap
+    // sits from a's, so the true offset is the stage offset less the shift
+    QVector<QPointF> offsets(pairs.size());
+    QVector<double> weights(pairs.size(), 0.0);
+    
+    #pragma omp parallel for schedule(dynamic)
+    for (int p = 0; p < pairs.size(); p++)
+    {
+        const int a = pairs[p].first;
+        const int b = pairs[p].second;
+        const QPoint stageA = m_tiles[a].stagePosition.toPoint();
+        const QPoint stageB = m_tiles[b].stagePosition.toPoint();
+        const QRect overlap = QRect(stageA, m_tiles[a].size) & QRect(stageB, m_tiles[b].size);
+        
+        const QImage cropA = ImageSampler::luminanceImage(tileImage(a).copy(overlap.translated(-stageA)), QImage::Format_Grayscale8);
+        const QImage cropB = ImageSampler::luminanceImage(tileImage(b).copy(overlap.translated(-stageB)), QImage::Format_Grayscale8);
+        if (cropA.isNull() || cropB.isNull())
+            continue;
+        
+        cv::Mat floatA;
+        cv::Mat floatB;
+        cv::Mat(cropA.height(), cropA.width(), CV_8UC1, const_cast<uchar*>(cropA.constBits()), cropA.bytesPerLine()).convertTo(floatA, CV_32F);
+        cv::Mat(cropB.height(), cropB.width(), CV_8UC1, const_cast<uchar*>(cropB.constBits()), cropB.bytesPerLine()).convertTo(floatB, CV_32F);
+        cv::Mat window;
+        cv::createHanningWindow(window, floatA.size(), CV_32F);
+        
+        double response = 0.0;
+        const cv::Point2d shift = cv::phaseCorrelate(floatA, floatB, window, &response);
+        if (std::fabs(shift.x) > m_maxCorrection || std::fabs(shift.y) > m_maxCorrection)
+            continue;
+        
+        offsets[p] = QPointF(stageB - stageA) - QPointF(shift.x, shift.y);
+        weights[p] = response;
+    }
+    
+    // Which pairs each tile is in
+    QVector<QVector<int> > tilePairs(m_tiles.size());
+    int usedPairs = 0;
+    for (int p = 0; p < pairs.size(); p++)
+    {
+        if (weights[p] <= 0.0)
+            continue;
+        tilePairs[pairs[p].first].push_back(p);
+        tilePairs[pairs[p].second].push_back(p);
+        usedPairs++;
+    }
+    
+    // Gauss-Seidel relaxation of all the offsets at once, with the first tile pinned
+    const double stageWeight = 1e-3;
+    QVector<QPointF> positions(m_tiles.size());
+    for (int i = 0; i < m_tiles.size(); i++)
+        positions[i] = m_tiles[i].stagePosition;
+    for (int iteration = 0; iteration < 1000; iteration++)
+    {
+        qreal largestMove = 0.0;
+        for (int i = 1; i < m_tiles.size(); i++)
+        {
+            QPointF sum = m_tiles[i].stagePosition * stageWeight;
+            double weightSum = stageWeight;
+            for (int j = 0; j < tilePairs[i].size(); j++)
+            {
+                const int p = tilePairs[i][j];
+                const bool isFirst = (pairs[p].first == i);
+                const QPointF implied = isFirst ? positions[pairs[p].second] - offsets[p] : positions[pairs[p].first] + offsets[p];
+                sum += implied * weights[p];
+                weightSum += weights[p];
+            }
+            
+            const QPointF updated = sum / weightSum;
+            largestMove = qMax(largestMove, (updated - positions[i]).manhattanLength());
+            positions[i] = updated;
+        }
+        if (largestMove < 0.01)
+            break;
+    }
+    
+    placeTiles(positions);
+    qDebug() << "Mosaic refined from" << usedPairs << "of" << pairs.size() << "overlaps";
+    return true;
+}
+
+
+QImage TileMosaic::tileImage(const int& i, const int& level) const
+{
+    const qint64 key = (qint64)i * 32 + level;
+    {
+        QMutexLocker locker(&m_cacheMutex);
+        const QImage* cached = m_cache.object(key);
+        if (cached)
+            return *cached;
+    }
+    
+    // Decoded (or reduced from the level above) outside the lock
+    QImage image;
+    if (level == 0)
+    {
+        if (!image.load(m_tiles[i].image))
+            qWarning() << "Unable to load mosaic tile " << m_tiles[i].image;
+    }
+    else
+    {
+        const QImage finer = tileImage(i, level - 1);
+        image = finer.scaled((finer.width() + 1) / 2, (finer.height() + 1) / 2, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+    }
+    
+    QMutexLocker locker(&m_cacheMutex);
+    m_cache.insert(key, new QImage(image), qMax((qint64)1, (qint64)image.sizeInBytes() / 1024));
+    return image;
+}
+
+
+QImage TileMosaic::region(const QRect& rect, const int& level) const
+{
+    const int step = 1 << level;
+    QImage result((rect.width() + step - 1) / step, (rect.height() + step - 1) / step, QImage::Format_RGB32);
+    if (result.isNull())
+        return result;
+    result.fill(Qt::black);
+    
+    // Later tiles land on top of earlier ones
+    QPainter painter(&result);
+    painter.setCompositionMode(QPainter::CompositionMode_Source);
+    for (int i = 0; i < m_tiles.size(); i++)
+    {
+        const QRect tileRect(m_tiles[i].position, m_tiles[i].size);
+        if (!tileRect.intersects(rect))
+            continue;
+        
+        const QPoint offset = tileRect.topLeft() - rect.topLeft();
+        const QPoint origin(std::floor((double)offset.x() / step), std::floor((double)offset.y() / step));
+        painter.drawImage(origin, tileImage(i, level));
+    }
+    
+    return result;
+}
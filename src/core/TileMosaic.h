@@ -0,0 +1,81 @@
+#ifndef DIETOY_TILE_MOSAIC_H
+#define DIETOY_TILE_MOSAIC_H
+
+#include <QRect>
+#include <QSize>
+#include <QCache>
+#include <QImage>
+#include <QMutex>
+#include <QPoint>
+#include <QString>
+#include <QVector>
+#include <QPointF>
+
+
+/// Microscope tile mosaics ///////////////////////////////////////////////////
+
+// One microscope tile: its file, its size, where the stage said it was and where
+// it ended up after refinement (both in mosaic pixels)
+struct MosaicTile
+{
+    QString image;
+    QSize size;
+    QPointF stagePosition;
+    QPoint position;
+};
+
+
+// A die image made of overlapping tiles that is never composited as a whole.
+// Regions are put together on demand from the tiles under them, at full
+// resolution or any power-of-two reduction, through a bounded cache of decoded
+// (and reduced) tiles - so the display and the bit sampler only pay for what
+// they look at.
+//
+// The stage positions are refined by phase correlating every overlapping pair
+// (in parallel) and relaxing all the measured offsets together, with a faint
+// pull back towards the stage positions for tiles nothing correlates with.
+class TileMosaic
+{
+public:
+    TileMosaic();
+
+    // JSON manifest - { "version": 1, "tiles": [ { "image", "x", "y" } ] } with the
+    // approximate stage position of each tile's top left in pixels, and relative
+    // paths taken from the manifest's directory.  Only the image headers are read
+    bool loadManifest(const QString& filename);
+    void clear();
+
+    void setCacheLimit(const qint64& bytes);
+    void setMaxCorrection(const int& pixels) { m_maxCorrection = pixels; }
+
+    bool refine();
+
+    bool isEmpty() const { return m_tiles.isEmpty(); }
+    QSize size() const { return m_size; }
+    QRect rect() const { return QRect(QPoint(0, 0), m_size); }
+    int tileCount() const { return m_tiles.size(); }
+    const MosaicTile& tile(const int& i) const { return m_tiles[i]; }
+
+    // The mosaic pixels in rect, black where no tile lands.  Each level halves the
+    // resolution, so the result is rect's size divided by 2^level (rounded up)
+    QImage region(const QRect& rect, const int& level = 0) const;
+
+    // Tile i by itself, reduced by 2^level
+    QImage tileImage(const int& i, const int& level = 0) const;
+
+private:
+    Q_DISABLE_COPY(TileMosaic)
+
+    void placeTiles(const QVector<QPointF>& positions);
+
+    QVector<MosaicTile> m_tiles;
+    QSize m_size;
+    int m_maxCorrection;
+
+    // Decoded tiles keyed by tile and level, costed in KiB
+    mutable QMutex m_cacheMutex;
+    mutable QCache<qint64, QImage> m_cache;
+};
+
+
+#endif // DIETOY_TILE_MOSAIC_H
@@ -0,0 +1,168 @@
+#include "WorkStealingPool.h"
+
+#include <QMutexLocker>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+
+// The worker index of the current thread in the pool it belongs to
+static thread_local const WorkStealingPool* t_pool = NULL;
+static thread_local int t_workerIndex = -1;
+
+
+class WorkStealingPool::Worker : public QThread
+{
+public:
+    Worker(WorkStealingPool* pool, const int& index)
+        : m_pool(pool)
+        , m_index(index)
+    {
+        
+    }
+
+protected:
+    void run()
+    {
+        m_pool->runWorker(m_index);
+    }
+
+private:
+    WorkStealingPool* m_pool;
+    int m_index;
+};
+
+
+WorkStealingPool::WorkStealingPool(const int& threadCount)
+    : m_workers()
+    , m_queues()
+    , m_stopping(false)
+    , m_queuedCount(0)
+    , m_pendingCount(0)
+    , m_nextQueue(0)
+{
+    const int count = qMax(threadCount, 1);
+    for (int i = 0; i < count; i++)
+        m_queues.push_back(new TaskQueue);
+    for (int i = 0; i < count; i++)
+    {
+        m_workers.push_back(new Worker(this, i));
+        m_workers.back()->start();
+    }
+}
+
+
+WorkStealingPool::~WorkStealingPool()
+{
+    waitForDone();
+    
+    {
+        QMutexLocker lock(&m_mutex);
+        m_stopping = true;
+        m_workAvailable.wakeAll();
+    }
+    
+    for (int i = 0; i < m_workers.size(); i++)
+    {
+        m_workers[i]->wait();
+        delete m_workers[i];
+    }
+    qDeleteAll(m_queues);
+}
+
+
+void WorkStealingPool::submit(const Task& task)
+{
+    // Counted as pending before it's visible, so waitForDone() can't slip through
+    m_pendingCount.ref();
+    
+    // Workers keep their own work local, everyone else spreads it around
+    const int index = (t_pool == this) ? t_workerIndex
+                                       : (m_nextQueue.fetchAndAddRelaxed(1) & 0x7fffffff) % m_queues.size();
+    m_queuedCount.ref();
+    {
+        QMutexLocker queueLock(&m_queues[index]->mutex);
+        m_queues[index]->tasks.push_back(task);
+    }
+    
+    QMutexLocker lock(&m_mutex);
+    m_workAvailable.wakeOne();
+}
+
+
+void WorkStealingPool::waitForDone()
+{
+    QMutexLocker lock(&m_mutex);
+    while (m_pendingCount.load() > 0)
+        m_allDone.wait(&m_mutex);
+}
+
+
+void WorkStealingPool::runWorker(const int& index)
+{
+    t_pool = this;
+    t_workerIndex = index;
+    
+#ifdef _OPENMP
+    // Every core already has a task - keep the core's own parallel loops on this thread
+    omp_set_num_threads(1);
+#endif
+    
+    forever
+    {
+        Task task;
+        if (takeTask(index, task))
+        {
+            task();
+            task = Task();
+            
+            if (!m_pendingCount.deref())
+            {
+                QMutexLocker lock(&m_mutex);
+                m_allDone.wakeAll();
+            }
+            continue;
+        }
+        
+        // Nothing anywhere - sleep until a submission (checked under the lock submit() wakes with)
+        QMutexLocker lock(&m_mutex);
+        if (m_stopping)
+            return;
+        if (m_queuedCount.load() == 0)
+            m_workAvailable.wait(&m_mutex);
+    }
+}
+
+
+bool WorkStealingPool::takeTask(const int& index, Task& task)
+{
+    // Newest of our own first...
+    {
+        TaskQueue* own = m_queues[index];
+        QMutexLocker lock(&own->mutex);
+        if (!own->tasks.empty())
+        {
+            task = own->tasks.back();
+            own->tasks.pop_back();
+            m_queuedCount.deref();
+            return true;
+        }
+    }
+    
+    // ...then the oldest of someone else's
+    for (int offset = 1; offset < m_queues.size(); offset++)
+    {
+        TaskQueue* victim = m_queues[(index + offset) % m_queues.size()];
+        QMutexLocker lock(&victim->mutex);
+        if (!victim->tasks.empty())
+        {
+            task = victim->tasks.front();
+            victim->tasks.pop_front();
+            m_queuedCount.deref();
+            return true;
+        }
+    }
+    
+    return false;
+}
@@ -0,0 +1,62 @@
+#ifndef DIETOY_WORK_STEALING_POOL_H
+#define DIETOY_WORK_STEALING_POOL_H
+
+#include <QMutex>
+#include <QThread>
+#include <QVector>
+#include <QAtomicInt>
+#include <QWaitCondition>
+
+#include <deque>
+#include <functional>
+
+
+/// Task pool //////////////////////////////////////////////////////////////////
+
+// A fixed set of worker threads, each with its own task deque.  Tasks submitted
+// from inside a task go on the submitting worker's deque and are run newest first
+// (so a die's follow-up work stays on a warm core); idle workers steal the oldest
+// tasks from the others.  Tasks are free to submit more tasks.
+class WorkStealingPool
+{
+public:
+    typedef std::function<void()> Task;
+
+    explicit WorkStealingPool(const int& threadCount = QThread::idealThreadCount());
+    ~WorkStealingPool();
+
+    int threadCount() const { return m_workers.size(); }
+
+    void submit(const Task& task);
+
+    // Blocks until every submitted task (and everything they submitted) has run
+    void waitForDone();
+
+private:
+    class Worker;
+    friend class Worker;
+
+    struct TaskQueue
+    {
+        QMutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    void runWorker(const int& index);
+    bool takeTask(const int& index, Task& task);
+
+    QVector<Worker*> m_workers;
+    QVector<TaskQueue*> m_queues;
+
+    QMutex m_mutex;
+    QWaitCondition m_workAvailable;
+    QWaitCondition m_allDone;
+    bool m_stopping;
+
+    QAtomicInt m_queuedCount;       // Sitting in a deque
+    QAtomicInt m_pendingCount;      // Submitted but not finished
+    QAtomicInt m_nextQueue;         // Round robin for submissions from outside the pool
+};
+
+
+#endif // DIETOY_WORK_STEALING_POOL_H
@@ -24,17 +24,48 @@ int main(int argc, char *argv[])
     QCommandLineOption dieImageOption(QStringList() << "i" << "image",
                                       QCoreApplication::translate("main", "Die image to load."),
                                       QCoreApplication::translate("main", "filename"));
+    QCommandLineOption mosaicOption(QStringList() << "mosaic",
+                                    QCoreApplication::translate("main", "Tile mosaic manifest to stitch and load in place of an image."),
+                                    QCoreApplication::translate("main", "manifest"));
     QCommandLineOption ddfOption(QStringList() << "d" << "dieDescription",
                                  QCoreApplication::translate("main", "Die description file to load."),
                                  QCoreApplication::translate("main", "filename"));
+    QCommandLineOption grayscaleOption(QStringList() << "g" << "grayscale",
+                                       QCoreApplication::translate("main", "Sample from a grayscale working image of <bits> (8 or 16) per pixel."),
+                                       QCoreApplication::translate("main", "bits"));
+    QCommandLineOption keepColorOption(QStringList() << "keep-color",
+                                       QCoreApplication::translate("main", "Display the color image and keep it next to the grayscale working image."));
+    QCommandLineOption registerFromOption(QStringList() << "register-from",
+                                          QCoreApplication::translate("main", "The die description was made on this image - register it onto the loaded one."),
+                                          QCoreApplication::translate("main", "filename"));
+    QCommandLineOption noImageCacheOption(QStringList() << "no-image-cache",
+                                          QCoreApplication::translate("main", "Always decode the image instead of mapping (and storing) its decoded pixels in the image cache."));
     parser.addOption(dieImageOption);
+    parser.addOption(mosaicOption);
     parser.addOption(ddfOption);
+    parser.addOption(grayscaleOption);
+    parser.addOption(keepColorOption);
+    parser.addOption(registerFromOption);
+    parser.addOption(noImageCacheOption);
    
     parser.process(app);
 
     QString dieImageFilename = parser.value(dieImageOption);
     QString dieDescriptionFilename = parser.value(ddfOption);
     
+    MainWindow::WorkingImageDepth workingImageDepth = MainWindow::WorkingColor;
+    if (parser.isSet(grayscaleOption))
+    {
+        const int bits = parser.value(grayscaleOption).toInt();
+        if (bits == 8)
+            workingImageDepth = MainWindow::WorkingGray8;
+        else if (bits == 16)
+            workingImageDepth = MainWindow::WorkingGray16;
+        else
+            qWarning() << "Grayscale working images can only be 8 or 16 bits.  Using color";
+    }
+    const bool keepColorImage = parser.isSet(keepColorOption);
+    
     // -- End arg parsing -- //
     
     
@@ -47,6 +78,8 @@ int main(int argc, char *argv[])
     win.resize(winSize);
     win.move(position);
     win.show();
+    win.setWorkingImageDepth(workingImageDepth, keepColorImage);
+    win.setImageCacheEnabled(!parser.isSet(noImageCacheOption));
 
     
     // Now that the show() message has been called, tell the window all about the commandline
@@ -59,9 +92,16 @@ int main(int argc, char *argv[])
         }
         
     }
+    else if (parser.isSet(mosaicOption))
+    {
+        if (!win.loadMosaic(parser.value(mosaicOption)))
+            qWarning() << "Unable to load tile mosaic " << parser.value(mosaicOption);
+    }
     if (dieDescriptionFilename != "")
     {
-        const bool success = win.loadDescriptionJson(dieDescriptionFilename);
+        const bool success = parser.isSet(registerFromOption)
+                           ? win.transferDescriptionJson(dieDescriptionFilename, parser.value(registerFromOption))
+                           : win.loadDescriptionJson(dieDescriptionFilename);
         if (!success)
         {
             qWarning() << "Unable to load die description file " << dieDescriptionFilename;
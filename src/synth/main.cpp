@@ -0,0 +1,214 @@
+#include "core/RomFormat.h"
+#include "core/SyntheticDie.h"
+
+#include <QDir>
+#include <QFile>
+#include <QDebug>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QJsonDocument>
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QCommandLineOption>
+
+
+// Renders the die a tile at a time, next to a mosaic manifest placing them - for dies bigger than one image can hold
+static bool writeTiles(const SyntheticDie& synth, const QString& manifestFilename, const int& tileSize, const int& overlap)
+{
+    const QFileInfo manifestInfo(manifestFilename);
+    const QDir dir = manifestInfo.absoluteDir();
+    const int stride = tileSize - overlap;
+    const QSize imageSize = synth.imageSize();
+
+    QJsonArray tileArray;
+    for (int y = 0; y < imageSize.height(); y += stride)
+    {
+        for (int x = 0; x < imageSize.width(); x += stride)
+        {
+            const QRect region = QRect(x, y, tileSize, tileSize) & QRect(QPoint(0, 0), imageSize);
+            const QString tileName = QString("%1_%2_%3.png").arg(manifestInfo.completeBaseName()).arg(x).arg(y);
+            const QImage tile = synth.render(region);
+            if (tile.isNull() || !tile.save(dir.absoluteFilePath(tileName)))
+            {
+                qWarning() << "Unable to write tile " << dir.absoluteFilePath(tileName);
+                return false;
+            }
+
+            QJsonObject tileObj;
+            tileObj["image"] = tileName;
+            tileObj["x"] = x;
+            tileObj["y"] = y;
+            tileArray.append(tileObj);
+
+            if (x + tileSize >= imageSize.width())
+                break;
+        }
+        if (y + tileSize >= imageSize.height())
+            break;
+    }
+
+    QJsonObject docObj;
+    docObj["version"] = 1;
+    docObj["tiles"] = tileArray;
+
+    QFile file(manifestFilename);
+    if (!file.open(QIODevice::WriteOnly))
+    {
+        qWarning() << "Unable to write mosaic manifest " << manifestFilename;
+        return false;
+    }
+    file.write(QJsonDocument(docObj).toJson());
+    qDebug() << "Wrote" << tileArray.size() << "tiles";
+    return true;
+}
+
+
+int main(int argc, char *argv[])
+{
+    // Create and name our app
+    QCoreApplication app(argc, argv);
+    app.setApplicationName("DieToySynth");
+    app.setApplicationVersion("0.6");
+
+    // -- Begin arg parsing -- //
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("DieToySynth : Synthetic ROM die images with known bits, for testing and benchmarking.");
+    parser.addHelpOption();
+    parser.addVersionOption();
+
+    QCommandLineOption outputOption(QStringList() << "o" << "output",
+                                    QCoreApplication::translate("main", "Die image to write (the mosaic manifest with --tiles)."),
+                                    QCoreApplication::translate("main", "filename"));
+    QCommandLineOption ddfOption(QStringList() << "d" << "dieDescription",
+                                 QCoreApplication::translate("main", "Write the ground truth die description here."),
+                                 QCoreApplication::translate("main", "filename"));
+    QCommandLineOption bitsOption(QStringList() << "bits",
+                                  QCoreApplication::translate("main", "Write the ground truth bits here as rows of 0s and 1s."),
+                                  QCoreApplication::translate("main", "filename"));
+    QCommandLineOption sizeOption(QStringList() << "size",
+                                  QCoreApplication::translate("main", "Image size in pixels (default 4096x4096)."),
+                                  QCoreApplication::translate("main", "WxH"));
+    QCommandLineOption bitCountOption(QStringList() << "bit-count",
+                                      QCoreApplication::translate("main", "Bits across and down (default 256x256)."),
+                                      QCoreApplication::translate("main", "CxR"));
+    QCommandLineOption marginOption(QStringList() << "margin",
+                                    QCoreApplication::translate("main", "Border around the ROM as a fraction of the image (default 0.05)."),
+                                    QCoreApplication::translate("main", "fraction"));
+    QCommandLineOption skewOption(QStringList() << "skew",
+                                  QCoreApplication::translate("main", "How far each ROM corner may move, as a fraction of the ROM (default 0.01)."),
+                                  QCoreApplication::translate("main", "fraction"));
+    QCommandLineOption jitterOption(QStringList() << "slice-jitter",
+                                    QCoreApplication::translate("main", "How far each slice may stray from even spacing, in bit pitches (default 0.05)."),
+                                    QCoreApplication::translate("main", "pitches"));
+    QCommandLineOption radiusOption(QStringList() << "bit-radius",
+                                    QCoreApplication::translate("main", "Radius of a 1 bit's dot, in bit pitches (default 0.3)."),
+                                    QCoreApplication::translate("main", "pitches"));
+    QCommandLineOption noiseOption(QStringList() << "noise",
+                                   QCoreApplication::translate("main", "Gaussian noise standard deviation in gray levels (default 8)."),
+                                   QCoreApplication::translate("main", "sigma"));
+    QCommandLineOption distortionOption(QStringList() << "distortion",
+                                        QCoreApplication::translate("main", "Radial lens distortion at the image corners, + for pincushion and - for barrel (default 0)."),
+                                        QCoreApplication::translate("main", "k1"));
+    QCommandLineOption seedOption(QStringList() << "seed",
+                                  QCoreApplication::translate("main", "Random seed - the same seed and options always make the same die (default 1)."),
+                                  QCoreApplication::translate("main", "seed"));
+    QCommandLineOption tilesOption(QStringList() << "tiles",
+                                   QCoreApplication::translate("main", "Write square tiles of this size and a mosaic manifest instead of one image."),
+                                   QCoreApplication::translate("main", "pixels"));
+    QCommandLineOption overlapOption(QStringList() << "overlap",
+                                     QCoreApplication::translate("main", "Pixels neighbouring --tiles share (default 64)."),
+                                     QCoreApplication::translate("main", "pixels"));
+    parser.addOption(outputOption);
+    parser.addOption(ddfOption);
+    parser.addOption(bitsOption);
+    parser.addOption(sizeOption);
+    parser.addOption(bitCountOption);
+    parser.addOption(marginOption);
+    parser.addOption(skewOption);
+    parser.addOption(jitterOption);
+    parser.addOption(radiusOption);
+    parser.addOption(noiseOption);
+    parser.addOption(distortionOption);
+    parser.addOption(seedOption);
+    parser.addOption(tilesOption);
+    parser.addOption(overlapOption);
+
+    parser.process(app);
+
+    // -- End arg parsing -- //
+
+
+    SyntheticDie synth;
+    if (parser.isSet(sizeOption))
+    {
+        const QSize size = SyntheticDie::parseSize(parser.value(sizeOption));
+        if (size.isEmpty())
+        {
+            qWarning() << "--size needs a width and height like 4096x4096";
+            return 1;
+        }
+        synth.setImageSize(size);
+    }
+    if (parser.isSet(bitCountOption))
+    {
+        const QSize bitCount = SyntheticDie::parseSize(parser.value(bitCountOption));
+        if (bitCount.isEmpty())
+        {
+            qWarning() << "--bit-count needs columns and rows like 256x256";
+            return 1;
+        }
+        synth.setBitCount(bitCount);
+    }
+    if (parser.isSet(marginOption))
+        synth.setMargin(parser.value(marginOption).toDouble());
+    if (parser.isSet(skewOption))
+        synth.setSkew(parser.value(skewOption).toDouble());
+    if (parser.isSet(jitterOption))
+        synth.setSliceJitter(parser.value(jitterOption).toDouble());
+    if (parser.isSet(radiusOption))
+        synth.setBitRadius(parser.value(radiusOption).toDouble());
+    if (parser.isSet(noiseOption))
+        synth.setNoise(parser.value(noiseOption).toDouble());
+    if (parser.isSet(distortionOption))
+        synth.setDistortion(parser.value(distortionOption).toDouble());
+    if (parser.isSet(seedOption))
+        synth.setSeed(parser.value(seedOption).toUInt());
+
+    if (!synth.generate())
+        return 1;
+    qDebug() << "Bits across" << synth.dieDescription().bitCount().width() << "down" << synth.dieDescription().bitCount().height();
+
+    // The ground truth
+    if (parser.isSet(ddfOption) && !synth.dieDescription().saveJson(parser.value(ddfOption)))
+    {
+        qWarning() << "Unable to write " << parser.value(ddfOption);
+        return 1;
+    }
+    if (parser.isSet(bitsOption) && !RomFormat::writeBitRows(parser.value(bitsOption), synth.bits(), synth.dieDescription().bitCount().width()))
+        return 1;
+
+    if (!parser.isSet(outputOption))
+        return 0;
+
+    if (parser.isSet(tilesOption))
+    {
+        const int tileSize = parser.value(tilesOption).toInt();
+        const int overlap = parser.isSet(overlapOption) ? parser.value(overlapOption).toInt() : 64;
+        if (tileSize <= 0 || overlap < 0 || overlap >= tileSize)
+        {
+            qWarning() << "--tiles needs a size bigger than the --overlap";
+            return 1;
+        }
+        return writeTiles(synth, parser.value(outputOption), tileSize, overlap) ? 0 : 1;
+    }
+
+    const QImage image = synth.render();
+    if (image.isNull() || !image.save(parser.value(outputOption)))
+    {
+        qWarning() << "Unable to write " << parser.value(outputOption) << "- try --tiles for very large dies";
+        return 1;
+    }
+    return 0;
+}